@@ -0,0 +1,28 @@
+#pragma once
+
+// Heap allocation counting. Build with -DDIFFUSE_COUNT_ALLOCATIONS (CMake option
+// DIFFUSE_CHECK_FRAME_ALLOCATIONS) to replace the global operator new with one that counts
+// per thread and for the whole process; without it nothing is replaced and the counts stay 0.
+//
+//   const uint64_t before = Utils::AllocationCounter::Count();
+//   ...
+//   assert(Utils::AllocationCounter::Count() == before);
+
+#include <cstdint>
+
+namespace Utils {
+	class AllocationCounter {
+	public:
+		static constexpr bool Enabled() {
+#ifdef DIFFUSE_COUNT_ALLOCATIONS
+			return true;
+#else
+			return false;
+#endif
+		}
+		// operator new calls made by the calling thread so far
+		static uint64_t ThreadCount();
+		// operator new calls made by all threads so far, job system workers included
+		static uint64_t Count();
+	};
+}
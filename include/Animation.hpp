@@ -0,0 +1,37 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Diffuse {
+
+	// Keyframes of one animated property of one node. Times and values live in separate arrays
+	// so finding the key only touches the times.
+	struct AnimationChannel {
+		enum Path : uint8_t { PATH_TRANSLATION, PATH_ROTATION, PATH_SCALE };
+		enum Interpolation : uint8_t { INTERPOLATION_LINEAR, INTERPOLATION_STEP, INTERPOLATION_CUBICSPLINE };
+		Path path = PATH_TRANSLATION;
+		Interpolation interpolation = INTERPOLATION_LINEAR;
+		// Index into the linear nodes of the model
+		uint32_t target = 0;
+		std::vector<float> times;
+		// vec3 are padded to four floats, rotations are xyzw. Cubic splines store
+		// in-tangent, value and out-tangent of every key.
+		std::vector<glm::vec4> values;
+	};
+
+	struct Animation {
+		std::string name;
+		std::vector<AnimationChannel> channels;
+		float start = 0.0f;
+		float end = 0.0f;
+	};
+
+	// Value of the channel at time, clamped to its first and last key. Rotations come back normalized.
+	// cursor is the key the previous sample of this channel landed on, playing forward only moves it
+	// by a key or two, so sequential sampling does not search.
+	glm::vec4 SampleAnimationChannel(const AnimationChannel& channel, float time, uint32_t& cursor);
+}
@@ -2,14 +2,61 @@
 
 #include "GraphicsDevice.hpp"
 
+#include "CameraPath.hpp"
+#include "Benchmark.hpp"
+#include "FrameTimeHistogram.hpp"
+#include "FrameEvents.hpp"
+
+#include <string>
+
 namespace Diffuse {
+    struct ApplicationOptions {
+        // Camera path to replay with a fixed time step, empty runs interactively
+        std::string replay_path;
+        std::string record_path = "camera_path.json";
+        std::string benchmark_output = "benchmark.json";
+        float fixed_dt = 1.0f / 60.0f;
+        uint32_t warmup_frames = 60;
+        // Frames between averaged GPU pass timings in the log, 0 disables it
+        uint32_t gpu_log_interval = 0;
+        // Enables pipeline statistics queries and logs them every n frames, 0 disables them
+        uint32_t pipeline_statistics_interval = 0;
+        // Chrome trace outputs, only used in DIFFUSE_PROFILE builds
+        std::string trace_load_path;
+        std::string trace_frames_path;
+        uint32_t trace_first_frame = 100;
+        uint32_t trace_frame_count = 10;
+        // Per asset and per texture load accounting (json), empty disables it
+        std::string load_report_path;
+        // Frames slower than spike_threshold_ms (0 disables it) or spike_factor times the
+        // rolling median are logged with the frame events that happened during them
+        float spike_threshold_ms = 0.0f;
+        float spike_factor = 2.0f;
+        // Frames between frame time histogram logs, 0 only logs it on exit
+        uint32_t frame_histogram_interval = 0;
+        // Frame time the background task budget is tuned against
+        float target_frame_ms = 1000.0f / 60.0f;
+        // Animation every scene object plays, -1 keeps them in their rest pose
+        int32_t animation = -1;
+    };
+
     class Application {
     public:
-        void Init();
+        void Init(const ApplicationOptions& options = {});
         void Update();
         void Destroy();
      private:
+        void EndLoadTrace();
+
         GraphicsDevice* m_graphics;
         Config m_config;
+        ApplicationOptions m_options;
+
+        CameraPath m_camera_path;
+        BenchmarkReport m_benchmark;
+        bool m_recording_path = false;
+
+        FrameTimeHistogram m_frame_times;
+        std::vector<Utils::FrameEvent> m_frame_events;
     };
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Diffuse {
+
+	struct FrameSample {
+		uint32_t frame = 0;
+		double cpu_ms = 0.0;
+		double gpu_ms = 0.0;
+	};
+
+	// Collects per-frame timings of a benchmark run and writes them with percentile summaries
+	class BenchmarkReport {
+	public:
+		void AddFrame(double cpu_ms, double gpu_ms);
+		void SetInfo(const std::string& key, const std::string& value) { m_info.push_back({ key, value }); }
+
+		const std::vector<FrameSample>& GetFrames() const { return m_frames; }
+		static double Percentile(std::vector<double> values, double percentile);
+
+		bool WriteJson(const std::string& path) const;
+	private:
+		std::vector<FrameSample> m_frames;
+		std::vector<std::pair<std::string, std::string>> m_info;
+	};
+}
@@ -34,6 +34,10 @@ namespace Diffuse {
 
 		float GetPitch() const { return m_Pitch; }
 		float GetYaw() const { return m_Yaw; }
+		const glm::vec3& GetFocalPoint() const { return m_FocalPoint; }
+
+		// Places the camera directly, used by camera path playback
+		void SetView(const glm::vec3& focalPoint, float distance, float pitch, float yaw);
 	private:
 		void UpdateProjection();
 		void UpdateView();
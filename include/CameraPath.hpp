@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Camera.hpp"
+
+#include "glm/glm.hpp"
+
+#include <string>
+#include <vector>
+
+namespace Diffuse {
+
+	struct CameraKeyframe {
+		float time = 0.0f;
+		glm::vec3 focal_point{ 0.0f };
+		float distance = 10.0f;
+		float pitch = 0.0f;
+		float yaw = 0.0f;
+	};
+
+	// Timestamped editor camera keyframes, recorded while flying and replayed for benchmarks
+	class CameraPath {
+	public:
+		void AddKeyframe(const CameraKeyframe& keyframe) { m_keyframes.push_back(keyframe); }
+		void Record(float time, const EditorCamera& camera);
+		// Interpolates between the surrounding keyframes and applies the result to camera
+		void Apply(float time, EditorCamera& camera) const;
+
+		float Duration() const { return m_keyframes.empty() ? 0.0f : m_keyframes.back().time; }
+		bool Empty() const { return m_keyframes.empty(); }
+		void Clear() { m_keyframes.clear(); }
+
+		bool Load(const std::string& path);
+		bool Save(const std::string& path) const;
+	private:
+		std::vector<CameraKeyframe> m_keyframes;
+	};
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Events that are known to cause hitches when they happen inside a frame. They are
+// collected per frame so a slow frame can be attributed to what happened during it.
+//
+//   Utils::FrameEventScope event(Utils::FrameEventType::UploadWait, "Texture2D");
+
+namespace Utils {
+	enum class FrameEventType : uint8_t { PipelineCompile, Allocation, UploadWait, FenceTimeout, Resize, Count };
+
+	const char* FrameEventName(FrameEventType type);
+
+	struct FrameEvent {
+		FrameEventType type;
+		// String literal, never owned
+		const char* detail;
+		double ms;
+	};
+
+	class FrameEvents {
+	public:
+		// Thread safe, detail has to outlive the frame
+		static void Record(FrameEventType type, const char* detail, double ms = 0.0);
+		// Moves everything recorded since the last call into events
+		static void Take(std::vector<FrameEvent>& events);
+	};
+
+	// Records an event with the duration of the enclosing scope
+	class FrameEventScope {
+	public:
+		FrameEventScope(FrameEventType type, const char* detail)
+			: m_type(type), m_detail(detail), m_start(std::chrono::steady_clock::now()) {}
+		~FrameEventScope() {
+			FrameEvents::Record(m_type, m_detail, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count());
+		}
+
+		FrameEventScope(const FrameEventScope&) = delete;
+		FrameEventScope& operator=(const FrameEventScope&) = delete;
+	private:
+		FrameEventType m_type;
+		const char* m_detail;
+		std::chrono::steady_clock::time_point m_start;
+	};
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Main thread work that is spread over frames instead of stalling one: upload submissions,
+// mip generation, bake tiles, descriptor writes. Every frame runs task steps by priority until
+// its time or byte budget is spent, the rest waits for a later frame. The time budget follows
+// the measured frame time: it halves after a frame that missed the target and grows back slowly.
+//
+//   scheduler.Add({ "Texture upload", visibility, bytes, [=](Utils::BackgroundTask& task) { return UploadNextMip(task); } });
+//   ...
+//   scheduler.RunFrame(busy_ms);   once per frame, after the frame was submitted
+
+namespace Utils {
+	struct BackgroundTask {
+		// String literal, never owned
+		const char* name = "";
+		// Share of the view waiting on the result, 0 when nothing visible does. Higher runs first,
+		// waiting tasks gain priority with age so nothing starves.
+		float visibility = 0.0f;
+		// Bytes the next step uploads, counted against the byte budget. Steps may update it.
+		uint64_t bytes = 0;
+		// One step on the main thread, returns true once the task is finished
+		std::function<bool(BackgroundTask& task)> step;
+	};
+
+	struct FrameSchedulerStats {
+		// Frame time without background work and the budget derived from it
+		double frame_ms = 0.0;
+		double budget_ms = 0.0;
+		double spent_ms = 0.0;
+		uint64_t spent_bytes = 0;
+		uint32_t steps = 0;
+		uint32_t finished = 0;
+		// Tasks left for a later frame
+		uint32_t deferred = 0;
+	};
+
+	class FrameScheduler {
+	public:
+		FrameScheduler() = default;
+		FrameScheduler(const FrameScheduler&) = delete;
+		FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+		// Thread safe, picked up by the next RunFrame. Returns an id for SetVisibility.
+		uint64_t Add(BackgroundTask task);
+		// Main thread, ignored once the task has finished
+		void SetVisibility(uint64_t id, float visibility);
+
+		void SetTargetFrameTime(double ms) { m_target_ms = ms; }
+		void SetByteBudget(uint64_t bytes) { m_byte_budget = bytes; }
+
+		// busy_ms is what the frame spent working, without waits on the GPU or the display and without
+		// background work. At least one step runs every frame while tasks are pending.
+		void RunFrame(double busy_ms);
+
+		uint32_t GetPendingCount() const { return static_cast<uint32_t>(m_tasks.size()); }
+		// Of the last RunFrame
+		const FrameSchedulerStats& GetStats() const { return m_stats; }
+	private:
+		struct Entry {
+			BackgroundTask task;
+			uint64_t id = 0;
+			uint64_t added_frame = 0;
+			// Running average, 0 until the first step
+			double step_ms = 0.0;
+			float priority = 0.0f;
+			bool finished = false;
+		};
+
+		void TuneBudget(double busy_ms);
+	private:
+		double m_target_ms = 1000.0 / 60.0;
+		uint64_t m_byte_budget = 16ull * 1024 * 1024;
+		double m_budget_ms = 1.0;
+		uint64_t m_frame = 0;
+		uint64_t m_next_id = 1;
+
+		std::vector<Entry> m_tasks;
+		std::vector<uint32_t> m_order;
+		FrameSchedulerStats m_stats;
+
+		std::mutex m_mutex;
+		std::vector<Entry> m_added;
+	};
+}
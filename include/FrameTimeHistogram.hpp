@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Diffuse {
+
+	// Rolling window of frame times with a fixed bucket histogram and a spike detector.
+	// A frame is a spike if it exceeds the absolute threshold (if set) or factor times
+	// the rolling median.
+	class FrameTimeHistogram {
+	public:
+		FrameTimeHistogram(uint32_t window = 1024, double bucket_ms = 0.5, uint32_t bucket_count = 100);
+
+		void SetSpikeThreshold(double absolute_ms, double median_factor);
+
+		// Returns true if the frame was a spike
+		bool AddFrame(double ms);
+
+		// Exact percentile over the window, percentile in [0, 100]
+		double Percentile(double percentile) const;
+		// Bucket resolution estimate, cheap enough to use every frame
+		double ApproximatePercentile(double percentile) const;
+
+		uint64_t GetFrameCount() const { return m_frame_count; }
+		uint64_t GetSpikeCount() const { return m_spike_count; }
+
+		// Percentiles and a text histogram of the window
+		std::string Summary() const;
+	private:
+		uint32_t BucketIndex(double ms) const;
+	private:
+		std::vector<double> m_samples;
+		uint32_t m_next = 0;
+		uint32_t m_size = 0;
+
+		double m_bucket_ms;
+		std::vector<uint32_t> m_buckets;
+
+		double m_spike_absolute_ms = 0.0;
+		double m_spike_median_factor = 2.0;
+		uint64_t m_frame_count = 0;
+		uint64_t m_spike_count = 0;
+	};
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Diffuse {
+
+	class GraphicsDevice;
+
+	struct GpuScopeResult {
+		std::string name;
+		uint32_t depth = 0;
+		double ms = 0.0;
+		// Startup scopes recorded on the dedicated compute queue, they overlap the graphics ones
+		bool compute_queue = false;
+	};
+
+	// Timestamp queries around named passes. Every frame in flight owns its own query
+	// pool; results are read once the frame's fence has signaled so nothing ever waits
+	// on the GPU. Scopes also emit VK_EXT_debug_utils labels when the extension is loaded.
+	class GpuProfiler {
+	public:
+		GpuProfiler(GraphicsDevice* device, VkInstance instance, uint32_t queue_family, uint32_t frames_in_flight, uint32_t max_scopes = 64);
+
+		GpuProfiler() = delete;
+		GpuProfiler(const GpuProfiler&) = delete;
+		GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+		// Collects the results of frame_index (its fence must have signaled) and resets its queries.
+		// Has to be recorded outside of a render pass.
+		void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_index);
+		void BeginScope(VkCommandBuffer command_buffer, const std::string& name);
+		void EndScope(VkCommandBuffer command_buffer);
+
+		// Scopes for one-off setup work (IBL bakes, LUTs). They are submitted through blocking
+		// helpers, so ReportStartup() can read them right after setup.
+		void BeginStartupScope(VkCommandBuffer command_buffer, const std::string& name);
+		void EndStartupScope(VkCommandBuffer command_buffer);
+		// Setup work submitted to a dedicated compute queue gets its own query pool, so nothing the
+		// graphics queue records resets queries the compute queue still writes
+		void EnableComputeQueue(uint32_t queue_family);
+		void BeginComputeStartupScope(VkCommandBuffer command_buffer, const std::string& name);
+		void EndComputeStartupScope(VkCommandBuffer command_buffer);
+		// Compute queue scopes are listed after the graphics ones, marked "(compute queue)"
+		void ReportStartup();
+
+		// Debug labels only, for work that isn't timed
+		void BeginLabel(VkCommandBuffer command_buffer, const char* name);
+		void EndLabel(VkCommandBuffer command_buffer);
+
+		const std::vector<GpuScopeResult>& GetFrameResults() const { return m_frame_results; }
+		const std::vector<GpuScopeResult>& GetStartupResults() const { return m_startup_results; }
+		// Sum of the top level scopes of the latest resolved frame
+		double GetFrameTime() const { return m_frame_time_ms; }
+		bool TimestampsSupported() const { return m_supported; }
+
+		// Prints averaged scope times every interval frames, 0 disables the log
+		void SetLogInterval(uint32_t frames) { m_log_interval = frames; }
+
+		void Destroy();
+	private:
+		struct Scope {
+			std::string name;
+			uint32_t depth = 0;
+			uint32_t begin_query = 0;
+			uint32_t end_query = 0;
+		};
+
+		struct QueryBlock {
+			VkQueryPool pool = VK_NULL_HANDLE;
+			std::vector<Scope> scopes;
+			std::vector<uint32_t> open;
+			uint32_t next_query = 0;
+			bool reset = false;
+			// Valid timestamp bits differ between queue families
+			bool supported = false;
+			uint64_t timestamp_mask = ~0ull;
+		};
+
+		uint32_t TimestampValidBits(uint32_t queue_family) const;
+		void CreateBlock(QueryBlock& block, uint32_t valid_bits);
+		void BeginStartup(QueryBlock& block, VkCommandBuffer command_buffer, const std::string& name);
+		void Begin(QueryBlock& block, VkCommandBuffer command_buffer, const std::string& name);
+		void End(QueryBlock& block, VkCommandBuffer command_buffer);
+		void Resolve(QueryBlock& block, std::vector<GpuScopeResult>& results);
+		void Log();
+	private:
+		GraphicsDevice* m_device;
+		bool m_supported = false;
+		float m_timestamp_period = 1.0f;
+		uint32_t m_max_queries = 0;
+
+		std::vector<QueryBlock> m_frames;
+		QueryBlock m_startup;
+		QueryBlock m_compute_startup;
+		uint32_t m_current_frame = 0;
+
+		std::vector<GpuScopeResult> m_frame_results;
+		std::vector<GpuScopeResult> m_startup_results;
+		std::vector<uint64_t> m_timestamps;
+		double m_frame_time_ms = 0.0;
+
+		uint32_t m_log_interval = 0;
+		uint32_t m_logged_frames = 0;
+		std::map<std::string, double> m_log_accumulator;
+
+		PFN_vkCmdBeginDebugUtilsLabelEXT m_cmd_begin_label = nullptr;
+		PFN_vkCmdEndDebugUtilsLabelEXT m_cmd_end_label = nullptr;
+	};
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "Buffer.hpp"
+
+#include <vulkan/vulkan.hpp>
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Diffuse {
+
+	class GraphicsDevice;
+	class Model;
+
+	// Compute skinning and morph targets of every deformed model instance, one dispatch each per frame.
+	// Each instance owns a copy of its model's vertex buffer inside one shared output buffer,
+	// the dispatches rewrite the position, normal and tangent of its deformed ranges, everything else is
+	// copied once by Build(). Morphing runs first, skinned primitives are morphed into the rest
+	// pose the skinning reads. Joint matrices and the morph jobs of the targets with a non-zero
+	// weight are written on the CPU per frame in flight.
+	class GpuSkinning {
+	public:
+		GpuSkinning(GraphicsDevice* device, uint32_t frames_in_flight);
+
+		GpuSkinning() = delete;
+		GpuSkinning(const GpuSkinning&) = delete;
+		GpuSkinning& operator=(const GpuSkinning&) = delete;
+
+		// The model has to outlive the skinning. Returns the instance to draw with.
+		uint32_t AddInstance(const Model& model);
+		// Uploads the skinning and morph streams of all instances and waits for it
+		void Build();
+
+		// Joint matrices of the current node transforms, morph weights of the models
+		void Update(uint32_t frame_index);
+		// Outside a render pass, orders the dispatches after the vertex reads of the previous frame
+		// and before the vertex reads that follow
+		void Record(VkCommandBuffer command_buffer, uint32_t frame_index);
+
+		VkBuffer OutputBuffer() const { return m_output.buffer; }
+		VkDeviceSize OutputOffset(uint32_t instance) const;
+		uint32_t GetSkinnedVertexCount() const { return m_skinned_vertex_count; }
+		// Only the spans of targets with a non-zero weight are dispatched, plus what has to go back to rest
+		uint32_t GetMorphedVertexCount(uint32_t frame_index) const { return m_frames[frame_index].morph_vertex_count; }
+
+		void Destroy();
+	private:
+		struct Instance {
+			const Model* model;
+			uint32_t output_vertex;
+			uint32_t first_joint;
+		};
+
+		// Matches Job in skinning.comp
+		struct Job {
+			uint32_t first;
+			uint32_t count;
+			uint32_t output_vertex;
+			uint32_t first_joint;
+		};
+
+		// Matches MorphVertex in morph_targets.comp
+		struct GpuMorphVertex {
+			glm::vec3 position;
+			uint32_t destination;
+			glm::vec3 normal;
+			uint32_t padding;
+		};
+		static_assert(sizeof(GpuMorphVertex) == 32, "morph_targets.comp reads MorphVertex with std430 layout");
+
+		// Morphed primitive of one instance
+		struct MorphSource {
+			const Model* model;
+			// Into the targets of the model
+			uint32_t first_target;
+			uint32_t target_count;
+			uint32_t first_morph_vertex;
+			uint32_t morph_vertex_count;
+			// Model deltas start here in the shared delta buffer
+			uint32_t first_delta;
+			uint32_t target;
+			// Morph vertices [dirty_begin, dirty_end) of the range are not at rest in the output
+			uint32_t dirty_begin = 0;
+			uint32_t dirty_end = 0;
+		};
+
+		// Matches Job in morph_targets.comp, built per frame
+		struct MorphJob {
+			uint32_t first;
+			uint32_t count;
+			uint32_t first_morph_vertex;
+			// Relative to the first morph vertex of the range, like the spans of its targets
+			uint32_t range_vertex;
+			uint32_t first_active_target;
+			uint32_t active_target_count;
+			uint32_t target;
+			uint32_t padding;
+		};
+
+		// Matches ActiveTarget in morph_targets.comp
+		struct ActiveTarget {
+			uint32_t first_delta;
+			uint32_t first_morph_vertex;
+			uint32_t morph_vertex_count;
+			float weight;
+		};
+
+		struct ComputePass {
+			VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+			VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+			// One per frame in flight
+			std::vector<VkDescriptorSet> descriptor_sets;
+			VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+		};
+
+		// Persistently mapped
+		struct Frame {
+			Buffer joint_matrices;
+			Buffer morph_jobs;
+			Buffer active_targets;
+			uint32_t morph_vertex_count = 0;
+			uint32_t morph_job_count = 0;
+		};
+
+		// bindings[frame] are the storage buffers of the descriptor set of that frame
+		void CreatePass(ComputePass& pass, const std::string& shader, const char* name, const std::vector<std::vector<const Buffer*>>& bindings);
+		void Dispatch(VkCommandBuffer command_buffer, const ComputePass& pass, uint32_t frame_index, uint32_t vertex_count, uint32_t job_count);
+		void DestroyPass(ComputePass& pass);
+	private:
+		GraphicsDevice* m_device;
+		std::vector<Instance> m_instances;
+		uint32_t m_output_vertex_count = 0;
+		uint32_t m_joint_count = 0;
+		uint32_t m_skinned_vertex_count = 0;
+		uint32_t m_job_count = 0;
+		uint32_t m_morph_target_count = 0;
+		std::vector<MorphSource> m_morph_sources;
+
+		Buffer m_rest_vertices;
+		Buffer m_skin_vertices;
+		Buffer m_jobs;
+		Buffer m_morph_vertices;
+		Buffer m_morph_deltas;
+		Buffer m_output;
+		std::vector<Frame> m_frames;
+
+		ComputePass m_skinning_pass;
+		ComputePass m_morph_pass;
+	};
+}
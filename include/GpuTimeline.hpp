@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Diffuse {
+
+	// A value on the timeline of a queue, what submissions return and other queues wait on
+	struct GpuSyncPoint {
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		uint64_t value = 0;
+	};
+
+	// GPU progress of one queue as a single timeline semaphore (Vulkan 1.2). Every submission
+	// signals the next value, so "is the GPU done with X" becomes a comparison against the value
+	// of the submission that used X instead of a fence per submit.
+	// Safe to use from any thread, submissions and presents are serialized on the queue.
+	class GpuTimeline {
+	public:
+		GpuTimeline(VkDevice device, VkQueue queue);
+
+		GpuTimeline() = delete;
+		GpuTimeline(const GpuTimeline&) = delete;
+		GpuTimeline& operator=(const GpuTimeline&) = delete;
+
+		// Submits and returns the value signaled once it completes. The binary semaphores of
+		// submit_info are kept, waits are points of other timelines the submission waits on at wait_stage.
+		uint64_t Submit(const VkSubmitInfo& submit_info, const std::vector<GpuSyncPoint>& waits = {},
+			VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		uint64_t Submit(VkCommandBuffer command_buffer, const std::vector<GpuSyncPoint>& waits = {},
+			VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+		// False if the timeout (in ns) ran out first
+		bool Wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+		bool IsComplete(uint64_t value);
+		uint64_t GetCompletedValue();
+		uint64_t GetSubmittedValue() const { return m_submitted.load(std::memory_order_acquire); }
+		GpuSyncPoint GetSyncPoint(uint64_t value) const { return { m_semaphore, value }; }
+		VkQueue Queue() const { return m_queue; }
+		// For a present queue that is this queue, it is externally synchronized with the submissions
+		VkResult Present(const VkPresentInfoKHR& present_info);
+
+		// Runs destroy from CollectGarbage() once the GPU is past value
+		void DeferDestroy(uint64_t value, std::function<void()> destroy);
+		// After everything submitted so far
+		void DeferDestroy(std::function<void()> destroy) { DeferDestroy(GetSubmittedValue(), std::move(destroy)); }
+		void CollectGarbage();
+
+		// The queue has to be idle, runs what is left of the deferred destroys
+		void Destroy();
+	private:
+		// Semaphores of one submission, binary ones from the submit info plus the timeline ones
+		static constexpr uint32_t s_max_semaphores = 8;
+
+		void SetCompleted(uint64_t value);
+
+		VkDevice m_device;
+		VkQueue m_queue;
+		VkSemaphore m_semaphore = VK_NULL_HANDLE;
+		// Held around every use of the queue, values have to be signaled in submission order
+		std::mutex m_queue_mutex;
+		std::atomic<uint64_t> m_submitted{ 0 };
+		std::atomic<uint64_t> m_completed{ 0 };
+		std::mutex m_deferred_mutex;
+		std::deque<std::pair<uint64_t, std::function<void()>>> m_deferred;
+	};
+}
@@ -4,6 +4,16 @@
 #include "Window.hpp"
 #include "Buffer.hpp"
 #include "Swapchain.hpp"
+#include "ReadbackRing.hpp"
+#include "GpuProfiler.hpp"
+#include "GpuTimeline.hpp"
+#include "GpuSkinning.hpp"
+#include "MaterialTable.hpp"
+#include "PipelineStatistics.hpp"
+#include "RenderStats.hpp"
+#include "TextOverlay.hpp"
+#include "FrameEvents.hpp"
+#include "FrameScheduler.hpp"
 #include "Model.hpp"
 #include "Scene.hpp"
 
@@ -13,11 +23,25 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
 
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace Diffuse {
     struct Config {
         bool enable_validation_layers = true;
+        // Pipeline statistics queries around each render bucket, needs the pipelineStatisticsQuery feature
+        bool enable_pipeline_statistics = false;
+        // No visible window, presents to a VK_EXT_headless_surface (lavapipe, CI machines). Only GLFW 3.4+
+        // (GLFW_PLATFORM_NULL) runs without a display server, older versions still open a hidden window on one.
+        bool headless = false;
+        uint32_t width = 1280;
+        uint32_t height = 720;
+        // Edge length of the IBL environment cubemap bake
+        uint32_t offscreen_size = 1024;
+        // Compute work goes to a dedicated compute queue when the device has one
+        bool enable_async_compute = true;
         const std::vector<const char*> validation_layers = {
             "VK_LAYER_KHRONOS_validation"
         };
@@ -76,28 +100,84 @@ namespace Diffuse {
         std::shared_ptr<Window> GetWindow() const { return m_window; }
         const VkDevice& Device() const { return m_device; }
         const VkQueue& Queue() const { return m_graphics_queue; }
+        // Pool of the thread that created the device, the frame command buffers come from it
         const VkCommandPool& CommandPool() const { return m_command_pool; }
+        // Graphics pool of the calling thread, created on first use. Command pools are externally
+        // synchronized, so every loader thread records its uploads into its own.
+        VkCommandPool ThreadCommandPool();
         const VkPhysicalDevice& PhysicalDevice() const { return m_physical_device; }
         const VkSurfaceKHR& Surface() const { return m_surface; }
-
-        void Draw(std::shared_ptr<Scene> scene, std::shared_ptr<EditorCamera> camera, float dt);
-        void DrawNode(const std::shared_ptr<SceneObject> object, Node* node, VkCommandBuffer commandBuffer, Material::AlphaMode alpha_mode);
+        const VkPhysicalDeviceProperties& PhysicalDeviceProperties() const { return m_physical_device_properties; }
+        GpuProfiler* GetGpuProfiler() const { return m_gpu_profiler.get(); }
+        // Progress of the graphics queue, every submission to it goes through here
+        GpuTimeline& GraphicsTimeline() const { return *m_graphics_timeline; }
+        // The graphics timeline when there is no dedicated compute queue
+        GpuTimeline& ComputeTimeline() const { return m_compute_timeline ? *m_compute_timeline : *m_graphics_timeline; }
+        const VkCommandPool& ComputeCommandPool() const { return m_compute_timeline ? m_compute_command_pool : m_command_pool; }
+        bool HasAsyncCompute() const { return m_compute_timeline != nullptr; }
+        // Images used on both queues are shared concurrently instead of transferring ownership
+        void ShareWithComputeQueue(VkImageCreateInfo& image_info) const {
+            if (HasAsyncCompute()) {
+                image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+                image_info.queueFamilyIndexCount = static_cast<uint32_t>(m_shared_queue_families.size());
+                image_info.pQueueFamilyIndices = m_shared_queue_families.data();
+            }
+        }
+        // nullptr unless Config::enable_pipeline_statistics was set and the device supports it
+        PipelineStatistics* GetPipelineStatistics() const { return m_pipeline_statistics.get(); }
+        // GPU duration of the most recently completed frame, read back without waiting
+        double GetGpuFrameTime() const { return m_gpu_profiler->GetFrameTime(); }
+        // Counters of the most recently recorded frame
+        const RenderStats& GetRenderStats() const { return m_last_render_stats; }
+        // Time the last Draw blocked on the frame fence, image acquisition and present
+        double GetFrameWaitTime() const { return m_frame_wait_ms; }
+        // Main thread work spread over frames, the frame loop runs it after Draw
+        Utils::FrameScheduler& GetBackgroundTasks() { return m_background_tasks; }
+
+        // Render stats text drawn on top of the frame
+        void SetStatsOverlay(bool enabled) { m_stats_overlay = enabled; }
+        bool IsStatsOverlayEnabled() const { return m_stats_overlay; }
+        // Lighting only view, materials drop their base color. The material edits run as background tasks,
+        // so a scene with many materials switches over a few frames.
+        void SetUntexturedMaterials(bool untextured);
+        bool IsUntexturedMaterials() const { return m_untextured_materials; }
+
+        // Captures
+        void RequestCapture(const std::string& path) { m_readback->RequestCapture(path); }
+        void SetContinuousCapture(const std::string& directory) { m_readback->SetContinuousCapture(directory); }
+        // A capture is requested or still read back and encoded, frames then build paths and queue work
+        bool IsCapturing() const { return m_readback->HasPendingRequest() || m_readback->HasCapturesInFlight(); }
+
+        void Draw(const std::shared_ptr<Scene>& scene, const std::shared_ptr<EditorCamera>& camera, float dt);
+        // All instances of the mesh in one draw per primitive
+        void DrawMesh(const std::shared_ptr<SceneObject>& object, const Mesh* mesh, VkCommandBuffer commandBuffer, Material::AlphaMode alpha_mode);
         void DrawNodeSkybox(Node* node, VkCommandBuffer commandBuffer);
+        // Uploads the changed parameters of a material of the object with the next recorded frame,
+        // descriptor sets and buffers stay as they are. Returns false when the material table is full,
+        // the material then keeps drawing with its previous parameters.
+        bool UpdateMaterial(const std::shared_ptr<SceneObject>& object, uint32_t material);
 
+        // Resource creation can run on several threads at once, e.g. models loading in parallel
         void CreateVertexBuffer(VkBuffer& vertex_buffer, VkDeviceMemory& vertex_buffer_memory, uint32_t buffer_size, const Vertex* vertices);
         void CreateIndexBuffer(VkBuffer& index_buffer, VkDeviceMemory& index_buffer_memory, uint32_t buffer_size, const uint32_t* indices);
         void CreateUniformBuffer(const std::shared_ptr<Scene> scene);
 
         void DeleteUniformBuffers(const std::shared_ptr<Scene> scene);
 
-        void RecordCommandBuffer(std::shared_ptr<Scene> scene, std::shared_ptr<EditorCamera> camera, VkCommandBuffer command_buffer, uint32_t image_index);
+        void RecordCommandBuffer(const std::shared_ptr<Scene>& scene, const std::shared_ptr<EditorCamera>& camera, VkCommandBuffer command_buffer, uint32_t image_index);
+        // Marks a render bucket for the GPU profiler and pipeline statistics
+        void BeginPass(VkCommandBuffer command_buffer, const char* name);
+        void EndPass(VkCommandBuffer command_buffer);
         void CreateGraphicsPipeline();
+        // vkCreateGraphicsPipelines reported as a pipeline compile frame event
+        VkResult CompileGraphicsPipeline(VkPipelineCache cache, const VkGraphicsPipelineCreateInfo& create_info, VkPipeline* pipeline, const char* name);
 
+        // From the pool of the calling thread, flush it on the same thread
         VkCommandBuffer CreateCommandBuffer(VkCommandBufferLevel level, bool begin = false)
         {
             VkCommandBufferAllocateInfo cmdBufAllocateInfo{};
             cmdBufAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            cmdBufAllocateInfo.commandPool = m_command_pool;
+            cmdBufAllocateInfo.commandPool = ThreadCommandPool();
             cmdBufAllocateInfo.level = level;
             cmdBufAllocateInfo.commandBufferCount = 1;
 
@@ -118,38 +198,25 @@ namespace Diffuse {
             return cmdBuffer;
         }
 
-        void FlushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free = true)
+        // Submits on the timeline of queue and waits for it. Command buffers for the compute queue
+        // come from ComputeCommandPool(), the others from ThreadCommandPool().
+        void FlushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free = true, const std::vector<GpuSyncPoint>& waits = {})
         {
             if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
                 assert(false);
             }
 
-            VkSubmitInfo submitInfo{};
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &commandBuffer;
-
-            // Create fence to ensure that the command buffer has finished executing
-            VkFenceCreateInfo fenceInfo{};
-            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            VkFence fence;
-            if (vkCreateFence(m_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
-                assert(false);
-            }
-
-            // Submit to the queue
-            if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
-                assert(false);
-            }
-            // Wait for the fence to signal that command buffer has finished executing
-            if (vkWaitForFences(m_device, 1, &fence, VK_TRUE, 100000000000) != VK_SUCCESS) {
-                assert(false);
+            const bool compute = HasAsyncCompute() && queue == m_compute_queue;
+            assert(compute || queue == m_graphics_queue);
+            GpuTimeline& timeline = compute ? ComputeTimeline() : GraphicsTimeline();
+            const uint64_t value = timeline.Submit(commandBuffer, waits);
+            {
+                Utils::FrameEventScope frame_event(Utils::FrameEventType::UploadWait, "GraphicsDevice::FlushCommandBuffer");
+                timeline.Wait(value);
             }
 
-            vkDestroyFence(m_device, fence, nullptr);
-
             if (free) {
-                vkFreeCommandBuffers(m_device, m_command_pool, 1, &commandBuffer);
+                vkFreeCommandBuffers(m_device, compute ? ComputeCommandPool() : ThreadCommandPool(), 1, &commandBuffer);
             }
         }
 
@@ -166,10 +233,16 @@ namespace Diffuse {
         Texture2D* m_white_texture;
 
     private:
+        // Copies on the graphics queue with a command buffer of the calling thread and waits for it
+        void CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+
         std::shared_ptr<Window>         m_window;
         // == VULKAN HANDLES ===================================
         VkQueue                         m_present_queue;
         VkQueue                         m_graphics_queue;
+        VkQueue                         m_compute_queue = VK_NULL_HANDLE;
+        // Graphics and compute family, for images shared between the queues
+        std::array<uint32_t, 2>         m_shared_queue_families;
         VkImage                         m_depth_image;
         VkRect2D                        m_frame_rect;
         VkDevice                        m_device;
@@ -183,11 +256,39 @@ namespace Diffuse {
         VkRenderPass                    m_render_pass;
         VkRenderPass                    m_offscreen_render_pass;
         VkCommandPool                   m_command_pool;
+        VkCommandPool                   m_compute_command_pool = VK_NULL_HANDLE;
+        uint32_t                        m_graphics_queue_family = 0;
+        std::thread::id                 m_owner_thread;
+        // ThreadCommandPool() of every other thread
+        std::mutex                      m_thread_command_pool_mutex;
+        std::unordered_map<std::thread::id, VkCommandPool> m_thread_command_pools;
         VkDeviceMemory                  m_index_buffer_memory;
         VkDeviceMemory                  m_depth_image_memory;
         std::unique_ptr<Swapchain>      m_swapchain;
+        std::unique_ptr<ReadbackRing>   m_readback;
+        std::unique_ptr<GpuProfiler>    m_gpu_profiler;
+        std::unique_ptr<GpuTimeline>    m_graphics_timeline;
+        // Only created with a dedicated compute queue
+        std::unique_ptr<GpuTimeline>    m_compute_timeline;
+        // Environment bake, the IBL filter passes wait on it
+        GpuSyncPoint                    m_environment_ready;
+        // Only created when the scene has skinned models
+        std::unique_ptr<GpuSkinning>    m_skinning;
+        // Parameters of all materials of the scene, shared by every draw
+        std::unique_ptr<MaterialTable>  m_materials;
+        std::unique_ptr<PipelineStatistics> m_pipeline_statistics;
+        RenderStats                     m_render_stats;
+        RenderStats                     m_last_render_stats;
+        double                          m_frame_wait_ms = 0.0;
+        Utils::FrameScheduler           m_background_tasks;
+        TextOverlay                     m_stats_text;
+        bool                            m_stats_overlay = false;
+        bool                            m_untextured_materials = false;
+        // Pending material edits of an older generation are dropped
+        uint64_t                        m_material_edit_generation = 0;
         VkDeviceMemory                  m_vertex_buffer_memory;
         VkPipelineCache                 m_pipeline_cache;
+        VkPhysicalDeviceProperties      m_physical_device_properties;
         //VkPipelineLayout                m_pipeline_layout;
         VkPhysicalDevice                m_physical_device;
         std::vector<void*>              m_uniform_buffers_mapped;
@@ -212,24 +313,7 @@ namespace Diffuse {
         };
 
         enum PBRWorkflows { PBR_WORKFLOW_METALLIC_ROUGHNESS = 0, PBR_WORKFLOW_SPECULAR_GLOSINESS = 1 };
-
-        struct alignas(16) ShaderMaterial {
-            glm::vec4 baseColorFactor;
-            glm::vec4 emissiveFactor;
-            glm::vec4 diffuseFactor;
-            glm::vec4 specularFactor;
-            float workflow;
-            int colorTextureSet;
-            int PhysicalDescriptorTextureSet;
-            int normalTextureSet;
-            int occlusionTextureSet;
-            int emissiveTextureSet;
-            float metallicFactor;
-            float roughnessFactor;
-            float alphaMask;
-            float alphaMaskCutoff;
-            float emissiveStrength;
-        };
+        ShaderMaterial MakeShaderMaterial(const Material& material) const;
 
         struct DescriptorPools {
             VkDescriptorPool scene;
@@ -295,14 +379,6 @@ namespace Diffuse {
             VkDescriptorImageInfo descriptor;
         } m_brdf_lut;
 
-        struct {
-            VkImageView view;
-            VkImage image;
-            VkDeviceMemory memory;
-            VkSampler sampler;
-            VkImageLayout layout;
-        } m_cubemap;
-
         struct {
             VkImageView view;
             VkImage image;
@@ -319,7 +395,8 @@ namespace Diffuse {
         //std::array<VkImageView, 6> m_cubemap_face_image_views;
         VkSampler computeSampler;
 
-        std::vector<VkFence> m_wait_fences;
+        // Graphics timeline value of the last submission of each frame in flight
+        std::vector<uint64_t> m_frame_timeline_values;
         std::vector<VkCommandBuffer> commandBuffers;
         std::vector<VkSemaphore> m_render_complete_semaphores;
         std::vector<VkSemaphore> m_present_complete_semaphores;
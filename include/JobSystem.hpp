@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Engine wide job system. One worker per core besides the main thread, every thread owns a
+// mutex guarded deque it pops from the back of while idle threads steal from the front of the
+// others. Threads the job system does not know spread their jobs over all deques.
+// Threads that wait on a counter keep running jobs, and only block once there are none left.
+//
+//   Utils::JobCounter counter;
+//   Utils::JobSystem::ParallelFor(count, 64, [&](uint32_t begin, uint32_t end) { ... }, &counter);
+//   Utils::JobSystem::Wait(counter);
+//
+// Until Init is called (and after Shutdown) every job runs inline on the calling thread.
+
+namespace Utils {
+	using Job = std::function<void()>;
+	struct QueuedJob;
+
+	// Number of unfinished jobs of a group, plus the jobs that were queued to run after it
+	class JobCounter {
+	public:
+		JobCounter() = default;
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+
+		// Only true once the last job is completely done with the counter, so it can go out of scope
+		bool Done() const;
+	private:
+		friend class JobSystem;
+		std::atomic<uint32_t> m_pending{ 0 };
+		mutable std::mutex m_mutex;
+		std::vector<std::pair<Job, JobCounter*>> m_continuations;
+	};
+
+	class JobSystem {
+	public:
+		// worker_count 0 uses one worker per hardware thread besides the caller
+		static void Init(uint32_t worker_count = 0);
+		// Finishes queued jobs, then joins the workers
+		static void Shutdown();
+
+		// Workers only, the main thread comes on top
+		static uint32_t GetWorkerCount();
+		// 0 for the thread that called Init, 1..GetWorkerCount() for the workers, UINT32_MAX for any other thread
+		static uint32_t GetThreadIndex();
+
+		static void Run(Job job, JobCounter* counter = nullptr);
+		// Queued once dependency has reached zero
+		static void RunAfter(JobCounter& dependency, Job job, JobCounter* counter = nullptr);
+		// Splits [0, count) into batches of batch_size, waits for them unless a counter is given.
+		// The batches refer to body, so with a counter it has to outlive the wait on it.
+		template<typename Body>
+		static void ParallelFor(uint32_t count, uint32_t batch_size, const Body& body, JobCounter* counter = nullptr) {
+			if (count == 0)
+				return;
+			batch_size = std::max(batch_size, 1u);
+			// Not running or a single batch, nothing to gain from queueing
+			if (!IsRunning() || count <= batch_size) {
+				body(0, count);
+				return;
+			}
+
+			JobCounter local_counter;
+			JobCounter* group = counter ? counter : &local_counter;
+			for (uint32_t begin = 0; begin < count; begin += batch_size) {
+				const uint32_t end = std::min(begin + batch_size, count);
+				// Small enough for the inline storage of std::function, queueing a batch does not allocate
+				Run([&body, begin, end] { body(begin, end); }, group);
+			}
+			if (!counter)
+				Wait(local_counter);
+		}
+		// Runs other jobs until counter reaches zero
+		static void Wait(JobCounter& counter);
+	private:
+		static bool IsRunning();
+		static void Schedule(Job job, JobCounter* counter);
+		static void Execute(QueuedJob& job);
+		static void Finish(JobCounter* counter);
+	};
+}
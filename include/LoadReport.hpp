@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Diffuse {
+
+	enum class LoadPhase : uint32_t { Read, Parse, Decode, Convert, Upload, MipGen, Wait, Count };
+
+	const char* LoadPhaseName(LoadPhase phase);
+
+	struct PhaseStats {
+		double wall_ms = 0.0;
+		double cpu_ms = 0.0;
+		uint64_t bytes = 0;
+
+		PhaseStats& operator+=(const PhaseStats& other);
+	};
+
+	struct PhaseTable {
+		PhaseStats phases[static_cast<uint32_t>(LoadPhase::Count)];
+
+		PhaseStats& operator[](LoadPhase phase) { return phases[static_cast<uint32_t>(phase)]; }
+		const PhaseStats& operator[](LoadPhase phase) const { return phases[static_cast<uint32_t>(phase)]; }
+		PhaseTable& operator+=(const PhaseTable& other);
+		PhaseStats Total() const;
+	};
+
+	struct TextureLoadStats {
+		int texture_index = -1;
+		int image_index = -1;
+		std::string name;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		bool srgb = false;
+		PhaseTable phases;
+	};
+
+	// Accounting of a single Model::Load. Decode is tracked per source image since
+	// several textures may share one, texture entries carry everything after that.
+	struct AssetLoadStats {
+		std::string path;
+		uint32_t vertex_count = 0;
+		uint32_t index_count = 0;
+		// Nodes drawing a mesh converted for an earlier node, primitives reusing converted vertices
+		uint32_t shared_mesh_nodes = 0;
+		uint32_t shared_primitives = 0;
+		// Vertices whose tangents were generated since the asset had none
+		uint32_t generated_tangents = 0;
+		PhaseTable phases;
+		std::vector<PhaseStats> image_decode;
+		std::vector<TextureLoadStats> textures;
+	};
+
+	// Measures wall and calling-thread cpu time of a scope and adds it to a phase
+	class PhaseTimer {
+	public:
+		PhaseTimer(PhaseStats* stats, uint64_t bytes = 0);
+		~PhaseTimer() { Stop(); }
+
+		PhaseTimer(const PhaseTimer&) = delete;
+		PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+		// Ends the measurement early, later calls do nothing
+		void Stop();
+
+		static double ThreadCpuMs();
+	private:
+		PhaseStats* m_stats;
+		uint64_t m_bytes;
+		std::chrono::steady_clock::time_point m_wall_start;
+		double m_cpu_start;
+	};
+
+	// Scene wide collection of asset load stats, written as json with per asset and scene totals
+	class LoadReport {
+	public:
+		void AddAsset(const AssetLoadStats& asset) { m_assets.push_back(asset); }
+		void SetScene(const std::string& name) { m_scene = name; }
+
+		const std::vector<AssetLoadStats>& GetAssets() const { return m_assets; }
+		PhaseTable Totals() const;
+
+		bool WriteJson(const std::string& path) const;
+	private:
+		std::string m_scene;
+		std::vector<AssetLoadStats> m_assets;
+	};
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Model.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Inner loops of the glTF loader. Model and Texture2D call these and DiffuseMicroBench
+// measures the same functions, so its numbers are the renderer's.
+
+namespace Diffuse {
+
+	// Float attribute streams of one primitive, strides are in floats. Missing streams are null.
+	struct VertexStreams {
+		const float* position = nullptr;
+		const float* normal = nullptr;
+		const float* uv0 = nullptr;
+		const float* uv1 = nullptr;
+		const float* color = nullptr;
+		size_t position_stride = 3;
+		size_t normal_stride = 3;
+		size_t uv0_stride = 2;
+		size_t uv1_stride = 2;
+		size_t color_stride = 4;
+	};
+
+	// Writes count vertices, missing attributes get their defaults and the tangent is +x
+	void ConvertVertices(const VertexStreams& streams, size_t count, Vertex* vertices);
+
+	// Widens an index accessor and offsets it by the first vertex of its primitive
+	template<typename T>
+	void RebaseIndices(const T* source, size_t count, uint32_t vertex_start, uint32_t* indices) {
+		for (size_t i = 0; i < count; i++) {
+			indices[i] = uint32_t(source[i]) + vertex_start;
+		}
+	}
+
+	// Texels [first, last) of an RGB8 image to RGBA8, alpha is opaque
+	void ExpandRgbToRgba(const uint8_t* rgb, uint8_t* rgba, size_t first, size_t last);
+}
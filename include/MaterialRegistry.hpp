@@ -0,0 +1,84 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Diffuse {
+
+	// Matches ShaderMaterial in pbr.frag
+	struct alignas(16) ShaderMaterial {
+		glm::vec4 baseColorFactor;
+		glm::vec4 emissiveFactor;
+		glm::vec4 diffuseFactor;
+		glm::vec4 specularFactor;
+		float workflow;
+		int colorTextureSet;
+		int PhysicalDescriptorTextureSet;
+		int normalTextureSet;
+		int occlusionTextureSet;
+		int emissiveTextureSet;
+		float metallicFactor;
+		float roughnessFactor;
+		float alphaMask;
+		float alphaMaskCutoff;
+		float emissiveStrength;
+	};
+
+	// Consecutive ids whose entries changed
+	struct MaterialRange {
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+
+	// Id bookkeeping of the MaterialTable, without GPU resources. Materials with identical
+	// parameters share one id, ids stay valid until their last reference is released and are
+	// then reused. Changed ids are remembered until the next CollectDirty.
+	class MaterialRegistry {
+	public:
+		explicit MaterialRegistry(uint32_t capacity);
+
+		// Id of a material with these parameters, adds it if there is none yet. Throws when that needs a new id and all are taken.
+		uint32_t Acquire(const ShaderMaterial& material);
+		void Release(uint32_t id);
+		// Changes the parameters behind one reference to id. An id shared with other references is left
+		// alone and id is set to another one. Returns false and keeps id when that needs a new id and all are taken.
+		bool Update(uint32_t& id, const ShaderMaterial& material);
+
+		// Ids changed since the last call in ascending order, neighbouring ids merged into one range
+		void CollectDirty(std::vector<MaterialRange>& ranges);
+
+		const ShaderMaterial& Get(uint32_t id) const { return m_entries[id].material; }
+		uint32_t GetCapacity() const { return m_capacity; }
+		// Live entries, references to them
+		uint32_t GetMaterialCount() const { return static_cast<uint32_t>(m_entries.size() - m_free.size()); }
+		uint32_t GetReferenceCount() const { return m_references; }
+
+		void Clear();
+	private:
+		struct Entry {
+			ShaderMaterial material;
+			uint64_t hash = 0;
+			uint32_t references = 0;
+			bool dirty = false;
+		};
+
+		static constexpr uint32_t s_invalid_id = ~0u;
+
+		static uint64_t Hash(const ShaderMaterial& material);
+		static bool Equal(const ShaderMaterial& a, const ShaderMaterial& b);
+		uint32_t Find(uint64_t hash, const ShaderMaterial& material) const;
+		bool IsFull() const { return m_free.empty() && m_entries.size() >= m_capacity; }
+		void MarkDirty(uint32_t id);
+	private:
+		uint32_t m_capacity;
+		std::vector<Entry> m_entries;
+		std::vector<uint32_t> m_free;
+		std::unordered_multimap<uint64_t, uint32_t> m_lookup;
+		std::vector<uint32_t> m_dirty;
+		uint32_t m_references = 0;
+	};
+}
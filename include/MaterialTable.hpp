@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "MaterialRegistry.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Diffuse {
+
+	class GraphicsDevice;
+
+	// Device wide storage buffer of every material in use, indexed by the material push constant.
+	// Ids come from a MaterialRegistry. Changed entries are copied through a staging slice of the
+	// frame being recorded, so edits never touch descriptor sets or reallocate the buffer.
+	class MaterialTable {
+	public:
+		MaterialTable(GraphicsDevice* device, uint32_t frames_in_flight, uint32_t capacity);
+
+		MaterialTable() = delete;
+		MaterialTable(const MaterialTable&) = delete;
+		MaterialTable& operator=(const MaterialTable&) = delete;
+
+		// See MaterialRegistry
+		uint32_t Acquire(const ShaderMaterial& material) { return m_registry.Acquire(material); }
+		void Release(uint32_t id) { m_registry.Release(id); }
+		bool Update(uint32_t& id, const ShaderMaterial& material) { return m_registry.Update(id, material); }
+
+		// Outside a render pass, copies the entries changed since the last call and orders
+		// them against the fragment shader reads before and after
+		void Record(VkCommandBuffer command_buffer, uint32_t frame_index);
+
+		const VkDescriptorBufferInfo& Descriptor() const { return m_buffer.descriptor; }
+		const MaterialRegistry& GetRegistry() const { return m_registry; }
+		// Bytes copied by the last Record
+		uint64_t GetUploadedBytes() const { return m_uploaded_bytes; }
+
+		void Destroy();
+	private:
+		GraphicsDevice* m_device;
+		MaterialRegistry m_registry;
+		std::vector<MaterialRange> m_ranges;
+		std::vector<VkBufferCopy> m_copies;
+		uint64_t m_uploaded_bytes = 0;
+
+		Buffer m_buffer;
+		// Persistently mapped, one per frame in flight with the layout of m_buffer
+		std::vector<Buffer> m_staging;
+	};
+}
@@ -1,14 +1,22 @@
 #pragma once
 
 #include "Texture2D.hpp"
+#include "LoadReport.hpp"
+#include "Animation.hpp"
 
 #include "tiny_gltf.h"
 
 #include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
 #include "glm/gtc/type_ptr.hpp"
 #include "vulkan/vulkan.hpp"
 #include "vulkan/vulkan.h"
+#include <functional>
 #include <iostream>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace Diffuse {
 
@@ -20,6 +28,48 @@ namespace Diffuse {
 		glm::vec2 uv0;
 		glm::vec2 uv1;
 		glm::vec4 color;
+		// Towards +u of uv0, w is the handedness of the bitangent cross(normal, tangent.xyz)
+		glm::vec4 tangent;
+	};
+
+	// Per instance stream of pbr.vert, the normal matrix is the inverse transpose of the upper 3x3 of node
+	struct InstanceData {
+		glm::mat4 node;
+		glm::mat3 normal;
+	};
+
+	// Skinning stream, kept out of Vertex so only skinned vertices pay for it. Joints index
+	// into the joints of the skin of the node.
+	struct SkinVertex {
+		glm::uvec4 joints;
+		glm::vec4 weights;
+	};
+
+	// Morph target delta of one vertex. Laid out like MorphDelta in morph_targets.comp.
+	struct MorphDelta {
+		glm::vec3 position;
+		float padding0 = 0.0f;
+		glm::vec3 normal;
+		float padding1 = 0.0f;
+	};
+
+	// Vertex with at least one non-zero delta
+	struct MorphVertex {
+		uint32_t vertex;
+		// Rest pose the deltas are added to
+		glm::vec3 position;
+		glm::vec3 normal;
+	};
+
+	// One target of a morphed primitive. Its deltas are stored target after target, one per morph
+	// vertex of the span between the first and last vertex it moves, zeros in between included.
+	struct MorphTarget {
+		// Into the morph weights of the model
+		uint32_t weight;
+		// Relative to the first morph vertex of the range
+		uint32_t first_morph_vertex;
+		uint32_t morph_vertex_count;
+		uint32_t first_delta;
 	};
 
 	struct Texture {
@@ -72,6 +122,8 @@ namespace Diffuse {
 			bool specularGlossiness = false;
 		} pbrWorkflows;
 		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		// Entry in the material table of the graphics device, pushed per draw
+		uint32_t tableIndex = 0;
 		int index = 0;
 		bool unlit = false;
 		float emissiveStrength = 1.0f;
@@ -87,9 +139,16 @@ namespace Diffuse {
 			:first_index(_first_index), index_count(_index_count), vertex_count(_vertex_count), material_index(index) {}
 	};
 
+	struct Node;
+
+	// Owned by the model, nodes referencing the same glTF mesh share one
 	struct Mesh {
 		std::vector<Primitive*> primitives;
 		glm::mat4 matrix;
+		// Nodes drawing this mesh, one instance each
+		std::vector<Node*> instances;
+		// Of the first instance in GetInstanceData
+		uint32_t first_instance = 0;
 		Mesh(const glm::mat4& mat)
 			:matrix(mat) {}
 		~Mesh() {
@@ -106,33 +165,130 @@ namespace Diffuse {
 		Mesh* mesh = nullptr;
 		glm::mat4 matrix;
 		std::string name;
-		glm::vec3 translation;
+		glm::vec3 translation = glm::vec3(0.0f);
 		glm::vec3 scale = glm::vec3(1.0f);
-		glm::quat rotation;
-		~Node() {
-			if (mesh) {
-				delete mesh;
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		int32_t skin_index = -1;
+		glm::mat4 LocalMatrix() const {
+			return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
+		}
+		// Model space transform, parents included
+		glm::mat4 GetMatrix() const {
+			glm::mat4 m = LocalMatrix();
+			for (const Node* p = parent; p; p = p->parent) {
+				m = p->LocalMatrix() * m;
 			}
+			return m;
+		}
+		~Node() {
 			for (auto& child : children) {
 				delete child;
 			}
 		}
 	};
 
+	struct Skin {
+		std::string name;
+		std::vector<Node*> joints;
+		std::vector<glm::mat4> inverse_bind_matrices;
+	};
+
+	// Vertices of one skinned primitive, in the vertex buffer and in the skinning stream
+	struct SkinnedRange {
+		uint32_t first_vertex;
+		uint32_t vertex_count;
+		uint32_t first_skin_vertex;
+		uint32_t skin_index;
+	};
+
+	// Morphed vertices of one primitive and its targets that move any of them
+	struct MorphRange {
+		uint32_t first_vertex;
+		uint32_t vertex_count;
+		uint32_t first_morph_vertex;
+		uint32_t morph_vertex_count;
+		uint32_t first_target;
+		uint32_t target_count;
+	};
+
 	class Model {
 	public:
 		Model() = default;
 		~Model();
 		void Load(const std::string& path, GraphicsDevice* device);
-		void GetNodeProps(const tinygltf::Node& node, const tinygltf::Model& model, uint32_t& vertex_count, uint32_t& index_count);
+		// Builds the GPU resources of an already parsed (or generated) glTF model
+		void Load(tinygltf::Model& model, GraphicsDevice* device);
+		// Runs every load as a job and waits for all of them, loads of different models share
+		// nothing but the thread safe device. The first exception of a load is rethrown here.
+		static void LoadAll(const std::vector<std::function<void()>>& loads);
 		void LoadNode(Node* parent, const tinygltf::Node& node, uint32_t node_index, const tinygltf::Model& model);
 		void LoadMaterials(tinygltf::Model model);
+		void LoadSkins(const tinygltf::Model& model);
+		void LoadAnimations(const tinygltf::Model& model);
+		void LoadMorphTargets(const tinygltf::Primitive& primitive, const tinygltf::Model& model, uint32_t vertex_start, uint32_t vertex_count, uint32_t first_weight);
+		// Tangents of the primitives that came without TANGENT, one job per vertex range
+		void GenerateTangents();
+		Node* FindNode(uint32_t index) const;
 
-		const std::vector<Node*> GetNodes() const { return m_nodes; }
-		const std::vector<Node*> GetLinearNodes() const { return m_linear_nodes; }
+		const std::vector<Node*>& GetNodes() const { return m_nodes; }
+		const std::vector<Node*>& GetLinearNodes() const { return m_linear_nodes; }
 		const std::vector<Material>& GetMaterials() const { return m_materials; }
+		std::vector<Material>& GetMaterials() { return m_materials; }
 		const Material& GetMaterial(int i) const { return m_materials[i]; }
 		Material& GetMaterial(int i) { return m_materials[i]; }
+		// Phase timings and byte counts of the last Load
+		const AssetLoadStats& GetLoadStats() const { return m_load_stats; }
+
+		uint32_t GetVertexCount() const { return m_vertex_pos; }
+		bool IsSkinned() const { return !m_skinned_ranges.empty(); }
+		const std::vector<Skin>& GetSkins() const { return m_skins; }
+		const std::vector<SkinnedRange>& GetSkinnedRanges() const { return m_skinned_ranges; }
+		const std::vector<SkinVertex>& GetSkinVertices() const { return m_skin_vertices; }
+		// Joints of all skins, skin after skin
+		uint32_t GetJointCount() const;
+		// Joint matrices of the current node transforms, GetJointCount() of them
+		void GetJointMatrices(glm::mat4* matrices) const;
+
+		bool HasMorphTargets() const { return !m_morph_ranges.empty(); }
+		const std::vector<MorphRange>& GetMorphRanges() const { return m_morph_ranges; }
+		const std::vector<MorphVertex>& GetMorphVertices() const { return m_morph_vertices; }
+		const std::vector<MorphTarget>& GetMorphTargets() const { return m_morph_targets; }
+		const std::vector<MorphDelta>& GetMorphDeltas() const { return m_morph_deltas; }
+		// One per target of every morphed mesh, node after node. Set them directly.
+		std::vector<float>& GetMorphWeights() { return m_morph_weights; }
+		const std::vector<float>& GetMorphWeights() const { return m_morph_weights; }
+
+		const std::vector<Mesh*>& GetMeshes() const { return m_meshes; }
+		// Instances of all meshes, mesh after mesh
+		uint32_t GetInstanceCount() const { return m_instance_count; }
+		// Model space matrices of the current node transforms, GetInstanceCount() of them
+		void GetInstanceData(InstanceData* instances) const;
+
+		const std::vector<Animation>& GetAnimations() const { return m_animations; }
+		// Samples every channel at time, looped over the length of the animation, into the node transforms
+		void UpdateAnimation(uint32_t index, float time);
+	private:
+		// Geometry already converted during one Load. Meshes are keyed by glTF mesh index, vertex
+		// ranges by their attribute accessors and index ranges by those plus the index accessor.
+		// Skinned and morphed geometry is never shared since it is deformed per node.
+		struct GeometryCache {
+			std::unordered_map<int, Mesh*> meshes;
+			// first, count
+			std::map<std::vector<int>, std::pair<uint32_t, uint32_t>> vertices;
+			std::map<std::vector<int>, std::pair<uint32_t, uint32_t>> indices;
+			// Index into m_tangent_jobs by first vertex
+			std::unordered_map<uint32_t, uint32_t> tangent_jobs;
+		};
+
+		// Vertex range without imported tangents and the index ranges (first, count) drawing it
+		struct TangentJob {
+			uint32_t first_vertex;
+			uint32_t vertex_count;
+			std::vector<std::pair<uint32_t, uint32_t>> index_ranges;
+		};
+
+		// Vertices and indices LoadNode will write, geometry it shares is counted once
+		void GetNodeProps(const tinygltf::Node& node, const tinygltf::Model& model, uint32_t& vertex_count, uint32_t& index_count, GeometryCache& counted);
 	private:
 		std::vector<Node*> m_nodes;
 		std::vector<Node*> m_linear_nodes;
@@ -143,6 +299,22 @@ namespace Diffuse {
 		Vertex* m_vertex_buffer;
 		uint32_t m_vertex_pos = 0;
 		uint32_t m_index_pos = 0;
+		std::vector<Mesh*> m_meshes;
+		uint32_t m_instance_count = 0;
+		GeometryCache m_geometry_cache;
+		std::vector<TangentJob> m_tangent_jobs;
+		AssetLoadStats m_load_stats;
+		std::vector<Skin> m_skins;
+		std::vector<SkinnedRange> m_skinned_ranges;
+		std::vector<SkinVertex> m_skin_vertices;
+		std::vector<MorphRange> m_morph_ranges;
+		std::vector<MorphVertex> m_morph_vertices;
+		std::vector<MorphTarget> m_morph_targets;
+		std::vector<MorphDelta> m_morph_deltas;
+		std::vector<float> m_morph_weights;
+		std::vector<Animation> m_animations;
+		// Per animation, one per channel
+		std::vector<std::vector<uint32_t>> m_animation_cursors;
 
 	public:
 		struct {
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <string>
+#include <vector>
+
+namespace Diffuse {
+
+	class GraphicsDevice;
+
+	struct PipelineStatisticsResult {
+		std::string name;
+		uint64_t input_vertices = 0;
+		uint64_t input_primitives = 0;
+		uint64_t vertex_invocations = 0;
+		uint64_t clipping_primitives = 0;
+		uint64_t fragment_invocations = 0;
+		// Samples of the pass that passed the depth and stencil tests, 0 without precise occlusion queries
+		uint64_t covered_samples = 0;
+		// Fragment invocations per covered sample
+		double overdraw = 0.0;
+	};
+
+	// VK_QUERY_TYPE_PIPELINE_STATISTICS and, when the device counts samples precisely,
+	// VK_QUERY_TYPE_OCCLUSION around render buckets. Same ring layout as the GpuProfiler:
+	// one pool per type and frame in flight, read back once the frame fence signaled.
+	// Queries of one type can't be nested, so passes must not overlap.
+	class PipelineStatistics {
+	public:
+		PipelineStatistics(GraphicsDevice* device, uint32_t frames_in_flight, bool precise_occlusion, uint32_t max_passes = 16);
+
+		PipelineStatistics() = delete;
+		PipelineStatistics(const PipelineStatistics&) = delete;
+		PipelineStatistics& operator=(const PipelineStatistics&) = delete;
+
+		// Outside of a render pass
+		void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_index);
+		void BeginPass(VkCommandBuffer command_buffer, const char* name);
+		void EndPass(VkCommandBuffer command_buffer);
+
+		const std::vector<PipelineStatisticsResult>& GetResults() const { return m_results; }
+		void SetLogInterval(uint32_t frames) { m_log_interval = frames; }
+
+		void Destroy();
+	private:
+		struct Pass {
+			const char* name;
+			uint32_t query;
+		};
+
+		struct QueryBlock {
+			VkQueryPool pool = VK_NULL_HANDLE;
+			VkQueryPool occlusion_pool = VK_NULL_HANDLE;
+			std::vector<Pass> passes;
+			bool active = false;
+			bool reset = false;
+		};
+
+		void Resolve(QueryBlock& block);
+		void Log();
+	private:
+		GraphicsDevice* m_device;
+		uint32_t m_max_passes;
+		std::vector<QueryBlock> m_frames;
+		uint32_t m_current_frame = 0;
+
+		std::vector<PipelineStatisticsResult> m_results;
+		std::vector<uint64_t> m_counters;
+		std::vector<uint64_t> m_samples;
+
+		uint32_t m_log_interval = 0;
+		uint32_t m_frames_since_log = 0;
+	};
+}
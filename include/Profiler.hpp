@@ -0,0 +1,57 @@
+#pragma once
+
+// CPU instrumentation. Build with -DDIFFUSE_PROFILE (CMake option DIFFUSE_ENABLE_PROFILER)
+// to record scoped zones; without it every macro below expands to nothing.
+//
+//   DIFFUSE_PROFILE_FUNCTION();          zone named after the enclosing function
+//   DIFFUSE_PROFILE_SCOPE("Upload");     zone with a string literal name
+//   DIFFUSE_PROFILE_FRAME();             marks the end of a frame, drives frame captures
+
+#ifdef DIFFUSE_PROFILE
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Utils {
+	class Profiler {
+	public:
+		enum class EventType : uint8_t { Begin, End };
+
+		struct Event {
+			const char* name;
+			uint64_t tsc;
+			EventType type;
+		};
+
+		static uint64_t Now();
+		static void Record(const char* name, EventType type);
+		static void MarkFrame();
+
+		// Chrome trace of everything recorded between BeginCapture and EndCapture
+		static void BeginCapture();
+		static void EndCapture(const std::string& path);
+		// Chrome trace of frame_count frames, starting once first_frame has been marked
+		static void CaptureFrames(uint64_t first_frame, uint64_t frame_count, const std::string& path);
+	};
+
+	struct ProfileScope {
+		const char* name;
+		ProfileScope(const char* n) : name(n) { Profiler::Record(name, Profiler::EventType::Begin); }
+		~ProfileScope() { Profiler::Record(name, Profiler::EventType::End); }
+	};
+}
+
+#define DIFFUSE_PROFILE_CONCAT_INNER(a, b) a##b
+#define DIFFUSE_PROFILE_CONCAT(a, b) DIFFUSE_PROFILE_CONCAT_INNER(a, b)
+#define DIFFUSE_PROFILE_SCOPE(name) ::Utils::ProfileScope DIFFUSE_PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define DIFFUSE_PROFILE_FUNCTION() DIFFUSE_PROFILE_SCOPE(__FUNCTION__)
+#define DIFFUSE_PROFILE_FRAME() ::Utils::Profiler::MarkFrame()
+
+#else
+
+#define DIFFUSE_PROFILE_SCOPE(name)
+#define DIFFUSE_PROFILE_FUNCTION()
+#define DIFFUSE_PROFILE_FRAME()
+
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Buffer.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Diffuse {
+
+	class GraphicsDevice;
+
+	// Asynchronous GPU -> CPU copies of the presented image.
+	// The render thread only records a copy into a free host-cached slot and tags it with the
+	// graphics timeline value of the submission that carries it. Once the timeline has passed
+	// that value the slot is handed to a worker thread that encodes it to disk and returns it to the ring.
+	class ReadbackRing {
+	public:
+		ReadbackRing(GraphicsDevice* device, uint32_t slot_count = 3);
+		// Only stops the encoder, the slot buffers are released by Destroy()
+		~ReadbackRing();
+
+		ReadbackRing() = delete;
+		ReadbackRing(const ReadbackRing&) = delete;
+		ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+		// Capture the next recorded frame into path (png)
+		void RequestCapture(const std::string& path);
+		// Capture every frame into directory/frame_XXXXX.png until called with an empty string
+		void SetContinuousCapture(const std::string& directory);
+		bool HasPendingRequest() const { return !m_requests.empty() || !m_continuous_directory.empty(); }
+
+		// Records the copy of image into a free slot. image has to be in PRESENT_SRC_KHR
+		// layout and is returned to it. Returns false (and drops the request) if every slot is busy.
+		bool RecordCopy(VkCommandBuffer command_buffer, VkImage image, VkFormat format, VkExtent2D extent);
+		// The command buffer of the copies recorded since the last call was submitted as timeline_value
+		void OnSubmitted(uint64_t timeline_value);
+		// Hands every slot whose submission the graphics timeline has passed to the worker
+		void RetireCompleted();
+		// Hands every submitted slot to the worker, the caller guarantees the device is idle
+		void OnDeviceIdle();
+
+		uint64_t GetDroppedCaptures() const { return m_dropped; }
+		// A copy is recorded or waits for its frame or the encoder
+		bool HasCapturesInFlight();
+
+		void Destroy();
+	private:
+		// Recorded until its command buffer is submitted
+		enum class SlotState { Free, Recorded, InFlight, Encoding };
+
+		struct Slot {
+			Buffer buffer;
+			SlotState state = SlotState::Free;
+			uint64_t timeline_value = 0;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			std::string path;
+		};
+
+		void EnsureSlotSize(Slot& slot, VkDeviceSize size);
+		void StopWorker();
+		void HandOff(uint32_t slot_index);
+		void WorkerLoop();
+		void Encode(Slot& slot);
+	private:
+		GraphicsDevice* m_device;
+		std::vector<Slot> m_slots;
+		std::deque<std::string> m_requests;
+		std::string m_continuous_directory;
+		uint64_t m_continuous_counter = 0;
+		uint64_t m_dropped = 0;
+
+		std::thread m_worker;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque<uint32_t> m_encode_queue;
+		bool m_stop = false;
+	};
+}
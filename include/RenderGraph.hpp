@@ -0,0 +1,174 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Diffuse {
+
+	// How a pass touches an image, decides the stage, access mask and layout of the barriers around it
+	enum class ResourceUsage {
+		SampledFragment,
+		SampledCompute,
+		StorageCompute,
+		ColorAttachment,
+		DepthAttachment,
+		TransferSrc,
+		TransferDst,
+	};
+
+	struct ImageDesc {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 1;
+		uint32_t height = 1;
+		uint32_t mip_levels = 1;
+		uint32_t array_layers = 1;
+		// Transients get the usage bits of their passes on top
+		VkImageUsageFlags usage = 0;
+		VkImageCreateFlags flags = 0;
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	};
+
+	using RenderGraphImage = uint32_t;
+
+	// Frame graph for one-shot GPU work. Passes declare which subresources they read and write,
+	// Compile() culls the passes nothing depends on and places transient images whose lifetimes
+	// do not overlap in the same memory, Execute() records the passes with the minimal barriers
+	// and layout transitions between them, batched into one vkCmdPipelineBarrier per pass.
+	//
+	//   RenderGraph graph(device, physical_device);
+	//   RenderGraphImage target = graph.CreateTransient("target", desc);
+	//   graph.AddPass("draw", [&](RenderGraph::PassBuilder& pass) { pass.Write(target, ResourceUsage::ColorAttachment); },
+	//       [&](VkCommandBuffer command_buffer) { ... });
+	//   graph.Compile();
+	//   graph.Execute(command_buffer);
+	//   ... submit and wait ...
+	//   graph.Destroy(); // or let the graph go out of scope
+	class RenderGraph {
+	public:
+		// aspectMask 0 stands for the aspect of the image
+		static constexpr VkImageSubresourceRange WholeImage = { 0, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+		class PassBuilder {
+		public:
+			void Read(RenderGraphImage image, ResourceUsage usage, VkImageSubresourceRange range = WholeImage);
+			void Write(RenderGraphImage image, ResourceUsage usage, VkImageSubresourceRange range = WholeImage);
+			// Never culled, for passes whose output leaves the graph some other way
+			void SideEffect();
+		private:
+			friend class RenderGraph;
+			PassBuilder(RenderGraph* graph, uint32_t pass) : m_graph(graph), m_pass(pass) {}
+			RenderGraph* m_graph;
+			uint32_t m_pass;
+		};
+
+		struct Stats {
+			uint32_t passes = 0;
+			uint32_t culled_passes = 0;
+			uint32_t barriers = 0;
+			uint32_t barrier_batches = 0;
+			// Sum of the transient images vs. what was actually allocated for them
+			VkDeviceSize transient_bytes = 0;
+			VkDeviceSize allocated_bytes = 0;
+		};
+
+		RenderGraph(VkDevice device, VkPhysicalDevice physical_device);
+		// Destroys the transients, the GPU has to be done with them
+		~RenderGraph();
+
+		RenderGraph() = delete;
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+
+		// Image owned by the caller. Work that last touched it has to be complete (fence waited on).
+		RenderGraphImage Import(const std::string& name, VkImage image, const ImageDesc& desc, VkImageLayout current_layout = VK_IMAGE_LAYOUT_UNDEFINED);
+		// Image created by Compile() and destroyed with the graph, its contents only live inside the graph
+		RenderGraphImage CreateTransient(const std::string& name, const ImageDesc& desc);
+		// Transitions the image for usage at the end of the graph, which also keeps its writers alive
+		void SetFinalUsage(RenderGraphImage image, ResourceUsage usage);
+
+		void AddPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, std::function<void(VkCommandBuffer)> execute);
+
+		void Compile();
+		void Execute(VkCommandBuffer command_buffer);
+
+		// Valid after Compile(), views are only created for transients
+		VkImage GetImage(RenderGraphImage image) const { return m_images[image].image; }
+		VkImageView GetImageView(RenderGraphImage image) const { return m_images[image].view; }
+		const Stats& GetStats() const { return m_stats; }
+
+		void Destroy();
+	private:
+		struct Access {
+			RenderGraphImage image;
+			ResourceUsage usage;
+			VkImageSubresourceRange range;
+			bool write;
+		};
+
+		struct Pass {
+			std::string name;
+			std::function<void(VkCommandBuffer)> execute;
+			std::vector<Access> accesses;
+			bool side_effect = false;
+			bool culled = false;
+		};
+
+		// Synchronization state of one mip level of one layer
+		struct SubresourceState {
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags write_stages = 0;
+			VkAccessFlags write_access = 0;
+			// Readers since the last write, and what the last write was made visible to
+			VkPipelineStageFlags read_stages = 0;
+			VkPipelineStageFlags visible_stages = 0;
+			VkAccessFlags visible_access = 0;
+		};
+
+		struct Image {
+			std::string name;
+			ImageDesc desc;
+			bool transient = false;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			bool has_final_usage = false;
+			ResourceUsage final_usage = ResourceUsage::SampledFragment;
+			// Live pass range, UINT32_MAX while unused
+			uint32_t first_pass = UINT32_MAX;
+			uint32_t last_pass = 0;
+			uint32_t memory_block = UINT32_MAX;
+			// Indexed layer * mip_levels + mip
+			std::vector<SubresourceState> states;
+			bool touched = false;
+		};
+
+		// Memory shared by transients with disjoint lifetimes
+		struct MemoryBlock {
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			uint32_t memory_type_bits = ~0u;
+			std::vector<RenderGraphImage> images;
+			// Every stage that touched the block so far, the next image in it has to wait for them
+			VkPipelineStageFlags stages = 0;
+			VkAccessFlags write_access = 0;
+		};
+
+		void AddAccess(uint32_t pass, RenderGraphImage image, ResourceUsage usage, VkImageSubresourceRange range, bool write);
+		void CullPasses();
+		void CreateTransients();
+		void Transition(const Access& access, std::vector<VkImageMemoryBarrier>& barriers, VkPipelineStageFlags& src_stages, VkPipelineStageFlags& dst_stages);
+		void FlushBarriers(VkCommandBuffer command_buffer, std::vector<VkImageMemoryBarrier>& barriers, VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages);
+	private:
+		VkDevice m_device;
+		VkPhysicalDevice m_physical_device;
+		std::vector<Image> m_images;
+		std::vector<Pass> m_passes;
+		std::vector<MemoryBlock> m_memory_blocks;
+		bool m_compiled = false;
+		Stats m_stats;
+	};
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Diffuse {
+
+	class TextOverlay;
+
+	// Counters gathered while a frame is recorded, reset at the start of every Draw
+	struct RenderStats {
+		uint32_t draws = 0;
+		uint64_t triangles = 0;
+		uint32_t instances = 0;
+		uint32_t pipeline_binds = 0;
+		uint32_t descriptor_set_binds = 0;
+		uint32_t push_constants = 0;
+		uint32_t vertex_buffer_binds = 0;
+		uint32_t index_buffer_binds = 0;
+		// Scene objects skipped because p_render is off, there is no frustum culling
+		uint32_t hidden_objects = 0;
+		uint64_t uniform_bytes = 0;
+		uint32_t skinned_vertices = 0;
+		uint32_t morphed_vertices = 0;
+		// Material table entries copied to the GPU
+		uint64_t material_bytes = 0;
+
+		void Reset() { *this = RenderStats{}; }
+		// One "name: value" line per counter, formatted without heap allocations
+		void AddLines(TextOverlay& overlay) const;
+	};
+}
@@ -9,9 +9,16 @@ namespace Diffuse {
 		Renderer(GraphicsDevice* graphics_device);
 		Renderer() = delete;
 
-		void RenderScene(std::shared_ptr<Scene> scene, std::shared_ptr<EditorCamera> camera, float dt);
+		// Animates the scene and draws it
+		void RenderScene(const std::shared_ptr<Scene>& scene, const std::shared_ptr<EditorCamera>& camera, float dt);
 		//void RenderModel(Camera* camera, float dt, Model* model);
+
+		// Heap allocations of all threads during the last RenderScene, always 0 unless
+		// built with DIFFUSE_CHECK_FRAME_ALLOCATIONS (see AllocationCounter.hpp)
+		uint64_t GetFrameAllocations() const { return m_frame_allocations; }
 	private:
 		GraphicsDevice* device;
+		uint64_t m_frame_allocations = 0;
+		uint64_t m_frames_rendered = 0;
 	};
 }
\ No newline at end of file
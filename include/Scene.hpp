@@ -32,9 +32,11 @@ namespace Diffuse {
 		} p_transform;
 
 		bool p_render = true;
-		
-		//
-		VkDescriptorSet p_mat_descritpor_set;
+		// Instance in GpuSkinning whose output replaces the model vertex buffer, -1 when not skinned or morphed
+		int32_t p_skinning_instance = -1;
+		// Animation of the model that is played, -1 (the default) for none
+		int32_t p_animation = -1;
+		float p_animation_time = 0.0f;
 
 		struct {
 			std::vector<VkBuffer> uniformBuffers;
@@ -48,11 +50,12 @@ namespace Diffuse {
 			std::vector<void*> uniformBuffersMapped;
 		} p_shader_values_ubo;
 
+		// Per frame in flight, the matrices of all mesh instances of the model as per instance vertex input
 		struct {
-			VkBuffer buffer = VK_NULL_HANDLE;
-			VkDeviceMemory memory = VK_NULL_HANDLE;
-			VkDescriptorBufferInfo descriptor;
-		} p_shader_material_buffer;
+			std::vector<VkBuffer> instanceBuffers;
+			std::vector<VkDeviceMemory> instanceBuffersMemory;
+			std::vector<void*> instanceBuffersMapped;
+		} p_instances;
 	};
 
 	struct Skybox {
@@ -85,12 +88,18 @@ namespace Diffuse {
 		void AddEditorCamera(const std::shared_ptr<EditorCamera> camera) { m_editor_camera = camera; }
 
 		std::shared_ptr<SceneCamera> GetSceneCamera() { return m_scene_camera; }
-		std::vector<std::shared_ptr<SceneObject>> GetSceneObjects() const { return m_scene_objects; }
-		std::shared_ptr<Skybox> GetSkybox() const { return m_skybox; }
+		// By reference, the frame loop walks them every frame
+		const std::vector<std::shared_ptr<SceneObject>>& GetSceneObjects() const { return m_scene_objects; }
+		const std::shared_ptr<Skybox>& GetSkybox() const { return m_skybox; }
+
+		// Advances and samples the animation of every animated object, one job per object
+		void Animate(float dt);
 	private:
 		std::shared_ptr<SceneCamera> m_scene_camera;
 		std::shared_ptr<EditorCamera> m_editor_camera;
 		std::shared_ptr<Skybox> m_skybox;
 		std::vector<std::shared_ptr<SceneObject>> m_scene_objects;
+		// Objects Animate samples this frame, keeps its capacity across frames
+		std::vector<SceneObject*> m_animated;
 	};
 }
\ No newline at end of file
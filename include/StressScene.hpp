@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Scene.hpp"
+
+#include "tiny_gltf.h"
+
+#include <memory>
+#include <string>
+
+namespace Diffuse {
+
+	class GraphicsDevice;
+
+	// Shape of a synthetic scene, see GenerateStressScene
+	struct StressSceneDesc {
+		uint32_t object_count = 100;
+		uint32_t primitives_per_object = 1;
+		// One material per primitive instead of one shared by the whole object
+		bool unique_materials = false;
+		// Procedural textures per object, handed out to the materials round robin
+		uint32_t texture_count = 0;
+		uint32_t texture_size = 64;
+		// Length of the node chain the primitives of an object are spread over
+		uint32_t hierarchy_depth = 1;
+		uint32_t seed = 1;
+	};
+
+	// In memory glTF model of one stress scene object, a box per primitive.
+	// Positions are baked into the vertices since object transforms are not applied when drawing.
+	tinygltf::Model GenerateStressModel(const StressSceneDesc& desc, uint32_t object_index);
+
+	// Objects laid out on a grid, every one loaded through Model like a file would be
+	std::shared_ptr<Scene> GenerateStressScene(const StressSceneDesc& desc, GraphicsDevice* device, const std::string& skybox_path);
+}
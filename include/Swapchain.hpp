@@ -49,6 +49,7 @@ namespace Diffuse {
 		VkExtent2D GetExtent() const { return m_extent; }
 		uint32_t GetImageCount() const { return m_image_count; }
 		VkPresentModeKHR GetPresentMode() const { return m_present_mode; }
+		VkImageUsageFlags GetImageUsage() const { return m_image_usage; }
 
 		void Initialize();
 	private:
@@ -62,6 +63,7 @@ namespace Diffuse {
 		uint32_t m_image_count;
 		VkExtent2D m_extent;
 		VkPresentModeKHR m_present_mode;
+		VkImageUsageFlags m_image_usage = 0;
 		
 		GraphicsDevice* m_device;
 	};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <string_view>
+#include <vector>
+
+namespace Diffuse {
+
+	// Minimal debug text drawn with vkCmdClearAttachments inside the active render pass.
+	// Every lit pixel of a built in 5x7 font becomes a clear rect, so no pipeline,
+	// shader or font texture is needed. Meant for a handful of short lines.
+	class TextOverlay {
+	public:
+		TextOverlay(uint32_t pixel_scale = 2) : m_pixel_scale(pixel_scale) {}
+
+		void Clear();
+		// Lines are stacked from the top left corner. Lowercase is drawn as uppercase,
+		// unsupported characters as blanks. The text is copied, storage is kept across Clear.
+		void AddLine(std::string_view text);
+
+		// Records the clears into color attachment 0 of the current subpass
+		void Record(VkCommandBuffer command_buffer, VkExtent2D extent);
+	private:
+		void AddGlyph(char c, int32_t x, int32_t y, VkExtent2D extent);
+	private:
+		uint32_t m_pixel_scale;
+		// All lines back to back, m_line_ends[i] is one past the last character of line i
+		std::vector<char> m_text;
+		std::vector<uint32_t> m_line_ends;
+		std::vector<VkClearRect> m_glyph_rects;
+	};
+}
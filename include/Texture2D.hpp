@@ -6,6 +6,11 @@
 namespace Diffuse {
 
 	class GraphicsDevice;
+	struct TextureLoadStats;
+
+    // What the texels of a glTF texture hold. Color is sRGB encoded and gets an _SRGB format,
+    // so sampling and mip generation happen in linear space; data is sampled as stored.
+    enum class TextureUsage { Data, Color };
 
     struct TextureSampler {
         VkFilter mag_filter;
@@ -18,7 +23,7 @@ namespace Diffuse {
 	class Texture2D {
 	public:
 		Texture2D() {}
-        Texture2D(tinygltf::Image image, TextureSampler sampler, VkQueue copy_queue, GraphicsDevice* graphics_device);
+        Texture2D(tinygltf::Image image, TextureSampler sampler, TextureUsage usage, VkQueue copy_queue, GraphicsDevice* graphics_device, TextureLoadStats* stats = nullptr);
 		Texture2D(const std::string& path, VkFormat format, TextureSampler sampler, VkImageUsageFlags additionalUsage, GraphicsDevice* graphics_device, bool null_texture = false);
 		Texture2D(uint32_t width, uint32_t height, uint32_t layers, VkFormat format, uint32_t levels, VkImageUsageFlags additionalUsage, GraphicsDevice* graphics_device);
         void UpdateDescriptor();
@@ -19,6 +19,8 @@ namespace Diffuse {
 	struct QueueFamilyIndices {
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
+		// Compute family without graphics, only set when the device has one
+		std::optional<uint32_t> computeFamily;
 
 		bool isComplete() {
 			return graphicsFamily.has_value() && presentFamily.has_value();
@@ -31,7 +33,8 @@ namespace Diffuse {
 	class vkUtilities {
 	public:
 		static bool CheckValidationLayerSupport(const std::vector<const char*> validation_layers);
-		static std::vector<const char*> GetRequiredExtensions(bool enableValidationLayers);
+		static std::vector<const char*> GetRequiredExtensions(bool enableValidationLayers, bool headless = false);
+		static VkResult CreateHeadlessSurfaceEXT(VkInstance instance, VkSurfaceKHR* surface);
         static void CheckAvailableExtensions(VkPhysicalDevice device);
         static void PopulateReportMessengerCreateInfo(VkDebugReportCallbackCreateInfoEXT& createInfo);
 		static void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
@@ -55,20 +58,15 @@ namespace Diffuse {
 		static uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkPhysicalDevice physical_device);
 		static void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, 
 			VkPhysicalDevice physical_device, VkDevice device);
-		static void CreateVertexBuffer(const std::vector<Vertex>& vertices, VkDevice device, VkBuffer vertex_buffer, VkDeviceMemory vertex_buffer_memory,
-			VkCommandPool command_pool, VkQueue graphics_queue, VkPhysicalDevice physical_device);
-		static 	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool command_pool, VkDevice device, VkQueue graphics_queue);
 		//static void UpdateUniformBuffers(Camera* camera, uint32_t current_image, VkExtent2D swap_chain_extent, std::vector<void*> uniform_buffers_mapped);
 		static VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features, VkPhysicalDevice physical_device);
 		static VkFormat FindDepthFormat(VkPhysicalDevice physical_device);
 		static void CreateImage(uint32_t width, uint32_t height, VkDevice device, VkPhysicalDevice physical_device, VkFormat format, VkImageTiling tiling, 
 			VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t layers, uint32_t miplevels);
 		static VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkDevice device, uint32_t layers, uint32_t basemiplevels, uint32_t nummiplevels);
-		static void TransitionImageLayout(VkQueue graphics_queue, VkCommandPool command_pool, VkDevice device,
-			VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-		static void CopyBufferToImage(VkQueue graphics_queue, VkCommandPool command_pool, VkDevice device, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
-		static VkCommandBuffer BeginSingleTimeCommands(VkCommandPool command_pool, VkDevice device);
-		static void EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkDevice device, VkQueue graphics_queue, VkCommandPool command_pool);
+		// Recorded into a command buffer the caller submits
+		static void RecordTransitionImageLayout(VkCommandBuffer command_buffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
+		static void RecordCopyBufferToImage(VkCommandBuffer command_buffer, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 		static void DrawNode(Model* model, VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout);
 		static VkDescriptorSetLayoutBinding DescriptorSetLayoutBinding(VkDescriptorType type, VkShaderStageFlags stageFlags, uint32_t binding, uint32_t descriptorCount = 1);
         static VkResult CreateBuffer(VkDevice device, VkPhysicalDevice physical_device, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, Buffer* buffer, VkDeviceSize size, void* data = nullptr);
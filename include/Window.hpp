@@ -6,7 +6,7 @@
 namespace Diffuse {	
 	class Window {
 	public:
-		Window();
+		Window(uint32_t width = 1280, uint32_t height = 720, bool visible = true);
 		void DestroyWindow();
 
 		bool WindowShouldClose();
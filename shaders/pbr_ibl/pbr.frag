@@ -9,6 +9,7 @@ layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV0;
 layout (location = 3) in vec2 inUV1;
 layout (location = 4) in vec4 inColor0;
+layout (location = 5) in vec4 inTangent;
 
 // Scene bindings
 
@@ -137,17 +138,12 @@ vec4 tonemap(vec4 color)
 // or from the interpolated mesh normal and tangent attributes.
 vec3 getNormal(ShaderMaterial material)
 {
-	// Perturb normal, see http://www.thetenthplanet.de/archives/1180
+	// Perturb normal with the vertex tangent frame, w holds the handedness of the bitangent
 	vec3 tangentNormal = texture(normalMap, material.normalTextureSet == 0 ? inUV0 : inUV1).xyz * 2.0 - 1.0;
 
-	vec3 q1 = dFdx(inWorldPos);
-	vec3 q2 = dFdy(inWorldPos);
-	vec2 st1 = dFdx(inUV0);
-	vec2 st2 = dFdy(inUV0);
-
 	vec3 N = normalize(inNormal);
-	vec3 T = normalize(q1 * st2.t - q2 * st1.t);
-	vec3 B = -normalize(cross(N, T));
+	vec3 T = normalize(inTangent.xyz - dot(inTangent.xyz, N) * N);
+	vec3 B = cross(N, T) * inTangent.w;
 	mat3 TBN = mat3(T, B, N);
 
 	return normalize(TBN * tangentNormal);
@@ -243,7 +239,7 @@ void main()
 
 	if (material.alphaMask == 1.0f) {
 		if (material.baseColorTextureSet > -1) {
-			baseColor = SRGBtoLINEAR(texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1)) * material.baseColorFactor;
+			baseColor = texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1) * material.baseColorFactor;
 		} else {
 			baseColor = material.baseColorFactor;
 		}
@@ -273,7 +269,7 @@ void main()
 
 		// The albedo may be defined from a base texture or a flat color
 		if (material.baseColorTextureSet > -1) {
-			baseColor = SRGBtoLINEAR(texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1)) * material.baseColorFactor;
+			baseColor = texture(colorMap, material.baseColorTextureSet == 0 ? inUV0 : inUV1) * material.baseColorFactor;
 		} else {
 			baseColor = material.baseColorFactor;
 		}
@@ -289,8 +285,9 @@ void main()
 
 		const float epsilon = 1e-6;
 
-		vec4 diffuse = SRGBtoLINEAR(texture(colorMap, inUV0));
-		vec3 specular = SRGBtoLINEAR(texture(physicalDescriptorMap, inUV0)).rgb;
+		// Color textures use sRGB formats, the samples are already linear
+		vec4 diffuse = texture(colorMap, inUV0);
+		vec3 specular = texture(physicalDescriptorMap, inUV0).rgb;
 
 		float maxSpecular = max(max(specular.r, specular.g), specular.b);
 
@@ -374,7 +371,7 @@ void main()
 
 	vec3 emissive = material.emissiveFactor.rgb * material.emissiveStrength;
 	if (material.emissiveTextureSet > -1) {
-		emissive *= SRGBtoLINEAR(texture(emissiveMap, material.emissiveTextureSet == 0 ? inUV0 : inUV1)).rgb;
+		emissive *= texture(emissiveMap, material.emissiveTextureSet == 0 ? inUV0 : inUV1).rgb;
 	};
 	color += emissive;
 	
@@ -5,6 +5,10 @@ layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inUV0;
 layout(location = 3) in vec2 inUV1;
 layout(location = 4) in vec4 inColor;
+layout(location = 5) in vec4 inTangent;
+// Per instance, model space transform of the node and the inverse transpose of its upper 3x3 for normals
+layout(location = 6) in mat4 inNodeMatrix;
+layout(location = 10) in mat3 inNormalMatrix;
 
 layout(set = 0, binding = 0) uniform UniformBufferObect {
     mat4 model;
@@ -17,12 +21,15 @@ layout (location = 1) out vec3 outNormal;
 layout (location = 2) out vec2 outUV0;
 layout (location = 3) out vec2 outUV1;
 layout (location = 4) out vec4 outColor0;
+layout (location = 5) out vec4 outTangent;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    vec4 position = inNodeMatrix * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * ubo.view * ubo.model * position;
 
-    pos = inPosition;
-    outNormal = inNormal;
+    pos = position.xyz;
+    outNormal = inNormalMatrix * inNormal;
+    outTangent = vec4(mat3(inNodeMatrix) * inTangent.xyz, inTangent.w);
     outUV0 = inUV0;
     outUV1 = inUV1;
     outColor0 = inColor;
@@ -0,0 +1,3 @@
+C:/VulkanSDK/1.3.250.1/Bin/glslc.exe skinning.comp -o skinning_cs.spv
+C:/VulkanSDK/1.3.250.1/Bin/glslc.exe morph_targets.comp -o morph_targets_cs.spv
+pause
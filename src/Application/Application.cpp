@@ -4,7 +4,11 @@
 #include "Camera.hpp"
 #include "Scene.hpp"
 #include "Renderer.hpp"
+#include "Profiler.hpp"
+#include "LoadReport.hpp"
+#include "JobSystem.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 
@@ -46,8 +50,18 @@ namespace Diffuse {
         g_editor_camera->OnMouseScroll(yoffset);
     }
 
-    void Application::Init() {
-        m_graphics = new GraphicsDevice();
+    void Application::Init(const ApplicationOptions& options) {
+        m_options = options;
+        Utils::JobSystem::Init();
+#ifdef DIFFUSE_PROFILE
+        if (!m_options.trace_load_path.empty())
+            Utils::Profiler::BeginCapture();
+        if (!m_options.trace_frames_path.empty())
+            Utils::Profiler::CaptureFrames(m_options.trace_first_frame, m_options.trace_frame_count, m_options.trace_frames_path);
+#endif
+        DIFFUSE_PROFILE_SCOPE("Application::Init");
+        m_config.enable_pipeline_statistics = m_options.pipeline_statistics_interval > 0;
+        m_graphics = new GraphicsDevice(m_config);
         {
             // Creating scene
             g_scene = std::make_shared<Scene>();
@@ -60,17 +74,32 @@ namespace Diffuse {
 
             // Createing scene object
             std::shared_ptr<SceneObject> object1 = std::make_shared<SceneObject>();
-            object1->p_model.Load("../assets/damaged_helmet/DamagedHelmet.gltf", m_graphics);
-
             std::shared_ptr<SceneObject> object2 = std::make_shared<SceneObject>();
-            object2->p_model.Load("../assets/FlightHelmet/glTF/FlightHelmet.gltf", m_graphics);
-
             std::shared_ptr<SceneObject> object3 = std::make_shared<SceneObject>();
-            object3->p_model.Load("../assets/revolver/revolver.gltf", m_graphics);
-            
             // Creating skybox 
             std::shared_ptr<Skybox> skybox = std::make_shared<Skybox>();
-            skybox->p_model.Load("../assets/Box.gltf", m_graphics);
+
+            // The models load in parallel
+            Model::LoadAll({
+                [&] { object1->p_model.Load("../assets/damaged_helmet/DamagedHelmet.gltf", m_graphics); },
+                [&] { object2->p_model.Load("../assets/FlightHelmet/glTF/FlightHelmet.gltf", m_graphics); },
+                [&] { object3->p_model.Load("../assets/revolver/revolver.gltf", m_graphics); },
+                [&] { skybox->p_model.Load("../assets/Box.gltf", m_graphics); },
+            });
+
+            if (!m_options.load_report_path.empty()) {
+                LoadReport load_report;
+                load_report.SetScene("default");
+                load_report.AddAsset(object1->p_model.GetLoadStats());
+                load_report.AddAsset(object2->p_model.GetLoadStats());
+                load_report.AddAsset(object3->p_model.GetLoadStats());
+                load_report.AddAsset(skybox->p_model.GetLoadStats());
+                load_report.WriteJson(m_options.load_report_path);
+            }
+
+            for (const std::shared_ptr<SceneObject>& object : { object1, object2, object3 }) {
+                object->p_animation = m_options.animation;
+            }
 
             // Adding scene objects
             g_scene->AddSceneObect(object3);
@@ -86,28 +115,158 @@ namespace Diffuse {
             glfwSetCursorPosCallback(m_graphics->GetWindow()->window(), mouse_callback);
             glfwSetScrollCallback(m_graphics->GetWindow()->window(), scroll_callback);
         }
+
+        m_graphics->GetGpuProfiler()->SetLogInterval(m_options.gpu_log_interval);
+        m_graphics->GetBackgroundTasks().SetTargetFrameTime(m_options.target_frame_ms);
+        if (m_graphics->GetPipelineStatistics())
+            m_graphics->GetPipelineStatistics()->SetLogInterval(m_options.pipeline_statistics_interval);
+
+        if (!m_options.replay_path.empty()) {
+            if (!m_camera_path.Load(m_options.replay_path)) {
+                throw std::runtime_error("Failed to load camera path " + m_options.replay_path);
+            }
+            m_benchmark.SetInfo("camera_path", m_options.replay_path);
+            m_benchmark.SetInfo("fixed_dt", std::to_string(m_options.fixed_dt));
+            m_benchmark.SetInfo("device", m_graphics->PhysicalDeviceProperties().deviceName);
+        }
+    }
+
+    void Application::EndLoadTrace() {
+#ifdef DIFFUSE_PROFILE
+        if (!m_options.trace_load_path.empty())
+            Utils::Profiler::EndCapture(m_options.trace_load_path);
+#endif
     }
     void Application::Update()
     {
         auto current_time = std::chrono::high_resolution_clock::now();
+        bool capture_key_down = false;
+        uint32_t capture_count = 0;
+        bool record_key_down = false;
+        bool overlay_key_down = false;
+        bool untextured_key_down = false;
+        float record_time = 0.0f;
+        const bool replaying = !m_camera_path.Empty() && !m_options.replay_path.empty();
+        uint32_t replay_frame = 0;
+
+        EndLoadTrace();
+
+        // Everything recorded while loading is expected, only frame events are attributed
+        m_frame_times.SetSpikeThreshold(m_options.spike_threshold_ms, m_options.spike_factor);
+        Utils::FrameEvents::Take(m_frame_events);
 
         while (!m_graphics->GetWindow()->WindowShouldClose()) {
+            DIFFUSE_PROFILE_FRAME();
+            DIFFUSE_PROFILE_SCOPE("Application::Update");
+            auto frame_start = std::chrono::high_resolution_clock::now();
             m_graphics->GetWindow()->PollEvents();
 
+            // F9 starts/stops recording the editor camera into a replayable path
+            bool record_key = glfwGetKey(m_graphics->GetWindow()->window(), GLFW_KEY_F9) == GLFW_PRESS;
+            if (record_key && !record_key_down && !replaying) {
+                m_recording_path = !m_recording_path;
+                if (m_recording_path) {
+                    m_camera_path.Clear();
+                    record_time = 0.0f;
+                }
+                else if (m_camera_path.Save(m_options.record_path)) {
+                    std::cout << "Camera path saved to " << m_options.record_path << std::endl;
+                }
+            }
+            record_key_down = record_key;
+
+            // F12 saves a screenshot without stalling the frame
+            bool capture_key = glfwGetKey(m_graphics->GetWindow()->window(), GLFW_KEY_F12) == GLFW_PRESS;
+            if (capture_key && !capture_key_down) {
+                m_graphics->RequestCapture("capture_" + std::to_string(capture_count++) + ".png");
+            }
+            capture_key_down = capture_key;
+
+            // F3 toggles the render stats overlay
+            bool overlay_key = glfwGetKey(m_graphics->GetWindow()->window(), GLFW_KEY_F3) == GLFW_PRESS;
+            if (overlay_key && !overlay_key_down) {
+                m_graphics->SetStatsOverlay(!m_graphics->IsStatsOverlayEnabled());
+            }
+            overlay_key_down = overlay_key;
+
+            // F4 toggles the lighting only view, the material edits run as background tasks
+            bool untextured_key = glfwGetKey(m_graphics->GetWindow()->window(), GLFW_KEY_F4) == GLFW_PRESS;
+            if (untextured_key && !untextured_key_down) {
+                m_graphics->SetUntexturedMaterials(!m_graphics->IsUntexturedMaterials());
+            }
+            untextured_key_down = untextured_key;
+
             auto new_time = std::chrono::high_resolution_clock::now();
             float frame_time = std::chrono::duration<float, std::chrono::seconds::period>(new_time - current_time).count();
             current_time = new_time;
 
-            g_renderer->RenderScene(g_scene, g_editor_camera, frame_time);
+            if (replaying) {
+                // Fixed time step so every run renders exactly the same frames
+                float t = replay_frame < m_options.warmup_frames ? 0.0f : (replay_frame - m_options.warmup_frames) * m_options.fixed_dt;
+                if (t > m_camera_path.Duration())
+                    break;
+                m_camera_path.Apply(t, *g_editor_camera);
+                frame_time = m_options.fixed_dt;
+            }
+
+            {
+                DIFFUSE_PROFILE_SCOPE("RenderScene");
+                g_renderer->RenderScene(g_scene, g_editor_camera, frame_time);
+            }
             //g_renderer->RenderScene(g_scene, g_scene_camera->p_camera.get(), frame_time);
             //g_scene_camera->p_camera->Update(frame_time, m_graphics->GetWindow()->window());
-            g_editor_camera->OnUpdate(frame_time, m_graphics->GetWindow()->window());
+            if (!replaying)
+                g_editor_camera->OnUpdate(frame_time, m_graphics->GetWindow()->window());
             //std::cout << "frame time: " << 1000.0f / frame_time << std::endl;
+
+            if (m_recording_path) {
+                m_camera_path.Record(record_time, *g_editor_camera);
+                record_time += frame_time;
+            }
+
+            // Background work fills what the frame left of the target, blocking on the GPU or the display is not work
+            {
+                DIFFUSE_PROFILE_SCOPE("Background tasks");
+                const double frame_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frame_start).count();
+                m_graphics->GetBackgroundTasks().RunFrame(std::max(0.0, frame_ms - m_graphics->GetFrameWaitTime()));
+            }
+
+            double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frame_start).count();
+            if (replaying) {
+                // GPU time is read back after the frame fence, so it trails the CPU sample by one frame
+                if (replay_frame >= m_options.warmup_frames)
+                    m_benchmark.AddFrame(cpu_ms, m_graphics->GetGpuFrameTime());
+                replay_frame++;
+            }
+
+            Utils::FrameEvents::Take(m_frame_events);
+            if (m_frame_times.AddFrame(cpu_ms)) {
+                std::cout << "Frame " << m_frame_times.GetFrameCount() - 1 << " spiked to " << cpu_ms << " ms (median "
+                    << m_frame_times.ApproximatePercentile(50.0) << " ms)";
+                if (m_frame_events.empty())
+                    std::cout << ", no instrumented events";
+                const Utils::FrameSchedulerStats& background = m_graphics->GetBackgroundTasks().GetStats();
+                if (background.steps > 0)
+                    std::cout << ", background tasks " << background.spent_ms << " ms of " << background.budget_ms << " ms budget";
+                std::cout << std::endl;
+                for (const Utils::FrameEvent& event : m_frame_events) {
+                    std::cout << "    " << Utils::FrameEventName(event.type) << ": " << event.detail << " " << event.ms << " ms" << std::endl;
+                }
+            }
+            if (m_options.frame_histogram_interval > 0 && m_frame_times.GetFrameCount() % m_options.frame_histogram_interval == 0) {
+                std::cout << m_frame_times.Summary();
+            }
+        }
+
+        if (replaying) {
+            m_benchmark.WriteJson(m_options.benchmark_output);
         }
+        std::cout << m_frame_times.Summary();
     }
     void Application::Destroy()
     {
         m_graphics->CleanUp();
         delete m_graphics;
+        Utils::JobSystem::Shutdown();
     }
 }
\ No newline at end of file
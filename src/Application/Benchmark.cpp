@@ -0,0 +1,72 @@
+#include "Benchmark.hpp"
+
+#include "json.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+namespace Diffuse {
+	void BenchmarkReport::AddFrame(double cpu_ms, double gpu_ms) {
+		FrameSample sample;
+		sample.frame = static_cast<uint32_t>(m_frames.size());
+		sample.cpu_ms = cpu_ms;
+		sample.gpu_ms = gpu_ms;
+		m_frames.push_back(sample);
+	}
+
+	// Nearest-rank percentile, percentile in [0, 100]
+	double BenchmarkReport::Percentile(std::vector<double> values, double percentile) {
+		if (values.empty())
+			return 0.0;
+		std::sort(values.begin(), values.end());
+		size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * values.size()));
+		rank = std::clamp<size_t>(rank, 1, values.size());
+		return values[rank - 1];
+	}
+
+	static nlohmann::json Summarize(const std::vector<double>& values) {
+		nlohmann::json summary;
+		if (values.empty())
+			return summary;
+		summary["mean"] = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+		summary["min"] = *std::min_element(values.begin(), values.end());
+		summary["max"] = *std::max_element(values.begin(), values.end());
+		summary["p50"] = BenchmarkReport::Percentile(values, 50.0);
+		summary["p95"] = BenchmarkReport::Percentile(values, 95.0);
+		summary["p99"] = BenchmarkReport::Percentile(values, 99.0);
+		return summary;
+	}
+
+	bool BenchmarkReport::WriteJson(const std::string& path) const {
+		std::vector<double> cpu, gpu;
+		cpu.reserve(m_frames.size());
+		gpu.reserve(m_frames.size());
+
+		nlohmann::json json;
+		for (auto& [key, value] : m_info) {
+			json["info"][key] = value;
+		}
+		json["frames"] = nlohmann::json::array();
+		for (auto& frame : m_frames) {
+			json["frames"].push_back({ { "frame", frame.frame }, { "cpu_ms", frame.cpu_ms }, { "gpu_ms", frame.gpu_ms } });
+			cpu.push_back(frame.cpu_ms);
+			gpu.push_back(frame.gpu_ms);
+		}
+		json["summary"]["frame_count"] = m_frames.size();
+		json["summary"]["cpu_ms"] = Summarize(cpu);
+		json["summary"]["gpu_ms"] = Summarize(gpu);
+
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			std::cout << "Failed to write benchmark results " << path << std::endl;
+			return false;
+		}
+		file << json.dump(2);
+		std::cout << "Benchmark: " << m_frames.size() << " frames, cpu p50 " << json["summary"]["cpu_ms"]["p50"] << " ms, p99 "
+			<< json["summary"]["cpu_ms"]["p99"] << " ms -> " << path << std::endl;
+		return true;
+	}
+}
@@ -0,0 +1,94 @@
+#include "FrameTimeHistogram.hpp"
+
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace Diffuse {
+	// The median is too noisy to compare against before this many frames
+	static constexpr uint32_t s_min_frames_for_median = 30;
+
+	FrameTimeHistogram::FrameTimeHistogram(uint32_t window, double bucket_ms, uint32_t bucket_count) {
+		m_samples.resize(std::max(window, 1u));
+		m_bucket_ms = bucket_ms;
+		// Last bucket collects everything beyond the range
+		m_buckets.resize(std::max(bucket_count, 2u) + 1, 0);
+	}
+
+	void FrameTimeHistogram::SetSpikeThreshold(double absolute_ms, double median_factor) {
+		m_spike_absolute_ms = absolute_ms;
+		m_spike_median_factor = median_factor;
+	}
+
+	uint32_t FrameTimeHistogram::BucketIndex(double ms) const {
+		const double index = std::max(ms, 0.0) / m_bucket_ms;
+		return static_cast<uint32_t>(std::min(index, static_cast<double>(m_buckets.size() - 1)));
+	}
+
+	bool FrameTimeHistogram::AddFrame(double ms) {
+		bool spike = false;
+		if (m_spike_absolute_ms > 0.0 && ms > m_spike_absolute_ms)
+			spike = true;
+		if (m_spike_median_factor > 0.0 && m_size >= s_min_frames_for_median && ms > m_spike_median_factor * ApproximatePercentile(50.0))
+			spike = true;
+
+		if (m_size == m_samples.size()) {
+			m_buckets[BucketIndex(m_samples[m_next])]--;
+		}
+		else {
+			m_size++;
+		}
+		m_samples[m_next] = ms;
+		m_buckets[BucketIndex(ms)]++;
+		m_next = (m_next + 1) % static_cast<uint32_t>(m_samples.size());
+
+		m_frame_count++;
+		if (spike)
+			m_spike_count++;
+		return spike;
+	}
+
+	double FrameTimeHistogram::Percentile(double percentile) const {
+		return BenchmarkReport::Percentile(std::vector<double>(m_samples.begin(), m_samples.begin() + m_size), percentile);
+	}
+
+	double FrameTimeHistogram::ApproximatePercentile(double percentile) const {
+		if (m_size == 0)
+			return 0.0;
+		const double target = percentile / 100.0 * m_size;
+		uint32_t cumulative = 0;
+		for (uint32_t i = 0; i < m_buckets.size(); i++) {
+			cumulative += m_buckets[i];
+			if (cumulative >= target)
+				return (i + 0.5) * m_bucket_ms;
+		}
+		return m_buckets.size() * m_bucket_ms;
+	}
+
+	std::string FrameTimeHistogram::Summary() const {
+		std::string summary;
+		char line[128];
+		snprintf(line, sizeof(line), "Frame times over %u frames: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms, %llu spikes\n",
+			m_size, Percentile(50.0), Percentile(90.0), Percentile(99.0), Percentile(99.9), Percentile(100.0), static_cast<unsigned long long>(m_spike_count));
+		summary += line;
+
+		const uint32_t peak = *std::max_element(m_buckets.begin(), m_buckets.end());
+		if (peak == 0)
+			return summary;
+		for (uint32_t i = 0; i < m_buckets.size(); i++) {
+			if (m_buckets[i] == 0)
+				continue;
+			const bool overflow = i == m_buckets.size() - 1;
+			const int bar = static_cast<int>(40.0 * m_buckets[i] / peak + 0.5);
+			if (overflow)
+				snprintf(line, sizeof(line), " >%6.1f ms %6u |", i * m_bucket_ms, m_buckets[i]);
+			else
+				snprintf(line, sizeof(line), "%7.1f ms %6u |", i * m_bucket_ms, m_buckets[i]);
+			summary += line;
+			summary.append(std::max(bar, 1), '#');
+			summary += '\n';
+		}
+		return summary;
+	}
+}
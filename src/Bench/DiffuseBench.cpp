@@ -0,0 +1,440 @@
+#include "GraphicsDevice.hpp"
+#include "Renderer.hpp"
+#include "Scene.hpp"
+#include "Camera.hpp"
+#include "Benchmark.hpp"
+#include "LoadReport.hpp"
+#include "StressScene.hpp"
+#include "JobSystem.hpp"
+#include "AllocationCounter.hpp"
+
+#include "json.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Headless benchmark suite, renders to a VK_EXT_headless_surface. Built against GLFW 3.4+ it runs
+// without a display server, so it also works on lavapipe build machines:
+// VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json
+// Older GLFW versions open a hidden window and still need a display (or Xvfb).
+//
+//   DiffuseBench [--assets <dir>] [--out <results.json>] [--frames <n>] [--warmup <n>] [--animation <index>] [--stress] [--check-allocations]
+//
+// --stress runs the synthetic scene sweep (include/StressScene.hpp) instead of the assets.
+// --animation plays that animation of every asset that has it, assets are static otherwise.
+// --check-allocations only renders the assets and exits with 1 if a measured frame allocated,
+// it needs a build with DIFFUSE_CHECK_FRAME_ALLOCATIONS and is run by ctest there.
+
+namespace {
+	using namespace Diffuse;
+
+	struct BenchOptions {
+		std::string assets = "../assets";
+		std::string output = "bench.json";
+		uint32_t warmup_frames = 30;
+		uint32_t frames = 300;
+		int32_t animation = -1;
+		bool stress = false;
+		bool check_allocations = false;
+	};
+
+	struct BenchAsset {
+		const char* name;
+		const char* path;
+	};
+
+	const BenchAsset s_assets[] = {
+		{ "Avocado", "/Avocado/Avocado.gltf" },
+		{ "DamagedHelmet", "/damaged_helmet/DamagedHelmet.gltf" },
+		{ "Sponza", "/Sponza/Sponza/glTF/Sponza.gltf" },
+		{ "teapot", "/teapot.gltf" },
+		{ "torusknot", "/torusknot.gltf" },
+		{ "venus", "/venus.gltf" },
+	};
+
+	struct StressCase {
+		const char* name;
+		StressSceneDesc desc;
+	};
+
+	// Each group varies one parameter. Every object owns several buffers and allocations,
+	// so the large object counts are expected to hit maxMemoryAllocationCount on some drivers.
+	const StressCase s_stress_cases[] = {
+		{ "objects_64", { .object_count = 64 } },
+		{ "objects_256", { .object_count = 256 } },
+		{ "objects_1024", { .object_count = 1024 } },
+		{ "objects_4096", { .object_count = 4096 } },
+		{ "primitives_64", { .object_count = 16, .primitives_per_object = 64 } },
+		{ "primitives_1024", { .object_count = 16, .primitives_per_object = 1024 } },
+		{ "unique_materials_64", { .object_count = 16, .primitives_per_object = 64, .unique_materials = true } },
+		{ "unique_materials_1024", { .object_count = 16, .primitives_per_object = 1024, .unique_materials = true } },
+		{ "textures_4x256", { .object_count = 64, .primitives_per_object = 4, .unique_materials = true, .texture_count = 4, .texture_size = 256 } },
+		{ "textures_16x256", { .object_count = 64, .primitives_per_object = 16, .unique_materials = true, .texture_count = 16, .texture_size = 256 } },
+		{ "depth_16", { .object_count = 16, .primitives_per_object = 256, .hierarchy_depth = 16 } },
+		{ "depth_256", { .object_count = 16, .primitives_per_object = 256, .hierarchy_depth = 256 } },
+	};
+
+	const uint32_t s_ibl_sizes[] = { 256, 512, 1024, 2048 };
+	const VkExtent2D s_resolutions[] = { { 1280, 720 }, { 1920, 1080 } };
+
+	double ElapsedMs(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	nlohmann::json Summarize(const std::vector<double>& values) {
+		nlohmann::json summary;
+		if (values.empty())
+			return summary;
+		summary["mean"] = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+		summary["p50"] = BenchmarkReport::Percentile(values, 50.0);
+		summary["p95"] = BenchmarkReport::Percentile(values, 95.0);
+		summary["p99"] = BenchmarkReport::Percentile(values, 99.0);
+		summary["max"] = BenchmarkReport::Percentile(values, 100.0);
+		return summary;
+	}
+
+	nlohmann::json MachineInfo(const VkPhysicalDeviceProperties& properties) {
+		nlohmann::json machine;
+		machine["device"] = properties.deviceName;
+		machine["vendor_id"] = properties.vendorID;
+		machine["device_id"] = properties.deviceID;
+		machine["device_type"] = properties.deviceType;
+		machine["driver_version"] = properties.driverVersion;
+		machine["api_version"] = std::to_string(VK_VERSION_MAJOR(properties.apiVersion)) + "." +
+			std::to_string(VK_VERSION_MINOR(properties.apiVersion)) + "." + std::to_string(VK_VERSION_PATCH(properties.apiVersion));
+		machine["cpu_threads"] = std::thread::hardware_concurrency();
+#if defined(_WIN32)
+		machine["os"] = "windows";
+#elif defined(__APPLE__)
+		machine["os"] = "macos";
+#else
+		machine["os"] = "linux";
+#endif
+#if defined(NDEBUG)
+		machine["build"] = "release";
+#else
+		machine["build"] = "debug";
+#endif
+		return machine;
+	}
+
+	Config BenchConfig(VkExtent2D resolution, uint32_t offscreen_size) {
+		Config config;
+		config.enable_validation_layers = false;
+		config.headless = true;
+		config.width = resolution.width;
+		config.height = resolution.height;
+		config.offscreen_size = offscreen_size;
+		return config;
+	}
+
+	std::shared_ptr<Scene> CreateScene(GraphicsDevice* device, const std::string& model_path, const std::string& assets, int32_t animation = -1) {
+		std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+		std::shared_ptr<SceneObject> object = std::make_shared<SceneObject>();
+		object->p_model.Load(model_path, device);
+		object->p_animation = animation;
+		std::shared_ptr<Skybox> skybox = std::make_shared<Skybox>();
+		skybox->p_model.Load(assets + "/Box.gltf", device);
+		scene->AddSceneObect(object);
+		scene->AddSkybox(skybox);
+		return scene;
+	}
+
+	// Load time, setup and steady state frame times of one asset at every resolution
+	void RunScene(const BenchAsset& asset, const BenchOptions& options, nlohmann::json& results) {
+		GraphicsDevice* device = new GraphicsDevice(BenchConfig(s_resolutions[0], 1024));
+		if (results["machine"].is_null())
+			results["machine"] = MachineInfo(device->PhysicalDeviceProperties());
+
+		auto load_start = std::chrono::steady_clock::now();
+		std::shared_ptr<Scene> scene = CreateScene(device, options.assets + asset.path, options.assets, options.animation);
+		double load_ms = ElapsedMs(load_start);
+
+		const AssetLoadStats& stats = scene->GetSceneObjects()[0]->p_model.GetLoadStats();
+		nlohmann::json load;
+		load["asset"] = asset.name;
+		load["wall_ms"] = load_ms;
+		load["vertex_count"] = stats.vertex_count;
+		load["index_count"] = stats.index_count;
+		load["shared_mesh_nodes"] = stats.shared_mesh_nodes;
+		load["shared_primitives"] = stats.shared_primitives;
+		load["generated_tangents"] = stats.generated_tangents;
+		load["texture_count"] = stats.textures.size();
+		for (uint32_t i = 0; i < static_cast<uint32_t>(LoadPhase::Count); i++) {
+			load["phases_ms"][LoadPhaseName(static_cast<LoadPhase>(i))] = stats.phases.phases[i].wall_ms;
+		}
+		results["asset_loads"].push_back(load);
+
+		auto setup_start = std::chrono::steady_clock::now();
+		device->Setup(scene);
+		double setup_ms = ElapsedMs(setup_start);
+
+		Renderer renderer(device);
+		std::shared_ptr<EditorCamera> camera = std::make_shared<EditorCamera>(60.0f, 16.0f / 9.0f, 0.01f, 10000.0f, device->GetWindow()->window());
+		const float dt = 1.0f / 60.0f;
+
+		for (const VkExtent2D& resolution : s_resolutions) {
+			glfwSetWindowSize(device->GetWindow()->window(), resolution.width, resolution.height);
+			device->GetWindow()->PollEvents();
+			device->GetWindow()->WindowResized(true);
+			camera->SetViewportSize(static_cast<float>(resolution.width), static_cast<float>(resolution.height));
+
+			// The first Draw after a resize only recreates the swapchain
+			for (uint32_t i = 0; i < options.warmup_frames; i++) {
+				renderer.RenderScene(scene, camera, dt);
+			}
+
+			std::vector<double> cpu_ms;
+			std::vector<double> gpu_ms;
+			cpu_ms.reserve(options.frames);
+			gpu_ms.reserve(options.frames);
+			uint64_t frame_allocations = 0;
+			for (uint32_t i = 0; i < options.frames; i++) {
+				auto frame_start = std::chrono::steady_clock::now();
+				renderer.RenderScene(scene, camera, dt);
+				cpu_ms.push_back(ElapsedMs(frame_start));
+				// Read back after the frame fence, so this trails the CPU sample by one frame
+				gpu_ms.push_back(device->GetGpuFrameTime());
+				frame_allocations += renderer.GetFrameAllocations();
+			}
+
+			nlohmann::json frames;
+			frames["asset"] = asset.name;
+			frames["width"] = resolution.width;
+			frames["height"] = resolution.height;
+			frames["setup_ms"] = setup_ms;
+			frames["cpu_ms"] = Summarize(cpu_ms);
+			frames["gpu_ms"] = Summarize(gpu_ms);
+			frames["frame_allocations"] = frame_allocations;
+			results["frames"].push_back(frames);
+			std::cout << asset.name << " " << resolution.width << "x" << resolution.height << ": cpu p50 " << frames["cpu_ms"]["p50"]
+				<< " ms, gpu p50 " << frames["gpu_ms"]["p50"] << " ms" << std::endl;
+		}
+
+		device->CleanUp();
+		delete device;
+	}
+
+	// Setup time and the GPU scopes of the IBL bake for one environment cubemap size, with the
+	// environment bake on the dedicated compute queue or on the graphics queue
+	void RunIBL(uint32_t offscreen_size, bool async_compute, const BenchOptions& options, nlohmann::json& results) {
+		Config config = BenchConfig(s_resolutions[0], offscreen_size);
+		config.enable_async_compute = async_compute;
+		GraphicsDevice* device = new GraphicsDevice(config);
+		std::shared_ptr<Scene> scene = CreateScene(device, options.assets + "/teapot.gltf", options.assets);
+
+		auto setup_start = std::chrono::steady_clock::now();
+		device->Setup(scene);
+		double setup_ms = ElapsedMs(setup_start);
+
+		nlohmann::json ibl;
+		ibl["offscreen_size"] = offscreen_size;
+		ibl["async_compute"] = device->HasAsyncCompute();
+		ibl["setup_ms"] = setup_ms;
+		// Per queue, the two overlap so their sum is busy time rather than elapsed time
+		double gpu_total = 0.0;
+		double gpu_compute = 0.0;
+		for (const GpuScopeResult& scope : device->GetGpuProfiler()->GetStartupResults()) {
+			ibl["gpu_scopes_ms"][scope.name] = scope.ms;
+			if (scope.depth == 0)
+				(scope.compute_queue ? gpu_compute : gpu_total) += scope.ms;
+		}
+		ibl["gpu_total_ms"] = gpu_total;
+		ibl["gpu_compute_ms"] = gpu_compute;
+		results["ibl"].push_back(ibl);
+		std::cout << "IBL " << offscreen_size << (device->HasAsyncCompute() ? " async" : "") << ": setup " << setup_ms << " ms, gpu " << gpu_total << " ms";
+		if (device->HasAsyncCompute())
+			std::cout << " + " << gpu_compute << " ms on the compute queue";
+		std::cout << std::endl;
+
+		device->CleanUp();
+		delete device;
+	}
+
+	// Load, Setup (descriptor allocation) and frame costs of one synthetic scene
+	void RunStress(const StressCase& stress, const BenchOptions& options, nlohmann::json& results) {
+		nlohmann::json run;
+		run["name"] = stress.name;
+		run["object_count"] = stress.desc.object_count;
+		run["primitives_per_object"] = stress.desc.primitives_per_object;
+		run["unique_materials"] = stress.desc.unique_materials;
+		run["texture_count"] = stress.desc.texture_count;
+		run["texture_size"] = stress.desc.texture_size;
+		run["hierarchy_depth"] = stress.desc.hierarchy_depth;
+
+		GraphicsDevice* device = new GraphicsDevice(BenchConfig(s_resolutions[0], 256));
+		if (results["machine"].is_null())
+			results["machine"] = MachineInfo(device->PhysicalDeviceProperties());
+		try {
+			auto load_start = std::chrono::steady_clock::now();
+			std::shared_ptr<Scene> scene = GenerateStressScene(stress.desc, device, options.assets + "/Box.gltf");
+			run["load_ms"] = ElapsedMs(load_start);
+
+			uint64_t upload_bytes = 0;
+			for (auto& object : scene->GetSceneObjects()) {
+				upload_bytes += object->p_model.GetLoadStats().phases.phases[static_cast<uint32_t>(LoadPhase::Upload)].bytes;
+			}
+			run["upload_bytes"] = upload_bytes;
+
+			auto setup_start = std::chrono::steady_clock::now();
+			device->Setup(scene);
+			run["setup_ms"] = ElapsedMs(setup_start);
+
+			Renderer renderer(device);
+			std::shared_ptr<EditorCamera> camera = std::make_shared<EditorCamera>(60.0f, 16.0f / 9.0f, 0.01f, 10000.0f, device->GetWindow()->window());
+			const float dt = 1.0f / 60.0f;
+			for (uint32_t i = 0; i < options.warmup_frames; i++) {
+				renderer.RenderScene(scene, camera, dt);
+			}
+			std::vector<double> cpu_ms;
+			std::vector<double> gpu_ms;
+			uint64_t frame_allocations = 0;
+			for (uint32_t i = 0; i < options.frames; i++) {
+				auto frame_start = std::chrono::steady_clock::now();
+				renderer.RenderScene(scene, camera, dt);
+				cpu_ms.push_back(ElapsedMs(frame_start));
+				gpu_ms.push_back(device->GetGpuFrameTime());
+				frame_allocations += renderer.GetFrameAllocations();
+			}
+			run["cpu_ms"] = Summarize(cpu_ms);
+			run["gpu_ms"] = Summarize(gpu_ms);
+			// Only counted with DIFFUSE_CHECK_FRAME_ALLOCATIONS, anything but 0 is a regression
+			run["frame_allocations"] = frame_allocations;
+			if (frame_allocations > 0)
+				std::cout << "Stress " << stress.name << ": " << frame_allocations << " heap allocations in " << options.frames << " frames" << std::endl;
+
+			const RenderStats& stats = device->GetRenderStats();
+			run["draws"] = stats.draws;
+			run["triangles"] = stats.triangles;
+			run["descriptor_set_binds"] = stats.descriptor_set_binds;
+			run["pipeline_binds"] = stats.pipeline_binds;
+			run["hidden_objects"] = stats.hidden_objects;
+			run["uniform_bytes"] = stats.uniform_bytes;
+			run["skinned_vertices"] = stats.skinned_vertices;
+			run["morphed_vertices"] = stats.morphed_vertices;
+			run["material_bytes"] = stats.material_bytes;
+			std::cout << "Stress " << stress.name << ": setup " << run["setup_ms"] << " ms, cpu p50 " << run["cpu_ms"]["p50"] << " ms" << std::endl;
+
+			device->CleanUp();
+			delete device;
+		}
+		catch (const std::exception& e) {
+			// Running out of allocations or descriptors is a result here, not a failure of the sweep.
+			// The device is left half set up, leak it rather than tear it down.
+			run["error"] = e.what();
+			std::cout << "Stress " << stress.name << " failed: " << e.what() << std::endl;
+		}
+		results["stress"].push_back(run);
+	}
+
+	// Steady state frames of every asset at the first resolution, true when none of them allocated
+	bool CheckFrameAllocations(const BenchOptions& options) {
+		if (!Utils::AllocationCounter::Enabled()) {
+			std::cout << "--check-allocations needs a build with DIFFUSE_CHECK_FRAME_ALLOCATIONS" << std::endl;
+			return false;
+		}
+		bool passed = true;
+		for (const BenchAsset& asset : s_assets) {
+			GraphicsDevice* device = new GraphicsDevice(BenchConfig(s_resolutions[0], 256));
+			std::shared_ptr<Scene> scene = CreateScene(device, options.assets + asset.path, options.assets, options.animation);
+			device->Setup(scene);
+
+			Renderer renderer(device);
+			std::shared_ptr<EditorCamera> camera = std::make_shared<EditorCamera>(60.0f, 16.0f / 9.0f, 0.01f, 10000.0f, device->GetWindow()->window());
+			camera->SetViewportSize(static_cast<float>(s_resolutions[0].width), static_cast<float>(s_resolutions[0].height));
+			const float dt = 1.0f / 60.0f;
+			for (uint32_t i = 0; i < options.warmup_frames; i++) {
+				renderer.RenderScene(scene, camera, dt);
+			}
+			uint64_t frame_allocations = 0;
+			for (uint32_t i = 0; i < options.frames; i++) {
+				renderer.RenderScene(scene, camera, dt);
+				frame_allocations += renderer.GetFrameAllocations();
+			}
+			std::cout << asset.name << ": " << frame_allocations << " heap allocations in " << options.frames << " frames" << std::endl;
+			passed = passed && frame_allocations == 0;
+
+			device->CleanUp();
+			delete device;
+		}
+		return passed;
+	}
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options;
+	for (int i = 1; i + 1 < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--assets")
+			options.assets = argv[++i];
+		else if (arg == "--out")
+			options.output = argv[++i];
+		else if (arg == "--frames")
+			options.frames = std::stoul(argv[++i]);
+		else if (arg == "--warmup")
+			options.warmup_frames = std::stoul(argv[++i]);
+		else if (arg == "--animation")
+			options.animation = std::stoi(argv[++i]);
+	}
+	// Flags without a value
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--stress")
+			options.stress = true;
+		else if (std::string(argv[i]) == "--check-allocations")
+			options.check_allocations = true;
+	}
+
+	Utils::JobSystem::Init();
+	if (options.check_allocations) {
+		bool passed = false;
+		try {
+			passed = CheckFrameAllocations(options);
+		}
+		catch (const std::exception& e) {
+			std::cout << "Allocation check failed: " << e.what() << std::endl;
+		}
+		Utils::JobSystem::Shutdown();
+		return passed ? 0 : 1;
+	}
+
+	nlohmann::json results;
+	results["frame_count"] = options.frames;
+	results["warmup_frames"] = options.warmup_frames;
+	results["animation"] = options.animation;
+	try {
+		if (options.stress) {
+			for (const StressCase& stress : s_stress_cases) {
+				RunStress(stress, options, results);
+			}
+		}
+		else {
+			for (const BenchAsset& asset : s_assets) {
+				RunScene(asset, options, results);
+			}
+			for (uint32_t size : s_ibl_sizes) {
+				RunIBL(size, true, options, results);
+				RunIBL(size, false, options, results);
+			}
+		}
+	}
+	catch (const std::exception& e) {
+		std::cout << "Benchmark failed: " << e.what() << std::endl;
+		Utils::JobSystem::Shutdown();
+		return 1;
+	}
+	Utils::JobSystem::Shutdown();
+
+	std::ofstream file(options.output);
+	if (!file.is_open()) {
+		std::cout << "Failed to open " << options.output << " for writing" << std::endl;
+		return 1;
+	}
+	file << results.dump(4);
+	std::cout << "Results written to " << options.output << std::endl;
+	return 0;
+}
@@ -0,0 +1,676 @@
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include "Animation.hpp"
+#include "JobSystem.hpp"
+#include "LoaderKernels.hpp"
+
+#include "json.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+// CPU microbenchmarks of the loader and per-frame kernels, each with a "scalar" and an
+// "optimized" variant producing the same output. The "renderer" column names the variant that
+// calls the renderer's own function (LoaderKernels.hpp, Node::GetMatrix, SampleAnimationChannel),
+// "-" marks candidates the renderer has no counterpart for yet. A variant may be missing.
+// No Vulkan device is needed. The thread is pinned to --cpu (0 by default, -1 to leave it unpinned).
+//
+//   DiffuseMicroBench [--reps <n>] [--warmup <n>] [--cpu <index>] [--out <results.json>] [--filter <name>] [--scaling]
+//
+// --scaling runs the data parallel kernels through Utils::JobSystem on 1 to N threads instead,
+// unpinned since the workers would inherit the affinity mask.
+
+namespace {
+	struct Options {
+		uint32_t warmup = 5;
+		uint32_t reps = 30;
+		int cpu = 0;
+		std::string output;
+		std::string filter;
+		bool scaling = false;
+	};
+
+	// Keeps the optimizer from dropping work whose result is otherwise unused
+	template<typename T>
+	void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const T* sink;
+		sink = &value;
+#endif
+	}
+
+	bool PinToCpu(int cpu) {
+		if (cpu < 0)
+			return false;
+#if defined(_WIN32)
+		return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+		return false;
+#endif
+	}
+
+	struct Stats {
+		double min_ns = 0.0;
+		double median_ns = 0.0;
+		double mean_ns = 0.0;
+		double stddev_ns = 0.0;
+	};
+
+	Stats Measure(const std::function<void()>& kernel, const Options& options) {
+		for (uint32_t i = 0; i < options.warmup; i++) {
+			kernel();
+		}
+		std::vector<double> samples(options.reps);
+		for (uint32_t i = 0; i < options.reps; i++) {
+			auto start = std::chrono::steady_clock::now();
+			kernel();
+			samples[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		}
+		std::sort(samples.begin(), samples.end());
+
+		Stats stats;
+		stats.min_ns = samples.front();
+		stats.median_ns = samples[samples.size() / 2];
+		stats.mean_ns = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+		double variance = 0.0;
+		for (double sample : samples) {
+			variance += (sample - stats.mean_ns) * (sample - stats.mean_ns);
+		}
+		stats.stddev_ns = std::sqrt(variance / samples.size());
+		return stats;
+	}
+
+	struct Case {
+		std::string name;
+		size_t items;
+		// "scalar", "optimized" or "-"
+		std::string renderer = "-";
+		std::function<void()> scalar;
+		std::function<void()> optimized;
+		// Data parallel kernels also expose the optimized variant over [begin, end) for the scaling run
+		std::function<void(uint32_t begin, uint32_t end)> range;
+	};
+
+	// The optimized variant is the range kernel over everything
+	void SetRange(Case& c, std::function<void(uint32_t begin, uint32_t end)> range) {
+		c.range = range;
+		const uint32_t count = static_cast<uint32_t>(c.items);
+		c.optimized = [range, count] { range(0, count); };
+	}
+
+	std::mt19937 s_rng(1234);
+
+	std::vector<float> RandomFloats(size_t count, float lo = -1.0f, float hi = 1.0f) {
+		std::uniform_real_distribution<float> dist(lo, hi);
+		std::vector<float> values(count);
+		for (float& v : values) {
+			v = dist(s_rng);
+		}
+		return values;
+	}
+
+	// === Accessor conversion (Model::LoadNode) ===
+	Case AccessorConversion() {
+		const size_t count = 1 << 18;
+		auto positions = std::make_shared<std::vector<float>>(RandomFloats(count * 3));
+		auto normals = std::make_shared<std::vector<float>>(RandomFloats(count * 3));
+		auto uvs = std::make_shared<std::vector<float>>(RandomFloats(count * 2, 0.0f, 1.0f));
+		auto vertices = std::make_shared<std::vector<Diffuse::Vertex>>(count);
+
+		Case c{ "accessor_conversion", count, "scalar" };
+		// Per vertex with a null check per attribute
+		c.scalar = [=] {
+			Diffuse::VertexStreams streams;
+			streams.position = positions->data();
+			streams.normal = normals->data();
+			streams.uv0 = uvs->data();
+			Diffuse::ConvertVertices(streams, count, vertices->data());
+			DoNotOptimize(vertices->data());
+		};
+		// One pass per attribute, branches hoisted out of the loops
+		SetRange(c, [=](uint32_t begin, uint32_t end) {
+			Diffuse::Vertex* out = vertices->data();
+			const float* pos = positions->data();
+			const float* nrm = normals->data();
+			const float* uv = uvs->data();
+			for (size_t v = begin; v < end; v++) {
+				memcpy(&out[v].pos, pos + v * 3, sizeof(glm::vec3));
+			}
+			for (size_t v = begin; v < end; v++) {
+				const float x = nrm[v * 3], y = nrm[v * 3 + 1], z = nrm[v * 3 + 2];
+				const float inv = 1.0f / std::sqrt(x * x + y * y + z * z);
+				out[v].normal = glm::vec3(x * inv, y * inv, z * inv);
+			}
+			for (size_t v = begin; v < end; v++) {
+				memcpy(&out[v].uv0, uv + v * 2, sizeof(glm::vec2));
+				out[v].uv1 = glm::vec2(0.0f);
+				out[v].color = glm::vec4(1.0f);
+				out[v].tangent = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+			}
+			DoNotOptimize(vertices->data());
+		});
+		return c;
+	}
+
+	// === RGB -> RGBA (Texture2D glTF constructor) ===
+	Case RgbToRgba() {
+		const size_t pixels = 2048 * 2048;
+		auto rgb = std::make_shared<std::vector<uint8_t>>(pixels * 3);
+		auto rgba = std::make_shared<std::vector<uint8_t>>(pixels * 4);
+		for (size_t i = 0; i < rgb->size(); i++) {
+			(*rgb)[i] = static_cast<uint8_t>(i * 31);
+		}
+
+		Case c{ "rgb_to_rgba", pixels, "scalar" };
+		// A byte at a time
+		c.scalar = [=] {
+			Diffuse::ExpandRgbToRgba(rgb->data(), rgba->data(), 0, pixels);
+			DoNotOptimize(rgba->data());
+		};
+		// Whole texels at a time
+		SetRange(c, [=](uint32_t begin, uint32_t end) {
+			uint32_t* dst = reinterpret_cast<uint32_t*>(rgba->data());
+			const uint8_t* src = rgb->data() + static_cast<size_t>(begin) * 3;
+			for (size_t i = begin; i < end; i++) {
+				dst[i] = uint32_t(src[0]) | (uint32_t(src[1]) << 8) | (uint32_t(src[2]) << 16) | 0xFF000000u;
+				src += 3;
+			}
+			DoNotOptimize(rgba->data());
+		});
+		return c;
+	}
+
+	// === Index rebasing (16 bit indices + vertex_start) ===
+	Case IndexRebase() {
+		const size_t count = 1 << 20;
+		auto source = std::make_shared<std::vector<uint16_t>>(count);
+		auto indices = std::make_shared<std::vector<uint32_t>>(count);
+		for (size_t i = 0; i < count; i++) {
+			(*source)[i] = static_cast<uint16_t>(i * 7);
+		}
+		const uint32_t vertex_start = 123456;
+
+		// Only the renderer's loop, there is no candidate to compare it against
+		Case c{ "index_rebase", count, "scalar" };
+		c.range = [=](uint32_t begin, uint32_t end) {
+			Diffuse::RebaseIndices(source->data() + begin, end - begin, vertex_start, indices->data() + begin);
+			DoNotOptimize(indices->data());
+		};
+		c.scalar = [range = c.range, count] { range(0, static_cast<uint32_t>(count)); };
+		return c;
+	}
+
+	// === Transform hierarchy ===
+	Case TransformHierarchy() {
+		const size_t count = 1 << 15;
+		auto nodes = std::make_shared<std::vector<Diffuse::Node*>>(count);
+		auto parents = std::make_shared<std::vector<int32_t>>(count, -1);
+		auto locals = std::make_shared<std::vector<glm::mat4>>(count);
+		auto worlds = std::make_shared<std::vector<glm::mat4>>(count);
+
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+		for (size_t i = 0; i < count; i++) {
+			Diffuse::Node* node = new Diffuse::Node{};
+			node->index = static_cast<uint32_t>(i);
+			node->matrix = glm::mat4(1.0f);
+			node->translation = glm::vec3(dist(s_rng), dist(s_rng), dist(s_rng));
+			node->rotation = glm::normalize(glm::quat(1.0f, dist(s_rng), dist(s_rng), dist(s_rng)));
+			// Parents always precede their children, four children per parent
+			if (i > 0) {
+				(*parents)[i] = static_cast<int32_t>((i - 1) / 4);
+				node->parent = (*nodes)[(i - 1) / 4];
+				node->parent->children.push_back(node);
+			}
+			(*nodes)[i] = node;
+		}
+		// The root deletes the rest
+		std::shared_ptr<Diffuse::Node> root((*nodes)[0]);
+
+		Case c{ "transform_hierarchy", count, "scalar" };
+		// Node::GetMatrix, walking up the parents of every node
+		c.scalar = [=] {
+			glm::mat4* world = worlds->data();
+			for (size_t i = 0; i < count; i++) {
+				world[i] = (*nodes)[i]->GetMatrix();
+			}
+			DoNotOptimize(root.get());
+			DoNotOptimize(worlds->data());
+		};
+		// Linear parent-before-child array, each world matrix reuses the parent's
+		c.optimized = [=] {
+			glm::mat4* world = worlds->data();
+			glm::mat4* local = locals->data();
+			const int32_t* parent = parents->data();
+			for (size_t i = 0; i < count; i++) {
+				local[i] = (*nodes)[i]->LocalMatrix();
+				world[i] = parent[i] < 0 ? local[i] : world[parent[i]] * local[i];
+			}
+			DoNotOptimize(worlds->data());
+		};
+		return c;
+	}
+
+	// === Frustum culling ===
+	Case FrustumCulling() {
+		const size_t count = 1 << 16;
+		auto centers = std::make_shared<std::vector<glm::vec3>>(count);
+		auto extents = std::make_shared<std::vector<glm::vec3>>(count);
+		auto visible = std::make_shared<std::vector<uint8_t>>(count);
+		std::uniform_real_distribution<float> pos(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> size(0.1f, 5.0f);
+		for (size_t i = 0; i < count; i++) {
+			(*centers)[i] = glm::vec3(pos(s_rng), pos(s_rng), pos(s_rng));
+			(*extents)[i] = glm::vec3(size(s_rng), size(s_rng), size(s_rng));
+		}
+
+		// Planes of a perspective camera looking down -z, normals point inwards
+		const glm::mat4 view_projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 150.0f) *
+			glm::lookAt(glm::vec3(0.0f, 0.0f, 50.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 m = glm::transpose(view_projection);
+		auto planes = std::make_shared<std::array<glm::vec4, 6>>(std::array<glm::vec4, 6>{
+			m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[2], m[3] - m[2] });
+
+		Case c{ "frustum_culling", count };
+		// All eight corners against every plane
+		c.scalar = [=] {
+			for (size_t i = 0; i < count; i++) {
+				const glm::vec3 mn = (*centers)[i] - (*extents)[i];
+				const glm::vec3 mx = (*centers)[i] + (*extents)[i];
+				bool inside = true;
+				for (const glm::vec4& plane : *planes) {
+					int outside = 0;
+					for (int corner = 0; corner < 8; corner++) {
+						glm::vec3 p((corner & 1) ? mx.x : mn.x, (corner & 2) ? mx.y : mn.y, (corner & 4) ? mx.z : mn.z);
+						if (glm::dot(glm::vec3(plane), p) + plane.w < 0.0f)
+							outside++;
+					}
+					if (outside == 8) {
+						inside = false;
+						break;
+					}
+				}
+				(*visible)[i] = inside;
+			}
+			DoNotOptimize(visible->data());
+		};
+		// Center/extent test, one dot product per plane
+		SetRange(c, [=](uint32_t begin, uint32_t end) {
+			const glm::vec4* p = planes->data();
+			const glm::vec3* center = centers->data();
+			const glm::vec3* extent = extents->data();
+			uint8_t* out = visible->data();
+			for (size_t i = begin; i < end; i++) {
+				bool inside = true;
+				for (int k = 0; k < 6; k++) {
+					const float distance = p[k].x * center[i].x + p[k].y * center[i].y + p[k].z * center[i].z + p[k].w;
+					const float radius = std::abs(p[k].x) * extent[i].x + std::abs(p[k].y) * extent[i].y + std::abs(p[k].z) * extent[i].z;
+					inside &= distance + radius >= 0.0f;
+				}
+				out[i] = inside;
+			}
+			DoNotOptimize(visible->data());
+		});
+		return c;
+	}
+
+	// === Draw key sorting ===
+	struct DrawItem {
+		uint32_t pipeline;
+		uint32_t material;
+		float depth;
+		uint32_t object;
+	};
+
+	struct SortKey {
+		uint64_t key;
+		uint32_t index;
+	};
+
+	uint64_t DrawKey(const DrawItem& item) {
+		uint32_t depth_bits;
+		memcpy(&depth_bits, &item.depth, sizeof(depth_bits));
+		// pipeline:4 | material:12 | depth:32 | object:16, depth is positive so its bits sort like the float
+		return (uint64_t(item.pipeline & 0xF) << 60) | (uint64_t(item.material & 0xFFF) << 48) | (uint64_t(depth_bits) << 16) | (item.object & 0xFFFF);
+	}
+
+	Case DrawKeySort() {
+		const size_t count = 1 << 16;
+		auto items = std::make_shared<std::vector<DrawItem>>(count);
+		std::uniform_int_distribution<uint32_t> pipeline(0, 3);
+		std::uniform_int_distribution<uint32_t> material(0, 511);
+		std::uniform_real_distribution<float> depth(0.1f, 1000.0f);
+		for (size_t i = 0; i < count; i++) {
+			(*items)[i] = { pipeline(s_rng), material(s_rng), depth(s_rng), static_cast<uint32_t>(i) };
+		}
+		auto sorted = std::make_shared<std::vector<DrawItem>>(count);
+		auto keys = std::make_shared<std::vector<SortKey>>(count);
+		auto scratch = std::make_shared<std::vector<SortKey>>(count);
+
+		// Both variants end with the items themselves in draw order
+		Case c{ "draw_key_sort", count };
+		// Comparator over the fields
+		c.scalar = [=] {
+			*sorted = *items;
+			std::sort(sorted->begin(), sorted->end(), [](const DrawItem& a, const DrawItem& b) {
+				if (a.pipeline != b.pipeline) return a.pipeline < b.pipeline;
+				if (a.material != b.material) return a.material < b.material;
+				return a.depth < b.depth;
+			});
+			DoNotOptimize(sorted->data());
+		};
+		// Packed 64 bit keys carrying the item index, LSD radix sort with 8 bit digits, then a gather
+		c.optimized = [=] {
+			SortKey* src = keys->data();
+			SortKey* dst = scratch->data();
+			for (size_t i = 0; i < count; i++) {
+				src[i] = { DrawKey((*items)[i]), static_cast<uint32_t>(i) };
+			}
+			for (uint32_t shift = 0; shift < 64; shift += 8) {
+				size_t histogram[257] = {};
+				for (size_t i = 0; i < count; i++) {
+					histogram[((src[i].key >> shift) & 0xFF) + 1]++;
+				}
+				// Every key shares this digit, nothing to move
+				if (std::any_of(histogram + 1, histogram + 257, [&](size_t n) { return n == count; }))
+					continue;
+				for (int b = 0; b < 256; b++) {
+					histogram[b + 1] += histogram[b];
+				}
+				for (size_t i = 0; i < count; i++) {
+					dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+				}
+				std::swap(src, dst);
+			}
+			DrawItem* out = sorted->data();
+			for (size_t i = 0; i < count; i++) {
+				out[i] = (*items)[src[i].index];
+			}
+			DoNotOptimize(sorted->data());
+		};
+		return c;
+	}
+
+	// === UBO packing ===
+	struct UBO {
+		glm::mat4 model;
+		glm::mat4 view;
+		glm::mat4 proj;
+	};
+
+	Case UboPacking() {
+		const size_t count = 4096;
+		auto separate = std::make_shared<std::vector<std::vector<uint8_t>>>(count, std::vector<uint8_t>(sizeof(UBO)));
+		auto packed = std::make_shared<std::vector<uint8_t>>(count * sizeof(glm::mat4) + sizeof(glm::mat4) * 2);
+		auto models = std::make_shared<std::vector<glm::mat4>>(count);
+		for (size_t i = 0; i < count; i++) {
+			(*models)[i] = glm::translate(glm::mat4(1.0f), glm::vec3(float(i), 0.0f, 0.0f));
+		}
+		const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+
+		Case c{ "ubo_packing", count };
+		// One full UBO per object into its own mapped buffer, the layout GraphicsDevice::Draw writes
+		c.scalar = [=] {
+			for (size_t i = 0; i < count; i++) {
+				UBO ubo{};
+				ubo.model = (*models)[i];
+				ubo.view = view;
+				ubo.proj = proj;
+				memcpy((*separate)[i].data(), &ubo, sizeof(ubo));
+			}
+			DoNotOptimize(separate->data());
+		};
+		// Camera matrices once, then a tightly packed array of model matrices
+		c.optimized = [=] {
+			uint8_t* dst = packed->data();
+			memcpy(dst, &view, sizeof(view));
+			memcpy(dst + sizeof(view), &proj, sizeof(proj));
+			memcpy(dst + sizeof(view) * 2, models->data(), count * sizeof(glm::mat4));
+			DoNotOptimize(packed->data());
+		};
+		return c;
+	}
+
+	// === Animation sampling (Model::UpdateAnimation) ===
+	Case AnimationSampling() {
+		const size_t count = 4096 * 3;
+		const uint32_t keys = 64;
+		const float key_interval = 1.0f / 30.0f;
+		const float duration = (keys - 1) * key_interval;
+		const float step = 1.0f / 60.0f;
+		// Interleaved time and value, the way a straight port of the glTF sampler would keep them
+		struct Key {
+			float time;
+			glm::vec4 value;
+		};
+		auto interleaved = std::make_shared<std::vector<std::vector<Key>>>(count);
+		auto channels = std::make_shared<std::vector<Diffuse::AnimationChannel>>(count);
+		auto cursors = std::make_shared<std::vector<uint32_t>>(count, 0);
+		auto out = std::make_shared<std::vector<glm::vec4>>(count);
+		auto clock = std::make_shared<float>(0.0f);
+
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+		for (size_t i = 0; i < count; i++) {
+			// Translation, rotation and scale of 4096 nodes
+			Diffuse::AnimationChannel& channel = (*channels)[i];
+			channel.path = static_cast<Diffuse::AnimationChannel::Path>(i % 3);
+			channel.target = static_cast<uint32_t>(i / 3);
+			for (uint32_t k = 0; k < keys; k++) {
+				glm::vec4 value(dist(s_rng), dist(s_rng), dist(s_rng), 0.0f);
+				if (channel.path == Diffuse::AnimationChannel::PATH_ROTATION)
+					value = glm::normalize(glm::vec4(glm::vec3(value), dist(s_rng)));
+				channel.times.push_back(k * key_interval);
+				channel.values.push_back(value);
+				(*interleaved)[i].push_back({ k * key_interval, value });
+			}
+		}
+
+		Case c{ "animation_sampling", count, "optimized" };
+		// Binary search from scratch and glm interpolation for every channel
+		c.scalar = [=] {
+			const float time = *clock = std::fmod(*clock + step, duration);
+			for (size_t i = 0; i < count; i++) {
+				const std::vector<Key>& k = (*interleaved)[i];
+				auto next = std::upper_bound(k.begin(), k.end(), time, [](float t, const Key& key) { return t < key.time; });
+				const size_t b = std::clamp<size_t>(next - k.begin(), 1, k.size() - 1);
+				const Key& k0 = k[b - 1];
+				const Key& k1 = k[b];
+				const float t = std::clamp((time - k0.time) / (k1.time - k0.time), 0.0f, 1.0f);
+				if ((*channels)[i].path == Diffuse::AnimationChannel::PATH_ROTATION) {
+					const glm::quat q = glm::slerp(glm::quat(k0.value.w, k0.value.x, k0.value.y, k0.value.z), glm::quat(k1.value.w, k1.value.x, k1.value.y, k1.value.z), t);
+					(*out)[i] = glm::vec4(q.x, q.y, q.z, q.w);
+				}
+				else {
+					(*out)[i] = glm::mix(k0.value, k1.value, t);
+				}
+			}
+			DoNotOptimize(out->data());
+		};
+		// SoA keys, cached cursors and the SIMD blends of SampleAnimationChannel
+		SetRange(c, [=](uint32_t begin, uint32_t end) {
+			const float time = *clock;
+			for (uint32_t i = begin; i < end; i++) {
+				(*out)[i] = Diffuse::SampleAnimationChannel((*channels)[i], time, (*cursors)[i]);
+			}
+			DoNotOptimize(out->data());
+		});
+		// The clock only advances here, the scaling run samples one time repeatedly
+		c.optimized = [=, range = c.range] {
+			*clock = std::fmod(*clock + step, duration);
+			range(0, static_cast<uint32_t>(count));
+		};
+		return c;
+	}
+
+	nlohmann::json ToJson(const Stats& stats, size_t items) {
+		nlohmann::json json;
+		json["min_ns"] = stats.min_ns;
+		json["median_ns"] = stats.median_ns;
+		json["mean_ns"] = stats.mean_ns;
+		json["stddev_ns"] = stats.stddev_ns;
+		json["ns_per_item"] = stats.median_ns / items;
+		return json;
+	}
+
+	// Scalar against optimized variant of every kernel, single threaded
+	void RunKernels(const std::vector<std::function<Case()>>& factories, const Options& options, nlohmann::json& results) {
+		printf("%-22s %10s %14s %14s %10s %8s\n", "kernel", "renderer", "scalar (us)", "optimized (us)", "stddev %", "speedup");
+		for (auto& factory : factories) {
+			Case c = factory();
+			if (!options.filter.empty() && c.name.find(options.filter) == std::string::npos)
+				continue;
+
+			nlohmann::json entry;
+			entry["name"] = c.name;
+			entry["items"] = c.items;
+			entry["renderer"] = c.renderer;
+			Stats scalar;
+			Stats optimized;
+			if (c.scalar) {
+				scalar = Measure(c.scalar, options);
+				entry["scalar"] = ToJson(scalar, c.items);
+			}
+			if (c.optimized) {
+				optimized = Measure(c.optimized, options);
+				entry["optimized"] = ToJson(optimized, c.items);
+			}
+			const Stats& spread = c.optimized ? optimized : scalar;
+			printf("%-22s %10s ", c.name.c_str(), c.renderer.c_str());
+			if (c.scalar)
+				printf("%14.1f ", scalar.median_ns / 1000.0);
+			else
+				printf("%14s ", "-");
+			if (c.optimized)
+				printf("%14.1f ", optimized.median_ns / 1000.0);
+			else
+				printf("%14s ", "-");
+			printf("%10.1f ", 100.0 * spread.stddev_ns / spread.mean_ns);
+			if (c.scalar && c.optimized) {
+				entry["speedup"] = scalar.median_ns / optimized.median_ns;
+				printf("%7.2fx\n", scalar.median_ns / optimized.median_ns);
+			}
+			else {
+				printf("%8s\n", "-");
+			}
+			results["kernels"].push_back(entry);
+		}
+	}
+
+	// One thread is the plain loop without the job system, N threads is N - 1 workers plus the caller
+	void RunScaling(const std::vector<std::function<Case()>>& factories, const Options& options, nlohmann::json& results) {
+		const uint32_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+		printf("%-22s %8s %14s %8s %11s\n", "kernel", "threads", "median (us)", "speedup", "efficiency");
+		for (auto& factory : factories) {
+			Case c = factory();
+			if (!c.range || (!options.filter.empty() && c.name.find(options.filter) == std::string::npos))
+				continue;
+
+			const uint32_t count = static_cast<uint32_t>(c.items);
+			double single_thread_ns = 0.0;
+			for (uint32_t threads = 1; threads <= max_threads; threads++) {
+				if (threads > 1)
+					Utils::JobSystem::Init(threads - 1);
+				// A few batches per thread so stealing can even out the load
+				const uint32_t batch_size = std::max(count / (threads * 8), 1024u);
+				Stats stats = Measure([&] { Utils::JobSystem::ParallelFor(count, batch_size, c.range); }, options);
+				Utils::JobSystem::Shutdown();
+
+				if (threads == 1)
+					single_thread_ns = stats.median_ns;
+				const double speedup = single_thread_ns / stats.median_ns;
+				printf("%-22s %8u %14.1f %7.2fx %10.0f%%\n", c.name.c_str(), threads, stats.median_ns / 1000.0, speedup, 100.0 * speedup / threads);
+
+				nlohmann::json entry = ToJson(stats, c.items);
+				entry["name"] = c.name;
+				entry["threads"] = threads;
+				entry["speedup"] = speedup;
+				results["scaling"].push_back(entry);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	for (int i = 1; i + 1 < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--reps")
+			options.reps = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		else if (arg == "--warmup")
+			options.warmup = std::stoul(argv[++i]);
+		else if (arg == "--cpu")
+			options.cpu = std::stoi(argv[++i]);
+		else if (arg == "--out")
+			options.output = argv[++i];
+		else if (arg == "--filter")
+			options.filter = argv[++i];
+	}
+	// Flags without a value
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--scaling")
+			options.scaling = true;
+	}
+
+	const bool pinned = !options.scaling && PinToCpu(options.cpu);
+	if (!pinned)
+		std::cout << "Running unpinned" << std::endl;
+
+	std::vector<std::function<Case()>> factories = {
+		AccessorConversion, RgbToRgba, IndexRebase, TransformHierarchy, FrustumCulling, DrawKeySort, UboPacking, AnimationSampling,
+	};
+
+	nlohmann::json results;
+	results["reps"] = options.reps;
+	results["warmup"] = options.warmup;
+	results["cpu"] = pinned ? options.cpu : -1;
+
+	if (options.scaling)
+		RunScaling(factories, options, results);
+	else
+		RunKernels(factories, options, results);
+
+	if (!options.output.empty()) {
+		std::ofstream file(options.output);
+		if (!file.is_open()) {
+			std::cout << "Failed to open " << options.output << " for writing" << std::endl;
+			return 1;
+		}
+		file << results.dump(4);
+	}
+	return 0;
+}
@@ -0,0 +1,224 @@
+#include "GpuProfiler.hpp"
+
+#include "GraphicsDevice.hpp"
+
+#include <iostream>
+
+namespace Diffuse {
+	GpuProfiler::GpuProfiler(GraphicsDevice* device, VkInstance instance, uint32_t queue_family, uint32_t frames_in_flight, uint32_t max_scopes) {
+		m_device = device;
+		m_max_queries = max_scopes * 2;
+
+		const uint32_t valid_bits = TimestampValidBits(queue_family);
+		m_supported = valid_bits > 0;
+		m_timestamp_period = m_device->PhysicalDeviceProperties().limits.timestampPeriod;
+
+		m_cmd_begin_label = reinterpret_cast<PFN_vkCmdBeginDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT"));
+		m_cmd_end_label = reinterpret_cast<PFN_vkCmdEndDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT"));
+
+		m_frames.resize(frames_in_flight);
+		for (auto& block : m_frames) {
+			CreateBlock(block, valid_bits);
+		}
+		CreateBlock(m_startup, valid_bits);
+		m_timestamps.resize(m_max_queries);
+	}
+
+	// 0 when the family can't write timestamps at all
+	uint32_t GpuProfiler::TimestampValidBits(uint32_t queue_family) const {
+		if (!m_device->PhysicalDeviceProperties().limits.timestampComputeAndGraphics)
+			return 0;
+		uint32_t family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(m_device->PhysicalDevice(), &family_count, nullptr);
+		std::vector<VkQueueFamilyProperties> families(family_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(m_device->PhysicalDevice(), &family_count, families.data());
+		return queue_family < family_count ? families[queue_family].timestampValidBits : 0;
+	}
+
+	void GpuProfiler::CreateBlock(QueryBlock& block, uint32_t valid_bits) {
+		block.scopes.reserve(m_max_queries / 2);
+		block.open.reserve(8);
+		block.supported = valid_bits > 0;
+		block.timestamp_mask = valid_bits >= 64 ? ~0ull : ((1ull << valid_bits) - 1);
+		if (!block.supported)
+			return;
+
+		VkQueryPoolCreateInfo query_pool_info{};
+		query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		query_pool_info.queryCount = m_max_queries;
+		if (vkCreateQueryPool(m_device->Device(), &query_pool_info, nullptr, &block.pool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timestamp query pool");
+		}
+	}
+
+	void GpuProfiler::BeginLabel(VkCommandBuffer command_buffer, const char* name) {
+		if (!m_cmd_begin_label)
+			return;
+		VkDebugUtilsLabelEXT label{};
+		label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+		label.pLabelName = name;
+		m_cmd_begin_label(command_buffer, &label);
+	}
+
+	void GpuProfiler::EndLabel(VkCommandBuffer command_buffer) {
+		if (m_cmd_end_label)
+			m_cmd_end_label(command_buffer);
+	}
+
+	void GpuProfiler::Begin(QueryBlock& block, VkCommandBuffer command_buffer, const std::string& name) {
+		BeginLabel(command_buffer, name.c_str());
+		if (!block.supported || block.next_query + 2 > m_max_queries) {
+			// Out of queries: keep the label balanced but don't time it
+			block.open.push_back(UINT32_MAX);
+			return;
+		}
+
+		Scope scope;
+		scope.name = name;
+		scope.depth = static_cast<uint32_t>(block.open.size());
+		scope.begin_query = block.next_query++;
+		scope.end_query = block.next_query++;
+		vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, block.pool, scope.begin_query);
+
+		block.open.push_back(static_cast<uint32_t>(block.scopes.size()));
+		block.scopes.push_back(std::move(scope));
+	}
+
+	void GpuProfiler::End(QueryBlock& block, VkCommandBuffer command_buffer) {
+		assert(!block.open.empty());
+		uint32_t scope = block.open.back();
+		block.open.pop_back();
+		if (scope != UINT32_MAX) {
+			vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, block.pool, block.scopes[scope].end_query);
+		}
+		EndLabel(command_buffer);
+	}
+
+	void GpuProfiler::Resolve(QueryBlock& block, std::vector<GpuScopeResult>& results) {
+		results.resize(block.scopes.size());
+		if (block.next_query == 0)
+			return;
+
+		// No VK_QUERY_RESULT_WAIT_BIT, the caller guarantees the work has completed
+		VkResult result = vkGetQueryPoolResults(m_device->Device(), block.pool, 0, block.next_query, block.next_query * sizeof(uint64_t),
+			m_timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			results.clear();
+			return;
+		}
+
+		for (size_t i = 0; i < block.scopes.size(); i++) {
+			const Scope& scope = block.scopes[i];
+			uint64_t ticks = (m_timestamps[scope.end_query] - m_timestamps[scope.begin_query]) & block.timestamp_mask;
+			results[i].name = scope.name;
+			results[i].depth = scope.depth;
+			results[i].ms = double(ticks) * m_timestamp_period / 1000000.0;
+		}
+	}
+
+	void GpuProfiler::BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_index) {
+		m_current_frame = frame_index;
+		QueryBlock& block = m_frames[frame_index];
+
+		if (block.reset && block.next_query > 0) {
+			Resolve(block, m_frame_results);
+			m_frame_time_ms = 0.0;
+			for (auto& result : m_frame_results) {
+				if (result.depth == 0)
+					m_frame_time_ms += result.ms;
+			}
+			Log();
+		}
+
+		block.scopes.clear();
+		block.open.clear();
+		block.next_query = 0;
+		if (block.supported) {
+			vkCmdResetQueryPool(command_buffer, block.pool, 0, m_max_queries);
+			block.reset = true;
+		}
+	}
+
+	void GpuProfiler::BeginScope(VkCommandBuffer command_buffer, const std::string& name) {
+		Begin(m_frames[m_current_frame], command_buffer, name);
+	}
+
+	void GpuProfiler::EndScope(VkCommandBuffer command_buffer) {
+		End(m_frames[m_current_frame], command_buffer);
+	}
+
+	void GpuProfiler::BeginStartup(QueryBlock& block, VkCommandBuffer command_buffer, const std::string& name) {
+		if (block.supported && !block.reset) {
+			vkCmdResetQueryPool(command_buffer, block.pool, 0, m_max_queries);
+			block.reset = true;
+		}
+		Begin(block, command_buffer, name);
+	}
+
+	void GpuProfiler::BeginStartupScope(VkCommandBuffer command_buffer, const std::string& name) {
+		BeginStartup(m_startup, command_buffer, name);
+	}
+
+	void GpuProfiler::EndStartupScope(VkCommandBuffer command_buffer) {
+		End(m_startup, command_buffer);
+	}
+
+	void GpuProfiler::EnableComputeQueue(uint32_t queue_family) {
+		if (m_compute_startup.pool == VK_NULL_HANDLE)
+			CreateBlock(m_compute_startup, TimestampValidBits(queue_family));
+	}
+
+	void GpuProfiler::BeginComputeStartupScope(VkCommandBuffer command_buffer, const std::string& name) {
+		BeginStartup(m_compute_startup, command_buffer, name);
+	}
+
+	void GpuProfiler::EndComputeStartupScope(VkCommandBuffer command_buffer) {
+		End(m_compute_startup, command_buffer);
+	}
+
+	void GpuProfiler::ReportStartup() {
+		Resolve(m_startup, m_startup_results);
+		std::vector<GpuScopeResult> compute_results;
+		Resolve(m_compute_startup, compute_results);
+		for (auto& result : compute_results) {
+			result.name += " (compute queue)";
+			result.compute_queue = true;
+			m_startup_results.push_back(std::move(result));
+		}
+		for (auto& result : m_startup_results) {
+			std::cout << "GPU " << std::string(result.depth * 2, ' ') << result.name << ": " << result.ms << " ms" << std::endl;
+		}
+	}
+
+	void GpuProfiler::Log() {
+		if (m_log_interval == 0)
+			return;
+
+		for (auto& result : m_frame_results) {
+			m_log_accumulator[result.name] += result.ms;
+		}
+		if (++m_logged_frames < m_log_interval)
+			return;
+
+		std::cout << "GPU average over " << m_logged_frames << " frames:";
+		for (auto& [name, total] : m_log_accumulator) {
+			std::cout << " " << name << " " << total / m_logged_frames << " ms;";
+			total = 0.0;
+		}
+		std::cout << std::endl;
+		m_logged_frames = 0;
+	}
+
+	void GpuProfiler::Destroy() {
+		for (auto& block : m_frames) {
+			if (block.pool != VK_NULL_HANDLE)
+				vkDestroyQueryPool(m_device->Device(), block.pool, nullptr);
+		}
+		if (m_startup.pool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(m_device->Device(), m_startup.pool, nullptr);
+		if (m_compute_startup.pool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(m_device->Device(), m_compute_startup.pool, nullptr);
+		m_frames.clear();
+	}
+}
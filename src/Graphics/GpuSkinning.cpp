@@ -0,0 +1,411 @@
+#include "GpuSkinning.hpp"
+
+#include "FrameEvents.hpp"
+#include "GraphicsDevice.hpp"
+#include "Model.hpp"
+#include "Profiler.hpp"
+#include "ReadFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace Diffuse {
+	struct SkinningPushConstants {
+		uint32_t vertex_count;
+		uint32_t job_count;
+	};
+
+	static constexpr uint32_t s_workgroup_size = 64;
+	// Target of a morph job, see morph_targets.comp
+	static constexpr uint32_t s_morph_target_output = 0;
+	static constexpr uint32_t s_morph_target_rest = 1;
+	static_assert(sizeof(MorphDelta) == 32, "morph_targets.comp reads MorphDelta with std430 layout");
+	static_assert(sizeof(Vertex) == 18 * sizeof(float), "skinning.comp reads Vertex as 18 tightly packed floats");
+
+	GpuSkinning::GpuSkinning(GraphicsDevice* device, uint32_t frames_in_flight) {
+		m_device = device;
+		m_frames.resize(frames_in_flight);
+	}
+
+	uint32_t GpuSkinning::AddInstance(const Model& model) {
+		Instance instance;
+		instance.model = &model;
+		instance.output_vertex = m_output_vertex_count;
+		instance.first_joint = m_joint_count;
+		m_output_vertex_count += model.GetVertexCount();
+		m_joint_count += model.GetJointCount();
+		m_morph_target_count += static_cast<uint32_t>(model.GetMorphTargets().size());
+		m_instances.push_back(instance);
+		return static_cast<uint32_t>(m_instances.size() - 1);
+	}
+
+	VkDeviceSize GpuSkinning::OutputOffset(uint32_t instance) const {
+		return VkDeviceSize(m_instances[instance].output_vertex) * sizeof(Vertex);
+	}
+
+	void GpuSkinning::Build() {
+		DIFFUSE_PROFILE_FUNCTION();
+		VkDevice device = m_device->Device();
+		VkPhysicalDevice physical_device = m_device->PhysicalDevice();
+
+		// Jobs, the compact skinning stream and where its rest pose comes from
+		std::vector<Job> jobs;
+		std::vector<SkinVertex> skin_vertices;
+		std::vector<std::pair<const Model*, VkBufferCopy>> rest_copies;
+		// Deltas are shared by all instances of a model, morph vertices point into the output of their instance
+		std::vector<GpuMorphVertex> morph_vertices;
+		std::vector<MorphDelta> morph_deltas;
+		std::unordered_map<const Model*, uint32_t> first_delta_of_model;
+		for (const Instance& instance : m_instances) {
+			const Model& model = *instance.model;
+			std::vector<uint32_t> skin_first_joint;
+			uint32_t joint = instance.first_joint;
+			for (const Skin& skin : model.GetSkins()) {
+				skin_first_joint.push_back(joint);
+				joint += static_cast<uint32_t>(skin.joints.size());
+			}
+			// First vertex of every skinned primitive in the model and in the rest pose
+			std::unordered_map<uint32_t, uint32_t> rest_of_primitive;
+			for (const SkinnedRange& range : model.GetSkinnedRanges()) {
+				Job job;
+				job.first = static_cast<uint32_t>(skin_vertices.size());
+				job.count = range.vertex_count;
+				job.output_vertex = instance.output_vertex + range.first_vertex;
+				job.first_joint = skin_first_joint[range.skin_index];
+				jobs.push_back(job);
+				rest_of_primitive[range.first_vertex] = job.first;
+
+				VkBufferCopy copy;
+				copy.srcOffset = VkDeviceSize(range.first_vertex) * sizeof(Vertex);
+				copy.dstOffset = VkDeviceSize(job.first) * sizeof(Vertex);
+				copy.size = VkDeviceSize(range.vertex_count) * sizeof(Vertex);
+				rest_copies.push_back({ &model, copy });
+
+				const SkinVertex* source = &model.GetSkinVertices()[range.first_skin_vertex];
+				skin_vertices.insert(skin_vertices.end(), source, source + range.vertex_count);
+			}
+
+			if (!model.HasMorphTargets())
+				continue;
+			auto [first_delta, inserted] = first_delta_of_model.try_emplace(&model, static_cast<uint32_t>(morph_deltas.size()));
+			if (inserted) {
+				morph_deltas.insert(morph_deltas.end(), model.GetMorphDeltas().begin(), model.GetMorphDeltas().end());
+			}
+			for (const MorphRange& range : model.GetMorphRanges()) {
+				auto rest = rest_of_primitive.find(range.first_vertex);
+				MorphSource source;
+				source.model = &model;
+				source.first_target = range.first_target;
+				source.target_count = range.target_count;
+				source.first_morph_vertex = static_cast<uint32_t>(morph_vertices.size());
+				source.morph_vertex_count = range.morph_vertex_count;
+				source.first_delta = first_delta->second;
+				source.target = rest != rest_of_primitive.end() ? s_morph_target_rest : s_morph_target_output;
+				m_morph_sources.push_back(source);
+
+				for (uint32_t i = 0; i < range.morph_vertex_count; i++) {
+					const MorphVertex& morph_vertex = model.GetMorphVertices()[range.first_morph_vertex + i];
+					GpuMorphVertex vertex{};
+					vertex.position = morph_vertex.position;
+					vertex.normal = morph_vertex.normal;
+					vertex.destination = source.target == s_morph_target_rest ? rest->second + morph_vertex.vertex - range.first_vertex : instance.output_vertex + morph_vertex.vertex;
+					morph_vertices.push_back(vertex);
+				}
+			}
+		}
+		m_job_count = static_cast<uint32_t>(jobs.size());
+		m_skinned_vertex_count = static_cast<uint32_t>(skin_vertices.size());
+		if (m_skinned_vertex_count == 0 && morph_vertices.empty()) {
+			throw std::runtime_error("GpuSkinning::Build without skinned or morphed instances");
+		}
+
+		// Device local streams, uploaded through one staging buffer
+		struct Upload {
+			Buffer* buffer;
+			const void* data;
+			VkDeviceSize size;
+		};
+		std::vector<Upload> uploads;
+		if (m_skinned_vertex_count > 0) {
+			VK_CHECK_RESULT(vkUtilities::CreateBuffer(device, physical_device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_rest_vertices, VkDeviceSize(m_skinned_vertex_count) * sizeof(Vertex)));
+			uploads.push_back({ &m_skin_vertices, skin_vertices.data(), skin_vertices.size() * sizeof(SkinVertex) });
+			uploads.push_back({ &m_jobs, jobs.data(), jobs.size() * sizeof(Job) });
+		}
+		if (!morph_vertices.empty()) {
+			uploads.push_back({ &m_morph_vertices, morph_vertices.data(), morph_vertices.size() * sizeof(GpuMorphVertex) });
+			uploads.push_back({ &m_morph_deltas, morph_deltas.data(), morph_deltas.size() * sizeof(MorphDelta) });
+		}
+		VkDeviceSize staging_size = 0;
+		for (const Upload& upload : uploads) {
+			VK_CHECK_RESULT(vkUtilities::CreateBuffer(device, physical_device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, upload.buffer, upload.size));
+			staging_size += upload.size;
+		}
+		VK_CHECK_RESULT(vkUtilities::CreateBuffer(device, physical_device, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_output, VkDeviceSize(m_output_vertex_count) * sizeof(Vertex)));
+		for (Frame& frame : m_frames) {
+			if (m_joint_count > 0) {
+				VK_CHECK_RESULT(vkUtilities::CreateBuffer(device, physical_device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &frame.joint_matrices, VkDeviceSize(m_joint_count) * sizeof(glm::mat4)));
+				frame.joint_matrices.Map();
+			}
+			// Sized for every target of every primitive being active at once
+			if (!m_morph_sources.empty()) {
+				VK_CHECK_RESULT(vkUtilities::CreateBuffer(device, physical_device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &frame.morph_jobs, m_morph_sources.size() * sizeof(MorphJob)));
+				VK_CHECK_RESULT(vkUtilities::CreateBuffer(device, physical_device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &frame.active_targets, VkDeviceSize(m_morph_target_count) * sizeof(ActiveTarget)));
+				frame.morph_jobs.Map();
+				frame.active_targets.Map();
+			}
+		}
+
+		Buffer staging;
+		VK_CHECK_RESULT(vkUtilities::CreateBuffer(device, physical_device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, staging_size));
+		staging.Map();
+		VkCommandBuffer copy_cmd = m_device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkDeviceSize staging_offset = 0;
+		for (const Upload& upload : uploads) {
+			std::memcpy(static_cast<char*>(staging.mapped) + staging_offset, upload.data, upload.size);
+			VkBufferCopy copy = { staging_offset, 0, upload.size };
+			vkCmdCopyBuffer(copy_cmd, staging.buffer, upload.buffer->buffer, 1, &copy);
+			staging_offset += upload.size;
+		}
+		staging.Unmap();
+		for (auto& [model, copy] : rest_copies) {
+			vkCmdCopyBuffer(copy_cmd, model->m_vertices.buffer, m_rest_vertices.buffer, 1, &copy);
+		}
+		// Undeformed parts of the output never change
+		for (const Instance& instance : m_instances) {
+			VkBufferCopy copy = { 0, OutputOffset(static_cast<uint32_t>(&instance - m_instances.data())), VkDeviceSize(instance.model->GetVertexCount()) * sizeof(Vertex) };
+			vkCmdCopyBuffer(copy_cmd, instance.model->m_vertices.buffer, m_output.buffer, 1, &copy);
+		}
+		{
+			VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+			vkCmdPipelineBarrier(copy_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+				0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+		m_device->FlushCommandBuffer(copy_cmd, m_device->Queue(), true);
+		staging.Destroy();
+
+		// A pass is only created when it has work, so its shader is only needed then
+		if (m_skinned_vertex_count > 0) {
+			std::vector<std::vector<const Buffer*>> bindings;
+			for (const Frame& frame : m_frames) {
+				bindings.push_back({ &m_rest_vertices, &m_skin_vertices, &m_jobs, &frame.joint_matrices, &m_output });
+			}
+			CreatePass(m_skinning_pass, "../shaders/skinning/skinning_cs.spv", "skinning", bindings);
+		}
+		if (!m_morph_sources.empty()) {
+			// Without skinned instances nothing is morphed into the rest pose, the output stands in
+			const Buffer* rest = m_skinned_vertex_count > 0 ? &m_rest_vertices : &m_output;
+			std::vector<std::vector<const Buffer*>> bindings;
+			for (const Frame& frame : m_frames) {
+				bindings.push_back({ &m_morph_vertices, &m_morph_deltas, &frame.morph_jobs, &frame.active_targets, &m_output, rest });
+			}
+			CreatePass(m_morph_pass, "../shaders/skinning/morph_targets_cs.spv", "morph targets", bindings);
+		}
+		std::cout << "GPU skinning: " << m_instances.size() << " instances, " << m_job_count << " skinned primitives, "
+			<< m_skinned_vertex_count << " vertices, " << m_joint_count << " joints, " << m_morph_sources.size() << " morphed primitives, "
+			<< morph_vertices.size() << " vertices, " << morph_deltas.size() << " deltas" << std::endl;
+	}
+
+	void GpuSkinning::CreatePass(ComputePass& pass, const std::string& shader, const char* name, const std::vector<std::vector<const Buffer*>>& bindings) {
+		VkDevice device = m_device->Device();
+		const uint32_t frame_count = static_cast<uint32_t>(bindings.size());
+		const uint32_t binding_count = static_cast<uint32_t>(bindings[0].size());
+
+		std::vector<VkDescriptorSetLayoutBinding> layout_bindings(binding_count);
+		for (uint32_t i = 0; i < binding_count; i++) {
+			layout_bindings[i] = { i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+		}
+		VkDescriptorSetLayoutCreateInfo layout_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layout_info.bindingCount = binding_count;
+		layout_info.pBindings = layout_bindings.data();
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &pass.descriptor_set_layout));
+
+		VkDescriptorPoolSize pool_size = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, binding_count * frame_count };
+		VkDescriptorPoolCreateInfo pool_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		pool_info.maxSets = frame_count;
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes = &pool_size;
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &pool_info, nullptr, &pass.descriptor_pool));
+
+		std::vector<VkDescriptorSetLayout> set_layouts(frame_count, pass.descriptor_set_layout);
+		VkDescriptorSetAllocateInfo allocate_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocate_info.descriptorPool = pass.descriptor_pool;
+		allocate_info.descriptorSetCount = frame_count;
+		allocate_info.pSetLayouts = set_layouts.data();
+		pass.descriptor_sets.resize(frame_count);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocate_info, pass.descriptor_sets.data()));
+
+		for (uint32_t frame = 0; frame < frame_count; frame++) {
+			std::vector<VkWriteDescriptorSet> writes(binding_count);
+			for (uint32_t i = 0; i < binding_count; i++) {
+				writes[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+				writes[i].dstSet = pass.descriptor_sets[frame];
+				writes[i].dstBinding = i;
+				writes[i].descriptorCount = 1;
+				writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[i].pBufferInfo = &bindings[frame][i]->descriptor;
+			}
+			vkUpdateDescriptorSets(device, binding_count, writes.data(), 0, nullptr);
+		}
+
+		VkPushConstantRange push_constant_range = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants) };
+		VkPipelineLayoutCreateInfo pipeline_layout_info = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipeline_layout_info.setLayoutCount = 1;
+		pipeline_layout_info.pSetLayouts = &pass.descriptor_set_layout;
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pass.pipeline_layout));
+
+		auto shader_code = Utils::File::ReadFile(shader);
+		VkShaderModule shader_module = vkUtilities::CreateShaderModule(shader_code, device);
+		VkComputePipelineCreateInfo pipeline_info = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+		pipeline_info.stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_COMPUTE_BIT, shader_module, "main", nullptr };
+		pipeline_info.layout = pass.pipeline_layout;
+		VkResult result;
+		{
+			Utils::FrameEventScope frame_event(Utils::FrameEventType::PipelineCompile, name);
+			result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pass.pipeline);
+		}
+		vkDestroyShaderModule(device, shader_module, nullptr);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error(std::string("Failed to create ") + name + " pipeline");
+		}
+	}
+
+	void GpuSkinning::Update(uint32_t frame_index) {
+		DIFFUSE_PROFILE_FUNCTION();
+		Frame& frame = m_frames[frame_index];
+		glm::mat4* matrices = static_cast<glm::mat4*>(frame.joint_matrices.mapped);
+		if (matrices) {
+			for (const Instance& instance : m_instances) {
+				instance.model->GetJointMatrices(matrices + instance.first_joint);
+			}
+		}
+
+		MorphJob* morph_jobs = static_cast<MorphJob*>(frame.morph_jobs.mapped);
+		ActiveTarget* active_targets = static_cast<ActiveTarget*>(frame.active_targets.mapped);
+		uint32_t active_target_count = 0;
+		frame.morph_vertex_count = 0;
+		frame.morph_job_count = 0;
+		for (MorphSource& source : m_morph_sources) {
+			const std::vector<float>& weights = source.model->GetMorphWeights();
+			const MorphTarget* targets = source.model->GetMorphTargets().data() + source.first_target;
+			MorphJob job;
+			job.first_active_target = active_target_count;
+			uint32_t active_begin = source.morph_vertex_count;
+			uint32_t active_end = 0;
+			for (uint32_t t = 0; t < source.target_count; t++) {
+				const MorphTarget& target = targets[t];
+				const float weight = weights[target.weight];
+				if (weight == 0.0f)
+					continue;
+				active_targets[active_target_count++] = { source.first_delta + target.first_delta, target.first_morph_vertex, target.morph_vertex_count, weight };
+				active_begin = std::min(active_begin, target.first_morph_vertex);
+				active_end = std::max(active_end, target.first_morph_vertex + target.morph_vertex_count);
+			}
+			job.active_target_count = active_target_count - job.first_active_target;
+
+			// The output is shared by the frames in flight, whatever the last dispatch moved
+			// and the active targets no longer cover has to go back to rest
+			uint32_t begin = active_begin;
+			uint32_t end = active_end;
+			if (source.dirty_begin < source.dirty_end) {
+				begin = std::min(begin, source.dirty_begin);
+				end = std::max(end, source.dirty_end);
+			}
+			source.dirty_begin = active_begin;
+			source.dirty_end = active_end;
+			if (begin >= end)
+				continue;
+
+			job.first = frame.morph_vertex_count;
+			job.count = end - begin;
+			job.first_morph_vertex = source.first_morph_vertex + begin;
+			job.range_vertex = begin;
+			job.target = source.target;
+			job.padding = 0;
+			morph_jobs[frame.morph_job_count++] = job;
+			frame.morph_vertex_count += job.count;
+		}
+	}
+
+	void GpuSkinning::Dispatch(VkCommandBuffer command_buffer, const ComputePass& pass, uint32_t frame_index, uint32_t vertex_count, uint32_t job_count) {
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipeline);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipeline_layout, 0, 1, &pass.descriptor_sets[frame_index], 0, nullptr);
+		const SkinningPushConstants push_constants = { vertex_count, job_count };
+		vkCmdPushConstants(command_buffer, pass.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+		vkCmdDispatch(command_buffer, (vertex_count + s_workgroup_size - 1) / s_workgroup_size, 1, 1);
+	}
+
+	void GpuSkinning::Record(VkCommandBuffer command_buffer, uint32_t frame_index) {
+		const Frame& frame = m_frames[frame_index];
+		// The previous frame may still read the output as vertices and the rest pose in the skinning,
+		// execution dependency only
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		if (frame.morph_vertex_count > 0) {
+			Dispatch(command_buffer, m_morph_pass, frame_index, frame.morph_vertex_count, frame.morph_job_count);
+			if (m_skinned_vertex_count > 0) {
+				// Morphed rest pose before the skinning reads it
+				VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+				barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+			}
+		}
+		if (m_skinned_vertex_count > 0) {
+			Dispatch(command_buffer, m_skinning_pass, frame_index, m_skinned_vertex_count, m_job_count);
+		}
+
+		VkBufferMemoryBarrier barrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = m_output.buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+	}
+
+	void GpuSkinning::DestroyPass(ComputePass& pass) {
+		VkDevice device = m_device->Device();
+		vkDestroyPipeline(device, pass.pipeline, nullptr);
+		vkDestroyPipelineLayout(device, pass.pipeline_layout, nullptr);
+		vkDestroyDescriptorPool(device, pass.descriptor_pool, nullptr);
+		vkDestroyDescriptorSetLayout(device, pass.descriptor_set_layout, nullptr);
+		pass = ComputePass{};
+	}
+
+	void GpuSkinning::Destroy() {
+		DestroyPass(m_skinning_pass);
+		DestroyPass(m_morph_pass);
+		for (Frame& frame : m_frames) {
+			frame.joint_matrices.Unmap();
+			frame.joint_matrices.Destroy();
+			frame.morph_jobs.Unmap();
+			frame.morph_jobs.Destroy();
+			frame.active_targets.Unmap();
+			frame.active_targets.Destroy();
+		}
+		m_rest_vertices.Destroy();
+		m_skin_vertices.Destroy();
+		m_jobs.Destroy();
+		m_morph_vertices.Destroy();
+		m_morph_deltas.Destroy();
+		m_output.Destroy();
+		m_instances.clear();
+		m_morph_sources.clear();
+	}
+}
@@ -0,0 +1,157 @@
+#include "GpuTimeline.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace Diffuse {
+	GpuTimeline::GpuTimeline(VkDevice device, VkQueue queue) {
+		m_device = device;
+		m_queue = queue;
+
+		VkSemaphoreTypeCreateInfo type_info = { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+		type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		type_info.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphore_info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		semaphore_info.pNext = &type_info;
+		if (vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_semaphore) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timeline semaphore");
+		}
+	}
+
+	uint64_t GpuTimeline::Submit(const VkSubmitInfo& submit_info, const std::vector<GpuSyncPoint>& waits, VkPipelineStageFlags wait_stage) {
+		const uint32_t wait_count = submit_info.waitSemaphoreCount + static_cast<uint32_t>(waits.size());
+		const uint32_t signal_count = submit_info.signalSemaphoreCount + 1;
+		if (wait_count > s_max_semaphores || signal_count > s_max_semaphores) {
+			throw std::runtime_error("Too many semaphores in one submission");
+		}
+
+		// Values of binary semaphores are ignored, they only have to line up with the semaphore arrays
+		std::array<VkSemaphore, s_max_semaphores> wait_semaphores;
+		std::array<VkPipelineStageFlags, s_max_semaphores> wait_stages;
+		std::array<uint64_t, s_max_semaphores> wait_values{};
+		for (uint32_t i = 0; i < submit_info.waitSemaphoreCount; i++) {
+			wait_semaphores[i] = submit_info.pWaitSemaphores[i];
+			wait_stages[i] = submit_info.pWaitDstStageMask[i];
+		}
+		for (uint32_t i = 0; i < waits.size(); i++) {
+			wait_semaphores[submit_info.waitSemaphoreCount + i] = waits[i].semaphore;
+			wait_stages[submit_info.waitSemaphoreCount + i] = wait_stage;
+			wait_values[submit_info.waitSemaphoreCount + i] = waits[i].value;
+		}
+
+		std::array<VkSemaphore, s_max_semaphores> signal_semaphores;
+		std::array<uint64_t, s_max_semaphores> signal_values{};
+		std::copy(submit_info.pSignalSemaphores, submit_info.pSignalSemaphores + submit_info.signalSemaphoreCount, signal_semaphores.begin());
+		signal_semaphores[signal_count - 1] = m_semaphore;
+
+		VkTimelineSemaphoreSubmitInfo timeline_info = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+		timeline_info.pNext = submit_info.pNext;
+		timeline_info.waitSemaphoreValueCount = wait_count;
+		timeline_info.pWaitSemaphoreValues = wait_values.data();
+		timeline_info.signalSemaphoreValueCount = signal_count;
+		timeline_info.pSignalSemaphoreValues = signal_values.data();
+
+		VkSubmitInfo info = submit_info;
+		info.pNext = &timeline_info;
+		info.waitSemaphoreCount = wait_count;
+		info.pWaitSemaphores = wait_semaphores.data();
+		info.pWaitDstStageMask = wait_stages.data();
+		info.signalSemaphoreCount = signal_count;
+		info.pSignalSemaphores = signal_semaphores.data();
+
+		std::lock_guard<std::mutex> lock(m_queue_mutex);
+		const uint64_t value = m_submitted.load(std::memory_order_relaxed) + 1;
+		signal_values[signal_count - 1] = value;
+		if (vkQueueSubmit(m_queue, 1, &info, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to submit to queue");
+		}
+		m_submitted.store(value, std::memory_order_release);
+		return value;
+	}
+
+	uint64_t GpuTimeline::Submit(VkCommandBuffer command_buffer, const std::vector<GpuSyncPoint>& waits, VkPipelineStageFlags wait_stage) {
+		VkSubmitInfo submit_info = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &command_buffer;
+		return Submit(submit_info, waits, wait_stage);
+	}
+
+	VkResult GpuTimeline::Present(const VkPresentInfoKHR& present_info) {
+		std::lock_guard<std::mutex> lock(m_queue_mutex);
+		return vkQueuePresentKHR(m_queue, &present_info);
+	}
+
+	void GpuTimeline::SetCompleted(uint64_t value) {
+		uint64_t completed = m_completed.load(std::memory_order_relaxed);
+		while (completed < value && !m_completed.compare_exchange_weak(completed, value, std::memory_order_release, std::memory_order_relaxed)) {
+		}
+	}
+
+	bool GpuTimeline::Wait(uint64_t value, uint64_t timeout) {
+		if (value <= m_completed.load(std::memory_order_acquire))
+			return true;
+
+		VkSemaphoreWaitInfo wait_info = { VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &m_semaphore;
+		wait_info.pValues = &value;
+		const VkResult result = vkWaitSemaphores(m_device, &wait_info, timeout);
+		if (result == VK_TIMEOUT)
+			return false;
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to wait for timeline semaphore");
+		}
+		SetCompleted(value);
+		return true;
+	}
+
+	bool GpuTimeline::IsComplete(uint64_t value) {
+		return value <= m_completed.load(std::memory_order_acquire) || value <= GetCompletedValue();
+	}
+
+	uint64_t GpuTimeline::GetCompletedValue() {
+		uint64_t value = 0;
+		if (vkGetSemaphoreCounterValue(m_device, m_semaphore, &value) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to read timeline semaphore");
+		}
+		SetCompleted(value);
+		return m_completed.load(std::memory_order_acquire);
+	}
+
+	void GpuTimeline::DeferDestroy(uint64_t value, std::function<void()> destroy) {
+		// Kept sorted by value, usually this is an append
+		std::lock_guard<std::mutex> lock(m_deferred_mutex);
+		auto position = std::upper_bound(m_deferred.begin(), m_deferred.end(), value, [](uint64_t v, const auto& deferred) {
+			return v < deferred.first;
+		});
+		m_deferred.emplace(position, value, std::move(destroy));
+	}
+
+	void GpuTimeline::CollectGarbage() {
+		std::unique_lock<std::mutex> lock(m_deferred_mutex);
+		if (m_deferred.empty())
+			return;
+
+		// Destroys run unlocked, they may defer more
+		const uint64_t completed = GetCompletedValue();
+		while (!m_deferred.empty() && m_deferred.front().first <= completed) {
+			std::function<void()> destroy = std::move(m_deferred.front().second);
+			m_deferred.pop_front();
+			lock.unlock();
+			destroy();
+			lock.lock();
+		}
+	}
+
+	void GpuTimeline::Destroy() {
+		std::lock_guard<std::mutex> lock(m_deferred_mutex);
+		for (auto& deferred : m_deferred) {
+			deferred.second();
+		}
+		m_deferred.clear();
+		vkDestroySemaphore(m_device, m_semaphore, nullptr);
+		m_semaphore = VK_NULL_HANDLE;
+	}
+}
@@ -3,12 +3,16 @@
 #include "Renderer.hpp"
 #include "Texture2D.hpp"
 #include "Scene.hpp"
+#include "Profiler.hpp"
+#include "RenderGraph.hpp"
 
 #include "stb_image.h"
 #include "tiny_gltf.h"
 
 #include <math.h>
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <set>
 
@@ -27,13 +31,27 @@
 #define VK_CHECK_RESULT(result) { assert(result == VK_SUCCESS); }
 
 namespace Diffuse {
+    // Material edits per background task step, an untextured toggle of a small scene takes one
+    static constexpr uint32_t s_material_edits_per_step = 256;
+
     GraphicsDevice::GraphicsDevice(Config config) {
+        m_owner_thread = std::this_thread::get_id();
         // === Initializing GLFW ===
         {
+#ifdef GLFW_PLATFORM_NULL
+            // GLFW 3.4+ can run without any display server, the surface comes from Vulkan directly
+            if (config.headless)
+                glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
             int result = glfwInit();
+#ifndef GLFW_PLATFORM_NULL
+            if (result != GLFW_TRUE && config.headless)
+                throw std::runtime_error("Failed to intitialize GLFW, headless mode needs GLFW 3.4 or a display server");
+#endif
             LOG_ERROR(result == GLFW_TRUE, "Failed to intitialize GLFW");
-            m_window = std::make_unique<Window>();
+            m_window = std::make_unique<Window>(config.width, config.height, !config.headless);
         }
+        offscreen_size = config.offscreen_size;
         
         // Check for validation layer support
         if (config.enable_validation_layers && !vkUtilities::CheckValidationLayerSupport(config.validation_layers)) {
@@ -49,9 +67,10 @@ namespace Diffuse {
             app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
             app_info.pEngineName = "Diffuse";
             app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-            app_info.apiVersion = VK_API_VERSION_1_0;
+            // 1.2 for timeline semaphores
+            app_info.apiVersion = VK_API_VERSION_1_2;
 
-            std::vector<const char*> extensions = vkUtilities::GetRequiredExtensions(config.enable_validation_layers); // TODO: add a boolean for if validation layers is enabled
+            std::vector<const char*> extensions = vkUtilities::GetRequiredExtensions(config.enable_validation_layers, config.headless); // TODO: add a boolean for if validation layers is enabled
 
             VkInstanceCreateInfo instance_create_info{};
             instance_create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -99,7 +118,12 @@ namespace Diffuse {
             }
         }
         // === Create Surface ===
-        if (glfwCreateWindowSurface(m_instance, m_window->window(), nullptr, &m_surface) != VK_SUCCESS) {
+        if (config.headless) {
+            if (vkUtilities::CreateHeadlessSurfaceEXT(m_instance, &m_surface) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create headless surface!");
+            }
+        }
+        else if (glfwCreateWindowSurface(m_instance, m_window->window(), nullptr, &m_surface) != VK_SUCCESS) {
             LOG_ERROR(false, "Failed to create window surface!");
         }
 
@@ -113,6 +137,10 @@ namespace Diffuse {
             std::vector<VkPhysicalDevice> devices(device_count);
             vkEnumeratePhysicalDevices(m_instance, &device_count, devices.data());
             for (const auto& device : devices) {
+                VkPhysicalDeviceProperties properties;
+                vkGetPhysicalDeviceProperties(device, &properties);
+                if (properties.apiVersion < VK_API_VERSION_1_2)
+                    continue;
                 if (vkUtilities::IsDeviceSuitable(device, m_surface, config.required_device_extensions)) {
                     m_physical_device = device;
                     break;
@@ -124,12 +152,17 @@ namespace Diffuse {
         }
 
         vkUtilities::CheckAvailableExtensions(m_physical_device);
+        vkGetPhysicalDeviceProperties(m_physical_device, &m_physical_device_properties);
 
         // === Create Logical Device ===
         {
             QueueFamilyIndices indices = vkUtilities::FindQueueFamilies(m_physical_device, m_surface);
             std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
             std::set<uint32_t> unique_queue_families = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+            const bool async_compute = config.enable_async_compute && indices.computeFamily.has_value();
+            if (async_compute) {
+                unique_queue_families.insert(indices.computeFamily.value());
+            }
             float queue_priority = 1.0f;
             for (uint32_t queue_family : unique_queue_families) {
                 VkDeviceQueueCreateInfo queue_create_info{};
@@ -140,10 +173,35 @@ namespace Diffuse {
                 queue_create_infos.push_back(queue_create_info);
             }
 
+            VkPhysicalDeviceFeatures supported_features;
+            vkGetPhysicalDeviceFeatures(m_physical_device, &supported_features);
+
             VkPhysicalDeviceFeatures device_features{};
             device_features.samplerAnisotropy = VK_TRUE;
+            if (config.enable_pipeline_statistics) {
+                LOG_WARN(supported_features.pipelineStatisticsQuery, "Pipeline statistics queries are not supported on this device");
+                device_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+                // Covered sample counts for the overdraw of each pass
+                device_features.occlusionQueryPrecise = supported_features.occlusionQueryPrecise;
+            }
+
+            // Timeline semaphores are the only GPU progress tracking, see GpuTimeline
+            VkPhysicalDeviceVulkan12Features supported_features12{};
+            supported_features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            VkPhysicalDeviceFeatures2 supported_features2{};
+            supported_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            supported_features2.pNext = &supported_features12;
+            vkGetPhysicalDeviceFeatures2(m_physical_device, &supported_features2);
+            if (!supported_features12.timelineSemaphore) {
+                throw std::runtime_error("Timeline semaphores are not supported on this device");
+            }
+            VkPhysicalDeviceVulkan12Features device_features12{};
+            device_features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            device_features12.timelineSemaphore = VK_TRUE;
+
             VkDeviceCreateInfo device_create_info{};
             device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+            device_create_info.pNext = &device_features12;
             device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
             device_create_info.pQueueCreateInfos = queue_create_infos.data();
             device_create_info.pEnabledFeatures = &device_features;
@@ -161,6 +219,11 @@ namespace Diffuse {
             }
             vkGetDeviceQueue(m_device, indices.graphicsFamily.value(), 0, &m_graphics_queue);
             vkGetDeviceQueue(m_device, indices.presentFamily.value(), 0, &m_present_queue);
+            if (async_compute) {
+                vkGetDeviceQueue(m_device, indices.computeFamily.value(), 0, &m_compute_queue);
+                m_shared_queue_families = { indices.graphicsFamily.value(), indices.computeFamily.value() };
+                std::cout << "Async compute on queue family " << indices.computeFamily.value() << std::endl;
+            }
         }
 
         // Create Command Pool
@@ -170,37 +233,58 @@ namespace Diffuse {
             pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
             pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
             pool_info.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+            m_graphics_queue_family = pool_info.queueFamilyIndex;
 
             if (vkCreateCommandPool(m_device, &pool_info, nullptr, &m_command_pool) != VK_SUCCESS) {
                 LOG_ERROR(false, "Failed to create command pool!");
             }
+            if (m_compute_queue != VK_NULL_HANDLE) {
+                pool_info.queueFamilyIndex = queueFamilyIndices.computeFamily.value();
+                if (vkCreateCommandPool(m_device, &pool_info, nullptr, &m_compute_command_pool) != VK_SUCCESS) {
+                    LOG_ERROR(false, "Failed to create compute command pool!");
+                }
+            }
+        }
+
+        // === Create GPU Profiler ===
+        {
+            QueueFamilyIndices queueFamilyIndices = vkUtilities::FindQueueFamilies(m_physical_device, m_surface);
+            m_gpu_profiler = std::make_unique<GpuProfiler>(this, m_instance, queueFamilyIndices.graphicsFamily.value(), m_render_ahead);
+            if (HasAsyncCompute())
+                m_gpu_profiler->EnableComputeQueue(queueFamilyIndices.computeFamily.value());
+
+            VkPhysicalDeviceFeatures supported_features;
+            vkGetPhysicalDeviceFeatures(m_physical_device, &supported_features);
+            if (config.enable_pipeline_statistics && supported_features.pipelineStatisticsQuery) {
+                m_pipeline_statistics = std::make_unique<PipelineStatistics>(this, m_render_ahead, supported_features.occlusionQueryPrecise);
+            }
         }
 
         // === Create Sync Obects ===
         {
             m_render_complete_semaphores.resize(m_render_ahead);
             m_present_complete_semaphores.resize(m_render_ahead);
-            m_wait_fences.resize(m_render_ahead);
+            m_frame_timeline_values.assign(m_render_ahead, 0);
 
             VkSemaphoreCreateInfo semaphore_info{};
             semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-            VkFenceCreateInfo fence_info{};
-            fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
             for (size_t i = 0; i < m_render_ahead; i++) {
                 if (vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_render_complete_semaphores[i]) != VK_SUCCESS ||
-                    vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_present_complete_semaphores[i]) != VK_SUCCESS ||
-                    vkCreateFence(m_device, &fence_info, nullptr, &m_wait_fences[i]) != VK_SUCCESS) {
+                    vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_present_complete_semaphores[i]) != VK_SUCCESS) {
                     LOG_ERROR(false, "Failed to create synchronization objects for a frame!");
                 }
             }
+            m_graphics_timeline = std::make_unique<GpuTimeline>(m_device, m_graphics_queue);
+            if (m_compute_queue != VK_NULL_HANDLE) {
+                m_compute_timeline = std::make_unique<GpuTimeline>(m_device, m_compute_queue);
+            }
         }
         // SUCCESS
     }
 
     void GraphicsDevice::Setup(std::shared_ptr<Scene> scene) {
+        DIFFUSE_PROFILE_FUNCTION();
         m_active_scene = scene;
 
         TextureSampler sampler{};
@@ -218,6 +302,8 @@ namespace Diffuse {
         m_swapchain = std::make_unique<Swapchain>(this);
         m_swapchain->Initialize();
 
+        m_readback = std::make_unique<ReadbackRing>(this);
+
         // === Create Render Pass ===
         {
             VkAttachmentDescription color_attachment{};
@@ -321,6 +407,19 @@ namespace Diffuse {
             }
         }
 
+        // === GPU Skinning and morph targets ===
+        {
+            for (auto& object : scene->GetSceneObjects()) {
+                if (!object->p_model.IsSkinned() && !object->p_model.HasMorphTargets())
+                    continue;
+                if (!m_skinning)
+                    m_skinning = std::make_unique<GpuSkinning>(this, m_render_ahead);
+                object->p_skinning_instance = m_skinning->AddInstance(object->p_model);
+            }
+            if (m_skinning)
+                m_skinning->Build();
+        }
+
         CreateUniformBuffer(scene);
 
         std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings_model = {
@@ -372,7 +471,7 @@ namespace Diffuse {
             { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 8 + imageSamplerCount * m_swapchain->GetImageCount() + 2 },
             { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, (8 + meshCount) * m_swapchain->GetImageCount() },
             { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE , 8 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , meshCount },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , 1 },
         } };
 
         VkDescriptorPoolCreateInfo createInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
@@ -495,10 +594,13 @@ namespace Diffuse {
             }
         }
 
+        // The environment bake runs on the compute queue, the BRDF LUT overlaps it on the graphics queue
         SetupIBL();
+        GenerateBRDF_LUT();
         SetupIBLCubemaps(scene);
         SetupSkybox(scene->GetSkybox());
-        GenerateBRDF_LUT();
+        // All startup passes have been waited on by now
+        m_gpu_profiler->ReportStartup();
 
         // IBL cubemaps
         {
@@ -553,75 +655,18 @@ namespace Diffuse {
         }
 
         // Shader material
-        for (auto& scene_object : scene->GetSceneObjects()) {
-            std::vector<ShaderMaterial> shaderMaterials{};
-            for (auto& material : scene_object->p_model.GetMaterials()) {
-                ShaderMaterial shaderMaterial{};
-
-                shaderMaterial.emissiveFactor = glm::vec4(material.emissiveFactor[0], material.emissiveFactor[1], material.emissiveFactor[2], 0);
-                // To save space, availabilty and texture coordinate set are combined
-                // -1 = texture not used for this material, >= 0 texture used and index of texture coordinate set
-                shaderMaterial.colorTextureSet = material.baseColorTexture != nullptr ? material.texCoordSets.baseColor : -1;
-                shaderMaterial.normalTextureSet = material.normalTexture != nullptr ? material.texCoordSets.normal : -1;
-                shaderMaterial.occlusionTextureSet = material.occlusionTexture != nullptr ? material.texCoordSets.occlusion : -1;
-                shaderMaterial.emissiveTextureSet = material.emissiveTexture != nullptr ? material.texCoordSets.emissive : -1;
-                shaderMaterial.alphaMask = static_cast<float>(material.alphaMode == Material::ALPHAMODE_MASK);
-                shaderMaterial.alphaMaskCutoff = material.alphaCutoff;
-                shaderMaterial.emissiveStrength = material.emissiveStrength;
-
-                // TODO: glTF specs states that metallic roughness should be preferred, even if specular glosiness is present
-
-                if (material.pbrWorkflows.metallicRoughness) {
-                    // Metallic roughness workflow
-                    shaderMaterial.workflow = static_cast<float>(PBRWorkflows::PBR_WORKFLOW_METALLIC_ROUGHNESS);
-                    shaderMaterial.baseColorFactor = material.baseColorFactor;
-                    shaderMaterial.metallicFactor = material.metallicFactor;
-                    shaderMaterial.roughnessFactor = material.roughnessFactor;
-                    shaderMaterial.PhysicalDescriptorTextureSet = material.metallicRoughnessTexture != nullptr ? material.texCoordSets.metallicRoughness : -1;
-                    shaderMaterial.colorTextureSet = material.baseColorTexture != nullptr ? material.texCoordSets.baseColor : -1;
-                }
-
-                if (material.pbrWorkflows.specularGlossiness) {
-                    // Specular glossiness workflow
-                    shaderMaterial.workflow = static_cast<float>(PBR_WORKFLOW_SPECULAR_GLOSINESS);
-                    shaderMaterial.PhysicalDescriptorTextureSet = material.extension.specularGlossinessTexture != nullptr ? material.texCoordSets.specularGlossiness : -1;
-                    shaderMaterial.colorTextureSet = material.extension.diffuseTexture != nullptr ? material.texCoordSets.baseColor : -1;
-                    shaderMaterial.diffuseFactor = material.extension.diffuseFactor;
-                    shaderMaterial.specularFactor = glm::vec4(material.extension.specularFactor, 1.0f);
+        {
+            if (m_materials)
+                m_materials->Destroy();
+            // Pending material edits hold ids of the old table
+            m_material_edit_generation++;
+            // Room for live edits that split shared materials
+            m_materials = std::make_unique<MaterialTable>(this, m_render_ahead, std::max(256u, 2 * materialCount));
+            for (auto& scene_object : scene->GetSceneObjects()) {
+                for (auto& material : scene_object->p_model.GetMaterials()) {
+                    material.tableIndex = m_materials->Acquire(MakeShaderMaterial(material));
                 }
-
-                shaderMaterials.push_back(shaderMaterial);
-            }
-
-            if (scene_object->p_shader_material_buffer.buffer != VK_NULL_HANDLE) {
-                vkDestroyBuffer(m_device, scene_object->p_shader_material_buffer.buffer, nullptr);
-                vkFreeMemory(m_device, scene_object->p_shader_material_buffer.memory, nullptr);
-                scene_object->p_shader_material_buffer.buffer = VK_NULL_HANDLE;
-                scene_object->p_shader_material_buffer.memory = VK_NULL_HANDLE;
-            }
-            VkDeviceSize bufferSize = shaderMaterials.size() * sizeof(ShaderMaterial);
-            Buffer stagingBuffer;
-            VK_CHECK_RESULT(vkUtilities::CreateBuffer(m_device, m_physical_device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufferSize,
-                &stagingBuffer.buffer, &stagingBuffer.memory, shaderMaterials.data()));
-            VK_CHECK_RESULT(vkUtilities::CreateBuffer(m_device, m_physical_device, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, bufferSize,
-                &scene_object->p_shader_material_buffer.buffer, &scene_object->p_shader_material_buffer.memory));
-
-            // Copy from staging buffers
-            VkCommandBuffer copyCmd = CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-            VkBufferCopy copyRegion{};
-            copyRegion.size = bufferSize;
-            vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, scene_object->p_shader_material_buffer.buffer, 1, &copyRegion);
-            FlushCommandBuffer(copyCmd, m_graphics_queue, true);
-            //
-            vkDestroyBuffer(m_device, stagingBuffer.buffer, nullptr);
-            vkFreeMemory(m_device, stagingBuffer.memory, nullptr);
-            stagingBuffer.buffer = VK_NULL_HANDLE;
-            stagingBuffer.memory = VK_NULL_HANDLE;
-
-            // Update descriptor
-            scene_object->p_shader_material_buffer.descriptor.buffer = scene_object->p_shader_material_buffer.buffer;
-            scene_object->p_shader_material_buffer.descriptor.offset = 0;
-            scene_object->p_shader_material_buffer.descriptor.range = bufferSize;
+            }
 
             VkDescriptorSetAllocateInfo allocInfo{};
             allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -629,7 +674,7 @@ namespace Diffuse {
             allocInfo.descriptorSetCount = 1;
             allocInfo.pSetLayouts = &m_descriptorSetLayouts.materialBuffer;
 
-            if (vkAllocateDescriptorSets(m_device, &allocInfo, &scene_object->p_mat_descritpor_set) != VK_SUCCESS) {
+            if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_descriptor_sets.materialBuffer) != VK_SUCCESS) {
                 throw std::runtime_error("failed to allocate descriptor sets!");
             }
 
@@ -637,10 +682,10 @@ namespace Diffuse {
             descriptorWrites.resize(1);
             descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            descriptorWrites[0].dstSet = scene_object->p_mat_descritpor_set;
+            descriptorWrites[0].dstSet = m_descriptor_sets.materialBuffer;
             descriptorWrites[0].dstBinding = 0;
             descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pBufferInfo = &scene_object->p_shader_material_buffer.descriptor;
+            descriptorWrites[0].pBufferInfo = &m_materials->Descriptor();
 
             vkUpdateDescriptorSets(m_device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
         }
@@ -665,80 +710,63 @@ namespace Diffuse {
         CreateGraphicsPipeline();
     }
 
-    void GraphicsDevice::SetupIBL() {
-        // --------------- Converting equirectangular to cubemap ------------------
-        uint32_t width = offscreen_size;
-        uint32_t height = offscreen_size;
-        VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        // Cubemap image
-        {
-            VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-            // Cube map image description
-            VkImageCreateInfo imageCreateInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
-            imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-            imageCreateInfo.format = format;
-            imageCreateInfo.extent = { width, height, 1 };
-            imageCreateInfo.mipLevels = 1;
-            imageCreateInfo.arrayLayers = 6;
-            imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-            imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-            imageCreateInfo.usage = usage;
-            imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-            imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            imageCreateInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-            if (vkCreateImage(m_device, &imageCreateInfo, nullptr, &m_cubemap.image) != VK_SUCCESS) {
-                assert(false);
-            }
-
-            VkMemoryRequirements memReqs{};
-            vkGetImageMemoryRequirements(m_device, m_cubemap.image, &memReqs);
-            VkMemoryAllocateInfo memAlloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-            memAlloc.allocationSize = memReqs.size;
-            memAlloc.memoryTypeIndex = vkUtilities::FindMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physical_device);
+    static void LogRenderGraphStats(const char* name, const RenderGraph::Stats& stats) {
+        std::cout << "Render graph " << name << ": " << stats.passes - stats.culled_passes << " passes (" << stats.culled_passes << " culled), "
+            << stats.barriers << " barriers in " << stats.barrier_batches << " batches, transients " << stats.transient_bytes / 1024
+            << " KB in " << stats.allocated_bytes / 1024 << " KB of memory" << std::endl;
+    }
 
-            if (vkAllocateMemory(m_device, &memAlloc, nullptr, &m_cubemap.memory) != VK_SUCCESS) {
-                assert(false);
-            }
-            if (vkBindImageMemory(m_device, m_cubemap.image, m_cubemap.memory, 0) != VK_SUCCESS) {
-                assert(false);
-            }
+    ShaderMaterial GraphicsDevice::MakeShaderMaterial(const Material& material) const {
+        ShaderMaterial shaderMaterial{};
+
+        shaderMaterial.emissiveFactor = glm::vec4(material.emissiveFactor[0], material.emissiveFactor[1], material.emissiveFactor[2], 0);
+        // To save space, availabilty and texture coordinate set are combined
+        // -1 = texture not used for this material, >= 0 texture used and index of texture coordinate set
+        shaderMaterial.colorTextureSet = material.baseColorTexture != nullptr ? material.texCoordSets.baseColor : -1;
+        shaderMaterial.normalTextureSet = material.normalTexture != nullptr ? material.texCoordSets.normal : -1;
+        shaderMaterial.occlusionTextureSet = material.occlusionTexture != nullptr ? material.texCoordSets.occlusion : -1;
+        shaderMaterial.emissiveTextureSet = material.emissiveTexture != nullptr ? material.texCoordSets.emissive : -1;
+        shaderMaterial.alphaMask = static_cast<float>(material.alphaMode == Material::ALPHAMODE_MASK);
+        shaderMaterial.alphaMaskCutoff = material.alphaCutoff;
+        shaderMaterial.emissiveStrength = material.emissiveStrength;
+
+        // TODO: glTF specs states that metallic roughness should be preferred, even if specular glosiness is present
+
+        if (material.pbrWorkflows.metallicRoughness) {
+            // Metallic roughness workflow
+            shaderMaterial.workflow = static_cast<float>(PBRWorkflows::PBR_WORKFLOW_METALLIC_ROUGHNESS);
+            shaderMaterial.baseColorFactor = material.baseColorFactor;
+            shaderMaterial.metallicFactor = material.metallicFactor;
+            shaderMaterial.roughnessFactor = material.roughnessFactor;
+            shaderMaterial.PhysicalDescriptorTextureSet = material.metallicRoughnessTexture != nullptr ? material.texCoordSets.metallicRoughness : -1;
+            shaderMaterial.colorTextureSet = material.baseColorTexture != nullptr ? material.texCoordSets.baseColor : -1;
+        }
 
-            m_cubemap.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        if (material.pbrWorkflows.specularGlossiness) {
+            // Specular glossiness workflow
+            shaderMaterial.workflow = static_cast<float>(PBR_WORKFLOW_SPECULAR_GLOSINESS);
+            shaderMaterial.PhysicalDescriptorTextureSet = material.extension.specularGlossinessTexture != nullptr ? material.texCoordSets.specularGlossiness : -1;
+            shaderMaterial.colorTextureSet = material.extension.diffuseTexture != nullptr ? material.texCoordSets.baseColor : -1;
+            shaderMaterial.diffuseFactor = material.extension.diffuseFactor;
+            shaderMaterial.specularFactor = glm::vec4(material.extension.specularFactor, 1.0f);
+        }
 
-            // Create sampler
-            VkSamplerCreateInfo sampler_create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
-            sampler_create_info.magFilter = VK_FILTER_LINEAR;
-            sampler_create_info.minFilter = VK_FILTER_LINEAR;
-            sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-            sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-            sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-            sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-            sampler_create_info.mipLodBias = 0.0f;
-            sampler_create_info.maxAnisotropy = 1.0f;
-            sampler_create_info.compareOp = VK_COMPARE_OP_NEVER;
-            sampler_create_info.minLod = 0.0f;
-            sampler_create_info.maxLod = 1.0f;
-            sampler_create_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-            if (vkCreateSampler(m_device, &sampler_create_info, nullptr, &m_cubemap.sampler) != VK_SUCCESS) {
-                assert(false);
-            }
+        // Lighting only, the other maps stay. Alpha masks lose the alpha of the color texture.
+        if (m_untextured_materials) {
+            shaderMaterial.baseColorFactor = glm::vec4(glm::vec3(1.0f), material.baseColorFactor.a);
+            shaderMaterial.diffuseFactor = glm::vec4(glm::vec3(1.0f), material.extension.diffuseFactor.a);
+            shaderMaterial.colorTextureSet = -1;
+        }
 
-            // Create image view
-            VkImageViewCreateInfo view_create_info = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
-            view_create_info.image = m_cubemap.image;
-            view_create_info.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-            view_create_info.format = format;
-            view_create_info.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
-            view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            view_create_info.subresourceRange.baseMipLevel = 0;
-            view_create_info.subresourceRange.levelCount = 1;
-            view_create_info.subresourceRange.baseArrayLayer = 0;
-            view_create_info.subresourceRange.layerCount = 6;
-            if (vkCreateImageView(m_device, &view_create_info, nullptr, &m_cubemap.view) != VK_SUCCESS) {
-                assert(false);
-            }
+        return shaderMaterial;
+    }
 
-        } // END - Cubemap image
+    void GraphicsDevice::SetupIBL() {
+        DIFFUSE_PROFILE_FUNCTION();
+        // --------------- Converting equirectangular to cubemap ------------------
+        uint32_t width = offscreen_size;
+        uint32_t height = offscreen_size;
+        VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT;
 
         {
             VkSamplerCreateInfo createInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
@@ -804,82 +832,18 @@ namespace Diffuse {
             compute_create_Info.pNext = nullptr;
             compute_create_Info.basePipelineHandle = VK_NULL_HANDLE;
 
-            if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &compute_create_Info, nullptr, &m_pipelines.compute) != VK_SUCCESS) {
+            VkResult compute_result;
+            {
+                Utils::FrameEventScope frame_event(Utils::FrameEventType::PipelineCompile, "compute");
+                compute_result = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &compute_create_Info, nullptr, &m_pipelines.compute);
+            }
+            if (compute_result != VK_SUCCESS) {
                 throw std::runtime_error("Failed to create compute pipeline");
             }
 
             vkDestroyShaderModule(m_device, compute_shader_module, nullptr);
         }
 
-        // converting equirenctangular to cubemap
-        {
-            const VkDescriptorImageInfo inputTexture = { VK_NULL_HANDLE, hdr->GetView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
-            const VkDescriptorImageInfo outputTexture = { VK_NULL_HANDLE, m_cubemap.view, VK_IMAGE_LAYOUT_GENERAL };
-            {
-                VkWriteDescriptorSet writeDescriptorSet = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-                writeDescriptorSet.dstSet = m_descriptor_sets.compute;
-                writeDescriptorSet.dstBinding = 0;
-                writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                writeDescriptorSet.descriptorCount = 1;
-                writeDescriptorSet.pImageInfo = &inputTexture;
-                vkUpdateDescriptorSets(m_device, 1, &writeDescriptorSet, 0, nullptr);
-            }
-
-            {
-                VkWriteDescriptorSet writeDescriptorSet = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-                writeDescriptorSet.dstSet = m_descriptor_sets.compute;
-                writeDescriptorSet.dstBinding = 1;
-                writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-                writeDescriptorSet.descriptorCount = 1;
-                writeDescriptorSet.pImageInfo = &outputTexture;
-                vkUpdateDescriptorSets(m_device, 1, &writeDescriptorSet, 0, nullptr);
-            }
-
-            VkCommandBuffer layoutCmd = vkUtilities::BeginSingleTimeCommands(m_command_pool, m_device);
-            {
-                {
-                    VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-                    barrier.srcAccessMask = 0;
-                    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-                    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-                    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier.image = m_cubemap.image;
-                    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-                    barrier.subresourceRange.baseMipLevel = 0;
-                    barrier.subresourceRange.levelCount = 1;
-                    vkCmdPipelineBarrier(layoutCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-                }
-
-                vkCmdBindPipeline(layoutCmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines.compute);
-                vkCmdBindDescriptorSets(layoutCmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layouts.compute, 0, 1, &m_descriptor_sets.compute, 0, nullptr);
-                vkCmdDispatch(layoutCmd, offscreen_size / 32, offscreen_size / 32, 6);
-
-                {
-                    VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-                    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-                    barrier.dstAccessMask = 0;
-                    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-                    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier.image = m_cubemap.image;
-                    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-                    barrier.subresourceRange.baseMipLevel = 0;
-                    barrier.subresourceRange.levelCount = 1;
-                    vkCmdPipelineBarrier(layoutCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-                }
-            }
-            vkUtilities::EndSingleTimeCommands(layoutCmd, m_device, m_graphics_queue, m_command_pool);
-
-            vkDestroyPipeline(m_device, m_pipelines.compute, nullptr);
-            //destroyTexture(envTextureEquirect);
-        }
-        // --------------- END - Converting equirectangular to cubemap - END --------------
-        // 
         // --------------- Copying cubemap image texture to main texture ------------------
         // Main Environment texture
         {
@@ -897,6 +861,8 @@ namespace Diffuse {
             imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
             imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
             imageCreateInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+            // Written on the compute queue, sampled on the graphics queue
+            ShareWithComputeQueue(imageCreateInfo);
             if (vkCreateImage(m_device, &imageCreateInfo, nullptr, &m_env_texuture.image) != VK_SUCCESS) {
                 assert(false);
             }
@@ -951,100 +917,162 @@ namespace Diffuse {
 
         } // END - Main Environment texture
 
-        // Copying the converted texture to main texture
-        {   
-            VkCommandBuffer layoutCmd = vkUtilities::BeginSingleTimeCommands(m_command_pool, m_device);
-            {
-                std::vector<VkImageMemoryBarrier> preCopyBarriers;
-                preCopyBarriers.resize(2);
-                {
-                    VkImageMemoryBarrier barrier1 = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-                    barrier1.srcAccessMask = 0;
-                    barrier1.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-                    barrier1.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                    barrier1.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                    barrier1.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier1.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier1.image = m_cubemap.image;
-                    barrier1.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    barrier1.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-                    barrier1.subresourceRange.baseMipLevel = 0;
-                    barrier1.subresourceRange.levelCount = 1;
-
-                    VkImageMemoryBarrier barrier2 = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-                    barrier2.srcAccessMask = 0;
-                    barrier2.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    barrier2.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                    barrier2.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    barrier2.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier2.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier2.image = m_env_texuture.image;
-                    barrier2.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    barrier2.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-                    barrier2.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-                    preCopyBarriers[0] = barrier1;
-                    preCopyBarriers[1] = barrier2;
-                }
-
-                std::vector<VkImageMemoryBarrier> postCopyBarriers;
-                postCopyBarriers.resize(2);
-                {
-                    VkImageMemoryBarrier barrier1 = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-                    barrier1.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-                    barrier1.dstAccessMask = 0;
-                    barrier1.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                    barrier1.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                    barrier1.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier1.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier1.image = m_cubemap.image;
-                    barrier1.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    barrier1.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-                    barrier1.subresourceRange.baseMipLevel = 0;
-                    barrier1.subresourceRange.levelCount = 1;
-
-                    VkImageMemoryBarrier barrier2 = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-                    barrier2.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    barrier2.dstAccessMask = 0;
-                    barrier2.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    barrier2.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                    barrier2.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier2.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier2.image = m_env_texuture.image;
-                    barrier2.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    barrier2.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-                    barrier2.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-                    postCopyBarriers[0] = barrier1;
-                    postCopyBarriers[1] = barrier2;
-                }
+        // Equirect to cube and the copy into the environment texture run as one render graph, the
+        // intermediate cube is a transient that only lives for the bake. It is submitted to the compute
+        // queue without waiting, SetupIBLCubemaps waits on m_environment_ready.
+        {
+            auto graph_ptr = std::make_shared<RenderGraph>(m_device, m_physical_device);
+            RenderGraph& graph = *graph_ptr;
+
+            ImageDesc cube_desc;
+            cube_desc.format = format;
+            cube_desc.width = width;
+            cube_desc.height = height;
+            cube_desc.array_layers = 6;
+            cube_desc.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+            const RenderGraphImage equirect_cube = graph.CreateTransient("Equirect cube", cube_desc);
+            const RenderGraphImage env_texture = graph.Import("Environment", m_env_texuture.image, cube_desc);
+            // A compute queue has no fragment stage, the semaphore wait covers the fragment shader reads
+            graph.SetFinalUsage(env_texture, ResourceUsage::SampledCompute);
+
+            graph.AddPass("Equirect to cube",
+                [&](RenderGraph::PassBuilder& pass) {
+                    pass.Write(equirect_cube, ResourceUsage::StorageCompute);
+                },
+                [&](VkCommandBuffer command_buffer) {
+                    // Timed in the query pool of the queue the bake is submitted to
+                    if (HasAsyncCompute())
+                        m_gpu_profiler->BeginComputeStartupScope(command_buffer, "Equirect to cube");
+                    else
+                        m_gpu_profiler->BeginStartupScope(command_buffer, "Equirect to cube");
+                    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines.compute);
+                    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layouts.compute, 0, 1, &m_descriptor_sets.compute, 0, nullptr);
+                    vkCmdDispatch(command_buffer, offscreen_size / 32, offscreen_size / 32, 6);
+                    if (HasAsyncCompute())
+                        m_gpu_profiler->EndComputeStartupScope(command_buffer);
+                    else
+                        m_gpu_profiler->EndStartupScope(command_buffer);
+                });
+
+            graph.AddPass("Copy to environment",
+                [&](RenderGraph::PassBuilder& pass) {
+                    pass.Read(equirect_cube, ResourceUsage::TransferSrc);
+                    pass.Write(env_texture, ResourceUsage::TransferDst);
+                },
+                [&](VkCommandBuffer command_buffer) {
+                    VkImageCopy copyRegion = {};
+                    copyRegion.extent = { width, height, 1 };
+                    copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                    copyRegion.srcSubresource.layerCount = 6;
+                    copyRegion.dstSubresource = copyRegion.srcSubresource;
+                    vkCmdCopyImage(command_buffer,
+                        graph.GetImage(equirect_cube), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        m_env_texuture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        1, &copyRegion);
+                });
 
-                vkCmdPipelineBarrier(layoutCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, preCopyBarriers.size(), preCopyBarriers.data());
+            graph.Compile();
 
-                VkImageCopy copyRegion = {};
-                uint32_t width = offscreen_size;
-                uint32_t height = offscreen_size;
-                copyRegion.extent = { width, height, 1 };
-                copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                copyRegion.srcSubresource.layerCount = 6;
-                copyRegion.dstSubresource = copyRegion.srcSubresource;
-                vkCmdCopyImage(layoutCmd,
-                    m_cubemap.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                    m_env_texuture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    1, &copyRegion);
+            const VkDescriptorImageInfo inputTexture = { VK_NULL_HANDLE, hdr->GetView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+            const VkDescriptorImageInfo outputTexture = { VK_NULL_HANDLE, graph.GetImageView(equirect_cube), VK_IMAGE_LAYOUT_GENERAL };
+            {
+                VkWriteDescriptorSet writeDescriptorSet = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+                writeDescriptorSet.dstSet = m_descriptor_sets.compute;
+                writeDescriptorSet.dstBinding = 0;
+                writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                writeDescriptorSet.descriptorCount = 1;
+                writeDescriptorSet.pImageInfo = &inputTexture;
+                vkUpdateDescriptorSets(m_device, 1, &writeDescriptorSet, 0, nullptr);
+            }
 
-                vkCmdPipelineBarrier(layoutCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, postCopyBarriers.size(), postCopyBarriers.data());
+            {
+                VkWriteDescriptorSet writeDescriptorSet = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+                writeDescriptorSet.dstSet = m_descriptor_sets.compute;
+                writeDescriptorSet.dstBinding = 1;
+                writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                writeDescriptorSet.descriptorCount = 1;
+                writeDescriptorSet.pImageInfo = &outputTexture;
+                vkUpdateDescriptorSets(m_device, 1, &writeDescriptorSet, 0, nullptr);
             }
-            vkUtilities::EndSingleTimeCommands(layoutCmd, m_device, m_graphics_queue, m_command_pool);
+
+            VkCommandBufferAllocateInfo allocate_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+            allocate_info.commandPool = ComputeCommandPool();
+            allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocate_info.commandBufferCount = 1;
+            VkCommandBuffer bake_cmd;
+            VK_CHECK_RESULT(vkAllocateCommandBuffers(m_device, &allocate_info, &bake_cmd));
+            VkCommandBufferBeginInfo begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            VK_CHECK_RESULT(vkBeginCommandBuffer(bake_cmd, &begin_info));
+            graph.Execute(bake_cmd);
+            VK_CHECK_RESULT(vkEndCommandBuffer(bake_cmd));
+            LogRenderGraphStats("Environment", graph.GetStats());
+
+            GpuTimeline& timeline = ComputeTimeline();
+            const uint64_t value = timeline.Submit(bake_cmd);
+            m_environment_ready = timeline.GetSyncPoint(value);
+            VkPipeline pipeline = m_pipelines.compute;
+            VkCommandPool pool = ComputeCommandPool();
+            timeline.DeferDestroy(value, [this, graph_ptr, pipeline, pool, bake_cmd]() {
+                graph_ptr->Destroy();
+                vkDestroyPipeline(m_device, pipeline, nullptr);
+                vkFreeCommandBuffers(m_device, pool, 1, &bake_cmd);
+            });
         }
-        // --------------- END - Copying cubemap image texture to main texture - END ------------------
     }
 
     void GraphicsDevice::SetupIBLCubemaps(std::shared_ptr<Scene> scene) {
+        DIFFUSE_PROFILE_FUNCTION();
         enum Target { IRRADIANCE = 0, PREFILTEREDENV = 1 };
 
-        for (uint32_t target = 0; target < PREFILTEREDENV + 1; target++) {
-            Cubemap cubemap_texture;
+        struct PushBlockIrradiance {
+            glm::mat4 mvp;
+            float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
+            float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
+        };
 
-            auto tStart = std::chrono::high_resolution_clock::now();
+        struct PushBlockPrefilterEnv {
+            glm::mat4 mvp;
+            float roughness;
+            uint32_t numSamples = 16u;
+        };
+
+        struct FilterTarget {
+            Cubemap cubemap;
+            VkFormat format;
+            int32_t dim;
+            uint32_t numMips;
+            VkRenderPass renderpass;
+            VkDescriptorSetLayout descriptorsetlayout;
+            VkDescriptorPool descriptorpool;
+            VkDescriptorSet descriptorset;
+            VkPipelineLayout pipelinelayout;
+            VkPipeline pipeline;
+            RenderGraphImage offscreen;
+            RenderGraphImage cube;
+            VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        };
+        std::array<FilterTarget, 2> targets;
+
+        const std::vector<glm::mat4> matrices = {
+            glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+            glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+            glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+            glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+            glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+            glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
+        };
+
+        auto tStart = std::chrono::high_resolution_clock::now();
+
+        // Both targets bake in one render graph and one submission. Every face of every mip is
+        // rendered into an offscreen target and copied into the cubemap, the offscreen targets
+        // of the two bakes never live at the same time so they share memory.
+        RenderGraph graph(m_device, m_physical_device);
+
+        for (uint32_t target = 0; target < PREFILTEREDENV + 1; target++) {
+            FilterTarget& filter = targets[target];
+            Cubemap& cubemap_texture = filter.cubemap;
 
             VkFormat format;
             int32_t dim;
@@ -1061,6 +1089,9 @@ namespace Diffuse {
                 break;
             };
             numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+            filter.format = format;
+            filter.dim = dim;
+            filter.numMips = numMips;
 
             // Create target cubemap
             {
@@ -1118,14 +1149,14 @@ namespace Diffuse {
 
             // FB, Att, RP, Pipe, etc.
             VkAttachmentDescription attDesc{};
-            // Color attachment
+            // Color attachment, the render graph transitions it around the pass
             attDesc.format = format;
             attDesc.samples = VK_SAMPLE_COUNT_1_BIT;
             attDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
             attDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
             attDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
             attDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-            attDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            attDesc.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
             attDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
             VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
 
@@ -1134,23 +1165,6 @@ namespace Diffuse {
             subpassDescription.colorAttachmentCount = 1;
             subpassDescription.pColorAttachments = &colorReference;
 
-            // Use subpass dependencies for layout transitions
-            std::array<VkSubpassDependency, 2> dependencies;
-            dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-            dependencies[0].dstSubpass = 0;
-            dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-            dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-            dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-            dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-            dependencies[1].srcSubpass = 0;
-            dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-            dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-            dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-            dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-            dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
             // Renderpass
             VkRenderPassCreateInfo renderPassCI{};
             renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -1158,92 +1172,15 @@ namespace Diffuse {
             renderPassCI.pAttachments = &attDesc;
             renderPassCI.subpassCount = 1;
             renderPassCI.pSubpasses = &subpassDescription;
-            renderPassCI.dependencyCount = 2;
-            renderPassCI.pDependencies = dependencies.data();
-            VkRenderPass renderpass;
-            VK_CHECK_RESULT(vkCreateRenderPass(m_device, &renderPassCI, nullptr, &renderpass));
-
-            struct Offscreen {
-                VkImage image;
-                VkImageView view;
-                VkDeviceMemory memory;
-                VkFramebuffer framebuffer;
-            } offscreen;
-
-            // Create offscreen framebuffer
-            {
-                // Image
-                VkImageCreateInfo imageCI{};
-                imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-                imageCI.imageType = VK_IMAGE_TYPE_2D;
-                imageCI.format = format;
-                imageCI.extent.width = dim;
-                imageCI.extent.height = dim;
-                imageCI.extent.depth = 1;
-                imageCI.mipLevels = 1;
-                imageCI.arrayLayers = 1;
-                imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-                imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-                imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-                imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-                VK_CHECK_RESULT(vkCreateImage(m_device, &imageCI, nullptr, &offscreen.image));
-                VkMemoryRequirements memReqs;
-                vkGetImageMemoryRequirements(m_device, offscreen.image, &memReqs);
-                VkMemoryAllocateInfo memAllocInfo{};
-                memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-                memAllocInfo.allocationSize = memReqs.size;
-                memAllocInfo.memoryTypeIndex = vkUtilities::FindMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physical_device);
-                VK_CHECK_RESULT(vkAllocateMemory(m_device, &memAllocInfo, nullptr, &offscreen.memory));
-                VK_CHECK_RESULT(vkBindImageMemory(m_device, offscreen.image, offscreen.memory, 0));
-
-                // View
-                VkImageViewCreateInfo viewCI{};
-                viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-                viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-                viewCI.format = format;
-                viewCI.flags = 0;
-                viewCI.subresourceRange = {};
-                viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                viewCI.subresourceRange.baseMipLevel = 0;
-                viewCI.subresourceRange.levelCount = 1;
-                viewCI.subresourceRange.baseArrayLayer = 0;
-                viewCI.subresourceRange.layerCount = 1;
-                viewCI.image = offscreen.image;
-                VK_CHECK_RESULT(vkCreateImageView(m_device, &viewCI, nullptr, &offscreen.view));
-
-                // Framebuffer
-                VkFramebufferCreateInfo framebufferCI{};
-                framebufferCI.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-                framebufferCI.renderPass = renderpass;
-                framebufferCI.attachmentCount = 1;
-                framebufferCI.pAttachments = &offscreen.view;
-                framebufferCI.width = dim;
-                framebufferCI.height = dim;
-                framebufferCI.layers = 1;
-                VK_CHECK_RESULT(vkCreateFramebuffer(m_device, &framebufferCI, nullptr, &offscreen.framebuffer));
-
-                VkCommandBuffer layoutCmd = CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-                VkImageMemoryBarrier imageMemoryBarrier{};
-                imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                imageMemoryBarrier.image = offscreen.image;
-                imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-                imageMemoryBarrier.srcAccessMask = 0;
-                imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-                imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-                vkCmdPipelineBarrier(layoutCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-                FlushCommandBuffer(layoutCmd, m_graphics_queue, true);
-            }
+            VK_CHECK_RESULT(vkCreateRenderPass(m_device, &renderPassCI, nullptr, &filter.renderpass));
 
             // Descriptors
-            VkDescriptorSetLayout descriptorsetlayout;
             VkDescriptorSetLayoutBinding setLayoutBinding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
             VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
             descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
             descriptorSetLayoutCI.pBindings = &setLayoutBinding;
             descriptorSetLayoutCI.bindingCount = 1;
-            VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &descriptorSetLayoutCI, nullptr, &descriptorsetlayout));
+            VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &descriptorSetLayoutCI, nullptr, &filter.descriptorsetlayout));
 
             // Descriptor Pool
             VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 };
@@ -1252,41 +1189,26 @@ namespace Diffuse {
             descriptorPoolCI.poolSizeCount = 1;
             descriptorPoolCI.pPoolSizes = &poolSize;
             descriptorPoolCI.maxSets = 2;
-            VkDescriptorPool descriptorpool;
-            VK_CHECK_RESULT(vkCreateDescriptorPool(m_device, &descriptorPoolCI, nullptr, &descriptorpool));
+            VK_CHECK_RESULT(vkCreateDescriptorPool(m_device, &descriptorPoolCI, nullptr, &filter.descriptorpool));
 
             // Descriptor sets
-            VkDescriptorSet descriptorset;
             VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
             descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-            descriptorSetAllocInfo.descriptorPool = descriptorpool;
-            descriptorSetAllocInfo.pSetLayouts = &descriptorsetlayout;
+            descriptorSetAllocInfo.descriptorPool = filter.descriptorpool;
+            descriptorSetAllocInfo.pSetLayouts = &filter.descriptorsetlayout;
             descriptorSetAllocInfo.descriptorSetCount = 1;
-            VK_CHECK_RESULT(vkAllocateDescriptorSets(m_device, &descriptorSetAllocInfo, &descriptorset));
+            VK_CHECK_RESULT(vkAllocateDescriptorSets(m_device, &descriptorSetAllocInfo, &filter.descriptorset));
             VkWriteDescriptorSet writeDescriptorSet{};
             writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
             writeDescriptorSet.descriptorCount = 1;
-            writeDescriptorSet.dstSet = descriptorset;
+            writeDescriptorSet.dstSet = filter.descriptorset;
             writeDescriptorSet.dstBinding = 0;
             VkDescriptorImageInfo env_image_info = { m_env_texuture.sampler, m_env_texuture.view, m_env_texuture.layout };
             writeDescriptorSet.pImageInfo = &env_image_info;
             vkUpdateDescriptorSets(m_device, 1, &writeDescriptorSet, 0, nullptr);
 
-            struct PushBlockIrradiance {
-                glm::mat4 mvp;
-                float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
-                float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
-            } pushBlockIrradiance;
-
-            struct PushBlockPrefilterEnv {
-                glm::mat4 mvp;
-                float roughness;
-                uint32_t numSamples = 16u;
-            } pushBlockPrefilterEnv;
-
             // Pipeline layout
-            VkPipelineLayout pipelinelayout;
             VkPushConstantRange pushConstantRange{};
             pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
@@ -1303,10 +1225,10 @@ namespace Diffuse {
             VkPipelineLayoutCreateInfo pipelineLayoutCI{};
             pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
             pipelineLayoutCI.setLayoutCount = 1;
-            pipelineLayoutCI.pSetLayouts = &descriptorsetlayout;
+            pipelineLayoutCI.pSetLayouts = &filter.descriptorsetlayout;
             pipelineLayoutCI.pushConstantRangeCount = 1;
             pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
-            VK_CHECK_RESULT(vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &pipelinelayout));
+            VK_CHECK_RESULT(vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &filter.pipelinelayout));
 
             // Pipeline
             VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{};
@@ -1367,8 +1289,8 @@ namespace Diffuse {
 
             VkGraphicsPipelineCreateInfo pipelineCI{};
             pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-            pipelineCI.layout = pipelinelayout;
-            pipelineCI.renderPass = renderpass;
+            pipelineCI.layout = filter.pipelinelayout;
+            pipelineCI.renderPass = filter.renderpass;
             pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
             pipelineCI.pVertexInputState = &vertexInputStateCI;
             pipelineCI.pRasterizationState = &rasterizationStateCI;
@@ -1379,7 +1301,7 @@ namespace Diffuse {
             pipelineCI.pDynamicState = &dynamicStateCI;
             pipelineCI.stageCount = 2;
             pipelineCI.pStages = shaderStages.data();
-            pipelineCI.renderPass = renderpass;
+            pipelineCI.renderPass = filter.renderpass;
 
             auto vert_shader_code = Utils::File::ReadFile("../shaders/pbr_ibl/filtercube.vert.spv");
 
@@ -1418,203 +1340,171 @@ namespace Diffuse {
                     break;
                 }
             };
-            VkPipeline pipeline;
-            VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, m_pipeline_cache, 1, &pipelineCI, nullptr, &pipeline));
+            VK_CHECK_RESULT(CompileGraphicsPipeline(m_pipeline_cache, pipelineCI, &filter.pipeline, "IBL filter"));
             for (auto shaderStage : shaderStages) {
                 vkDestroyShaderModule(m_device, shaderStage.module, nullptr);
             }
 
-            // Render cubemap
-            VkClearValue clearValues[1];
-            clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 0.0f } };
-
-            VkRenderPassBeginInfo renderPassBeginInfo{};
-            renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderPassBeginInfo.renderPass = renderpass;
-            renderPassBeginInfo.framebuffer = offscreen.framebuffer;
-            renderPassBeginInfo.renderArea.extent.width = dim;
-            renderPassBeginInfo.renderArea.extent.height = dim;
-            renderPassBeginInfo.clearValueCount = 1;
-            renderPassBeginInfo.pClearValues = clearValues;
-
-            std::vector<glm::mat4> matrices = {
-                glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-            };
-
-            VkCommandBuffer cmdBuf = CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
-
-            VkViewport viewport{};
-            viewport.width = (float)dim;
-            viewport.height = (float)dim;
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-
-            VkRect2D scissor{};
-            scissor.extent.width = dim;
-            scissor.extent.height = dim;
-
-            VkImageSubresourceRange subresourceRange{};
-            subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            subresourceRange.baseMipLevel = 0;
-            subresourceRange.levelCount = numMips;
-            subresourceRange.layerCount = 6;
+            ImageDesc offscreen_desc;
+            offscreen_desc.format = format;
+            offscreen_desc.width = dim;
+            offscreen_desc.height = dim;
+            filter.offscreen = graph.CreateTransient(target == IRRADIANCE ? "Irradiance offscreen" : "Prefilter offscreen", offscreen_desc);
 
-            // Change image layout for all cubemap faces to transfer destination
-            {
-                VkCommandBufferBeginInfo commandBufferBI{};
-                commandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-                VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuf, &commandBufferBI));
-                VkImageMemoryBarrier imageMemoryBarrier{};
-                imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                imageMemoryBarrier.image = cubemap_texture.image;
-                imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                imageMemoryBarrier.srcAccessMask = 0;
-                imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                imageMemoryBarrier.subresourceRange = subresourceRange;
-                vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-                FlushCommandBuffer(cmdBuf, m_graphics_queue, false);
-            }
+            ImageDesc cube_desc = offscreen_desc;
+            cube_desc.mip_levels = numMips;
+            cube_desc.array_layers = 6;
+            cube_desc.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+            filter.cube = graph.Import(target == IRRADIANCE ? "Irradiance cube" : "Prefilter cube", cubemap_texture.image, cube_desc);
+            graph.SetFinalUsage(filter.cube, ResourceUsage::SampledFragment);
 
             for (uint32_t m = 0; m < numMips; m++) {
                 for (uint32_t f = 0; f < 6; f++) {
-                    VkCommandBufferBeginInfo commandBufferBI{};
-                    commandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-                    VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuf, &commandBufferBI));
-
-                    viewport.width = static_cast<float>(dim * std::pow(0.5f, m));
-                    viewport.height = static_cast<float>(dim * std::pow(0.5f, m));
-                    vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-                    vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+                    const uint32_t mip_dim = static_cast<uint32_t>(dim * std::pow(0.5f, m));
 
                     // Render scene from cube face's point of view
-                    vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-                    // Pass parameters for current pass using a push constant block
-                    switch (target) {
-                    case IRRADIANCE:
-                        pushBlockIrradiance.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-                        vkCmdPushConstants(cmdBuf, pipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushBlockIrradiance), &pushBlockIrradiance);
-                        break;
-                    case PREFILTEREDENV:
-                        pushBlockPrefilterEnv.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-                        pushBlockPrefilterEnv.roughness = (float)m / (float)(numMips - 1);
-                        vkCmdPushConstants(cmdBuf, pipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushBlockPrefilterEnv), &pushBlockPrefilterEnv);
-                        break;
-                    };
-
-                    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-                    vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelinelayout, 0, 1, &descriptorset, 0, NULL);
-
-                    VkDeviceSize offsets[1] = { 0 };
-
-                    //models.skybox.draw(cmdBuf);
-                    {
-                        VkBuffer vertexBuffers[] = { scene->GetSkybox()->p_model.m_vertices.buffer };
-                        VkDeviceSize offsets[] = { 0 };
-                        vkCmdBindVertexBuffers(cmdBuf, 0, 1, vertexBuffers, offsets);
-                        vkCmdBindIndexBuffer(cmdBuf, scene->GetSkybox()->p_model.m_indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-                        for (auto& node : scene->GetSkybox()->p_model.GetNodes()) {
-                            DrawNodeSkybox(node, cmdBuf);
-                        }
-                    }
-
-                    vkCmdEndRenderPass(cmdBuf);
-
-                    VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-                    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    subresourceRange.baseMipLevel = 0;
-                    subresourceRange.levelCount = numMips;
-                    subresourceRange.layerCount = 6;
-
-                    {
-                        VkImageMemoryBarrier imageMemoryBarrier{};
-                        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                        imageMemoryBarrier.image = offscreen.image;
-                        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-                        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                        imageMemoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-                        imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-                        imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-                        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-                    }
+                    graph.AddPass("Filter face",
+                        [&](RenderGraph::PassBuilder& pass) {
+                            pass.Write(filter.offscreen, ResourceUsage::ColorAttachment);
+                        },
+                        [this, &filter, &matrices, scene, target, m, f, mip_dim](VkCommandBuffer cmdBuf) {
+                            // One scope per mip level, spanning the six faces
+                            if (f == 0) {
+                                m_gpu_profiler->BeginStartupScope(cmdBuf, (target == IRRADIANCE ? "Irradiance mip " : "Prefilter mip ") + std::to_string(m));
+                            }
+
+                            VkViewport viewport{};
+                            viewport.width = static_cast<float>(mip_dim);
+                            viewport.height = static_cast<float>(mip_dim);
+                            viewport.minDepth = 0.0f;
+                            viewport.maxDepth = 1.0f;
+                            vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
+
+                            VkRect2D scissor{};
+                            scissor.extent.width = filter.dim;
+                            scissor.extent.height = filter.dim;
+                            vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+
+                            VkClearValue clearValues[1];
+                            clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 0.0f } };
+
+                            VkRenderPassBeginInfo renderPassBeginInfo{};
+                            renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+                            renderPassBeginInfo.renderPass = filter.renderpass;
+                            renderPassBeginInfo.framebuffer = filter.framebuffer;
+                            renderPassBeginInfo.renderArea.extent.width = filter.dim;
+                            renderPassBeginInfo.renderArea.extent.height = filter.dim;
+                            renderPassBeginInfo.clearValueCount = 1;
+                            renderPassBeginInfo.pClearValues = clearValues;
+                            vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+                            // Pass parameters for current pass using a push constant block
+                            switch (target) {
+                            case IRRADIANCE:
+                            {
+                                PushBlockIrradiance pushBlockIrradiance;
+                                pushBlockIrradiance.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
+                                vkCmdPushConstants(cmdBuf, filter.pipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushBlockIrradiance), &pushBlockIrradiance);
+                                break;
+                            }
+                            case PREFILTEREDENV:
+                            {
+                                PushBlockPrefilterEnv pushBlockPrefilterEnv;
+                                pushBlockPrefilterEnv.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
+                                pushBlockPrefilterEnv.roughness = (float)m / (float)(filter.numMips - 1);
+                                vkCmdPushConstants(cmdBuf, filter.pipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushBlockPrefilterEnv), &pushBlockPrefilterEnv);
+                                break;
+                            }
+                            };
+
+                            vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, filter.pipeline);
+                            vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, filter.pipelinelayout, 0, 1, &filter.descriptorset, 0, NULL);
+
+                            VkBuffer vertexBuffers[] = { scene->GetSkybox()->p_model.m_vertices.buffer };
+                            VkDeviceSize offsets[] = { 0 };
+                            vkCmdBindVertexBuffers(cmdBuf, 0, 1, vertexBuffers, offsets);
+                            vkCmdBindIndexBuffer(cmdBuf, scene->GetSkybox()->p_model.m_indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+                            for (auto& node : scene->GetSkybox()->p_model.GetNodes()) {
+                                DrawNodeSkybox(node, cmdBuf);
+                            }
+
+                            vkCmdEndRenderPass(cmdBuf);
+                        });
 
                     // Copy region for transfer from framebuffer to cube face
-                    VkImageCopy copyRegion{};
-
-                    copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    copyRegion.srcSubresource.baseArrayLayer = 0;
-                    copyRegion.srcSubresource.mipLevel = 0;
-                    copyRegion.srcSubresource.layerCount = 1;
-                    copyRegion.srcOffset = { 0, 0, 0 };
-
-                    copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    copyRegion.dstSubresource.baseArrayLayer = f;
-                    copyRegion.dstSubresource.mipLevel = m;
-                    copyRegion.dstSubresource.layerCount = 1;
-                    copyRegion.dstOffset = { 0, 0, 0 };
-
-                    copyRegion.extent.width = static_cast<uint32_t>(viewport.width);
-                    copyRegion.extent.height = static_cast<uint32_t>(viewport.height);
-                    copyRegion.extent.depth = 1;
-
-                    vkCmdCopyImage(
-                        cmdBuf,
-                        offscreen.image,
-                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                        cubemap_texture.image,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                        1,
-                        &copyRegion);
-
-                    {
-                        VkImageMemoryBarrier imageMemoryBarrier{};
-                        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                        imageMemoryBarrier.image = offscreen.image;
-                        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-                        imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-                        imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-                        imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-                        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-                    }
-
-                    FlushCommandBuffer(cmdBuf, m_graphics_queue, false);
+                    graph.AddPass("Copy face",
+                        [&](RenderGraph::PassBuilder& pass) {
+                            pass.Read(filter.offscreen, ResourceUsage::TransferSrc);
+                            pass.Write(filter.cube, ResourceUsage::TransferDst, { VK_IMAGE_ASPECT_COLOR_BIT, m, 1, f, 1 });
+                        },
+                        [this, &graph, &filter, m, f, mip_dim](VkCommandBuffer cmdBuf) {
+                            VkImageCopy copyRegion{};
+
+                            copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                            copyRegion.srcSubresource.baseArrayLayer = 0;
+                            copyRegion.srcSubresource.mipLevel = 0;
+                            copyRegion.srcSubresource.layerCount = 1;
+                            copyRegion.srcOffset = { 0, 0, 0 };
+
+                            copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                            copyRegion.dstSubresource.baseArrayLayer = f;
+                            copyRegion.dstSubresource.mipLevel = m;
+                            copyRegion.dstSubresource.layerCount = 1;
+                            copyRegion.dstOffset = { 0, 0, 0 };
+
+                            copyRegion.extent.width = mip_dim;
+                            copyRegion.extent.height = mip_dim;
+                            copyRegion.extent.depth = 1;
+
+                            vkCmdCopyImage(
+                                cmdBuf,
+                                graph.GetImage(filter.offscreen),
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                filter.cubemap.image,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                1,
+                                &copyRegion);
+
+                            if (f == 5) {
+                                m_gpu_profiler->EndStartupScope(cmdBuf);
+                            }
+                        });
                 }
             }
+        }
 
-            {
-                VkCommandBufferBeginInfo commandBufferBI{};
-                commandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-                VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuf, &commandBufferBI));
-                VkImageMemoryBarrier imageMemoryBarrier{};
-                imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                imageMemoryBarrier.image = cubemap_texture.image;
-                imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                imageMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
-                imageMemoryBarrier.subresourceRange = subresourceRange;
-                vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-                FlushCommandBuffer(cmdBuf, m_graphics_queue, false);
-            }
-
-
-            vkDestroyRenderPass(m_device, renderpass, nullptr);
-            vkDestroyFramebuffer(m_device, offscreen.framebuffer, nullptr);
-            vkFreeMemory(m_device, offscreen.memory, nullptr);
-            vkDestroyImageView(m_device, offscreen.view, nullptr);
-            vkDestroyImage(m_device, offscreen.image, nullptr);
-            vkDestroyDescriptorPool(m_device, descriptorpool, nullptr);
-            vkDestroyDescriptorSetLayout(m_device, descriptorsetlayout, nullptr);
-            vkDestroyPipeline(m_device, pipeline, nullptr);
-            vkDestroyPipelineLayout(m_device, pipelinelayout, nullptr);
+        graph.Compile();
+
+        // Offscreen framebuffers, the images only exist once the graph has placed them
+        for (FilterTarget& filter : targets) {
+            const VkImageView offscreen_view = graph.GetImageView(filter.offscreen);
+            VkFramebufferCreateInfo framebufferCI{};
+            framebufferCI.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferCI.renderPass = filter.renderpass;
+            framebufferCI.attachmentCount = 1;
+            framebufferCI.pAttachments = &offscreen_view;
+            framebufferCI.width = filter.dim;
+            framebufferCI.height = filter.dim;
+            framebufferCI.layers = 1;
+            VK_CHECK_RESULT(vkCreateFramebuffer(m_device, &framebufferCI, nullptr, &filter.framebuffer));
+        }
 
+        VkCommandBuffer cmdBuf = CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        graph.Execute(cmdBuf);
+        FlushCommandBuffer(cmdBuf, m_graphics_queue, true, { m_environment_ready });
+        LogRenderGraphStats("IBL filter", graph.GetStats());
+        graph.Destroy();
+
+        for (uint32_t target = 0; target < PREFILTEREDENV + 1; target++) {
+            FilterTarget& filter = targets[target];
+            vkDestroyRenderPass(m_device, filter.renderpass, nullptr);
+            vkDestroyFramebuffer(m_device, filter.framebuffer, nullptr);
+            vkDestroyDescriptorPool(m_device, filter.descriptorpool, nullptr);
+            vkDestroyDescriptorSetLayout(m_device, filter.descriptorsetlayout, nullptr);
+            vkDestroyPipeline(m_device, filter.pipeline, nullptr);
+            vkDestroyPipelineLayout(m_device, filter.pipelinelayout, nullptr);
+
+            Cubemap& cubemap_texture = filter.cubemap;
             cubemap_texture.descriptor.imageView = cubemap_texture.view;
             cubemap_texture.descriptor.sampler = cubemap_texture.sampler;
             cubemap_texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -1628,14 +1518,16 @@ namespace Diffuse {
                 //shaderValuesParams.prefilteredCubeMipLevels = static_cast<float>(numMips);
                 break;
             };
-
-            auto tEnd = std::chrono::high_resolution_clock::now();
-            auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-            std::cout << "Generating cube map with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
         }
+
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+        std::cout << "Generating irradiance (" << targets[IRRADIANCE].numMips << " mips) and prefiltered (" << targets[PREFILTEREDENV].numMips
+            << " mips) cube maps took " << tDiff << " ms" << std::endl;
     }
 
     void GraphicsDevice::GenerateBRDF_LUT() {
+        DIFFUSE_PROFILE_FUNCTION();
         auto tStart = std::chrono::high_resolution_clock::now();
 
         const VkFormat format = VK_FORMAT_R16G16_SFLOAT;
@@ -1854,7 +1746,7 @@ namespace Diffuse {
             frag_shader_stage_info
         };
         VkPipeline pipeline;
-        VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, m_pipeline_cache, 1, &pipelineCI, nullptr, &pipeline));
+        VK_CHECK_RESULT(CompileGraphicsPipeline(m_pipeline_cache, pipelineCI, &pipeline, "BRDF LUT"));
         for (auto shaderStage : shaderStages) {
             vkDestroyShaderModule(m_device, shaderStage.module, nullptr);
         }
@@ -1873,6 +1765,7 @@ namespace Diffuse {
         renderPassBeginInfo.framebuffer = framebuffer;
 
         VkCommandBuffer cmdBuf = CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        m_gpu_profiler->BeginStartupScope(cmdBuf, "BRDF LUT");
         vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
         VkViewport viewport{};
@@ -1890,10 +1783,9 @@ namespace Diffuse {
         vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
         vkCmdDraw(cmdBuf, 3, 1, 0, 0);
         vkCmdEndRenderPass(cmdBuf);
+        m_gpu_profiler->EndStartupScope(cmdBuf);
         FlushCommandBuffer(cmdBuf, m_graphics_queue);
 
-        vkQueueWaitIdle(m_graphics_queue);
-
         vkDestroyPipeline(m_device, pipeline, nullptr);
         vkDestroyPipelineLayout(m_device, pipelinelayout, nullptr);
         vkDestroyRenderPass(m_device, renderpass, nullptr);
@@ -2092,7 +1984,7 @@ namespace Diffuse {
             pipeline_info.pNext = nullptr;
             
 
-            if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &m_pipelines.skybox) != VK_SUCCESS) {
+            if (CompileGraphicsPipeline(VK_NULL_HANDLE, pipeline_info, &m_pipelines.skybox, "skybox") != VK_SUCCESS) {
                 LOG_ERROR(false, "Failed to create graphics pipeline!");
             }
 
@@ -2113,8 +2005,9 @@ namespace Diffuse {
         memcpy(data, vertices, (size_t)bufferSize);
         vkUnmapMemory(m_device, stagingBufferMemory);
 
-        vkUtilities::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_buffer_memory, m_physical_device, m_device);
-        vkUtilities::CopyBuffer(stagingBuffer, vertex_buffer, bufferSize, m_command_pool, m_device, m_graphics_queue);
+        // Transfer source for the per instance copies of GPU skinning
+        vkUtilities::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_buffer_memory, m_physical_device, m_device);
+        CopyBuffer(stagingBuffer, vertex_buffer, bufferSize);
 
         vkDestroyBuffer(m_device, stagingBuffer, nullptr);
         vkFreeMemory(m_device, stagingBufferMemory, nullptr);
@@ -2134,12 +2027,43 @@ namespace Diffuse {
 
         vkUtilities::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer, index_buffer_memory, m_physical_device, m_device);
 
-        vkUtilities::CopyBuffer(stagingBuffer, index_buffer, bufferSize, m_command_pool, m_device, m_graphics_queue);
+        CopyBuffer(stagingBuffer, index_buffer, bufferSize);
 
         vkDestroyBuffer(m_device, stagingBuffer, nullptr);
         vkFreeMemory(m_device, stagingBufferMemory, nullptr);
     }
 
+    void GraphicsDevice::CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
+        VkCommandBuffer command_buffer = CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        VkBufferCopy region{};
+        region.size = size;
+        vkCmdCopyBuffer(command_buffer, src, dst, 1, &region);
+        FlushCommandBuffer(command_buffer, m_graphics_queue);
+    }
+
+    VkCommandPool GraphicsDevice::ThreadCommandPool() {
+        const std::thread::id thread = std::this_thread::get_id();
+        if (thread == m_owner_thread)
+            return m_command_pool;
+
+        std::lock_guard<std::mutex> lock(m_thread_command_pool_mutex);
+        auto it = m_thread_command_pools.find(thread);
+        if (it != m_thread_command_pools.end())
+            return it->second;
+
+        // Only single use upload command buffers come from these
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = m_graphics_queue_family;
+        VkCommandPool pool;
+        if (vkCreateCommandPool(m_device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create command pool of a loader thread");
+        }
+        m_thread_command_pools.emplace(thread, pool);
+        return pool;
+    }
+
     void GraphicsDevice::CreateUniformBuffer(const std::shared_ptr<Scene> scene) {
         VkDeviceSize buffer_size = sizeof(UBO);
         scene->GetSkybox()->p_ubo.uniformBuffers.resize(m_render_ahead);
@@ -2177,6 +2101,18 @@ namespace Diffuse {
 
                 vkMapMemory(m_device, object->p_shader_values_ubo.uniformBuffersMemory[i], 0, buffer_size, 0, &object->p_shader_values_ubo.uniformBuffersMapped[i]);
             }
+
+            buffer_size = std::max<VkDeviceSize>(object->p_model.GetInstanceCount(), 1) * sizeof(InstanceData);
+            object->p_instances.instanceBuffers.resize(m_render_ahead);
+            object->p_instances.instanceBuffersMemory.resize(m_render_ahead);
+            object->p_instances.instanceBuffersMapped.resize(m_render_ahead);
+            for (int i = 0; i < object->p_instances.instanceBuffers.size(); i++) {
+                vkUtilities::CreateBuffer(buffer_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, object->p_instances.instanceBuffers[i],
+                    object->p_instances.instanceBuffersMemory[i], m_physical_device, m_device);
+
+                vkMapMemory(m_device, object->p_instances.instanceBuffersMemory[i], 0, buffer_size, 0, &object->p_instances.instanceBuffersMapped[i]);
+            }
         }
     }
 
@@ -2209,19 +2145,29 @@ namespace Diffuse {
         VkPipelineVertexInputStateCreateInfo vertex_input_info{};
         vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-        VkVertexInputBindingDescription vertex_input_binding = { 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
+        // Binding 1 holds the InstanceData of each mesh instance, one matrix column per location
+        const std::array<VkVertexInputBindingDescription, 2> vertex_input_bindings = { {
+            { 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX },
+            { 1, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE },
+        } };
         std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
             { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
             { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3 },
             { 2, 0, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 6 },
             { 3, 0, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 8 },
             { 4, 0, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 10 },
-            //{ 5, 0, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 14 },
-            //{ 6, 0, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 18 }
+            { 5, 0, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 14 },
+            { 6, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 0 },
+            { 7, 1, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 4 },
+            { 8, 1, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 8 },
+            { 9, 1, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 12 },
+            { 10, 1, VK_FORMAT_R32G32B32_SFLOAT, sizeof(glm::mat4) },
+            { 11, 1, VK_FORMAT_R32G32B32_SFLOAT, sizeof(glm::mat4) + sizeof(float) * 3 },
+            { 12, 1, VK_FORMAT_R32G32B32_SFLOAT, sizeof(glm::mat4) + sizeof(float) * 6 },
         };
 
-        vertex_input_info.vertexBindingDescriptionCount = 1;
-        vertex_input_info.pVertexBindingDescriptions = &vertex_input_binding;
+        vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_input_bindings.size());
+        vertex_input_info.pVertexBindingDescriptions = vertex_input_bindings.data();
         vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
         vertex_input_info.pVertexAttributeDescriptions = vertexInputAttributes.data();
 
@@ -2289,13 +2235,13 @@ namespace Diffuse {
         pipeline_info.subpass = 0;
         pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 
-        if (vkCreateGraphicsPipelines(m_device, m_pipeline_cache, 1, &pipeline_info, nullptr, &m_pipelines.pbr) != VK_SUCCESS) {
+        if (CompileGraphicsPipeline(m_pipeline_cache, pipeline_info, &m_pipelines.pbr, "pbr") != VK_SUCCESS) {
             LOG_ERROR(false, "Failed to create graphics pipeline!");
         }
 
         // Double sided
         rasterizer.cullMode = VK_CULL_MODE_NONE;
-        if (vkCreateGraphicsPipelines(m_device, m_pipeline_cache, 1, &pipeline_info, nullptr, &m_pipelines.double_sided) != VK_SUCCESS) {
+        if (CompileGraphicsPipeline(m_pipeline_cache, pipeline_info, &m_pipelines.double_sided, "double_sided") != VK_SUCCESS) {
             LOG_ERROR(false, "Failed to create graphics pipeline!");
         }
         // Alpha blending
@@ -2308,7 +2254,7 @@ namespace Diffuse {
         color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
         color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
         color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
-        if (vkCreateGraphicsPipelines(m_device, m_pipeline_cache, 1, &pipeline_info, nullptr, &m_pipelines.alpha_blending) != VK_SUCCESS) {
+        if (CompileGraphicsPipeline(m_pipeline_cache, pipeline_info, &m_pipelines.alpha_blending, "alpha_blending") != VK_SUCCESS) {
             LOG_ERROR(false, "Failed to create graphics pipeline!");
         }
 
@@ -2316,8 +2262,24 @@ namespace Diffuse {
         vkDestroyShaderModule(m_device, vert_shader_module, nullptr);
     }
 
-    void GraphicsDevice::Draw(std::shared_ptr<Scene> scene, std::shared_ptr<EditorCamera> camera, float dt) {
-        vkWaitForFences(m_device, 1, &m_wait_fences[m_current_frame_index], VK_TRUE, UINT64_MAX);
+    void GraphicsDevice::Draw(const std::shared_ptr<Scene>& scene, const std::shared_ptr<EditorCamera>& camera, float dt) {
+        DIFFUSE_PROFILE_FUNCTION();
+        m_frame_wait_ms = 0.0;
+        {
+            DIFFUSE_PROFILE_SCOPE("Wait for frame fence");
+            const auto wait_start = std::chrono::steady_clock::now();
+            // Finite timeout so a stalled GPU shows up as a frame event instead of a silent hang
+            const uint64_t fence_timeout = 100ull * 1000 * 1000;
+            while (!m_graphics_timeline->Wait(m_frame_timeline_values[m_current_frame_index], fence_timeout)) {
+                Utils::FrameEvents::Record(Utils::FrameEventType::FenceTimeout, "frame timeline", fence_timeout / 1e6);
+            }
+            m_frame_wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wait_start).count();
+        }
+        m_graphics_timeline->CollectGarbage();
+        if (m_compute_timeline)
+            m_compute_timeline->CollectGarbage();
+        // Copies whose submission the timeline has passed go to the encoder, whichever frame recorded them
+        m_readback->RetireCompleted();
 
         if (m_window->IsWindowResized()) {
             RecreateSwapchain();
@@ -2326,7 +2288,9 @@ namespace Diffuse {
         }
 
         uint32_t imageIndex;
+        const auto acquire_start = std::chrono::steady_clock::now();
         VkResult result = vkAcquireNextImageKHR(m_device, m_swapchain->GetSwapchain(), UINT64_MAX, m_render_complete_semaphores[m_current_frame_index], VK_NULL_HANDLE, &imageIndex);
+        m_frame_wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - acquire_start).count();
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
             RecreateSwapchain();
@@ -2338,6 +2302,7 @@ namespace Diffuse {
             LOG_ERROR(false, "Failed to acquire swap chain image!");
         }
 
+        m_render_stats.Reset();
         {
             UBO ubo{};
             ubo.model = glm::mat4(1.0f);
@@ -2345,6 +2310,7 @@ namespace Diffuse {
             ubo.proj = camera->GetProjection();
 
             memcpy(scene->GetSkybox()->p_ubo.uniformBuffersMapped[m_current_frame_index], &ubo, sizeof(ubo));
+            m_render_stats.uniform_bytes += sizeof(ubo);
         }
 
         // Updating uniform buffers
@@ -2361,6 +2327,7 @@ namespace Diffuse {
                 //ubo.cam_pos = camera->GetPosition();
 
                 memcpy(object->p_ubo.uniformBuffersMapped[m_current_frame_index], &ubo, sizeof(ubo));
+                m_render_stats.uniform_bytes += sizeof(ubo);
             }
 
             {
@@ -2374,13 +2341,19 @@ namespace Diffuse {
                 ubo.debugViewEquation = 0.0f;
 
                 memcpy(object->p_shader_values_ubo.uniformBuffersMapped[m_current_frame_index], &ubo, sizeof(ubo));
+                m_render_stats.uniform_bytes += sizeof(ubo);
             }
+
+            object->p_model.GetInstanceData(static_cast<InstanceData*>(object->p_instances.instanceBuffersMapped[m_current_frame_index]));
+            m_render_stats.uniform_bytes += object->p_model.GetInstanceCount() * sizeof(InstanceData);
         }
 
-        vkResetFences(m_device, 1, &m_wait_fences[m_current_frame_index]);
+        if (m_skinning)
+            m_skinning->Update(m_current_frame_index);
 
         vkResetCommandBuffer(m_command_buffers[m_current_frame_index], /*VkCommandBufferResetFlagBits*/ 0);
         RecordCommandBuffer(scene, camera, m_command_buffers[m_current_frame_index], imageIndex);
+        m_last_render_stats = m_render_stats;
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -2398,9 +2371,8 @@ namespace Diffuse {
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        if (vkQueueSubmit(m_graphics_queue, 1, &submitInfo, m_wait_fences[m_current_frame_index]) != VK_SUCCESS) {
-            LOG_ERROR(false, "failed to submit draw command buffer!");
-        }
+        m_frame_timeline_values[m_current_frame_index] = m_graphics_timeline->Submit(submitInfo);
+        m_readback->OnSubmitted(m_frame_timeline_values[m_current_frame_index]);
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -2416,7 +2388,13 @@ namespace Diffuse {
 
         presentInfo.pImageIndices = &imageIndex;
 
-        result = vkQueuePresentKHR(m_present_queue, &presentInfo);
+        {
+            DIFFUSE_PROFILE_SCOPE("Present");
+            const auto present_start = std::chrono::steady_clock::now();
+            // A present to the graphics queue must not race a loader thread submitting to it
+            result = m_present_queue == m_graphics_queue ? m_graphics_timeline->Present(presentInfo) : vkQueuePresentKHR(m_present_queue, &presentInfo);
+            m_frame_wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - present_start).count();
+        }
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_window->IsWindowResized()) {
             m_window->WindowResized(false);
@@ -2429,13 +2407,33 @@ namespace Diffuse {
         m_current_frame_index = (m_current_frame_index + 1) % m_render_ahead;
     }
 
-    void GraphicsDevice::RecordCommandBuffer(std::shared_ptr<Scene> scene, std::shared_ptr<EditorCamera> camera, VkCommandBuffer command_buffer, uint32_t image_index) {
+    void GraphicsDevice::RecordCommandBuffer(const std::shared_ptr<Scene>& scene, const std::shared_ptr<EditorCamera>& camera, VkCommandBuffer command_buffer, uint32_t image_index) {
+        DIFFUSE_PROFILE_FUNCTION();
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         if (vkBeginCommandBuffer(command_buffer, &beginInfo) != VK_SUCCESS) {
             throw std::runtime_error("failed to begin recording command buffer!");
         }
 
+        // Results of the previous use of this frame slot are ready, the fence was waited on in Draw
+        m_gpu_profiler->BeginFrame(command_buffer, m_current_frame_index);
+        m_gpu_profiler->BeginScope(command_buffer, "Frame");
+        if (m_pipeline_statistics) {
+            m_pipeline_statistics->BeginFrame(command_buffer, m_current_frame_index);
+        }
+
+        // Skinned and morphed vertices have to be written before the render pass reads them
+        if (m_skinning) {
+            m_gpu_profiler->BeginScope(command_buffer, "Skinning");
+            m_skinning->Record(command_buffer, m_current_frame_index);
+            m_gpu_profiler->EndScope(command_buffer);
+            m_render_stats.skinned_vertices = m_skinning->GetSkinnedVertexCount();
+            m_render_stats.morphed_vertices = m_skinning->GetMorphedVertexCount(m_current_frame_index);
+        }
+        // Material edits since this frame slot was last recorded
+        m_materials->Record(command_buffer, m_current_frame_index);
+        m_render_stats.material_bytes = m_materials->GetUploadedBytes();
+
         // Render offscreen framebuffer
         // only once
         VkRenderPassBeginInfo renderPassInfo{};
@@ -2469,79 +2467,182 @@ namespace Diffuse {
         vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
         if (scene->GetSkybox()->p_render) {
+            BeginPass(command_buffer, "Skybox");
             vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layouts.skybox, 0, 1, &m_descriptor_sets.skybox, 0, nullptr);
             vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelines.skybox);
             VkBuffer vertexBuffers[] = { scene->GetSkybox()->p_model.m_vertices.buffer };
             VkDeviceSize offsets[] = { 0 };
             vkCmdBindVertexBuffers(command_buffer, 0, 1, vertexBuffers, offsets);
             vkCmdBindIndexBuffer(command_buffer, scene->GetSkybox()->p_model.m_indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+            m_render_stats.descriptor_set_binds++;
+            m_render_stats.pipeline_binds++;
+            m_render_stats.vertex_buffer_binds++;
+            m_render_stats.index_buffer_binds++;
             //models.skybox.draw(currentCB);
             for (auto& node : scene->GetSkybox()->p_model.GetNodes()) {
                 DrawNodeSkybox(node, command_buffer);
             }
+            EndPass(command_buffer);
         }
 
+        // One bucket per alpha mode across all objects, so blended geometry is drawn after everything opaque
+        const std::array<std::pair<Material::AlphaMode, const char*>, 3> buckets = { {
+            { Material::ALPHAMODE_OPAQUE, "Opaque" },
+            { Material::ALPHAMODE_MASK, "Mask" },
+            { Material::ALPHAMODE_BLEND, "Blend" },
+        } };
         //vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &m_descriptor_sets.scene[m_current_frame_index], 0, nullptr);
-        for (auto& object : scene->GetSceneObjects()) {
-            if (!object->p_render)
-                continue;
-            VkBuffer vertexBuffers[] = { object->p_model.m_vertices.buffer };
-            VkDeviceSize offsets[] = { 0 };
-            vkCmdBindVertexBuffers(command_buffer, 0, 1, vertexBuffers, offsets);
-            vkCmdBindIndexBuffer(command_buffer, object->p_model.m_indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-
-            for (auto& node : object->p_model.GetNodes()) {
-                DrawNode(object, node, command_buffer, Material::ALPHAMODE_OPAQUE);
-            }
+        for (auto& [alpha_mode, bucket_name] : buckets) {
+            BeginPass(command_buffer, bucket_name);
+            for (auto& object : scene->GetSceneObjects()) {
+                if (!object->p_render) {
+                    // Counted once per frame, not once per bucket
+                    if (alpha_mode == Material::ALPHAMODE_OPAQUE)
+                        m_render_stats.hidden_objects++;
+                    continue;
+                }
+                VkBuffer vertexBuffers[] = { object->p_model.m_vertices.buffer, object->p_instances.instanceBuffers[m_current_frame_index] };
+                VkDeviceSize offsets[] = { 0, 0 };
+                if (object->p_skinning_instance >= 0) {
+                    vertexBuffers[0] = m_skinning->OutputBuffer();
+                    offsets[0] = m_skinning->OutputOffset(object->p_skinning_instance);
+                }
+                vkCmdBindVertexBuffers(command_buffer, 0, 2, vertexBuffers, offsets);
+                vkCmdBindIndexBuffer(command_buffer, object->p_model.m_indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+                m_render_stats.vertex_buffer_binds++;
+                m_render_stats.index_buffer_binds++;
 
-            for (auto& node : object->p_model.GetNodes()) {
-                DrawNode(object, node, command_buffer, Material::ALPHAMODE_MASK);
+                for (const Mesh* mesh : object->p_model.GetMeshes()) {
+                    DrawMesh(object, mesh, command_buffer, alpha_mode);
+                }
             }
+            EndPass(command_buffer);
+        }
 
-            for (auto& node : object->p_model.GetNodes()) {
-                DrawNode(object, node, command_buffer, Material::ALPHAMODE_BLEND);
-            }
+        // Last thing in the render pass so it lands on top, its clears are not part of the counters
+        if (m_stats_overlay) {
+            BeginPass(command_buffer, "Stats overlay");
+            m_stats_text.Clear();
+            char gpu_time[32];
+            snprintf(gpu_time, sizeof(gpu_time), "GPU: %.2f ms", GetGpuFrameTime());
+            m_stats_text.AddLine(gpu_time);
+            m_render_stats.AddLines(m_stats_text);
+            m_stats_text.Record(command_buffer, m_swapchain->GetExtent());
+            EndPass(command_buffer);
         }
 
         vkCmdEndRenderPass(command_buffer);
 
+        if (m_readback->HasPendingRequest() && (m_swapchain->GetImageUsage() & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+            m_readback->RecordCopy(command_buffer, m_swapchain->GetSwapchainImage(image_index), m_swapchain->GetFormat(), m_swapchain->GetExtent());
+        }
+
+        m_gpu_profiler->EndScope(command_buffer);
+
         if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to record command buffer!");
         }
     }
 
-    void GraphicsDevice::DrawNode(const std::shared_ptr<SceneObject> object, Node* node, VkCommandBuffer commandBuffer, Material::AlphaMode alpha_mode) {
-        if (node->mesh) {
-            for (Primitive* primitive : node->mesh->primitives) {
-                {
-                    if (alpha_mode == Material::ALPHAMODE_BLEND) {
-                        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelines.alpha_blending);
-                    }
-                    else if (object->p_model.GetMaterial(primitive->material_index).doubleSided) {
-                        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelines.double_sided);
-                    }
-                    else {
-                        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelines.pbr);
-                    }
+    VkResult GraphicsDevice::CompileGraphicsPipeline(VkPipelineCache cache, const VkGraphicsPipelineCreateInfo& create_info, VkPipeline* pipeline, const char* name) {
+        Utils::FrameEventScope frame_event(Utils::FrameEventType::PipelineCompile, name);
+        return vkCreateGraphicsPipelines(m_device, cache, 1, &create_info, nullptr, pipeline);
+    }
+
+    void GraphicsDevice::BeginPass(VkCommandBuffer command_buffer, const char* name) {
+        m_gpu_profiler->BeginScope(command_buffer, name);
+        if (m_pipeline_statistics)
+            m_pipeline_statistics->BeginPass(command_buffer, name);
+    }
+
+    void GraphicsDevice::EndPass(VkCommandBuffer command_buffer) {
+        if (m_pipeline_statistics)
+            m_pipeline_statistics->EndPass(command_buffer);
+        m_gpu_profiler->EndScope(command_buffer);
+    }
+
+    void GraphicsDevice::DrawMesh(const std::shared_ptr<SceneObject>& object, const Mesh* mesh, VkCommandBuffer commandBuffer, Material::AlphaMode alpha_mode) {
+        const uint32_t instance_count = static_cast<uint32_t>(mesh->instances.size());
+        for (Primitive* primitive : mesh->primitives) {
+            if (object->p_model.GetMaterial(primitive->material_index > -1 ? primitive->material_index : 0).alphaMode != alpha_mode)
+                continue;
+            {
+                if (alpha_mode == Material::ALPHAMODE_BLEND) {
+                    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelines.alpha_blending);
                 }
-                uint32_t index = primitive->material_index > -1 ? primitive->material_index : 0;
-    			const std::vector<VkDescriptorSet> descriptorsets = {
-                    object->p_model.GetMaterial(index).descriptorSet,
-					m_descriptor_sets.ibl,
-                    object->p_mat_descritpor_set
-				};
-                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layouts.scene, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), 0, NULL);
-                vkCmdPushConstants(commandBuffer, m_pipeline_layouts.scene, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &primitive->material_index);
-
-                //vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layouts.scene, 0, 1, 
-                //    &m_models[0]->GetMaterial(index).descriptorSet, 0, NULL);
-                //vkCmdDraw(commandBuffer, primitive->vertex_count, 1, 0, 0);
-                vkCmdDrawIndexed(commandBuffer, primitive->index_count, 1, primitive->first_index, 0, 0);
+                else if (object->p_model.GetMaterial(primitive->material_index).doubleSided) {
+                    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelines.double_sided);
+                }
+                else {
+                    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelines.pbr);
+                }
+                m_render_stats.pipeline_binds++;
             }
+            uint32_t index = primitive->material_index > -1 ? primitive->material_index : 0;
+            const std::array<VkDescriptorSet, 3> descriptorsets = {
+                object->p_model.GetMaterial(index).descriptorSet,
+                m_descriptor_sets.ibl,
+                m_descriptor_sets.materialBuffer
+            };
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layouts.scene, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), 0, NULL);
+            vkCmdPushConstants(commandBuffer, m_pipeline_layouts.scene, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &object->p_model.GetMaterial(index).tableIndex);
+            m_render_stats.descriptor_set_binds++;
+            m_render_stats.push_constants++;
+
+            //vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layouts.scene, 0, 1, 
+            //    &m_models[0]->GetMaterial(index).descriptorSet, 0, NULL);
+            //vkCmdDraw(commandBuffer, primitive->vertex_count, 1, 0, 0);
+            vkCmdDrawIndexed(commandBuffer, primitive->index_count, instance_count, primitive->first_index, 0, mesh->first_instance);
+            m_render_stats.draws++;
+            m_render_stats.instances += instance_count;
+            m_render_stats.triangles += primitive->index_count / 3 * instance_count;
         }
-        for (auto& child : node->children) {
-            DrawNode(object, child, commandBuffer, alpha_mode);
+    }
+
+    bool GraphicsDevice::UpdateMaterial(const std::shared_ptr<SceneObject>& object, uint32_t material) {
+        Material& model_material = object->p_model.GetMaterial(material);
+        return m_materials->Update(model_material.tableIndex, MakeShaderMaterial(model_material));
+    }
+
+    void GraphicsDevice::SetUntexturedMaterials(bool untextured) {
+        if (untextured == m_untextured_materials || !m_active_scene)
+            return;
+        m_untextured_materials = untextured;
+
+        std::vector<std::pair<std::weak_ptr<SceneObject>, uint32_t>> edits;
+        for (const std::shared_ptr<SceneObject>& object : m_active_scene->GetSceneObjects()) {
+            for (uint32_t material = 0; material < object->p_model.GetMaterials().size(); material++) {
+                edits.emplace_back(object, material);
+            }
         }
+
+        // Every step edits a batch of materials, the next frame copies each changed table entry.
+        // Toggling again before the last step supersedes the rest, the new task edits everything.
+        const uint64_t generation = ++m_material_edit_generation;
+        auto step_bytes = [](size_t remaining) { return std::min<uint64_t>(remaining, s_material_edits_per_step) * sizeof(ShaderMaterial); };
+        Utils::BackgroundTask task;
+        task.name = "Material edits";
+        // Every draw changes
+        task.visibility = 1.0f;
+        task.bytes = step_bytes(edits.size());
+        task.step = [this, generation, step_bytes, edits = std::move(edits), next = size_t(0), failed = uint32_t(0)](Utils::BackgroundTask& pending) mutable {
+            if (generation != m_material_edit_generation)
+                return true;
+            const size_t end = std::min<size_t>(edits.size(), next + s_material_edits_per_step);
+            for (; next < end; next++) {
+                if (std::shared_ptr<SceneObject> object = edits[next].first.lock()) {
+                    if (!UpdateMaterial(object, edits[next].second))
+                        failed++;
+                }
+            }
+            pending.bytes = step_bytes(edits.size() - next);
+            if (next < edits.size())
+                return false;
+            if (failed > 0)
+                std::cout << failed << " materials kept their parameters, the material table is full" << std::endl;
+            return true;
+        };
+        m_background_tasks.Add(std::move(task));
     }
 
     void GraphicsDevice::DrawNodeSkybox(Node* node, VkCommandBuffer commandBuffer) {
@@ -2549,6 +2650,9 @@ namespace Diffuse {
             for (Primitive* primitive : node->mesh->primitives) {
                 uint32_t index = primitive->material_index > -1 ? primitive->material_index : 0;
                 vkCmdDrawIndexed(commandBuffer, primitive->index_count, 1, primitive->first_index, 0, 0);
+                m_render_stats.draws++;
+                m_render_stats.instances++;
+                m_render_stats.triangles += primitive->index_count / 3;
             }
         }
         for (auto& child : node->children) {
@@ -2567,8 +2671,11 @@ namespace Diffuse {
     }
 
     void GraphicsDevice::CleanUp(const Config& config) {
-        glfwWaitEvents();
+        // Never blocks, a hidden window may not receive another event
+        glfwPollEvents();
         vkDeviceWaitIdle(m_device);
+        m_readback->OnDeviceIdle();
+        m_readback->Destroy();
         CleanUpSwapchain();
         for (size_t i = 0; i < m_render_ahead; i++) {
             vkDestroyBuffer(m_device, m_active_scene->GetSkybox()->p_ubo.uniformBuffers[i], nullptr);
@@ -2582,10 +2689,10 @@ namespace Diffuse {
 
                 vkDestroyBuffer(m_device, m_active_scene->GetSceneObjects()[index]->p_shader_values_ubo.uniformBuffers[i], nullptr);
                 vkFreeMemory(m_device, m_active_scene->GetSceneObjects()[index]->p_shader_values_ubo.uniformBuffersMemory[i], nullptr);
-            }
-            vkDestroyBuffer(m_device, m_active_scene->GetSceneObjects()[index]->p_shader_material_buffer.buffer, nullptr);
-            vkFreeMemory(m_device, m_active_scene->GetSceneObjects()[index]->p_shader_material_buffer.memory, nullptr);
 
+                vkDestroyBuffer(m_device, m_active_scene->GetSceneObjects()[index]->p_instances.instanceBuffers[i], nullptr);
+                vkFreeMemory(m_device, m_active_scene->GetSceneObjects()[index]->p_instances.instanceBuffersMemory[i], nullptr);
+            }
             // delete vertices
             vkDestroyBuffer(m_device, m_active_scene->GetSceneObjects()[index]->p_model.m_vertices.buffer, nullptr);
             vkFreeMemory(m_device, m_active_scene->GetSceneObjects()[index]->p_model.m_vertices.memory, nullptr);
@@ -2627,11 +2734,6 @@ namespace Diffuse {
         vkDestroyImage(m_device, m_env_texuture.image, nullptr);
         vkFreeMemory(m_device, m_env_texuture.memory, nullptr);
         vkDestroySampler(m_device, m_env_texuture.sampler, nullptr);
-        // m_cubemap
-        vkDestroyImageView(m_device, m_cubemap.view, nullptr);
-        vkDestroyImage(m_device, m_cubemap.image, nullptr);
-        vkFreeMemory(m_device, m_cubemap.memory, nullptr);
-        vkDestroySampler(m_device, m_cubemap.sampler, nullptr);
         // m_brdf_lut
         vkDestroyImageView(m_device, m_brdf_lut.view, nullptr);
         vkDestroyImage(m_device, m_brdf_lut.image, nullptr);
@@ -2667,11 +2769,25 @@ namespace Diffuse {
         for (size_t i = 0; i < m_render_ahead; i++) {
             vkDestroySemaphore(m_device, m_render_complete_semaphores[i], nullptr);
             vkDestroySemaphore(m_device, m_present_complete_semaphores[i], nullptr);
-            vkDestroyFence(m_device, m_wait_fences[i], nullptr);
+        }
+        if (m_skinning)
+            m_skinning->Destroy();
+        m_materials->Destroy();
+        m_graphics_timeline->Destroy();
+        if (m_compute_timeline) {
+            m_compute_timeline->Destroy();
+            vkDestroyCommandPool(m_device, m_compute_command_pool, nullptr);
         }
         
+        m_gpu_profiler->Destroy();
+        if (m_pipeline_statistics)
+            m_pipeline_statistics->Destroy();
         vkFreeCommandBuffers(m_device, m_command_pool, m_command_buffers.size(), m_command_buffers.data());
         vkDestroyCommandPool(m_device, m_command_pool, nullptr);
+        for (auto& [thread, pool] : m_thread_command_pools) {
+            vkDestroyCommandPool(m_device, pool, nullptr);
+        }
+        m_thread_command_pools.clear();
         vkDestroyDevice(m_device, nullptr);
         if (config.enable_validation_layers)
             vkUtilities::DestroyDebugUtilsMessengerEXT(m_instance, m_debug_messenger, nullptr);
@@ -2682,6 +2798,7 @@ namespace Diffuse {
     }
 
     void GraphicsDevice::RecreateSwapchain() {
+        Utils::FrameEventScope frame_event(Utils::FrameEventType::Resize, "GraphicsDevice::RecreateSwapchain");
         int width = 0, height = 0;
         glfwGetFramebufferSize(m_window->window(), &width, &height);
         while (width == 0 || height == 0) {
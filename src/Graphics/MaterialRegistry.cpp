@@ -0,0 +1,130 @@
+#include "MaterialRegistry.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace Diffuse {
+	// The members are packed without padding up to here, the tail padding is never compared
+	static constexpr size_t s_material_bytes = offsetof(ShaderMaterial, emissiveStrength) + sizeof(float);
+	static_assert(sizeof(ShaderMaterial) == 112, "pbr.frag reads ShaderMaterial with std430 layout");
+
+	MaterialRegistry::MaterialRegistry(uint32_t capacity) {
+		m_capacity = capacity;
+		m_entries.reserve(capacity);
+		m_dirty.reserve(capacity);
+	}
+
+	uint64_t MaterialRegistry::Hash(const ShaderMaterial& material) {
+		// FNV-1a
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&material);
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < s_material_bytes; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool MaterialRegistry::Equal(const ShaderMaterial& a, const ShaderMaterial& b) {
+		return std::memcmp(&a, &b, s_material_bytes) == 0;
+	}
+
+	uint32_t MaterialRegistry::Find(uint64_t hash, const ShaderMaterial& material) const {
+		auto [begin, end] = m_lookup.equal_range(hash);
+		for (auto it = begin; it != end; ++it) {
+			if (Equal(m_entries[it->second].material, material))
+				return it->second;
+		}
+		return s_invalid_id;
+	}
+
+	void MaterialRegistry::MarkDirty(uint32_t id) {
+		if (!m_entries[id].dirty) {
+			m_entries[id].dirty = true;
+			m_dirty.push_back(id);
+		}
+	}
+
+	uint32_t MaterialRegistry::Acquire(const ShaderMaterial& material) {
+		const uint64_t hash = Hash(material);
+		uint32_t id = Find(hash, material);
+		if (id != s_invalid_id) {
+			m_entries[id].references++;
+			m_references++;
+			return id;
+		}
+
+		if (!m_free.empty()) {
+			id = m_free.back();
+			m_free.pop_back();
+		}
+		else {
+			if (IsFull()) {
+				throw std::runtime_error("Material table is full, it holds " + std::to_string(m_capacity) + " materials");
+			}
+			id = static_cast<uint32_t>(m_entries.size());
+			m_entries.emplace_back();
+		}
+		Entry& entry = m_entries[id];
+		entry.material = material;
+		entry.hash = hash;
+		entry.references = 1;
+		m_lookup.emplace(hash, id);
+		m_references++;
+		MarkDirty(id);
+		return id;
+	}
+
+	void MaterialRegistry::Release(uint32_t id) {
+		Entry& entry = m_entries[id];
+		if (entry.references == 0) {
+			throw std::runtime_error("Material " + std::to_string(id) + " released more often than acquired");
+		}
+		m_references--;
+		if (--entry.references > 0)
+			return;
+		auto [begin, end] = m_lookup.equal_range(entry.hash);
+		for (auto it = begin; it != end; ++it) {
+			if (it->second == id) {
+				m_lookup.erase(it);
+				break;
+			}
+		}
+		m_free.push_back(id);
+	}
+
+	bool MaterialRegistry::Update(uint32_t& id, const ShaderMaterial& material) {
+		if (Equal(m_entries[id].material, material))
+			return true;
+		// Only a shared id needs a second one, Release hands back an id that was referenced once
+		if (m_entries[id].references > 1 && IsFull() && Find(Hash(material), material) == s_invalid_id)
+			return false;
+		Release(id);
+		id = Acquire(material);
+		return true;
+	}
+
+	void MaterialRegistry::CollectDirty(std::vector<MaterialRange>& ranges) {
+		ranges.clear();
+		std::sort(m_dirty.begin(), m_dirty.end());
+		for (uint32_t id : m_dirty) {
+			m_entries[id].dirty = false;
+			if (!ranges.empty() && ranges.back().first + ranges.back().count == id) {
+				ranges.back().count++;
+			}
+			else {
+				ranges.push_back({ id, 1 });
+			}
+		}
+		m_dirty.clear();
+	}
+
+	void MaterialRegistry::Clear() {
+		m_entries.clear();
+		m_free.clear();
+		m_lookup.clear();
+		m_dirty.clear();
+		m_references = 0;
+	}
+}
@@ -0,0 +1,64 @@
+#include "MaterialTable.hpp"
+
+#include "GraphicsDevice.hpp"
+
+#include <cstring>
+
+namespace Diffuse {
+	MaterialTable::MaterialTable(GraphicsDevice* device, uint32_t frames_in_flight, uint32_t capacity) : m_registry(capacity) {
+		m_device = device;
+		const VkDeviceSize size = VkDeviceSize(capacity) * sizeof(ShaderMaterial);
+		VK_CHECK_RESULT(vkUtilities::CreateBuffer(device->Device(), device->PhysicalDevice(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_buffer, size));
+		m_staging.resize(frames_in_flight);
+		for (Buffer& staging : m_staging) {
+			VK_CHECK_RESULT(vkUtilities::CreateBuffer(device->Device(), device->PhysicalDevice(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, size));
+			staging.Map();
+		}
+		m_ranges.reserve(capacity);
+		m_copies.reserve(capacity);
+	}
+
+	void MaterialTable::Record(VkCommandBuffer command_buffer, uint32_t frame_index) {
+		m_uploaded_bytes = 0;
+		m_registry.CollectDirty(m_ranges);
+		if (m_ranges.empty())
+			return;
+
+		// The staging slice mirrors the layout of the table, one copy per range of neighbouring ids
+		char* staging = static_cast<char*>(m_staging[frame_index].mapped);
+		m_copies.clear();
+		for (const MaterialRange& range : m_ranges) {
+			const VkDeviceSize offset = VkDeviceSize(range.first) * sizeof(ShaderMaterial);
+			for (uint32_t i = 0; i < range.count; i++) {
+				std::memcpy(staging + offset + i * sizeof(ShaderMaterial), &m_registry.Get(range.first + i), sizeof(ShaderMaterial));
+			}
+			m_copies.push_back({ offset, offset, VkDeviceSize(range.count) * sizeof(ShaderMaterial) });
+			m_uploaded_bytes += m_copies.back().size;
+		}
+
+		// Earlier frames may still read the entries being replaced
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		vkCmdCopyBuffer(command_buffer, m_staging[frame_index].buffer, m_buffer.buffer, static_cast<uint32_t>(m_copies.size()), m_copies.data());
+		VkBufferMemoryBarrier barrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = m_buffer.buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+	}
+
+	void MaterialTable::Destroy() {
+		for (Buffer& staging : m_staging) {
+			staging.Unmap();
+			staging.Destroy();
+		}
+		m_staging.clear();
+		m_buffer.Destroy();
+		m_registry.Clear();
+	}
+}
@@ -0,0 +1,135 @@
+#include "PipelineStatistics.hpp"
+
+#include "GraphicsDevice.hpp"
+
+#include <iostream>
+
+namespace Diffuse {
+	// Counters are written in ascending bit order
+	static constexpr VkQueryPipelineStatisticFlags s_statistic_flags =
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+	static constexpr uint32_t s_counter_count = 5;
+
+	PipelineStatistics::PipelineStatistics(GraphicsDevice* device, uint32_t frames_in_flight, bool precise_occlusion, uint32_t max_passes) {
+		m_device = device;
+		m_max_passes = max_passes;
+		m_frames.resize(frames_in_flight);
+		m_counters.resize(max_passes * s_counter_count);
+		m_samples.resize(max_passes);
+
+		for (auto& block : m_frames) {
+			VkQueryPoolCreateInfo query_pool_info{};
+			query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			query_pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			query_pool_info.queryCount = m_max_passes;
+			query_pool_info.pipelineStatistics = s_statistic_flags;
+			if (vkCreateQueryPool(m_device->Device(), &query_pool_info, nullptr, &block.pool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create pipeline statistics query pool");
+			}
+			// Without occlusionQueryPrecise a result may only tell whether any sample passed
+			if (precise_occlusion) {
+				query_pool_info.queryType = VK_QUERY_TYPE_OCCLUSION;
+				query_pool_info.pipelineStatistics = 0;
+				if (vkCreateQueryPool(m_device->Device(), &query_pool_info, nullptr, &block.occlusion_pool) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create occlusion query pool");
+				}
+			}
+			block.passes.reserve(m_max_passes);
+		}
+	}
+
+	void PipelineStatistics::BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_index) {
+		m_current_frame = frame_index;
+		QueryBlock& block = m_frames[frame_index];
+
+		if (block.reset && !block.passes.empty()) {
+			Resolve(block);
+			Log();
+		}
+
+		block.passes.clear();
+		vkCmdResetQueryPool(command_buffer, block.pool, 0, m_max_passes);
+		if (block.occlusion_pool)
+			vkCmdResetQueryPool(command_buffer, block.occlusion_pool, 0, m_max_passes);
+		block.reset = true;
+	}
+
+	void PipelineStatistics::BeginPass(VkCommandBuffer command_buffer, const char* name) {
+		QueryBlock& block = m_frames[m_current_frame];
+		assert(!block.active);
+		if (block.passes.size() >= m_max_passes)
+			return;
+
+		Pass pass{ name, static_cast<uint32_t>(block.passes.size()) };
+		vkCmdBeginQuery(command_buffer, block.pool, pass.query, 0);
+		if (block.occlusion_pool)
+			vkCmdBeginQuery(command_buffer, block.occlusion_pool, pass.query, VK_QUERY_CONTROL_PRECISE_BIT);
+		block.passes.push_back(pass);
+		block.active = true;
+	}
+
+	void PipelineStatistics::EndPass(VkCommandBuffer command_buffer) {
+		QueryBlock& block = m_frames[m_current_frame];
+		if (!block.active)
+			return;
+		if (block.occlusion_pool)
+			vkCmdEndQuery(command_buffer, block.occlusion_pool, block.passes.back().query);
+		vkCmdEndQuery(command_buffer, block.pool, block.passes.back().query);
+		block.active = false;
+	}
+
+	void PipelineStatistics::Resolve(QueryBlock& block) {
+		const uint32_t count = static_cast<uint32_t>(block.passes.size());
+		const VkDeviceSize stride = s_counter_count * sizeof(uint64_t);
+		if (vkGetQueryPoolResults(m_device->Device(), block.pool, 0, count, count * stride, m_counters.data(), stride, VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+			m_results.clear();
+			return;
+		}
+		const bool has_samples = block.occlusion_pool &&
+			vkGetQueryPoolResults(m_device->Device(), block.occlusion_pool, 0, count, count * sizeof(uint64_t), m_samples.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+
+		m_results.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			const uint64_t* counters = &m_counters[i * s_counter_count];
+			PipelineStatisticsResult& result = m_results[i];
+			result.name = block.passes[i].name;
+			result.input_vertices = counters[0];
+			result.input_primitives = counters[1];
+			result.vertex_invocations = counters[2];
+			result.clipping_primitives = counters[3];
+			result.fragment_invocations = counters[4];
+			result.covered_samples = has_samples ? m_samples[i] : 0;
+			result.overdraw = result.covered_samples > 0 ? double(result.fragment_invocations) / double(result.covered_samples) : 0.0;
+		}
+	}
+
+	void PipelineStatistics::Log() {
+		if (m_log_interval == 0 || ++m_frames_since_log < m_log_interval)
+			return;
+		m_frames_since_log = 0;
+
+		for (auto& result : m_results) {
+			std::cout << "Pipeline statistics " << result.name
+				<< ": vertices " << result.input_vertices
+				<< ", primitives " << result.input_primitives
+				<< ", vs invocations " << result.vertex_invocations
+				<< ", clipped primitives " << result.clipping_primitives
+				<< ", fs invocations " << result.fragment_invocations
+				<< ", covered samples " << result.covered_samples
+				<< ", overdraw " << result.overdraw << std::endl;
+		}
+	}
+
+	void PipelineStatistics::Destroy() {
+		for (auto& block : m_frames) {
+			vkDestroyQueryPool(m_device->Device(), block.pool, nullptr);
+			if (block.occlusion_pool)
+				vkDestroyQueryPool(m_device->Device(), block.occlusion_pool, nullptr);
+		}
+		m_frames.clear();
+	}
+}
@@ -0,0 +1,251 @@
+#include "ReadbackRing.hpp"
+
+#include "GraphicsDevice.hpp"
+
+#include "stb_image_write.h"
+
+#include <cstdio>
+#include <iostream>
+
+namespace Diffuse {
+	ReadbackRing::ReadbackRing(GraphicsDevice* device, uint32_t slot_count) {
+		m_device = device;
+		m_slots.resize(slot_count);
+		m_worker = std::thread(&ReadbackRing::WorkerLoop, this);
+	}
+
+	ReadbackRing::~ReadbackRing() {
+		StopWorker();
+	}
+
+	void ReadbackRing::RequestCapture(const std::string& path) {
+		m_requests.push_back(path);
+	}
+
+	void ReadbackRing::SetContinuousCapture(const std::string& directory) {
+		m_continuous_directory = directory;
+		m_continuous_counter = 0;
+	}
+
+	void ReadbackRing::EnsureSlotSize(Slot& slot, VkDeviceSize size) {
+		if (slot.buffer.buffer != VK_NULL_HANDLE && slot.buffer.size >= size)
+			return;
+
+		if (slot.buffer.buffer != VK_NULL_HANDLE) {
+			slot.buffer.Unmap();
+			slot.buffer.Destroy();
+			slot.buffer = Buffer{};
+		}
+
+		// Prefer cached memory so the encoder reads at full speed, not every device exposes it
+		try {
+			vkUtilities::CreateBuffer(m_device->Device(), m_device->PhysicalDevice(), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &slot.buffer, size);
+		}
+		catch (const std::runtime_error&) {
+			// The buffer handle was created before the memory type lookup failed
+			slot.buffer.Destroy();
+			slot.buffer = Buffer{};
+			vkUtilities::CreateBuffer(m_device->Device(), m_device->PhysicalDevice(), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &slot.buffer, size);
+		}
+		// Stays persistently mapped for the lifetime of the slot
+		slot.buffer.Map();
+	}
+
+	bool ReadbackRing::RecordCopy(VkCommandBuffer command_buffer, VkImage image, VkFormat format, VkExtent2D extent) {
+		if (!HasPendingRequest())
+			return false;
+
+		std::string path;
+		if (!m_requests.empty()) {
+			path = m_requests.front();
+		}
+		else {
+			char name[32];
+			snprintf(name, sizeof(name), "/frame_%05llu.png", static_cast<unsigned long long>(m_continuous_counter));
+			path = m_continuous_directory + name;
+		}
+
+		int slot_index = -1;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t i = 0; i < m_slots.size(); i++) {
+				if (m_slots[i].state == SlotState::Free) {
+					slot_index = static_cast<int>(i);
+					break;
+				}
+			}
+		}
+		// Never wait on the encoder from the render thread, skip this frame instead
+		if (slot_index < 0) {
+			m_dropped++;
+			return false;
+		}
+
+		if (!m_requests.empty())
+			m_requests.pop_front();
+		else
+			m_continuous_counter++;
+
+		Slot& slot = m_slots[slot_index];
+		EnsureSlotSize(slot, static_cast<VkDeviceSize>(extent.width) * extent.height * 4);
+		slot.state = SlotState::Recorded;
+		slot.timeline_value = 0;
+		slot.width = extent.width;
+		slot.height = extent.height;
+		slot.format = format;
+		slot.path = path;
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy region{};
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageExtent = { extent.width, extent.height, 1 };
+		vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &region);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		VkBufferMemoryBarrier buffer_barrier{};
+		buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		buffer_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		buffer_barrier.buffer = slot.buffer.buffer;
+		buffer_barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &buffer_barrier, 1, &barrier);
+
+		return true;
+	}
+
+	void ReadbackRing::OnSubmitted(uint64_t timeline_value) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (Slot& slot : m_slots) {
+			if (slot.state == SlotState::Recorded) {
+				slot.state = SlotState::InFlight;
+				slot.timeline_value = timeline_value;
+			}
+		}
+	}
+
+	void ReadbackRing::RetireCompleted() {
+		GpuTimeline& timeline = m_device->GraphicsTimeline();
+		bool handed_off = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (uint32_t i = 0; i < m_slots.size(); i++) {
+				if (m_slots[i].state == SlotState::InFlight && timeline.IsComplete(m_slots[i].timeline_value)) {
+					HandOff(i);
+					handed_off = true;
+				}
+			}
+		}
+		if (handed_off)
+			m_condition.notify_one();
+	}
+
+	void ReadbackRing::OnDeviceIdle() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (uint32_t i = 0; i < m_slots.size(); i++) {
+				if (m_slots[i].state == SlotState::InFlight) {
+					HandOff(i);
+				}
+				else if (m_slots[i].state == SlotState::Recorded) {
+					// Never submitted, the buffer holds nothing to encode
+					m_slots[i].state = SlotState::Free;
+					m_dropped++;
+				}
+			}
+		}
+		m_condition.notify_one();
+	}
+
+	bool ReadbackRing::HasCapturesInFlight() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const Slot& slot : m_slots) {
+			if (slot.state != SlotState::Free)
+				return true;
+		}
+		return false;
+	}
+
+	// m_mutex has to be held by the caller
+	void ReadbackRing::HandOff(uint32_t slot_index) {
+		m_slots[slot_index].state = SlotState::Encoding;
+		m_encode_queue.push_back(slot_index);
+	}
+
+	void ReadbackRing::WorkerLoop() {
+		while (true) {
+			uint32_t slot_index;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_stop || !m_encode_queue.empty(); });
+				if (m_encode_queue.empty())
+					return;
+				slot_index = m_encode_queue.front();
+				m_encode_queue.pop_front();
+			}
+
+			Encode(m_slots[slot_index]);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_slots[slot_index].state = SlotState::Free;
+		}
+	}
+
+	void ReadbackRing::Encode(Slot& slot) {
+		if ((slot.buffer.memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
+			slot.buffer.Invalidate();
+
+		uint8_t* pixels = static_cast<uint8_t*>(slot.buffer.mapped);
+		const size_t texel_count = static_cast<size_t>(slot.width) * slot.height;
+
+		// Swapchain images are usually BGRA, png wants RGBA. Alpha is forced opaque.
+		const bool bgra = slot.format == VK_FORMAT_B8G8R8A8_SRGB || slot.format == VK_FORMAT_B8G8R8A8_UNORM;
+		for (size_t i = 0; i < texel_count; i++) {
+			uint8_t* texel = pixels + i * 4;
+			if (bgra)
+				std::swap(texel[0], texel[2]);
+			texel[3] = 255;
+		}
+
+		if (!stbi_write_png(slot.path.c_str(), slot.width, slot.height, 4, pixels, slot.width * 4)) {
+			std::cout << "Failed to write capture " << slot.path << std::endl;
+		}
+	}
+
+	void ReadbackRing::StopWorker() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_condition.notify_one();
+		if (m_worker.joinable())
+			m_worker.join();
+	}
+
+	void ReadbackRing::Destroy() {
+		StopWorker();
+		for (auto& slot : m_slots) {
+			slot.buffer.Unmap();
+			slot.buffer.Destroy();
+		}
+		m_slots.clear();
+	}
+}
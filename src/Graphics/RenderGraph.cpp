@@ -0,0 +1,439 @@
+#include "RenderGraph.hpp"
+
+#include "VulkanUtilities.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace Diffuse {
+	struct UsageInfo {
+		VkPipelineStageFlags stages;
+		VkAccessFlags read_access;
+		VkAccessFlags write_access;
+		VkImageLayout layout;
+		VkImageUsageFlags image_usage;
+	};
+
+	static UsageInfo GetUsageInfo(ResourceUsage usage) {
+		switch (usage) {
+		case ResourceUsage::SampledFragment:
+			return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+		case ResourceUsage::SampledCompute:
+			return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+		case ResourceUsage::StorageCompute:
+			return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+		case ResourceUsage::ColorAttachment:
+			return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+		case ResourceUsage::DepthAttachment:
+			return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+		case ResourceUsage::TransferSrc:
+			return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+		case ResourceUsage::TransferDst:
+			return { VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT };
+		}
+		throw std::runtime_error("Unknown render graph resource usage");
+	}
+
+	void RenderGraph::PassBuilder::Read(RenderGraphImage image, ResourceUsage usage, VkImageSubresourceRange range) {
+		m_graph->AddAccess(m_pass, image, usage, range, false);
+	}
+
+	void RenderGraph::PassBuilder::Write(RenderGraphImage image, ResourceUsage usage, VkImageSubresourceRange range) {
+		m_graph->AddAccess(m_pass, image, usage, range, true);
+	}
+
+	void RenderGraph::PassBuilder::SideEffect() {
+		m_graph->m_passes[m_pass].side_effect = true;
+	}
+
+	RenderGraph::RenderGraph(VkDevice device, VkPhysicalDevice physical_device) {
+		m_device = device;
+		m_physical_device = physical_device;
+	}
+
+	RenderGraphImage RenderGraph::Import(const std::string& name, VkImage image, const ImageDesc& desc, VkImageLayout current_layout) {
+		Image& imported = m_images.emplace_back();
+		imported.name = name;
+		imported.desc = desc;
+		imported.image = image;
+		imported.initial_layout = current_layout;
+		return static_cast<RenderGraphImage>(m_images.size() - 1);
+	}
+
+	RenderGraphImage RenderGraph::CreateTransient(const std::string& name, const ImageDesc& desc) {
+		Image& transient = m_images.emplace_back();
+		transient.name = name;
+		transient.desc = desc;
+		transient.transient = true;
+		return static_cast<RenderGraphImage>(m_images.size() - 1);
+	}
+
+	void RenderGraph::SetFinalUsage(RenderGraphImage image, ResourceUsage usage) {
+		m_images[image].has_final_usage = true;
+		m_images[image].final_usage = usage;
+	}
+
+	void RenderGraph::AddPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, std::function<void(VkCommandBuffer)> execute) {
+		assert(!m_compiled && "Passes have to be added before Compile()");
+		Pass& pass = m_passes.emplace_back();
+		pass.name = name;
+		pass.execute = std::move(execute);
+		PassBuilder builder(this, static_cast<uint32_t>(m_passes.size() - 1));
+		setup(builder);
+	}
+
+	void RenderGraph::AddAccess(uint32_t pass, RenderGraphImage image, ResourceUsage usage, VkImageSubresourceRange range, bool write) {
+		const ImageDesc& desc = m_images[image].desc;
+		if (range.aspectMask == 0)
+			range.aspectMask = desc.aspect;
+		if (range.levelCount == VK_REMAINING_MIP_LEVELS)
+			range.levelCount = desc.mip_levels - range.baseMipLevel;
+		if (range.layerCount == VK_REMAINING_ARRAY_LAYERS)
+			range.layerCount = desc.array_layers - range.baseArrayLayer;
+		assert(range.baseMipLevel + range.levelCount <= desc.mip_levels);
+		assert(range.baseArrayLayer + range.layerCount <= desc.array_layers);
+		m_passes[pass].accesses.push_back({ image, usage, range, write });
+	}
+
+	void RenderGraph::Compile() {
+		CullPasses();
+		CreateTransients();
+		for (Image& image : m_images) {
+			SubresourceState state;
+			state.layout = image.initial_layout;
+			image.states.assign(static_cast<size_t>(image.desc.mip_levels) * image.desc.array_layers, state);
+		}
+		m_compiled = true;
+	}
+
+	void RenderGraph::CullPasses() {
+		// Walk backwards from what leaves the graph, a pass survives if a live consumer needs what it writes
+		std::vector<bool> needed(m_images.size(), false);
+		for (size_t i = 0; i < m_images.size(); i++) {
+			needed[i] = !m_images[i].transient || m_images[i].has_final_usage;
+		}
+
+		for (size_t p = m_passes.size(); p-- > 0;) {
+			Pass& pass = m_passes[p];
+			bool live = pass.side_effect;
+			for (const Access& access : pass.accesses) {
+				live |= access.write && needed[access.image];
+			}
+			pass.culled = !live;
+			if (!live)
+				continue;
+			for (const Access& access : pass.accesses) {
+				if (!access.write)
+					needed[access.image] = true;
+			}
+		}
+
+		m_stats.passes = static_cast<uint32_t>(m_passes.size());
+		m_stats.culled_passes = 0;
+		for (uint32_t p = 0; p < m_passes.size(); p++) {
+			if (m_passes[p].culled) {
+				m_stats.culled_passes++;
+				continue;
+			}
+			for (const Access& access : m_passes[p].accesses) {
+				Image& image = m_images[access.image];
+				image.first_pass = std::min(image.first_pass, p);
+				image.last_pass = std::max(image.last_pass, p);
+			}
+		}
+		// The final transition is recorded after every pass, nothing may alias the image until then
+		for (Image& image : m_images) {
+			if (image.has_final_usage && image.first_pass != UINT32_MAX)
+				image.last_pass = static_cast<uint32_t>(m_passes.size());
+		}
+	}
+
+	void RenderGraph::CreateTransients() {
+		struct Placement {
+			RenderGraphImage image;
+			VkMemoryRequirements requirements;
+		};
+		std::vector<Placement> placements;
+
+		for (RenderGraphImage i = 0; i < m_images.size(); i++) {
+			Image& image = m_images[i];
+			if (!image.transient || image.first_pass == UINT32_MAX)
+				continue;
+
+			VkImageUsageFlags usage = image.desc.usage;
+			for (const Pass& pass : m_passes) {
+				for (const Access& access : pass.accesses) {
+					if (access.image == i)
+						usage |= GetUsageInfo(access.usage).image_usage;
+				}
+			}
+			if (image.has_final_usage)
+				usage |= GetUsageInfo(image.final_usage).image_usage;
+
+			VkImageCreateInfo image_info = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+			image_info.flags = image.desc.flags;
+			image_info.imageType = VK_IMAGE_TYPE_2D;
+			image_info.format = image.desc.format;
+			image_info.extent = { image.desc.width, image.desc.height, 1 };
+			image_info.mipLevels = image.desc.mip_levels;
+			image_info.arrayLayers = image.desc.array_layers;
+			image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+			image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image_info.usage = usage;
+			image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			if (vkCreateImage(m_device, &image_info, nullptr, &image.image) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create render graph image " + image.name);
+			}
+
+			Placement placement;
+			placement.image = i;
+			vkGetImageMemoryRequirements(m_device, image.image, &placement.requirements);
+			placements.push_back(placement);
+			m_stats.transient_bytes += placement.requirements.size;
+		}
+
+		// Largest first, every image goes to the first block it fits in without overlapping the lifetime of a tenant
+		std::sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b) {
+			return a.requirements.size > b.requirements.size;
+		});
+		for (const Placement& placement : placements) {
+			Image& image = m_images[placement.image];
+			for (uint32_t b = 0; b < m_memory_blocks.size() && image.memory_block == UINT32_MAX; b++) {
+				MemoryBlock& block = m_memory_blocks[b];
+				if ((block.memory_type_bits & placement.requirements.memoryTypeBits) == 0)
+					continue;
+				const bool overlaps = std::any_of(block.images.begin(), block.images.end(), [&](RenderGraphImage other) {
+					return m_images[other].first_pass <= image.last_pass && image.first_pass <= m_images[other].last_pass;
+				});
+				if (!overlaps)
+					image.memory_block = b;
+			}
+			if (image.memory_block == UINT32_MAX) {
+				image.memory_block = static_cast<uint32_t>(m_memory_blocks.size());
+				m_memory_blocks.emplace_back();
+			}
+			MemoryBlock& block = m_memory_blocks[image.memory_block];
+			block.size = std::max(block.size, placement.requirements.size);
+			block.memory_type_bits &= placement.requirements.memoryTypeBits;
+			block.images.push_back(placement.image);
+		}
+
+		for (MemoryBlock& block : m_memory_blocks) {
+			VkMemoryAllocateInfo allocate_info = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+			allocate_info.allocationSize = block.size;
+			allocate_info.memoryTypeIndex = vkUtilities::FindMemoryType(block.memory_type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physical_device);
+			if (vkAllocateMemory(m_device, &allocate_info, nullptr, &block.memory) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to allocate render graph memory");
+			}
+			m_stats.allocated_bytes += block.size;
+
+			for (RenderGraphImage i : block.images) {
+				Image& image = m_images[i];
+				if (vkBindImageMemory(m_device, image.image, block.memory, 0) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to bind render graph image " + image.name);
+				}
+
+				VkImageViewCreateInfo view_info = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+				view_info.image = image.image;
+				if ((image.desc.flags & VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) && image.desc.array_layers % 6 == 0)
+					view_info.viewType = image.desc.array_layers == 6 ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_CUBE_ARRAY;
+				else
+					view_info.viewType = image.desc.array_layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+				view_info.format = image.desc.format;
+				view_info.subresourceRange = { image.desc.aspect, 0, image.desc.mip_levels, 0, image.desc.array_layers };
+				if (vkCreateImageView(m_device, &view_info, nullptr, &image.view) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create render graph image view " + image.name);
+				}
+			}
+		}
+	}
+
+	void RenderGraph::Transition(const Access& access, std::vector<VkImageMemoryBarrier>& barriers, VkPipelineStageFlags& src_stages, VkPipelineStageFlags& dst_stages) {
+		Image& image = m_images[access.image];
+		const UsageInfo info = GetUsageInfo(access.usage);
+		const VkAccessFlags dst_access = access.write ? info.write_access : info.read_access;
+
+		// The previous tenant of aliased memory has to be done before the first use, contents start out undefined
+		if (image.transient && !image.touched) {
+			const MemoryBlock& block = m_memory_blocks[image.memory_block];
+			for (SubresourceState& state : image.states) {
+				state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				state.write_stages = block.stages;
+				state.write_access = block.write_access;
+			}
+		}
+		image.touched = true;
+		if (image.transient) {
+			MemoryBlock& block = m_memory_blocks[image.memory_block];
+			block.stages |= info.stages;
+			if (access.write)
+				block.write_access |= dst_access;
+		}
+
+		struct Required {
+			bool needed = false;
+			VkImageLayout old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags src_stages = 0;
+			VkAccessFlags src_access = 0;
+
+			bool operator==(const Required& other) const {
+				return needed == other.needed && old_layout == other.old_layout && src_stages == other.src_stages && src_access == other.src_access;
+			}
+		};
+
+		std::vector<Required> required;
+		required.reserve(static_cast<size_t>(access.range.layerCount) * access.range.levelCount);
+		for (uint32_t layer = access.range.baseArrayLayer; layer < access.range.baseArrayLayer + access.range.layerCount; layer++) {
+			for (uint32_t mip = access.range.baseMipLevel; mip < access.range.baseMipLevel + access.range.levelCount; mip++) {
+				SubresourceState& state = image.states[static_cast<size_t>(layer) * image.desc.mip_levels + mip];
+				Required& r = required.emplace_back();
+				r.old_layout = state.layout;
+
+				if (state.layout != info.layout) {
+					// Layout transitions are writes, they wait for everything before and are visible to the pass
+					r.needed = true;
+					r.src_stages = state.write_stages | state.read_stages;
+					r.src_access = state.write_access;
+					state.layout = info.layout;
+					state.write_stages = info.stages;
+					state.write_access = access.write ? dst_access : 0;
+					state.read_stages = access.write ? 0 : info.stages;
+					state.visible_stages = access.write ? 0 : info.stages;
+					state.visible_access = access.write ? 0 : dst_access;
+				}
+				else if (access.write) {
+					// Write after read only needs the readers to be done, write after write also the flush
+					if (state.read_stages != 0) {
+						r.needed = true;
+						r.src_stages = state.read_stages;
+					}
+					else if (state.write_stages != 0) {
+						r.needed = true;
+						r.src_stages = state.write_stages;
+						r.src_access = state.write_access;
+					}
+					state.write_stages = info.stages;
+					state.write_access = dst_access;
+					state.read_stages = 0;
+					state.visible_stages = 0;
+					state.visible_access = 0;
+				}
+				else {
+					const bool visible = (state.visible_stages & info.stages) == info.stages && (state.visible_access & dst_access) == dst_access;
+					if (state.write_stages != 0 && !visible) {
+						r.needed = true;
+						r.src_stages = state.write_stages;
+						r.src_access = state.write_access;
+						state.visible_stages |= info.stages;
+						state.visible_access |= dst_access;
+					}
+					state.read_stages |= info.stages;
+				}
+			}
+		}
+
+		auto add_barrier = [&](const Required& r, const VkImageSubresourceRange& range) {
+			VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+			barrier.srcAccessMask = r.src_access;
+			barrier.dstAccessMask = dst_access;
+			barrier.oldLayout = r.old_layout;
+			barrier.newLayout = info.layout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image.image;
+			barrier.subresourceRange = range;
+			barriers.push_back(barrier);
+			src_stages |= r.src_stages;
+			dst_stages |= info.stages;
+		};
+
+		// The common case is a range in one state, which takes a single barrier
+		if (std::all_of(required.begin(), required.end(), [&](const Required& r) { return r == required.front(); })) {
+			if (required.front().needed)
+				add_barrier(required.front(), access.range);
+			return;
+		}
+
+		size_t index = 0;
+		for (uint32_t layer = access.range.baseArrayLayer; layer < access.range.baseArrayLayer + access.range.layerCount; layer++) {
+			for (uint32_t mip = access.range.baseMipLevel; mip < access.range.baseMipLevel + access.range.levelCount; mip++) {
+				const Required& r = required[index++];
+				if (r.needed)
+					add_barrier(r, { access.range.aspectMask, mip, 1, layer, 1 });
+			}
+		}
+	}
+
+	void RenderGraph::FlushBarriers(VkCommandBuffer command_buffer, std::vector<VkImageMemoryBarrier>& barriers, VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages) {
+		if (barriers.empty())
+			return;
+
+		// Nothing to wait for, only the layout transition of untouched memory
+		if (src_stages == 0)
+			src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+		m_stats.barriers += static_cast<uint32_t>(barriers.size());
+		m_stats.barrier_batches++;
+		barriers.clear();
+	}
+
+	void RenderGraph::Execute(VkCommandBuffer command_buffer) {
+		assert(m_compiled && "Compile() has to be called before Execute()");
+		std::vector<VkImageMemoryBarrier> barriers;
+		for (const Pass& pass : m_passes) {
+			if (pass.culled)
+				continue;
+
+			VkPipelineStageFlags src_stages = 0;
+			VkPipelineStageFlags dst_stages = 0;
+			for (const Access& access : pass.accesses) {
+				Transition(access, barriers, src_stages, dst_stages);
+			}
+			FlushBarriers(command_buffer, barriers, src_stages, dst_stages);
+			pass.execute(command_buffer);
+		}
+
+		VkPipelineStageFlags src_stages = 0;
+		VkPipelineStageFlags dst_stages = 0;
+		for (RenderGraphImage i = 0; i < m_images.size(); i++) {
+			const Image& image = m_images[i];
+			if (!image.has_final_usage || image.image == VK_NULL_HANDLE)
+				continue;
+			const Access access = { i, image.final_usage, { image.desc.aspect, 0, image.desc.mip_levels, 0, image.desc.array_layers }, false };
+			Transition(access, barriers, src_stages, dst_stages);
+		}
+		FlushBarriers(command_buffer, barriers, src_stages, dst_stages);
+	}
+
+	RenderGraph::~RenderGraph() {
+		Destroy();
+	}
+
+	void RenderGraph::Destroy() {
+		for (Image& image : m_images) {
+			if (!image.transient)
+				continue;
+			if (image.view != VK_NULL_HANDLE)
+				vkDestroyImageView(m_device, image.view, nullptr);
+			if (image.image != VK_NULL_HANDLE)
+				vkDestroyImage(m_device, image.image, nullptr);
+		}
+		for (MemoryBlock& block : m_memory_blocks) {
+			vkFreeMemory(m_device, block.memory, nullptr);
+		}
+		m_images.clear();
+		m_passes.clear();
+		m_memory_blocks.clear();
+		m_compiled = false;
+	}
+}
@@ -0,0 +1,29 @@
+#include "RenderStats.hpp"
+
+#include "TextOverlay.hpp"
+
+#include <cstdio>
+
+namespace Diffuse {
+	static void AddLine(TextOverlay& overlay, const char* name, uint64_t value) {
+		char line[64];
+		const int length = snprintf(line, sizeof(line), "%s: %llu", name, static_cast<unsigned long long>(value));
+		overlay.AddLine(std::string_view(line, length > 0 ? static_cast<size_t>(length) : 0));
+	}
+
+	void RenderStats::AddLines(TextOverlay& overlay) const {
+		AddLine(overlay, "Draws", draws);
+		AddLine(overlay, "Triangles", triangles);
+		AddLine(overlay, "Instances", instances);
+		AddLine(overlay, "Pipeline binds", pipeline_binds);
+		AddLine(overlay, "Descriptor set binds", descriptor_set_binds);
+		AddLine(overlay, "Push constants", push_constants);
+		AddLine(overlay, "VB binds", vertex_buffer_binds);
+		AddLine(overlay, "IB binds", index_buffer_binds);
+		AddLine(overlay, "Hidden objects", hidden_objects);
+		AddLine(overlay, "Uniform bytes", uniform_bytes);
+		AddLine(overlay, "Skinned vertices", skinned_vertices);
+		AddLine(overlay, "Morphed vertices", morphed_vertices);
+		AddLine(overlay, "Material bytes", material_bytes);
+	}
+}
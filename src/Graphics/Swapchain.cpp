@@ -45,6 +45,11 @@ namespace Diffuse {
 		swap_chain_create_info.imageExtent = m_extent;
 		swap_chain_create_info.imageArrayLayers = 1;
 		swap_chain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		// Needed by the readback ring to copy presented frames
+		if (m_swapchain_support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+			swap_chain_create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+		m_image_usage = swap_chain_create_info.imageUsage;
 
 		QueueFamilyIndices queue_family_indices = vkUtilities::FindQueueFamilies(m_device->PhysicalDevice(), m_device->Surface());
 		uint32_t queueFamilyIndices[] = { queue_family_indices.graphicsFamily.value(), queue_family_indices.presentFamily.value() };
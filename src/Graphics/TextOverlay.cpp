@@ -0,0 +1,128 @@
+#include "TextOverlay.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace Diffuse {
+	struct Glyph {
+		char c;
+		// Column major, bit 0 is the top row
+		uint8_t columns[5];
+	};
+
+	static const Glyph s_font[] = {
+		{ '0', { 0x3E, 0x51, 0x49, 0x45, 0x3E } }, { '1', { 0x00, 0x42, 0x7F, 0x40, 0x00 } },
+		{ '2', { 0x42, 0x61, 0x51, 0x49, 0x46 } }, { '3', { 0x21, 0x41, 0x45, 0x4B, 0x31 } },
+		{ '4', { 0x18, 0x14, 0x12, 0x7F, 0x10 } }, { '5', { 0x27, 0x45, 0x45, 0x45, 0x39 } },
+		{ '6', { 0x3C, 0x4A, 0x49, 0x49, 0x30 } }, { '7', { 0x01, 0x71, 0x09, 0x05, 0x03 } },
+		{ '8', { 0x36, 0x49, 0x49, 0x49, 0x36 } }, { '9', { 0x06, 0x49, 0x49, 0x29, 0x1E } },
+		{ 'A', { 0x7E, 0x11, 0x11, 0x11, 0x7E } }, { 'B', { 0x7F, 0x49, 0x49, 0x49, 0x36 } },
+		{ 'C', { 0x3E, 0x41, 0x41, 0x41, 0x22 } }, { 'D', { 0x7F, 0x41, 0x41, 0x22, 0x1C } },
+		{ 'E', { 0x7F, 0x49, 0x49, 0x49, 0x41 } }, { 'F', { 0x7F, 0x09, 0x09, 0x09, 0x01 } },
+		{ 'G', { 0x3E, 0x41, 0x49, 0x49, 0x7A } }, { 'H', { 0x7F, 0x08, 0x08, 0x08, 0x7F } },
+		{ 'I', { 0x00, 0x41, 0x7F, 0x41, 0x00 } }, { 'J', { 0x20, 0x40, 0x41, 0x3F, 0x01 } },
+		{ 'K', { 0x7F, 0x08, 0x14, 0x22, 0x41 } }, { 'L', { 0x7F, 0x40, 0x40, 0x40, 0x40 } },
+		{ 'M', { 0x7F, 0x02, 0x0C, 0x02, 0x7F } }, { 'N', { 0x7F, 0x04, 0x08, 0x10, 0x7F } },
+		{ 'O', { 0x3E, 0x41, 0x41, 0x41, 0x3E } }, { 'P', { 0x7F, 0x09, 0x09, 0x09, 0x06 } },
+		{ 'Q', { 0x3E, 0x41, 0x51, 0x21, 0x5E } }, { 'R', { 0x7F, 0x09, 0x19, 0x29, 0x46 } },
+		{ 'S', { 0x46, 0x49, 0x49, 0x49, 0x31 } }, { 'T', { 0x01, 0x01, 0x7F, 0x01, 0x01 } },
+		{ 'U', { 0x3F, 0x40, 0x40, 0x40, 0x3F } }, { 'V', { 0x1F, 0x20, 0x40, 0x20, 0x1F } },
+		{ 'W', { 0x3F, 0x40, 0x38, 0x40, 0x3F } }, { 'X', { 0x63, 0x14, 0x08, 0x14, 0x63 } },
+		{ 'Y', { 0x07, 0x08, 0x70, 0x08, 0x07 } }, { 'Z', { 0x61, 0x51, 0x49, 0x45, 0x43 } },
+		{ ':', { 0x00, 0x36, 0x36, 0x00, 0x00 } }, { '.', { 0x00, 0x60, 0x60, 0x00, 0x00 } },
+		{ ',', { 0x00, 0x50, 0x30, 0x00, 0x00 } }, { '-', { 0x08, 0x08, 0x08, 0x08, 0x08 } },
+		{ '_', { 0x40, 0x40, 0x40, 0x40, 0x40 } }, { '=', { 0x14, 0x14, 0x14, 0x14, 0x14 } },
+		{ '/', { 0x20, 0x10, 0x08, 0x04, 0x02 } }, { '%', { 0x23, 0x13, 0x08, 0x64, 0x62 } },
+		{ '(', { 0x00, 0x1C, 0x22, 0x41, 0x00 } }, { ')', { 0x00, 0x41, 0x22, 0x1C, 0x00 } },
+	};
+
+	static const Glyph* FindGlyph(char c) {
+		c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+		for (const Glyph& glyph : s_font) {
+			if (glyph.c == c)
+				return &glyph;
+		}
+		return nullptr;
+	}
+
+	// Glyph cell including one column and row of spacing
+	static constexpr int32_t s_cell_width = 6;
+	static constexpr int32_t s_cell_height = 9;
+	static constexpr int32_t s_margin = 4;
+
+	void TextOverlay::Clear() {
+		m_text.clear();
+		m_line_ends.clear();
+	}
+
+	void TextOverlay::AddLine(std::string_view text) {
+		m_text.insert(m_text.end(), text.begin(), text.end());
+		m_line_ends.push_back(static_cast<uint32_t>(m_text.size()));
+	}
+
+	void TextOverlay::AddGlyph(char c, int32_t x, int32_t y, VkExtent2D extent) {
+		const Glyph* glyph = FindGlyph(c);
+		if (!glyph)
+			return;
+
+		const int32_t scale = static_cast<int32_t>(m_pixel_scale);
+		for (int32_t column = 0; column < 5; column++) {
+			for (int32_t row = 0; row < 7; row++) {
+				if ((glyph->columns[column] & (1 << row)) == 0)
+					continue;
+				VkClearRect rect{};
+				rect.rect.offset = { x + column * scale, y + row * scale };
+				rect.rect.extent = { m_pixel_scale, m_pixel_scale };
+				rect.layerCount = 1;
+				// Clear rects have to stay inside the render area
+				if (rect.rect.offset.x + scale > static_cast<int32_t>(extent.width) || rect.rect.offset.y + scale > static_cast<int32_t>(extent.height))
+					continue;
+				m_glyph_rects.push_back(rect);
+			}
+		}
+	}
+
+	void TextOverlay::Record(VkCommandBuffer command_buffer, VkExtent2D extent) {
+		if (m_line_ends.empty())
+			return;
+
+		const int32_t scale = static_cast<int32_t>(m_pixel_scale);
+		uint32_t longest = 0;
+		uint32_t line_begin = 0;
+		for (uint32_t line_end : m_line_ends) {
+			longest = std::max(longest, line_end - line_begin);
+			line_begin = line_end;
+		}
+
+		// Dark backdrop so the text stays readable on bright scenes
+		VkClearRect background{};
+		background.rect.offset = { 0, 0 };
+		background.rect.extent.width = std::min<uint32_t>(extent.width, static_cast<uint32_t>(2 * s_margin + static_cast<int32_t>(longest) * s_cell_width * scale));
+		background.rect.extent.height = std::min<uint32_t>(extent.height, static_cast<uint32_t>(2 * s_margin + static_cast<int32_t>(m_line_ends.size()) * s_cell_height * scale));
+		background.layerCount = 1;
+
+		VkClearAttachment attachment{};
+		attachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		attachment.colorAttachment = 0;
+		attachment.clearValue.color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		vkCmdClearAttachments(command_buffer, 1, &attachment, 1, &background);
+
+		m_glyph_rects.clear();
+		int32_t y = s_margin;
+		line_begin = 0;
+		for (uint32_t line_end : m_line_ends) {
+			int32_t x = s_margin;
+			for (uint32_t i = line_begin; i < line_end; i++) {
+				AddGlyph(m_text[i], x, y, extent);
+				x += s_cell_width * scale;
+			}
+			y += s_cell_height * scale;
+			line_begin = line_end;
+		}
+		if (m_glyph_rects.empty())
+			return;
+
+		attachment.clearValue.color = { { 1.0f, 1.0f, 1.0f, 1.0f } };
+		vkCmdClearAttachments(command_buffer, 1, &attachment, static_cast<uint32_t>(m_glyph_rects.size()), m_glyph_rects.data());
+	}
+}
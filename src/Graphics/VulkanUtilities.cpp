@@ -2,6 +2,7 @@
 #include "Application.hpp"
 #include "Renderer.hpp"
 #include "Swapchain.hpp"
+#include "FrameEvents.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -48,18 +49,34 @@ namespace Diffuse {
 
 		return requiredExtensions.empty();
 	}
-	std::vector<const char*> vkUtilities::GetRequiredExtensions(bool enableValidationLayers) {
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	std::vector<const char*> vkUtilities::GetRequiredExtensions(bool enableValidationLayers, bool headless) {
+		std::vector<const char*> extensions;
+		if (headless) {
+			extensions = { VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME };
+		}
+		else {
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if (enableValidationLayers) {
-			//extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 			extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 		}
 
+		// Debug utils gives command buffer labels to external tools, enable it whenever it's there
+		uint32_t extensionCount = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+		for (const auto& extension : availableExtensions) {
+			if (strcmp(extension.extensionName, VK_EXT_DEBUG_UTILS_EXTENSION_NAME) == 0) {
+				extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+				break;
+			}
+		}
+
 		return extensions;
 	}
 
@@ -189,6 +206,13 @@ namespace Diffuse {
 			i++;
 		}
 
+		for (uint32_t j = 0; j < queueFamilyCount; j++) {
+			if ((queueFamilies[j].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilies[j].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+				indices.computeFamily = j;
+				break;
+			}
+		}
+
 		return indices;
 	}
 	void vkUtilities::PopulateReportMessengerCreateInfo(VkDebugReportCallbackCreateInfoEXT& createInfo) {
@@ -223,6 +247,17 @@ namespace Diffuse {
 			return VK_ERROR_EXTENSION_NOT_PRESENT;
 		}
 	}
+	VkResult vkUtilities::CreateHeadlessSurfaceEXT(VkInstance instance, VkSurfaceKHR* surface) {
+		auto func = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
+		if (func == nullptr) {
+			std::cout << "Headless surface extension not present" << std::endl;
+			return VK_ERROR_EXTENSION_NOT_PRESENT;
+		}
+		VkHeadlessSurfaceCreateInfoEXT create_info{};
+		create_info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+		return func(instance, &create_info, nullptr, surface);
+	}
+
 	VkResult vkUtilities::CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
 		auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
 		if (func != nullptr) {
@@ -406,6 +441,7 @@ namespace Diffuse {
 
 	void vkUtilities::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, 
 		VkPhysicalDevice physical_device, VkDevice device) {
+		Utils::FrameEventScope frame_event(Utils::FrameEventType::Allocation, "vkUtilities::CreateBuffer");
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size = size;
@@ -431,27 +467,6 @@ namespace Diffuse {
 		vkBindBufferMemory(device, buffer, bufferMemory, 0);
 	}
 
-	void vkUtilities::CreateVertexBuffer(const std::vector<Vertex>& vertices, VkDevice device, VkBuffer vertex_buffer, VkDeviceMemory vertex_buffer_memory, 
-		VkCommandPool command_pool, VkQueue graphics_queue, VkPhysicalDevice physical_device) {
-		VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		vkUtilities::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, physical_device, device);
-
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, vertices.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
-
-		vkUtilities::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_buffer_memory, physical_device, device);
-
-		vkUtilities::CopyBuffer(stagingBuffer, vertex_buffer, bufferSize, command_pool, device, graphics_queue);
-
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
-	}
-
 	//void vkUtilities::UpdateUniformBuffers(Camera* camera, uint32_t current_image, VkExtent2D swap_chain_extent, std::vector<void*> uniform_buffers_mapped)
 	//{
 		//UniformBufferObject ubo{};
@@ -468,16 +483,6 @@ namespace Diffuse {
 		//memcpy(uniform_buffers_mapped[current_image], &ubo, sizeof(ubo));
 	//}
 
-	void vkUtilities::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool command_pool, VkDevice device, VkQueue graphics_queue) {
-		VkCommandBuffer commandBuffer = BeginSingleTimeCommands(command_pool, device);
-
-		VkBufferCopy copyRegion{};
-		copyRegion.size = size;
-		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-		EndSingleTimeCommands(commandBuffer, device, graphics_queue, command_pool);
-	}
-
 	VkFormat vkUtilities::FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features, VkPhysicalDevice physical_device) {
 		for (VkFormat format : candidates) {
 			VkFormatProperties props;
@@ -504,6 +509,7 @@ namespace Diffuse {
 	}
 
 	void vkUtilities::CreateImage(uint32_t width, uint32_t height, VkDevice device, VkPhysicalDevice physical_device, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t layers, uint32_t miplevels) {
+		Utils::FrameEventScope frame_event(Utils::FrameEventType::Allocation, "vkUtilities::CreateImage");
 		assert(layers > 0);
 		assert(miplevels > 0);
 		VkImageCreateInfo imageInfo{};
@@ -541,46 +547,7 @@ namespace Diffuse {
 		vkBindImageMemory(device, image, imageMemory, 0);
 	}
 
-	VkCommandBuffer vkUtilities::BeginSingleTimeCommands(VkCommandPool command_pool, VkDevice device) {
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = command_pool;
-		allocInfo.commandBufferCount = 1;
-
-		VkCommandBuffer commandBuffer;
-		vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to reset immediate command buffer");
-		}
-		return commandBuffer;
-	}
-
-	void vkUtilities::EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkDevice device, VkQueue graphics_queue, VkCommandPool command_pool) {
-		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to reset immediate command buffer");
-		}
-
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-
-		vkQueueSubmit(graphics_queue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphics_queue);
-
-		vkFreeCommandBuffers(device, command_pool, 1, &commandBuffer);
-	}
-
-	void vkUtilities::TransitionImageLayout(VkQueue graphics_queue, VkCommandPool command_pool, VkDevice device, 
-		VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-		VkCommandBuffer commandBuffer = BeginSingleTimeCommands(command_pool, device);
-
+	void vkUtilities::RecordTransitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout) {
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		barrier.oldLayout = oldLayout;
@@ -623,13 +590,9 @@ namespace Diffuse {
 			0, nullptr,
 			1, &barrier
 		);
-
-		EndSingleTimeCommands(commandBuffer, device, graphics_queue, command_pool);
 	}
 
-	void vkUtilities::CopyBufferToImage(VkQueue graphics_queue, VkCommandPool command_pool, VkDevice device, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-		VkCommandBuffer commandBuffer = BeginSingleTimeCommands(command_pool, device);
-
+	void vkUtilities::RecordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
 		VkBufferImageCopy region{};
 		region.bufferOffset = 0;
 		region.bufferRowLength = 0;
@@ -646,8 +609,6 @@ namespace Diffuse {
 		};
 
 		vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-		EndSingleTimeCommands(commandBuffer, device, graphics_queue, command_pool);
 	}
 
 	VkImageView vkUtilities::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkDevice device, 
@@ -700,6 +661,7 @@ namespace Diffuse {
 
 	VkResult vkUtilities::CreateBuffer(VkDevice device, VkPhysicalDevice physical_device, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory, void* data)
 	{
+		Utils::FrameEventScope frame_event(Utils::FrameEventType::Allocation, "vkUtilities::CreateBuffer");
 		// Create the buffer handle
 		VkBufferCreateInfo bufferCreateInfo = BufferCreateInfo(usageFlags, size);
 		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -755,6 +717,7 @@ namespace Diffuse {
 
 	VkResult vkUtilities::CreateBuffer(VkDevice device, VkPhysicalDevice physical_device, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, Buffer* buffer, VkDeviceSize size, void* data)
 	{
+		Utils::FrameEventScope frame_event(Utils::FrameEventType::Allocation, "vkUtilities::CreateBuffer");
 		buffer->device = device;
 
 		// Create the buffer handle
@@ -8,9 +8,12 @@ namespace Diffuse {
 		w->WindowResized(true);
 	}
 
-	Window::Window() {
+	Window::Window(uint32_t width, uint32_t height, bool visible) {
+		m_width = width;
+		m_height = height;
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+		glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 		m_window = glfwCreateWindow(m_width, m_height, "Diffuse", nullptr, nullptr);
 		assert(m_window);
 
@@ -0,0 +1,126 @@
+#include "Animation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DIFFUSE_ANIMATION_SSE
+#include <emmintrin.h>
+#endif
+
+namespace Diffuse {
+	// Keys are four floats wide, so each blend is a handful of vector instructions
+#ifdef DIFFUSE_ANIMATION_SSE
+	using Vec4 = __m128;
+	static inline Vec4 Load(const glm::vec4& v) { return _mm_loadu_ps(&v.x); }
+	static inline glm::vec4 Store(Vec4 v) { glm::vec4 r; _mm_storeu_ps(&r.x, v); return r; }
+	static inline Vec4 Splat(float s) { return _mm_set1_ps(s); }
+	static inline Vec4 Add(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+	static inline Vec4 Sub(Vec4 a, Vec4 b) { return _mm_sub_ps(a, b); }
+	static inline Vec4 Mul(Vec4 a, Vec4 b) { return _mm_mul_ps(a, b); }
+	static inline Vec4 Negate(Vec4 a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+	static inline float Dot(Vec4 a, Vec4 b) {
+		Vec4 m = _mm_mul_ps(a, b);
+		Vec4 s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		s = _mm_add_ss(s, _mm_movehl_ps(s, s));
+		return _mm_cvtss_f32(s);
+	}
+#else
+	using Vec4 = glm::vec4;
+	static inline Vec4 Load(const glm::vec4& v) { return v; }
+	static inline glm::vec4 Store(Vec4 v) { return v; }
+	static inline Vec4 Splat(float s) { return Vec4(s); }
+	static inline Vec4 Add(Vec4 a, Vec4 b) { return a + b; }
+	static inline Vec4 Sub(Vec4 a, Vec4 b) { return a - b; }
+	static inline Vec4 Mul(Vec4 a, Vec4 b) { return a * b; }
+	static inline Vec4 Negate(Vec4 a) { return -a; }
+	static inline float Dot(Vec4 a, Vec4 b) { return glm::dot(a, b); }
+#endif
+
+	static inline Vec4 Lerp(Vec4 a, Vec4 b, float t) {
+		return Add(a, Mul(Sub(b, a), Splat(t)));
+	}
+
+	static inline Vec4 Normalize(Vec4 a) {
+		const float length_sq = Dot(a, a);
+		return length_sq > 0.0f ? Mul(a, Splat(1.0f / std::sqrt(length_sq))) : a;
+	}
+
+	// Shortest path, nearly parallel keys fall back to a normalized lerp
+	static Vec4 Slerp(Vec4 a, Vec4 b, float t) {
+		float cos_theta = Dot(a, b);
+		if (cos_theta < 0.0f) {
+			b = Negate(b);
+			cos_theta = -cos_theta;
+		}
+		if (cos_theta > 0.9995f) {
+			return Normalize(Lerp(a, b, t));
+		}
+		const float theta = std::acos(cos_theta);
+		const float inv_sin_theta = 1.0f / std::sin(theta);
+		const float wa = std::sin((1.0f - t) * theta) * inv_sin_theta;
+		const float wb = std::sin(t * theta) * inv_sin_theta;
+		return Add(Mul(a, Splat(wa)), Mul(b, Splat(wb)));
+	}
+
+	// Hermite spline between two keys, tangents are scaled by the key interval as glTF defines them
+	static Vec4 CubicSpline(Vec4 v0, Vec4 out_tangent0, Vec4 in_tangent1, Vec4 v1, float t, float dt) {
+		const float t2 = t * t;
+		const float t3 = t2 * t;
+		const float h00 = 2.0f * t3 - 3.0f * t2 + 1.0f;
+		const float h10 = (t3 - 2.0f * t2 + t) * dt;
+		const float h01 = -2.0f * t3 + 3.0f * t2;
+		const float h11 = (t3 - t2) * dt;
+		return Add(Add(Mul(v0, Splat(h00)), Mul(out_tangent0, Splat(h10))), Add(Mul(v1, Splat(h01)), Mul(in_tangent1, Splat(h11))));
+	}
+
+	// Key k with times[k] <= time < times[k + 1], clamped to [0, count - 2]
+	static uint32_t FindKey(const float* times, uint32_t count, float time, uint32_t& cursor) {
+		const uint32_t last = count - 2;
+		uint32_t key = std::min(cursor, last);
+		// Forward playback stays on the cursor or steps a few keys, anything else (seeking,
+		// looping back to the start) searches
+		uint32_t steps = 0;
+		while (key < last && time >= times[key + 1] && steps < 4) {
+			key++;
+			steps++;
+		}
+		if (time < times[key] || (key < last && time >= times[key + 1])) {
+			const uint32_t upper = static_cast<uint32_t>(std::upper_bound(times, times + count, time) - times);
+			key = std::min(upper > 0 ? upper - 1 : 0u, last);
+		}
+		cursor = key;
+		return key;
+	}
+
+	glm::vec4 SampleAnimationChannel(const AnimationChannel& channel, float time, uint32_t& cursor) {
+		const uint32_t count = static_cast<uint32_t>(channel.times.size());
+		const bool cubic = channel.interpolation == AnimationChannel::INTERPOLATION_CUBICSPLINE;
+		const glm::vec4* values = channel.values.data();
+		if (count < 2) {
+			return values[cubic ? 1 : 0];
+		}
+
+		const float* times = channel.times.data();
+		const uint32_t key = FindKey(times, count, time, cursor);
+		const float dt = times[key + 1] - times[key];
+		const float t = dt > 0.0f ? std::clamp((time - times[key]) / dt, 0.0f, 1.0f) : 0.0f;
+		const bool rotation = channel.path == AnimationChannel::PATH_ROTATION;
+
+		switch (channel.interpolation) {
+		case AnimationChannel::INTERPOLATION_STEP:
+			return values[t >= 1.0f ? key + 1 : key];
+		case AnimationChannel::INTERPOLATION_CUBICSPLINE: {
+			const glm::vec4* k0 = &values[key * 3];
+			const glm::vec4* k1 = &values[(key + 1) * 3];
+			Vec4 value = CubicSpline(Load(k0[1]), Load(k0[2]), Load(k1[0]), Load(k1[1]), t, dt);
+			return Store(rotation ? Normalize(value) : value);
+		}
+		default: {
+			const Vec4 a = Load(values[key]);
+			const Vec4 b = Load(values[key + 1]);
+			return Store(rotation ? Slerp(a, b, t) : Lerp(a, b, t));
+		}
+		}
+	}
+}
@@ -60,6 +60,14 @@ namespace Diffuse {
 		UpdateView();
 	}
 
+	void EditorCamera::SetView(const glm::vec3& focalPoint, float distance, float pitch, float yaw) {
+		m_FocalPoint = focalPoint;
+		m_Distance = distance;
+		m_Pitch = pitch;
+		m_Yaw = yaw;
+		UpdateView();
+	}
+
 	bool EditorCamera::OnMouseScroll(float yOffset) {
 		float delta = yOffset * 0.1f;
 		MouseZoom(delta);
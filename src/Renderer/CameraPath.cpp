@@ -0,0 +1,97 @@
+#include "CameraPath.hpp"
+
+#include "json.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace Diffuse {
+	void CameraPath::Record(float time, const EditorCamera& camera) {
+		CameraKeyframe keyframe;
+		keyframe.time = time;
+		keyframe.focal_point = camera.GetFocalPoint();
+		keyframe.distance = camera.GetDistance();
+		keyframe.pitch = camera.GetPitch();
+		keyframe.yaw = camera.GetYaw();
+		m_keyframes.push_back(keyframe);
+	}
+
+	void CameraPath::Apply(float time, EditorCamera& camera) const {
+		if (m_keyframes.empty())
+			return;
+
+		if (time <= m_keyframes.front().time) {
+			const CameraKeyframe& k = m_keyframes.front();
+			camera.SetView(k.focal_point, k.distance, k.pitch, k.yaw);
+			return;
+		}
+		if (time >= m_keyframes.back().time) {
+			const CameraKeyframe& k = m_keyframes.back();
+			camera.SetView(k.focal_point, k.distance, k.pitch, k.yaw);
+			return;
+		}
+
+		auto next = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), time,
+			[](float t, const CameraKeyframe& k) { return t < k.time; });
+		const CameraKeyframe& b = *next;
+		const CameraKeyframe& a = *(next - 1);
+
+		float span = b.time - a.time;
+		float f = span > 0.0f ? (time - a.time) / span : 0.0f;
+		camera.SetView(glm::mix(a.focal_point, b.focal_point, f), glm::mix(a.distance, b.distance, f),
+			glm::mix(a.pitch, b.pitch, f), glm::mix(a.yaw, b.yaw, f));
+	}
+
+	bool CameraPath::Load(const std::string& path) {
+		std::ifstream file(path);
+		if (!file.is_open()) {
+			std::cout << "Failed to open camera path " << path << std::endl;
+			return false;
+		}
+
+		nlohmann::json json;
+		try {
+			file >> json;
+		}
+		catch (const std::exception& e) {
+			std::cout << "Failed to parse camera path " << path << ": " << e.what() << std::endl;
+			return false;
+		}
+
+		m_keyframes.clear();
+		for (auto& k : json["keyframes"]) {
+			CameraKeyframe keyframe;
+			keyframe.time = k["time"].get<float>();
+			keyframe.focal_point = glm::vec3(k["focal_point"][0].get<float>(), k["focal_point"][1].get<float>(), k["focal_point"][2].get<float>());
+			keyframe.distance = k["distance"].get<float>();
+			keyframe.pitch = k["pitch"].get<float>();
+			keyframe.yaw = k["yaw"].get<float>();
+			m_keyframes.push_back(keyframe);
+		}
+		std::sort(m_keyframes.begin(), m_keyframes.end(), [](const CameraKeyframe& a, const CameraKeyframe& b) { return a.time < b.time; });
+		return !m_keyframes.empty();
+	}
+
+	bool CameraPath::Save(const std::string& path) const {
+		nlohmann::json json;
+		json["keyframes"] = nlohmann::json::array();
+		for (auto& k : m_keyframes) {
+			json["keyframes"].push_back({
+				{ "time", k.time },
+				{ "focal_point", { k.focal_point.x, k.focal_point.y, k.focal_point.z } },
+				{ "distance", k.distance },
+				{ "pitch", k.pitch },
+				{ "yaw", k.yaw }
+			});
+		}
+
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			std::cout << "Failed to write camera path " << path << std::endl;
+			return false;
+		}
+		file << json.dump(2);
+		return true;
+	}
+}
@@ -0,0 +1,150 @@
+#include "LoadReport.hpp"
+
+#include "json.hpp"
+
+#include <fstream>
+#include <iostream>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace Diffuse {
+	const char* LoadPhaseName(LoadPhase phase) {
+		switch (phase) {
+		case LoadPhase::Read: return "read";
+		case LoadPhase::Parse: return "parse";
+		case LoadPhase::Decode: return "decode";
+		case LoadPhase::Convert: return "convert";
+		case LoadPhase::Upload: return "upload";
+		case LoadPhase::MipGen: return "mipgen";
+		case LoadPhase::Wait: return "wait";
+		default: return "unknown";
+		}
+	}
+
+	PhaseStats& PhaseStats::operator+=(const PhaseStats& other) {
+		wall_ms += other.wall_ms;
+		cpu_ms += other.cpu_ms;
+		bytes += other.bytes;
+		return *this;
+	}
+
+	PhaseTable& PhaseTable::operator+=(const PhaseTable& other) {
+		for (uint32_t i = 0; i < static_cast<uint32_t>(LoadPhase::Count); i++) {
+			phases[i] += other.phases[i];
+		}
+		return *this;
+	}
+
+	PhaseStats PhaseTable::Total() const {
+		PhaseStats total;
+		for (const PhaseStats& phase : phases) {
+			total += phase;
+		}
+		return total;
+	}
+
+	PhaseTimer::PhaseTimer(PhaseStats* stats, uint64_t bytes) {
+		m_stats = stats;
+		m_bytes = bytes;
+		m_wall_start = std::chrono::steady_clock::now();
+		m_cpu_start = ThreadCpuMs();
+	}
+
+	void PhaseTimer::Stop() {
+		if (!m_stats)
+			return;
+		m_stats->wall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_wall_start).count();
+		m_stats->cpu_ms += ThreadCpuMs() - m_cpu_start;
+		m_stats->bytes += m_bytes;
+		m_stats = nullptr;
+	}
+
+	// Cpu time of the calling thread only, so waiting on the gpu shows up as wall time without cpu time
+	double PhaseTimer::ThreadCpuMs() {
+#if defined(_WIN32)
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+			return 0.0;
+		auto to_100ns = [](const FILETIME& time) { return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+		return static_cast<double>(to_100ns(kernel) + to_100ns(user)) / 10000.0;
+#else
+		timespec time{};
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+		return static_cast<double>(time.tv_sec) * 1000.0 + static_cast<double>(time.tv_nsec) / 1000000.0;
+#endif
+	}
+
+	PhaseTable LoadReport::Totals() const {
+		PhaseTable totals;
+		for (const AssetLoadStats& asset : m_assets) {
+			totals += asset.phases;
+		}
+		return totals;
+	}
+
+	static nlohmann::json ToJson(const PhaseStats& stats) {
+		nlohmann::json json;
+		json["wall_ms"] = stats.wall_ms;
+		json["cpu_ms"] = stats.cpu_ms;
+		json["bytes"] = stats.bytes;
+		return json;
+	}
+
+	static nlohmann::json ToJson(const PhaseTable& table) {
+		nlohmann::json json;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(LoadPhase::Count); i++) {
+			json[LoadPhaseName(static_cast<LoadPhase>(i))] = ToJson(table.phases[i]);
+		}
+		json["total"] = ToJson(table.Total());
+		return json;
+	}
+
+	bool LoadReport::WriteJson(const std::string& path) const {
+		nlohmann::json json;
+		json["scene"] = m_scene;
+
+		nlohmann::json assets = nlohmann::json::array();
+		for (const AssetLoadStats& asset : m_assets) {
+			nlohmann::json entry;
+			entry["path"] = asset.path;
+			entry["vertex_count"] = asset.vertex_count;
+			entry["index_count"] = asset.index_count;
+			entry["shared_mesh_nodes"] = asset.shared_mesh_nodes;
+			entry["shared_primitives"] = asset.shared_primitives;
+			entry["generated_tangents"] = asset.generated_tangents;
+			entry["phases"] = ToJson(asset.phases);
+
+			nlohmann::json textures = nlohmann::json::array();
+			for (const TextureLoadStats& texture : asset.textures) {
+				nlohmann::json texture_entry;
+				texture_entry["texture"] = texture.texture_index;
+				texture_entry["image"] = texture.image_index;
+				texture_entry["name"] = texture.name;
+				texture_entry["width"] = texture.width;
+				texture_entry["height"] = texture.height;
+				texture_entry["srgb"] = texture.srgb;
+				texture_entry["phases"] = ToJson(texture.phases);
+				textures.push_back(texture_entry);
+			}
+			entry["textures"] = textures;
+			assets.push_back(entry);
+		}
+		json["assets"] = assets;
+		json["totals"] = ToJson(Totals());
+
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			std::cout << "Failed to open " << path << " for writing" << std::endl;
+			return false;
+		}
+		file << json.dump(4);
+		return true;
+	}
+}
@@ -0,0 +1,24 @@
+#include "LoaderKernels.hpp"
+
+namespace Diffuse {
+	void ConvertVertices(const VertexStreams& streams, size_t count, Vertex* vertices) {
+		for (size_t v = 0; v < count; v++) {
+			Vertex& vert = vertices[v];
+			vert.pos = glm::make_vec3(&streams.position[v * streams.position_stride]);
+			vert.normal = glm::normalize(streams.normal ? glm::make_vec3(&streams.normal[v * streams.normal_stride]) : glm::vec3(0.0f));
+			vert.uv0 = streams.uv0 ? glm::make_vec2(&streams.uv0[v * streams.uv0_stride]) : glm::vec2(0.0f);
+			vert.uv1 = streams.uv1 ? glm::make_vec2(&streams.uv1[v * streams.uv1_stride]) : glm::vec2(0.0f);
+			vert.color = streams.color ? glm::make_vec4(&streams.color[v * streams.color_stride]) : glm::vec4(1.0f);
+			vert.tangent = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+
+	void ExpandRgbToRgba(const uint8_t* rgb, uint8_t* rgba, size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			rgba[i * 4 + 0] = rgb[i * 3 + 0];
+			rgba[i * 4 + 1] = rgb[i * 3 + 1];
+			rgba[i * 4 + 2] = rgb[i * 3 + 2];
+			rgba[i * 4 + 3] = 255;
+		}
+	}
+}
@@ -1,37 +1,192 @@
 #include "Model.hpp"
 
 #include "GraphicsDevice.hpp"
+#include "Profiler.hpp"
+#include "JobSystem.hpp"
+#include "ReadFile.hpp"
+#include "LoaderKernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
 
 namespace Diffuse {
 	Model::~Model() {
 		for (auto node : m_nodes) {
 			delete node;
 		}
+		for (auto mesh : m_meshes) {
+			delete mesh;
+		}
+	}
+
+	// Encoded image held back by the parser so all images can be decoded in parallel afterwards
+	struct DeferredImage {
+		int index;
+		int req_width;
+		int req_height;
+		std::vector<unsigned char> bytes;
+	};
+
+	static bool DeferImageData(tinygltf::Image* image, const int image_index, std::string* error, std::string* warning,
+		int req_width, int req_height, const unsigned char* bytes, int size, void* user_data) {
+		std::vector<DeferredImage>* deferred = static_cast<std::vector<DeferredImage>*>(user_data);
+		deferred->push_back({ image_index, req_width, req_height, std::vector<unsigned char>(bytes, bytes + size) });
+		return true;
+	}
+
+	// Decodes every deferred image on the job system, decode time is accounted per image
+	static void DecodeImages(tinygltf::Model& model, std::vector<DeferredImage>& deferred, AssetLoadStats& stats) {
+		DIFFUSE_PROFILE_FUNCTION();
+		stats.image_decode.resize(model.images.size());
+		std::vector<std::string> errors(deferred.size());
+		std::vector<uint8_t> loaded(deferred.size(), 0);
+		Utils::JobSystem::ParallelFor(static_cast<uint32_t>(deferred.size()), 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				DeferredImage& image = deferred[i];
+				tinygltf::Image& target = model.images[image.index];
+				std::string warning;
+				PhaseTimer timer(&stats.image_decode[image.index]);
+				loaded[i] = tinygltf::LoadImageData(&target, image.index, &errors[i], &warning, image.req_width, image.req_height,
+					image.bytes.data(), static_cast<int>(image.bytes.size()), nullptr);
+				timer.Stop();
+				stats.image_decode[image.index].bytes += target.image.size();
+			}
+		});
+		for (size_t i = 0; i < deferred.size(); i++) {
+			if (!loaded[i])
+				throw std::runtime_error("Failed to decode image " + std::to_string(deferred[i].index) + ": " + errors[i]);
+		}
 	}
 
 	void Model::Load(const std::string& path, GraphicsDevice* device) {
+		DIFFUSE_PROFILE_FUNCTION();
 		tinygltf::TinyGLTF loader;
 		tinygltf::Model model;
 		std::string error;
 		std::string warning;
 
+		m_load_stats = AssetLoadStats{};
+		m_load_stats.path = path;
+		PhaseTable& phases = m_load_stats.phases;
+		std::vector<DeferredImage> deferred_images;
+		loader.SetImageLoader(DeferImageData, &deferred_images);
+
 		bool binary = false;
 		size_t extpos = path.rfind('.', path.length());
 		if (extpos != std::string::npos) {
 			binary = (path.substr(extpos + 1, path.length() - extpos) == "glb");
 		}
 
+		std::vector<char> file_data;
+		{
+			PhaseTimer read_timer(&phases[LoadPhase::Read]);
+			file_data = Utils::File::ReadFile(path);
+		}
+		phases[LoadPhase::Read].bytes += file_data.size();
+
+		const size_t separator = path.find_last_of("/\\");
+		const std::string base_dir = separator != std::string::npos ? path.substr(0, separator) : "";
+
 		bool file_loaded = false;
-		if (binary) {
-			file_loaded = loader.LoadBinaryFromFile(&model, &error, &warning, path.c_str());
+		{
+			DIFFUSE_PROFILE_SCOPE("Parse glTF");
+			PhaseTimer parse_timer(&phases[LoadPhase::Parse]);
+			if (binary) {
+				file_loaded = loader.LoadBinaryFromMemory(&model, &error, &warning, reinterpret_cast<const unsigned char*>(file_data.data()), static_cast<unsigned int>(file_data.size()), base_dir);
+			}
+			else {
+				file_loaded = loader.LoadASCIIFromString(&model, &error, &warning, file_data.data(), static_cast<unsigned int>(file_data.size()), base_dir);
+			}
 		}
-		else {
-			file_loaded = loader.LoadASCIIFromFile(&model, &error, &warning, path.c_str());
+		if (file_loaded) {
+			// Wall time of the whole batch since the per image entries overlap, cpu time of the images
+			PhaseStats batch;
+			{
+				PhaseTimer decode_timer(&batch);
+				DecodeImages(model, deferred_images, m_load_stats);
+			}
+			phases[LoadPhase::Decode].wall_ms += batch.wall_ms;
+			for (const PhaseStats& decode : m_load_stats.image_decode) {
+				phases[LoadPhase::Decode].cpu_ms += decode.cpu_ms;
+				phases[LoadPhase::Decode].bytes += decode.bytes;
+			}
+		}
+		phases[LoadPhase::Parse].bytes += file_data.size();
+		if (!binary) {
+			for (const tinygltf::Buffer& buffer : model.buffers) {
+				phases[LoadPhase::Parse].bytes += buffer.data.size();
+			}
+		}
+
+		if (!file_loaded) {
+			throw std::runtime_error("Failed to load " + path + ": " + error);
+		}
+		Load(model, device);
+	}
+
+	void Model::LoadAll(const std::vector<std::function<void()>>& loads) {
+		DIFFUSE_PROFILE_FUNCTION();
+		// Jobs must not throw, failures are carried back to the caller instead
+		std::vector<std::exception_ptr> errors(loads.size());
+		Utils::JobCounter counter;
+		for (size_t i = 0; i < loads.size(); i++) {
+			Utils::JobSystem::Run([&loads, &errors, i] {
+				try {
+					loads[i]();
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			}, &counter);
+		}
+		Utils::JobSystem::Wait(counter);
+		for (const std::exception_ptr& error : errors) {
+			if (error)
+				std::rethrow_exception(error);
+		}
+	}
+
+	// Per texture, Color when any material samples it as base color, emissive, diffuse or specular
+	static std::vector<TextureUsage> GetTextureUsages(const tinygltf::Model& model) {
+		std::vector<TextureUsage> usages(model.textures.size(), TextureUsage::Data);
+		std::vector<int> data_textures;
+		auto color = [&](int index) {
+			if (index > -1 && static_cast<size_t>(index) < usages.size())
+				usages[index] = TextureUsage::Color;
+		};
+		auto texture = [](const tinygltf::ParameterMap& values, const char* name) {
+			auto it = values.find(name);
+			return it != values.end() ? it->second.TextureIndex() : -1;
+		};
+		for (const tinygltf::Material& mat : model.materials) {
+			color(texture(mat.values, "baseColorTexture"));
+			color(texture(mat.additionalValues, "emissiveTexture"));
+			auto ext = mat.extensions.find("KHR_materials_pbrSpecularGlossiness");
+			if (ext != mat.extensions.end()) {
+				for (const char* name : { "diffuseTexture", "specularGlossinessTexture" }) {
+					if (ext->second.Has(name) && ext->second.Get(name).Has("index"))
+						color(ext->second.Get(name).Get("index").Get<int>());
+				}
+			}
+			data_textures.push_back(texture(mat.values, "metallicRoughnessTexture"));
+			data_textures.push_back(texture(mat.additionalValues, "normalTexture"));
+			data_textures.push_back(texture(mat.additionalValues, "occlusionTexture"));
+		}
+		for (int index : data_textures) {
+			if (index > -1 && static_cast<size_t>(index) < usages.size() && usages[index] == TextureUsage::Color) {
+				std::cout << "Texture " << index << " is sampled as color and as data, it is decoded as sRGB for both" << std::endl;
+			}
 		}
+		return usages;
+	}
 
+	void Model::Load(tinygltf::Model& model, GraphicsDevice* device) {
+		PhaseTable& phases = m_load_stats.phases;
 		uint32_t vertex_count = 0;
 		uint32_t index_count = 0;
-		if (file_loaded) {
+		{
 			for (tinygltf::Sampler smpl : model.samplers) {
 				TextureSampler texture_sampler{};
 				texture_sampler.min_filter = vkUtilities::GetVkFilterMode(smpl.minFilter);
@@ -41,7 +196,10 @@ namespace Diffuse {
 				texture_sampler.address_modeW = texture_sampler.address_modeV;
 				m_texture_samplers.push_back(texture_sampler);
 			}
-			for (tinygltf::Texture& tex : model.textures) {
+			DIFFUSE_PROFILE_SCOPE("Textures");
+			const std::vector<TextureUsage> usages = GetTextureUsages(model);
+			for (size_t texture_index = 0; texture_index < model.textures.size(); texture_index++) {
+				tinygltf::Texture& tex = model.textures[texture_index];
 				tinygltf::Image image = model.images[tex.source];
 				TextureSampler texture_sampler{};
 				if (tex.sampler == -1) 
@@ -56,31 +214,71 @@ namespace Diffuse {
 				else {
 					texture_sampler = m_texture_samplers[tex.sampler];
 				}
+				TextureLoadStats texture_stats;
+				texture_stats.texture_index = static_cast<int>(texture_index);
+				texture_stats.image_index = tex.source;
+				texture_stats.name = !image.name.empty() ? image.name : image.uri;
+				texture_stats.width = image.width;
+				texture_stats.height = image.height;
+				texture_stats.srgb = usages[texture_index] == TextureUsage::Color;
+
 				Texture2D* texture;
-				texture = new Texture2D(image, texture_sampler, device->Queue(), device);
+				texture = new Texture2D(image, texture_sampler, usages[texture_index], device->Queue(), device, &texture_stats);
 				m_textures.push_back(texture);
+
+				// Decode is already part of the asset totals, it is only attached to the texture for the report
+				phases += texture_stats.phases;
+				if (tex.source >= 0 && static_cast<size_t>(tex.source) < m_load_stats.image_decode.size())
+					texture_stats.phases[LoadPhase::Decode] = m_load_stats.image_decode[tex.source];
+				m_load_stats.textures.push_back(texture_stats);
 			}
-			//Load Materials
-			LoadMaterials(model);
+		}
+		//Load Materials
+		LoadMaterials(model);
 
+		// Each phase closes its own profiler zone
+		{
+			DIFFUSE_PROFILE_SCOPE("Convert geometry");
+			PhaseTimer convert_timer(&phases[LoadPhase::Convert]);
 			const tinygltf::Scene& scene = model.scenes[model.defaultScene > -1 ? model.defaultScene : 0];
-			for (auto& node_index : scene.nodes) {
-				GetNodeProps(model.nodes[node_index], model, vertex_count, index_count);
+			{
+				GeometryCache counted;
+				for (auto& node_index : scene.nodes) {
+					GetNodeProps(model.nodes[node_index], model, vertex_count, index_count, counted);
+				}
 			}
 			assert(vertex_count > 0);
 			m_vertex_buffer = new Vertex[vertex_count];
 			m_index_buffer = new uint32_t[index_count];
 
 			for (auto& node_index : scene.nodes) {
-				const tinygltf::Node node = model.nodes[node_index];
+				const tinygltf::Node& node = model.nodes[node_index];
 				LoadNode(nullptr, node, node_index, model);
 			}
+			assert(m_vertex_pos == vertex_count && m_index_pos == index_count);
+			m_geometry_cache = GeometryCache{};
+			m_instance_count = 0;
+			for (Mesh* mesh : m_meshes) {
+				mesh->first_instance = m_instance_count;
+				m_instance_count += static_cast<uint32_t>(mesh->instances.size());
+			}
+			GenerateTangents();
+			LoadSkins(model);
+			LoadAnimations(model);
 		}
 
+		DIFFUSE_PROFILE_SCOPE("Upload geometry");
+
 		size_t vertexBufferSize = vertex_count * sizeof(Vertex);
 		size_t indexBufferSize = index_count * sizeof(uint32_t);
 		assert(vertexBufferSize > 0);
 
+		m_load_stats.vertex_count = vertex_count;
+		m_load_stats.index_count = index_count;
+		phases[LoadPhase::Convert].bytes += vertexBufferSize + indexBufferSize;
+		// Buffer uploads wait on the queue internally, so this includes their wait
+		PhaseTimer upload_timer(&phases[LoadPhase::Upload], vertexBufferSize + indexBufferSize);
+
 		struct StagingBuffer {
 			VkBuffer buffer;
 			VkDeviceMemory memory;
@@ -194,19 +392,405 @@ namespace Diffuse {
 		//m_materials.push_back(Material());
 	}
 
-	void Model::GetNodeProps(const tinygltf::Node& node, const tinygltf::Model& model, uint32_t& vertex_count, uint32_t& index_count) {
+	void Model::LoadSkins(const tinygltf::Model& model) {
+		for (const tinygltf::Skin& source : model.skins) {
+			Skin skin;
+			skin.name = source.name;
+			for (int joint : source.joints) {
+				Node* node = FindNode(static_cast<uint32_t>(joint));
+				if (!node) {
+					throw std::runtime_error("Joint " + std::to_string(joint) + " of skin " + source.name + " is not part of the scene");
+				}
+				skin.joints.push_back(node);
+			}
+			skin.inverse_bind_matrices.resize(skin.joints.size(), glm::mat4(1.0f));
+			if (source.inverseBindMatrices > -1) {
+				const tinygltf::Accessor& accessor = model.accessors[source.inverseBindMatrices];
+				const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+				const float* matrices = reinterpret_cast<const float*>(&model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]);
+				for (size_t i = 0; i < std::min<size_t>(accessor.count, skin.joints.size()); i++) {
+					skin.inverse_bind_matrices[i] = glm::make_mat4(&matrices[i * 16]);
+				}
+			}
+			m_skins.push_back(skin);
+		}
+	}
+
+	Node* Model::FindNode(uint32_t index) const {
+		for (Node* node : m_linear_nodes) {
+			if (node->index == index)
+				return node;
+		}
+		return nullptr;
+	}
+
+	uint32_t Model::GetJointCount() const {
+		uint32_t count = 0;
+		for (const Skin& skin : m_skins) {
+			count += static_cast<uint32_t>(skin.joints.size());
+		}
+		return count;
+	}
+
+	void Model::GetJointMatrices(glm::mat4* matrices) const {
+		// Skinned instances are drawn with an identity matrix, so the skinned vertices stay in model space
+		for (const Skin& skin : m_skins) {
+			for (size_t i = 0; i < skin.joints.size(); i++) {
+				*matrices++ = skin.joints[i]->GetMatrix() * skin.inverse_bind_matrices[i];
+			}
+		}
+	}
+
+	void Model::GetInstanceData(InstanceData* instances) const {
+		for (const Mesh* mesh : m_meshes) {
+			for (const Node* node : mesh->instances) {
+				// glTF ignores the transform of skinned nodes, their joints place the vertices
+				const glm::mat4 matrix = node->skin_index > -1 ? glm::mat4(1.0f) : node->GetMatrix();
+				// Once per instance here rather than for every vertex in the shader
+				*instances++ = { matrix, glm::transpose(glm::inverse(glm::mat3(matrix))) };
+			}
+		}
+	}
+
+	// Element v of a scalar to vec4 accessor, missing components are 0. Normalized integers
+	// (weights, quantized rotations) are mapped to [0, 1] or [-1, 1].
+	static glm::vec4 ReadVec4(const tinygltf::Model& model, const tinygltf::Accessor& accessor, size_t v) {
+		const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+		const int component_size = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+		const int components = std::min(tinygltf::GetNumComponentsInType(accessor.type), 4);
+		const int stride = accessor.ByteStride(view) ? accessor.ByteStride(view) : components * component_size;
+		const unsigned char* data = &model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset + v * stride];
+		glm::vec4 value(0.0f);
+		for (int c = 0; c < components; c++) {
+			switch (accessor.componentType) {
+			case TINYGLTF_COMPONENT_TYPE_FLOAT:
+				value[c] = reinterpret_cast<const float*>(data)[c];
+				break;
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+				value[c] = reinterpret_cast<const uint16_t*>(data)[c] / (accessor.normalized ? 65535.0f : 1.0f);
+				break;
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+				value[c] = data[c] / (accessor.normalized ? 255.0f : 1.0f);
+				break;
+			case TINYGLTF_COMPONENT_TYPE_SHORT:
+				value[c] = accessor.normalized ? std::max(reinterpret_cast<const int16_t*>(data)[c] / 32767.0f, -1.0f) : reinterpret_cast<const int16_t*>(data)[c];
+				break;
+			case TINYGLTF_COMPONENT_TYPE_BYTE:
+				value[c] = accessor.normalized ? std::max(reinterpret_cast<const int8_t*>(data)[c] / 127.0f, -1.0f) : reinterpret_cast<const int8_t*>(data)[c];
+				break;
+			default:
+				throw std::runtime_error("Unsupported component type " + std::to_string(accessor.componentType));
+			}
+		}
+		return value;
+	}
+
+	// Every element of an accessor with its sparse substitutions applied, an accessor without
+	// a buffer view starts out as zeros
+	static std::vector<glm::vec4> ReadAccessor(const tinygltf::Model& model, const tinygltf::Accessor& accessor) {
+		std::vector<glm::vec4> values(accessor.count, glm::vec4(0.0f));
+		if (accessor.bufferView > -1) {
+			for (size_t i = 0; i < accessor.count; i++) {
+				values[i] = ReadVec4(model, accessor, i);
+			}
+		}
+		if (accessor.sparse.isSparse) {
+			const tinygltf::BufferView& index_view = model.bufferViews[accessor.sparse.indices.bufferView];
+			const unsigned char* indices = &model.buffers[index_view.buffer].data[index_view.byteOffset + accessor.sparse.indices.byteOffset];
+			// Sparse values are tightly packed elements of the same type
+			tinygltf::Accessor sparse_values = accessor;
+			sparse_values.bufferView = accessor.sparse.values.bufferView;
+			sparse_values.byteOffset = accessor.sparse.values.byteOffset;
+			sparse_values.sparse.isSparse = false;
+			for (int i = 0; i < accessor.sparse.count; i++) {
+				size_t index;
+				switch (accessor.sparse.indices.componentType) {
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+					index = reinterpret_cast<const uint32_t*>(indices)[i];
+					break;
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+					index = reinterpret_cast<const uint16_t*>(indices)[i];
+					break;
+				default:
+					index = indices[i];
+					break;
+				}
+				if (index >= values.size()) {
+					throw std::runtime_error("Sparse accessor index " + std::to_string(index) + " is out of range");
+				}
+				values[index] = ReadVec4(model, sparse_values, i);
+			}
+		}
+		return values;
+	}
+
+	void Model::LoadMorphTargets(const tinygltf::Primitive& primitive, const tinygltf::Model& model, uint32_t vertex_start, uint32_t vertex_count, uint32_t first_weight) {
+		std::vector<std::vector<glm::vec4>> positions(primitive.targets.size());
+		std::vector<std::vector<glm::vec4>> normals(primitive.targets.size());
+		for (size_t t = 0; t < primitive.targets.size(); t++) {
+			auto position = primitive.targets[t].find("POSITION");
+			if (position != primitive.targets[t].end())
+				positions[t] = ReadAccessor(model, model.accessors[position->second]);
+			auto normal = primitive.targets[t].find("NORMAL");
+			if (normal != primitive.targets[t].end())
+				normals[t] = ReadAccessor(model, model.accessors[normal->second]);
+		}
+
+		auto delta_of = [&](size_t t, uint32_t v) {
+			MorphDelta delta;
+			delta.position = v < positions[t].size() ? glm::vec3(positions[t][v]) : glm::vec3(0.0f);
+			delta.normal = v < normals[t].size() ? glm::vec3(normals[t][v]) : glm::vec3(0.0f);
+			return delta;
+		};
+		auto moves = [](const MorphDelta& delta) { return delta.position != glm::vec3(0.0f) || delta.normal != glm::vec3(0.0f); };
+
+		// Vertices any target moves
+		MorphRange range{ vertex_start, vertex_count, static_cast<uint32_t>(m_morph_vertices.size()), 0, static_cast<uint32_t>(m_morph_targets.size()), 0 };
+		std::vector<uint32_t> morph_vertices;
+		for (uint32_t v = 0; v < vertex_count; v++) {
+			for (size_t t = 0; t < primitive.targets.size(); t++) {
+				if (moves(delta_of(t, v))) {
+					const Vertex& rest = m_vertex_buffer[vertex_start + v];
+					m_morph_vertices.push_back({ vertex_start + v, rest.pos, rest.normal });
+					morph_vertices.push_back(v);
+					break;
+				}
+			}
+		}
+		range.morph_vertex_count = static_cast<uint32_t>(morph_vertices.size());
+		if (range.morph_vertex_count == 0)
+			return;
+
+		// Target major, each target only over the span of morph vertices it moves
+		for (size_t t = 0; t < primitive.targets.size(); t++) {
+			uint32_t first = UINT32_MAX;
+			uint32_t last = 0;
+			for (uint32_t i = 0; i < range.morph_vertex_count; i++) {
+				if (moves(delta_of(t, morph_vertices[i]))) {
+					first = std::min(first, i);
+					last = i;
+				}
+			}
+			if (first == UINT32_MAX)
+				continue;
+			m_morph_targets.push_back({ first_weight + static_cast<uint32_t>(t), first, last - first + 1, static_cast<uint32_t>(m_morph_deltas.size()) });
+			for (uint32_t i = first; i <= last; i++) {
+				m_morph_deltas.push_back(delta_of(t, morph_vertices[i]));
+			}
+			range.target_count++;
+		}
+		m_morph_ranges.push_back(range);
+	}
+
+	// Any unit vector perpendicular to n
+	static glm::vec3 Perpendicular(const glm::vec3& n) {
+		const glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		return glm::normalize(glm::cross(n, axis));
+	}
+
+	// Per vertex tangents for primitives that have none: the tangent and bitangent of every triangle
+	// are projected into the tangent plane of each corner and accumulated weighted by the corner
+	// angle. This is not MikkTSpace, which yields tangents per triangle corner, so normal maps
+	// baked against MikkTSpace can show small differences. Vertices are not split, the index
+	// buffer stays as imported.
+	static void ComputeTangents(Vertex* vertices, uint32_t first_vertex, uint32_t vertex_count, const uint32_t* indices,
+		const std::vector<std::pair<uint32_t, uint32_t>>& index_ranges) {
+		std::vector<glm::vec3> tangents(vertex_count, glm::vec3(0.0f));
+		std::vector<glm::vec3> bitangents(vertex_count, glm::vec3(0.0f));
+		for (const auto& [first_index, index_count] : index_ranges) {
+			for (uint32_t i = first_index; i + 2 < first_index + index_count; i += 3) {
+				const uint32_t corners[3] = { indices[i] - first_vertex, indices[i + 1] - first_vertex, indices[i + 2] - first_vertex };
+				if (corners[0] >= vertex_count || corners[1] >= vertex_count || corners[2] >= vertex_count)
+					continue;
+				const Vertex& v0 = vertices[first_vertex + corners[0]];
+				const Vertex& v1 = vertices[first_vertex + corners[1]];
+				const Vertex& v2 = vertices[first_vertex + corners[2]];
+				const glm::vec3 e1 = v1.pos - v0.pos;
+				const glm::vec3 e2 = v2.pos - v0.pos;
+				const glm::vec2 duv1 = v1.uv0 - v0.uv0;
+				const glm::vec2 duv2 = v2.uv0 - v0.uv0;
+				const float det = duv1.x * duv2.y - duv2.x * duv1.y;
+				if (std::abs(det) < 1e-12f)
+					continue;
+				const glm::vec3 tangent = (e1 * duv2.y - e2 * duv1.y) / det;
+				const glm::vec3 bitangent = (e2 * duv1.x - e1 * duv2.x) / det;
+
+				for (int c = 0; c < 3; c++) {
+					const Vertex& corner = vertices[first_vertex + corners[c]];
+					const glm::vec3 a = vertices[first_vertex + corners[(c + 1) % 3]].pos - corner.pos;
+					const glm::vec3 b = vertices[first_vertex + corners[(c + 2) % 3]].pos - corner.pos;
+					const float length_sq = glm::dot(a, a) * glm::dot(b, b);
+					if (length_sq <= 0.0f)
+						continue;
+					const float angle = std::acos(std::clamp(glm::dot(a, b) / std::sqrt(length_sq), -1.0f, 1.0f));
+					const glm::vec3& n = corner.normal;
+					const glm::vec3 t = tangent - n * glm::dot(n, tangent);
+					const glm::vec3 bt = bitangent - n * glm::dot(n, bitangent);
+					const float t_length = glm::length(t);
+					const float bt_length = glm::length(bt);
+					if (t_length > 0.0f)
+						tangents[corners[c]] += t * (angle / t_length);
+					if (bt_length > 0.0f)
+						bitangents[corners[c]] += bt * (angle / bt_length);
+				}
+			}
+		}
+
+		for (uint32_t v = 0; v < vertex_count; v++) {
+			Vertex& vertex = vertices[first_vertex + v];
+			const glm::vec3& n = vertex.normal;
+			glm::vec3 t = tangents[v] - n * glm::dot(n, tangents[v]);
+			const float t_length = glm::length(t);
+			// Unreferenced vertices and degenerate uvs still get a valid frame
+			t = t_length > 1e-6f ? t / t_length : Perpendicular(n);
+			const float w = glm::dot(glm::cross(n, t), bitangents[v]) < 0.0f ? -1.0f : 1.0f;
+			vertex.tangent = glm::vec4(t, w);
+		}
+	}
+
+	void Model::GenerateTangents() {
+		DIFFUSE_PROFILE_FUNCTION();
+		// Jobs own disjoint vertex ranges, so they run without synchronization
+		Utils::JobSystem::ParallelFor(static_cast<uint32_t>(m_tangent_jobs.size()), 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				const TangentJob& job = m_tangent_jobs[i];
+				ComputeTangents(m_vertex_buffer, job.first_vertex, job.vertex_count, m_index_buffer, job.index_ranges);
+			}
+		});
+		for (const TangentJob& job : m_tangent_jobs) {
+			m_load_stats.generated_tangents += job.vertex_count;
+		}
+		m_tangent_jobs.clear();
+	}
+
+	void Model::LoadAnimations(const tinygltf::Model& model) {
+		DIFFUSE_PROFILE_FUNCTION();
+		for (const tinygltf::Animation& source : model.animations) {
+			Animation animation;
+			animation.name = source.name;
+			animation.start = std::numeric_limits<float>::max();
+			animation.end = std::numeric_limits<float>::lowest();
+			for (const tinygltf::AnimationChannel& source_channel : source.channels) {
+				AnimationChannel channel;
+				if (source_channel.target_path == "translation")
+					channel.path = AnimationChannel::PATH_TRANSLATION;
+				else if (source_channel.target_path == "rotation")
+					channel.path = AnimationChannel::PATH_ROTATION;
+				else if (source_channel.target_path == "scale")
+					channel.path = AnimationChannel::PATH_SCALE;
+				else
+					continue;
+
+				auto target = std::find_if(m_linear_nodes.begin(), m_linear_nodes.end(), [&](const Node* node) {
+					return node->index == static_cast<uint32_t>(source_channel.target_node);
+				});
+				if (target == m_linear_nodes.end()) {
+					std::cout << "Animation " << source.name << " targets node " << source_channel.target_node << " outside the scene" << std::endl;
+					continue;
+				}
+				channel.target = static_cast<uint32_t>(target - m_linear_nodes.begin());
+
+				const tinygltf::AnimationSampler& sampler = source.samplers[source_channel.sampler];
+				if (sampler.interpolation == "STEP")
+					channel.interpolation = AnimationChannel::INTERPOLATION_STEP;
+				else if (sampler.interpolation == "CUBICSPLINE")
+					channel.interpolation = AnimationChannel::INTERPOLATION_CUBICSPLINE;
+
+				const tinygltf::Accessor& input = model.accessors[sampler.input];
+				channel.times.resize(input.count);
+				for (size_t i = 0; i < input.count; i++) {
+					channel.times[i] = ReadVec4(model, input, i).x;
+				}
+				const tinygltf::Accessor& output = model.accessors[sampler.output];
+				channel.values.resize(output.count);
+				for (size_t i = 0; i < output.count; i++) {
+					channel.values[i] = ReadVec4(model, output, i);
+				}
+				const size_t values_per_key = channel.interpolation == AnimationChannel::INTERPOLATION_CUBICSPLINE ? 3 : 1;
+				if (channel.times.empty() || channel.values.size() != channel.times.size() * values_per_key) {
+					throw std::runtime_error("Animation " + source.name + " has a sampler with " + std::to_string(channel.times.size()) +
+						" keys and " + std::to_string(channel.values.size()) + " values");
+				}
+
+				animation.start = std::min(animation.start, channel.times.front());
+				animation.end = std::max(animation.end, channel.times.back());
+				animation.channels.push_back(std::move(channel));
+			}
+			if (animation.channels.empty()) {
+				animation.start = animation.end = 0.0f;
+			}
+			m_animation_cursors.emplace_back(animation.channels.size(), 0);
+			m_animations.push_back(std::move(animation));
+		}
+	}
+
+	void Model::UpdateAnimation(uint32_t index, float time) {
+		const Animation& animation = m_animations[index];
+		std::vector<uint32_t>& cursors = m_animation_cursors[index];
+		const float length = animation.end - animation.start;
+		time = animation.start + (length > 0.0f ? std::fmod(std::max(time, 0.0f), length) : 0.0f);
+		for (size_t i = 0; i < animation.channels.size(); i++) {
+			const AnimationChannel& channel = animation.channels[i];
+			const glm::vec4 value = SampleAnimationChannel(channel, time, cursors[i]);
+			Node* node = m_linear_nodes[channel.target];
+			switch (channel.path) {
+			case AnimationChannel::PATH_TRANSLATION:
+				node->translation = glm::vec3(value);
+				break;
+			case AnimationChannel::PATH_ROTATION:
+				node->rotation = glm::quat(value.w, value.x, value.y, value.z);
+				break;
+			case AnimationChannel::PATH_SCALE:
+				node->scale = glm::vec3(value);
+				break;
+			}
+		}
+	}
+
+	// Accessors of the attributes that end up in Vertex, -1 for missing ones
+	static std::vector<int> VertexKey(const tinygltf::Primitive& primitive) {
+		std::vector<int> key;
+		key.reserve(7);
+		for (const char* attribute : { "POSITION", "NORMAL", "TEXCOORD_0", "TEXCOORD_1", "COLOR_0", "TANGENT" }) {
+			auto it = primitive.attributes.find(attribute);
+			key.push_back(it != primitive.attributes.end() ? it->second : -1);
+		}
+		return key;
+	}
+
+	static bool IsShareable(const tinygltf::Node& node, const tinygltf::Primitive& primitive) {
+		return node.skin < 0 && primitive.targets.empty();
+	}
+
+	static bool IsShareable(const tinygltf::Node& node, const tinygltf::Mesh& mesh) {
+		return std::all_of(mesh.primitives.begin(), mesh.primitives.end(), [&](const tinygltf::Primitive& primitive) {
+			return IsShareable(node, primitive);
+		});
+	}
+
+	void Model::GetNodeProps(const tinygltf::Node& node, const tinygltf::Model& model, uint32_t& vertex_count, uint32_t& index_count, GeometryCache& counted) {
 		if (node.children.size() > 0) {
 			for (size_t i = 0; i < node.children.size(); i++) {
-				GetNodeProps(model.nodes[node.children[i]], model, vertex_count, index_count);
+				GetNodeProps(model.nodes[node.children[i]], model, vertex_count, index_count, counted);
 			}
 		}
 		if (node.mesh > -1) {
-			const tinygltf::Mesh mesh = model.meshes[node.mesh];
+			const tinygltf::Mesh& mesh = model.meshes[node.mesh];
+			if (IsShareable(node, mesh) && !counted.meshes.emplace(node.mesh, nullptr).second) {
+				return;
+			}
 			for (size_t i = 0; i < mesh.primitives.size(); i++) {
-				auto primitive = mesh.primitives[i];
-				vertex_count += model.accessors[primitive.attributes.find("POSITION")->second].count;
+				const tinygltf::Primitive& primitive = mesh.primitives[i];
+				const bool shareable = IsShareable(node, primitive);
+				std::vector<int> key = VertexKey(primitive);
+				if (!shareable || counted.vertices.emplace(key, std::make_pair(0u, 0u)).second) {
+					vertex_count += model.accessors[primitive.attributes.find("POSITION")->second].count;
+				}
 				if (primitive.indices > -1) {
-					index_count += model.accessors[primitive.indices].count;
+					key.push_back(primitive.indices);
+					if (!shareable || counted.indices.emplace(key, std::make_pair(0u, 0u)).second) {
+						index_count += model.accessors[primitive.indices].count;
+					}
 				}
 			}
 		}
@@ -218,6 +802,7 @@ namespace Diffuse {
 		new_node->index = node_index;
 		new_node->name = node.name;
 		new_node->matrix = glm::mat4(1.0f);
+		new_node->skin_index = node.skin;
 
 		if (node.translation.size() == 3) {
 			new_node->translation = glm::make_vec3(node.translation.data());
@@ -225,7 +810,7 @@ namespace Diffuse {
 		if (node.rotation.size() == 4) {
 			new_node->rotation = glm::make_quat(node.rotation.data());
 		}
-		if (node.scale.size() == 4) {
+		if (node.scale.size() == 3) {
 			new_node->scale = glm::make_vec3(node.scale.data());
 		}
 		if (node.matrix.size() == 16) {
@@ -237,38 +822,61 @@ namespace Diffuse {
 				LoadNode(new_node, model.nodes[node_index], node_index, model);
 		}
 		
-		if (node.mesh > -1) {
-			const tinygltf::Mesh mesh = model.meshes[node.mesh];
+		const bool shareable_mesh = node.mesh > -1 && IsShareable(node, model.meshes[node.mesh]);
+		auto cached_mesh = shareable_mesh ? m_geometry_cache.meshes.find(node.mesh) : m_geometry_cache.meshes.end();
+		if (cached_mesh != m_geometry_cache.meshes.end()) {
+			// Another node already converted this mesh, draw it once more
+			new_node->mesh = cached_mesh->second;
+			new_node->mesh->instances.push_back(new_node);
+			m_load_stats.shared_mesh_nodes++;
+		}
+		else if (node.mesh > -1) {
+			const tinygltf::Mesh& mesh = model.meshes[node.mesh];
 			Mesh* new_mesh = new Mesh(new_node->matrix);
+			// Morph weights are per node, the mesh only has the defaults
+			const uint32_t first_morph_weight = static_cast<uint32_t>(m_morph_weights.size());
+			size_t morph_target_count = 0;
+			for (auto& primitive : mesh.primitives) {
+				morph_target_count = std::max(morph_target_count, primitive.targets.size());
+			}
+			if (morph_target_count > 0) {
+				const std::vector<double>& weights = !node.weights.empty() ? node.weights : mesh.weights;
+				for (size_t t = 0; t < morph_target_count; t++) {
+					m_morph_weights.push_back(t < weights.size() ? static_cast<float>(weights[t]) : 0.0f);
+				}
+			}
 			for (auto& primitive : mesh.primitives) {
 				uint32_t vertex_start = m_vertex_pos;
 				uint32_t index_start = m_index_pos;
 				uint32_t vertex_count = 0;
 				uint32_t index_count = 0;
-				// Vertices
-				{
+				const bool shareable = IsShareable(node, primitive);
+				std::vector<int> key = VertexKey(primitive);
+				auto cached_vertices = shareable ? m_geometry_cache.vertices.find(key) : m_geometry_cache.vertices.end();
+				if (cached_vertices != m_geometry_cache.vertices.end()) {
+					vertex_start = cached_vertices->second.first;
+					vertex_count = cached_vertices->second.second;
+					m_load_stats.shared_primitives++;
+				}
+				else {
+					// Vertices
 					const float* buffer_pos = nullptr;
 					const float* buffer_normals = nullptr;
 					const float* buffer_uv_set0 = nullptr;
 					const float* buffer_uv_set1 = nullptr;
 					const float* buffer_color_set0 = nullptr;
-					const void*  buffer_joints = nullptr;
-					const float* buffer_weights = nullptr;
+					const tinygltf::Accessor* joints_accessor = nullptr;
+					const tinygltf::Accessor* weights_accessor = nullptr;
+					const tinygltf::Accessor* tangent_accessor = nullptr;
 
-					int posByteStride;
-					int normByteStride;
-					int uv0ByteStride;
-					int uv1ByteStride;
-					int color0ByteStride;
-					int jointByteStride;
-					int weightByteStride;
+					VertexStreams streams;
 
 					if (primitive.attributes.find("POSITION") != primitive.attributes.end()) {
 						const tinygltf::Accessor& pos_accessor = model.accessors[primitive.attributes.find("POSITION")->second];
 						const tinygltf::BufferView& pos_view = model.bufferViews[pos_accessor.bufferView];
 						vertex_count = static_cast<uint32_t>(pos_accessor.count);
 						buffer_pos = reinterpret_cast<const float*>(&(model.buffers[pos_view.buffer].data[pos_accessor.byteOffset + pos_view.byteOffset]));
-						posByteStride = pos_accessor.ByteStride(pos_view) ? (pos_accessor.ByteStride(pos_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
+						streams.position_stride = pos_accessor.ByteStride(pos_view) ? (pos_accessor.ByteStride(pos_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
 					}
 					else {
 						assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
@@ -278,45 +886,87 @@ namespace Diffuse {
 						const tinygltf::Accessor& normal_accessor = model.accessors[primitive.attributes.find("NORMAL")->second];
 						const tinygltf::BufferView& normal_view = model.bufferViews[normal_accessor.bufferView];
 						buffer_normals = reinterpret_cast<const float*>(&(model.buffers[normal_view.buffer].data[normal_accessor.byteOffset + normal_view.byteOffset]));
-						normByteStride = normal_accessor.ByteStride(normal_view) ? (normal_accessor.ByteStride(normal_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
+						streams.normal_stride = normal_accessor.ByteStride(normal_view) ? (normal_accessor.ByteStride(normal_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
 					}
 
 					if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
 						const tinygltf::Accessor& uv0_accessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
 						const tinygltf::BufferView& uv0_view = model.bufferViews[uv0_accessor.bufferView];
 						buffer_uv_set0 = reinterpret_cast<const float*>(&(model.buffers[uv0_view.buffer].data[uv0_accessor.byteOffset + uv0_view.byteOffset]));
-						uv0ByteStride = uv0_accessor.ByteStride(uv0_view) ? (uv0_accessor.ByteStride(uv0_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
+						streams.uv0_stride = uv0_accessor.ByteStride(uv0_view) ? (uv0_accessor.ByteStride(uv0_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
 					}
 
 					if (primitive.attributes.find("TEXCOORD_1") != primitive.attributes.end()) {
 						const tinygltf::Accessor& uv1_accessor = model.accessors[primitive.attributes.find("TEXCOORD_1")->second];
 						const tinygltf::BufferView& uv1_view = model.bufferViews[uv1_accessor.bufferView];
 						buffer_uv_set1 = reinterpret_cast<const float*>(&(model.buffers[uv1_view.buffer].data[uv1_accessor.byteOffset + uv1_view.byteOffset]));
-						uv1ByteStride = uv1_accessor.ByteStride(uv1_view) ? (uv1_accessor.ByteStride(uv1_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
+						streams.uv1_stride = uv1_accessor.ByteStride(uv1_view) ? (uv1_accessor.ByteStride(uv1_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
 					}
 
 					if (primitive.attributes.find("COLOR_0") != primitive.attributes.end()) {
 						const tinygltf::Accessor& color0_accessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
 						const tinygltf::BufferView& uv1_view = model.bufferViews[color0_accessor.bufferView];
 						buffer_color_set0 = reinterpret_cast<const float*>(&(model.buffers[uv1_view.buffer].data[color0_accessor.byteOffset + uv1_view.byteOffset]));
-						color0ByteStride = color0_accessor.ByteStride(uv1_view) ? (color0_accessor.ByteStride(uv1_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
+						streams.color_stride = color0_accessor.ByteStride(uv1_view) ? (color0_accessor.ByteStride(uv1_view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
+					}
+
+					// Skinning stream, only for primitives of skinned nodes
+					if (node.skin > -1 && primitive.attributes.find("JOINTS_0") != primitive.attributes.end() &&
+						primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
+						joints_accessor = &model.accessors[primitive.attributes.find("JOINTS_0")->second];
+						weights_accessor = &model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
+						m_skinned_ranges.push_back({ vertex_start, vertex_count, static_cast<uint32_t>(m_skin_vertices.size()), static_cast<uint32_t>(node.skin) });
+					}
+
+					if (primitive.attributes.find("TANGENT") != primitive.attributes.end()) {
+						tangent_accessor = &model.accessors[primitive.attributes.find("TANGENT")->second];
+					}
+					else if (buffer_normals && buffer_uv_set0 && primitive.indices > -1) {
+						// Generated once all geometry is converted, from the triangles of every primitive drawing the range
+						m_geometry_cache.tangent_jobs.emplace(vertex_start, static_cast<uint32_t>(m_tangent_jobs.size()));
+						m_tangent_jobs.push_back({ vertex_start, vertex_count, {} });
 					}
 
-					const tinygltf::Accessor& pos_accessor = model.accessors[primitive.attributes.find("POSITION")->second];
-					for (size_t v = 0; v < pos_accessor.count; v++) {
-						Vertex& vert = m_vertex_buffer[m_vertex_pos];
-						vert.pos = glm::vec4(glm::make_vec3(&buffer_pos[v * posByteStride]), 1.0f);
-						vert.normal = glm::normalize(glm::vec3(buffer_normals ? glm::make_vec3(&buffer_normals[v * normByteStride]) : glm::vec3(0.0f)));
-						vert.uv0 = buffer_uv_set0 ? glm::make_vec2(&buffer_uv_set0[v * uv0ByteStride]) : glm::vec3(0.0f);
-						vert.uv1 = buffer_uv_set1 ? glm::make_vec2(&buffer_uv_set1[v * uv1ByteStride]) : glm::vec3(0.0f);
-						vert.color = buffer_color_set0 ? glm::make_vec4(&buffer_color_set0[v * color0ByteStride]) : glm::vec4(1.0f);
+					streams.position = buffer_pos;
+					streams.normal = buffer_normals;
+					streams.uv0 = buffer_uv_set0;
+					streams.uv1 = buffer_uv_set1;
+					streams.color = buffer_color_set0;
+					ConvertVertices(streams, vertex_count, &m_vertex_buffer[m_vertex_pos]);
+
+					// Accessors of any component type go through ReadVec4
+					for (size_t v = 0; v < vertex_count; v++) {
+						if (tangent_accessor) {
+							m_vertex_buffer[m_vertex_pos].tangent = ReadVec4(model, *tangent_accessor, v);
+						}
+						if (joints_accessor) {
+							SkinVertex skin_vertex;
+							skin_vertex.joints = glm::uvec4(ReadVec4(model, *joints_accessor, v));
+							skin_vertex.weights = ReadVec4(model, *weights_accessor, v);
+							const float weight_sum = skin_vertex.weights.x + skin_vertex.weights.y + skin_vertex.weights.z + skin_vertex.weights.w;
+							skin_vertex.weights = weight_sum > 0.0f ? skin_vertex.weights / weight_sum : glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+							m_skin_vertices.push_back(skin_vertex);
+						}
 
 						m_vertex_pos++;
 					}
 
+					if (!primitive.targets.empty()) {
+						LoadMorphTargets(primitive, model, vertex_start, vertex_count, first_morph_weight);
+					}
+					if (shareable) {
+						m_geometry_cache.vertices.emplace(key, std::make_pair(vertex_start, vertex_count));
+					}
 				}
 				bool has_indices = primitive.indices > -1;
-				if (has_indices) {
+				// Indices are offset by the vertex range, so they are only shared along with it
+				key.push_back(primitive.indices);
+				auto cached_indices = shareable && has_indices ? m_geometry_cache.indices.find(key) : m_geometry_cache.indices.end();
+				if (cached_indices != m_geometry_cache.indices.end()) {
+					index_start = cached_indices->second.first;
+					index_count = cached_indices->second.second;
+				}
+				else if (has_indices) {
 					const tinygltf::Accessor& accessor = model.accessors[primitive.indices];
 					const tinygltf::BufferView& buffer_view = model.bufferViews[accessor.bufferView];
 					const tinygltf::Buffer& buffer = model.buffers[buffer_view.buffer];
@@ -326,33 +976,29 @@ namespace Diffuse {
 
 					switch (accessor.componentType) {
 					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-						const uint32_t* buf = static_cast<const uint32_t*>(data_ptr);
-						for (size_t index = 0; index < accessor.count; index++) {
-							m_index_buffer[m_index_pos] = buf[index] + vertex_start;
-							m_index_pos++;
-						}
+						RebaseIndices(static_cast<const uint32_t*>(data_ptr), accessor.count, vertex_start, &m_index_buffer[m_index_pos]);
 						break;
 					}
 					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-						const uint16_t* buf = static_cast<const uint16_t*>(data_ptr);
-						for (size_t index = 0; index < accessor.count; index++) {
-							m_index_buffer[m_index_pos] = buf[index] + vertex_start;
-							m_index_pos++;
-						}
+						RebaseIndices(static_cast<const uint16_t*>(data_ptr), accessor.count, vertex_start, &m_index_buffer[m_index_pos]);
 						break;
 					}
 					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-						const uint8_t* buf = static_cast<const uint8_t*>(data_ptr);
-						for (size_t index = 0; index < accessor.count; index++) {
-							m_index_buffer[m_index_pos] = buf[index] + vertex_start;
-							m_index_pos++;
-						}
+						RebaseIndices(static_cast<const uint8_t*>(data_ptr), accessor.count, vertex_start, &m_index_buffer[m_index_pos]);
 						break;
 					}
 					default:
 						std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
 						return;
 					}
+					m_index_pos += index_count;
+					if (shareable) {
+						m_geometry_cache.indices.emplace(key, std::make_pair(index_start, index_count));
+					}
+					auto tangent_job = m_geometry_cache.tangent_jobs.find(vertex_start);
+					if (tangent_job != m_geometry_cache.tangent_jobs.end()) {
+						m_tangent_jobs[tangent_job->second].index_ranges.emplace_back(index_start, index_count);
+					}
 				}
 				else {
 					assert(false);
@@ -361,7 +1007,12 @@ namespace Diffuse {
 				Primitive* new_primitive = new Primitive(index_start, index_count, vertex_count, mat_index);
 				new_mesh->primitives.push_back(new_primitive);
 			}
+			new_mesh->instances.push_back(new_node);
 			new_node->mesh = new_mesh;
+			m_meshes.push_back(new_mesh);
+			if (shareable_mesh) {
+				m_geometry_cache.meshes.emplace(node.mesh, new_mesh);
+			}
 		}
 		if (parent) {
 			parent->children.push_back(new_node);
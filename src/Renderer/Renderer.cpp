@@ -1,14 +1,27 @@
 #include "Renderer.hpp"
+#include "AllocationCounter.hpp"
 
 #include "tiny_gltf.h"
+#include <cassert>
 #include <iostream>
 #include <unordered_map>
 
 namespace Diffuse {
+	// Frames that may still size the per frame containers, one round through the frames in flight and some slack
+	static constexpr uint64_t s_allocation_warmup_frames = 8;
+
 	Renderer::Renderer(GraphicsDevice* graphics_device)
 		:device(graphics_device) { }
 
-	void Renderer::RenderScene(const std::shared_ptr<Scene> scene, std::shared_ptr<EditorCamera> camera, float dt) {
+	void Renderer::RenderScene(const std::shared_ptr<Scene>& scene, const std::shared_ptr<EditorCamera>& camera, float dt) {
+		const uint64_t allocations = Utils::AllocationCounter::Count();
+		scene->Animate(dt);
 		device->Draw(scene, camera, dt);
+
+		// Once every container of the frame loop has grown to its final size a frame must not allocate,
+		// on this thread or on the job system workers. Captures are exempt.
+		m_frame_allocations = Utils::AllocationCounter::Count() - allocations;
+		m_frames_rendered++;
+		assert(m_frame_allocations == 0 || m_frames_rendered <= s_allocation_warmup_frames || device->IsCapturing());
 	}
-}
\ No newline at end of file
+}
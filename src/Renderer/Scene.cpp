@@ -1,5 +1,23 @@
 #include "Scene.hpp"
 
-namespace Diffuse {
+#include "JobSystem.hpp"
+#include "Profiler.hpp"
 
-}
\ No newline at end of file
+namespace Diffuse {
+	void Scene::Animate(float dt) {
+		DIFFUSE_PROFILE_FUNCTION();
+		m_animated.clear();
+		for (auto& object : m_scene_objects) {
+			if (object->p_animation >= 0 && static_cast<size_t>(object->p_animation) < object->p_model.GetAnimations().size())
+				m_animated.push_back(object.get());
+		}
+		// Objects never share nodes, so every hierarchy is sampled independently
+		Utils::JobSystem::ParallelFor(static_cast<uint32_t>(m_animated.size()), 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				SceneObject* object = m_animated[i];
+				object->p_animation_time += dt;
+				object->p_model.UpdateAnimation(static_cast<uint32_t>(object->p_animation), object->p_animation_time);
+			}
+		});
+	}
+}
@@ -0,0 +1,200 @@
+#include "StressScene.hpp"
+
+#include "GraphicsDevice.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace Diffuse {
+	static constexpr float s_box_half_extent = 0.4f;
+
+	// Appends raw data to the model's single buffer and returns the view that covers it
+	static int AddBufferView(tinygltf::Model& model, const void* data, size_t size) {
+		tinygltf::Buffer& buffer = model.buffers[0];
+		tinygltf::BufferView view;
+		view.buffer = 0;
+		view.byteOffset = buffer.data.size();
+		view.byteLength = size;
+		buffer.data.resize(buffer.data.size() + size);
+		memcpy(buffer.data.data() + view.byteOffset, data, size);
+		model.bufferViews.push_back(view);
+		return static_cast<int>(model.bufferViews.size() - 1);
+	}
+
+	static int AddAccessor(tinygltf::Model& model, int buffer_view, int component_type, int type, size_t count) {
+		tinygltf::Accessor accessor;
+		accessor.bufferView = buffer_view;
+		accessor.componentType = component_type;
+		accessor.type = type;
+		accessor.count = count;
+		model.accessors.push_back(accessor);
+		return static_cast<int>(model.accessors.size() - 1);
+	}
+
+	// 24 vertex box so every face has its own normals
+	static tinygltf::Primitive AddBox(tinygltf::Model& model, const glm::vec3& center) {
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> uvs;
+		std::vector<uint16_t> indices;
+		for (int axis = 0; axis < 3; axis++) {
+			for (float sign : { 1.0f, -1.0f }) {
+				glm::vec3 normal(0.0f);
+				normal[axis] = sign;
+				const glm::vec3 u = glm::vec3(normal.y, normal.z, normal.x);
+				const glm::vec3 v = glm::cross(normal, u);
+				const uint16_t first = static_cast<uint16_t>(positions.size());
+				for (int corner = 0; corner < 4; corner++) {
+					const float cu = (corner & 1) ? 1.0f : -1.0f;
+					const float cv = (corner & 2) ? 1.0f : -1.0f;
+					positions.push_back(center + s_box_half_extent * (normal + cu * u + cv * v));
+					normals.push_back(normal);
+					uvs.push_back(glm::vec2(cu, cv) * 0.5f + 0.5f);
+				}
+				for (uint16_t index : { 0, 1, 3, 0, 3, 2 }) {
+					indices.push_back(static_cast<uint16_t>(first + index));
+				}
+			}
+		}
+
+		tinygltf::Primitive primitive;
+		primitive.mode = TINYGLTF_MODE_TRIANGLES;
+		primitive.attributes["POSITION"] = AddAccessor(model, AddBufferView(model, positions.data(), positions.size() * sizeof(glm::vec3)),
+			TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, positions.size());
+		primitive.attributes["NORMAL"] = AddAccessor(model, AddBufferView(model, normals.data(), normals.size() * sizeof(glm::vec3)),
+			TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, normals.size());
+		primitive.attributes["TEXCOORD_0"] = AddAccessor(model, AddBufferView(model, uvs.data(), uvs.size() * sizeof(glm::vec2)),
+			TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2, uvs.size());
+		primitive.indices = AddAccessor(model, AddBufferView(model, indices.data(), indices.size() * sizeof(uint16_t)),
+			TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_SCALAR, indices.size());
+		return primitive;
+	}
+
+	// Two tone checkerboard, RGBA8
+	static tinygltf::Image CheckerImage(uint32_t size, const glm::vec3& color) {
+		tinygltf::Image image;
+		image.width = static_cast<int>(size);
+		image.height = static_cast<int>(size);
+		image.component = 4;
+		image.bits = 8;
+		image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+		image.image.resize(static_cast<size_t>(size) * size * 4);
+		const uint32_t cell = std::max(size / 8, 1u);
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				const float shade = ((x / cell + y / cell) & 1) ? 1.0f : 0.5f;
+				unsigned char* texel = &image.image[(static_cast<size_t>(y) * size + x) * 4];
+				texel[0] = static_cast<unsigned char>(255.0f * color.r * shade);
+				texel[1] = static_cast<unsigned char>(255.0f * color.g * shade);
+				texel[2] = static_cast<unsigned char>(255.0f * color.b * shade);
+				texel[3] = 255;
+			}
+		}
+		return image;
+	}
+
+	// Smallest n with n^3 >= count, the side of the cube the boxes of one object are packed into
+	static uint32_t CubeSide(uint32_t count) {
+		uint32_t side = 1;
+		while (side * side * side < count) {
+			side++;
+		}
+		return side;
+	}
+
+	static glm::vec3 ObjectOrigin(const StressSceneDesc& desc, uint32_t object_index) {
+		const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(std::max(desc.object_count, 1u)))));
+		const float spacing = CubeSide(std::max(desc.primitives_per_object, 1u)) + 1.0f;
+		const float x = static_cast<float>(object_index % columns) - 0.5f * (columns - 1);
+		const float z = static_cast<float>(object_index / columns) - 0.5f * (columns - 1);
+		return glm::vec3(x, 0.0f, z) * spacing;
+	}
+
+	tinygltf::Model GenerateStressModel(const StressSceneDesc& desc, uint32_t object_index) {
+		std::mt19937 rng(desc.seed * 7919u + object_index);
+		std::uniform_real_distribution<float> unit(0.2f, 1.0f);
+
+		const uint32_t primitive_count = std::max(desc.primitives_per_object, 1u);
+		const uint32_t depth = std::max(desc.hierarchy_depth, 1u);
+		const uint32_t side = CubeSide(primitive_count);
+		const glm::vec3 origin = ObjectOrigin(desc, object_index);
+
+		tinygltf::Model model;
+		model.buffers.resize(1);
+
+		for (uint32_t i = 0; i < desc.texture_count; i++) {
+			model.images.push_back(CheckerImage(desc.texture_size, glm::vec3(unit(rng), unit(rng), unit(rng))));
+			tinygltf::Texture texture;
+			texture.source = static_cast<int>(i);
+			model.textures.push_back(texture);
+		}
+
+		const uint32_t material_count = desc.unique_materials ? primitive_count : 1;
+		for (uint32_t i = 0; i < material_count; i++) {
+			tinygltf::Material material;
+			material.values["baseColorFactor"].number_array = { unit(rng), unit(rng), unit(rng), 1.0 };
+			material.values["metallicFactor"].number_value = 0.0;
+			material.values["metallicFactor"].has_number_value = true;
+			material.values["roughnessFactor"].number_value = unit(rng);
+			material.values["roughnessFactor"].has_number_value = true;
+			if (desc.texture_count > 0)
+				material.values["baseColorTexture"].json_double_value["index"] = static_cast<double>(i % desc.texture_count);
+			model.materials.push_back(material);
+		}
+
+		// Primitives go to the levels of the node chain round robin
+		model.meshes.resize(depth);
+		for (uint32_t i = 0; i < primitive_count; i++) {
+			const glm::vec3 cell(static_cast<float>(i % side), static_cast<float>(i / side % side), static_cast<float>(i / (side * side)));
+			tinygltf::Primitive primitive = AddBox(model, origin + cell);
+			primitive.material = desc.unique_materials ? static_cast<int>(i) : 0;
+			model.meshes[i % depth].primitives.push_back(primitive);
+		}
+
+		for (uint32_t level = 0; level < depth; level++) {
+			tinygltf::Node node;
+			node.name = "level " + std::to_string(level);
+			node.mesh = model.meshes[level].primitives.empty() ? -1 : static_cast<int>(level);
+			if (level + 1 < depth)
+				node.children.push_back(static_cast<int>(level + 1));
+			model.nodes.push_back(node);
+		}
+
+		tinygltf::Scene scene;
+		scene.nodes.push_back(0);
+		model.scenes.push_back(scene);
+		model.defaultScene = 0;
+		return model;
+	}
+
+	std::shared_ptr<Scene> GenerateStressScene(const StressSceneDesc& desc, GraphicsDevice* device, const std::string& skybox_path) {
+		DIFFUSE_PROFILE_FUNCTION();
+		std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+		std::vector<std::shared_ptr<SceneObject>> objects(desc.object_count);
+		std::shared_ptr<Skybox> skybox = std::make_shared<Skybox>();
+
+		// Generation and loading run per object on the job system, the scene keeps the object order
+		std::vector<std::function<void()>> loads;
+		loads.reserve(desc.object_count + 1);
+		for (uint32_t i = 0; i < desc.object_count; i++) {
+			objects[i] = std::make_shared<SceneObject>();
+			loads.push_back([&desc, &objects, device, i] {
+				tinygltf::Model model = GenerateStressModel(desc, i);
+				objects[i]->p_model.Load(model, device);
+			});
+		}
+		loads.push_back([&] { skybox->p_model.Load(skybox_path, device); });
+		Model::LoadAll(loads);
+
+		for (const std::shared_ptr<SceneObject>& object : objects) {
+			scene->AddSceneObect(object);
+		}
+		scene->AddSkybox(skybox);
+		return scene;
+	}
+}
@@ -2,28 +2,34 @@
 
 #include "GraphicsDevice.hpp"
 #include "VulkanUtilities.hpp"
+#include "Profiler.hpp"
+#include "LoadReport.hpp"
+#include "JobSystem.hpp"
+#include "LoaderKernels.hpp"
 
 #include "stb_image.h"
 
 namespace Diffuse {
-	Texture2D::Texture2D(tinygltf::Image image, TextureSampler sampler, VkQueue copy_queue, GraphicsDevice* graphics_device) {
+	Texture2D::Texture2D(tinygltf::Image image, TextureSampler sampler, TextureUsage usage, VkQueue copy_queue, GraphicsDevice* graphics_device, TextureLoadStats* stats) {
+		DIFFUSE_PROFILE_SCOPE("Texture2D (glTF)");
 		m_graphics_device = graphics_device;
 
+		// Phases are only accounted when the caller asked for them
+		auto phase = [stats](LoadPhase load_phase) { return stats ? &stats->phases[load_phase] : nullptr; };
+
 		unsigned char* buffer = nullptr;
 		bool delete_buffer = false;
 		VkDeviceSize buffer_size = 0;
 		if (image.component == 3) {
+			PhaseTimer convert_timer(phase(LoadPhase::Convert), static_cast<uint64_t>(image.width) * image.height * 4);
 			buffer_size = image.width* image.height * 4;
 			buffer = new unsigned char[buffer_size];
+			const unsigned char* rgb = &image.image[0];
 			unsigned char* rgba = buffer;
-			unsigned char* rgb = &image.image[0];
-			for (int i = 0; i < image.width * image.height; i++) {
-				for (int j = 0; j < 3; j++) {
-					rgba[j] = rgb[j];
-				}
-				rgba += 4;
-				rgb += 3;
-			}
+			// Rows are independent
+			Utils::JobSystem::ParallelFor(static_cast<uint32_t>(image.height), 64, [&](uint32_t begin, uint32_t end) {
+				ExpandRgbToRgba(rgb, rgba, static_cast<size_t>(begin) * image.width, static_cast<size_t>(end) * image.width);
+			});
 			delete_buffer = true;
 		}
 		else {
@@ -31,7 +37,8 @@ namespace Diffuse {
 			buffer_size = image.image.size();
 		}
 
-		VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+		// Blits between sRGB images filter in linear space, so the mip chain below is correct for both
+		VkFormat format = usage == TextureUsage::Color ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
 
 		VkFormatProperties formatProperties;
 
@@ -50,6 +57,7 @@ namespace Diffuse {
 		VkBuffer stagingBuffer;
 		VkDeviceMemory stagingMemory;
 
+		PhaseTimer upload_timer(phase(LoadPhase::Upload), buffer_size);
 		VkBufferCreateInfo bufferCreateInfo{};
 		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferCreateInfo.size = buffer_size;
@@ -143,14 +151,20 @@ namespace Diffuse {
 			vkCmdPipelineBarrier(copy_cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
 		}
 
+		upload_timer.Stop();
+
 		// TODO: implement this
 		//device->flushCommandBuffer(copyCmd, copyQueue, true);
-		m_graphics_device->FlushCommandBuffer(copy_cmd, copy_queue, true);
+		{
+			PhaseTimer wait_timer(phase(LoadPhase::Wait));
+			m_graphics_device->FlushCommandBuffer(copy_cmd, copy_queue, true);
+		}
 
 		vkFreeMemory(m_graphics_device->Device(), stagingMemory, nullptr);
 		vkDestroyBuffer(m_graphics_device->Device(), stagingBuffer, nullptr);
 
 		// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
+		PhaseTimer mipgen_timer(phase(LoadPhase::MipGen));
 		VkCommandBuffer blit_cmd = m_graphics_device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 		for (uint32_t i = 1; i < m_mip_levels; i++) {
 			VkImageBlit imageBlit{};
@@ -217,7 +231,12 @@ namespace Diffuse {
 			vkCmdPipelineBarrier(blit_cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 		}
 
-		m_graphics_device->FlushCommandBuffer(blit_cmd, copy_queue, true);
+		mipgen_timer.Stop();
+
+		{
+			PhaseTimer wait_timer(phase(LoadPhase::Wait));
+			m_graphics_device->FlushCommandBuffer(blit_cmd, copy_queue, true);
+		}
 
 		VkSamplerCreateInfo samplerInfo{};
 		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -261,6 +280,7 @@ namespace Diffuse {
 	}
 
 	Texture2D::Texture2D(const std::string& path, VkFormat format, TextureSampler sampler, VkImageUsageFlags additionalUsage, GraphicsDevice* graphics_device, bool null_texture) {
+		DIFFUSE_PROFILE_SCOPE("Texture2D (file)");
 		m_graphics_device = graphics_device;
 		// Create Texture Image
 		int texWidth, texHeight, texChannels;
@@ -319,6 +339,8 @@ namespace Diffuse {
 		createInfo.usage = usage;
 		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// File textures include the environment source, which the bake reads on the compute queue
+		m_graphics_device->ShareWithComputeQueue(createInfo);
 		if (vkCreateImage(m_graphics_device->Device(), &createInfo, nullptr, &m_texture_image) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create image");
 		}
@@ -373,7 +395,7 @@ namespace Diffuse {
 		vkFlushMappedMemoryRanges(m_graphics_device->Device(), 1, &flushRange);
 		vkUnmapMemory(m_graphics_device->Device(), staging_memory);
 
-		VkCommandBuffer copy_cmd = vkUtilities::BeginSingleTimeCommands(m_graphics_device->CommandPool(), m_graphics_device->Device());
+		VkCommandBuffer copy_cmd = m_graphics_device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 		{
 			VkImageMemoryBarrier barrier{};
 			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -422,7 +444,7 @@ namespace Diffuse {
 			vkCmdPipelineBarrier(copy_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, size, &barrier);
 		}
 
-		vkUtilities::EndSingleTimeCommands(copy_cmd, m_graphics_device->Device(), m_graphics_device->Queue(), m_graphics_device->CommandPool());
+		m_graphics_device->FlushCommandBuffer(copy_cmd, m_graphics_device->Queue(), true);
 
 		VkSamplerCreateInfo samplerInfo{};
 		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -510,9 +532,11 @@ namespace Diffuse {
 			VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			m_texture_image, m_texture_image_memory, 1, 1);
 
-		vkUtilities::TransitionImageLayout(m_graphics_device->Queue(), m_graphics_device->CommandPool(), m_graphics_device->Device(), m_texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-		vkUtilities::CopyBufferToImage(m_graphics_device->Queue(), m_graphics_device->CommandPool(), m_graphics_device->Device(), stagingBuffer, m_texture_image, static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height));
-		vkUtilities::TransitionImageLayout(m_graphics_device->Queue(), m_graphics_device->CommandPool(), m_graphics_device->Device(), m_texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkCommandBuffer copy_cmd = m_graphics_device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkUtilities::RecordTransitionImageLayout(copy_cmd, m_texture_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		vkUtilities::RecordCopyBufferToImage(copy_cmd, stagingBuffer, m_texture_image, static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height));
+		vkUtilities::RecordTransitionImageLayout(copy_cmd, m_texture_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		m_graphics_device->FlushCommandBuffer(copy_cmd, m_graphics_device->Queue(), true);
 
 		vkDestroyBuffer(m_graphics_device->Device(), stagingBuffer, nullptr);
 		vkFreeMemory(m_graphics_device->Device(), stagingMemory, nullptr);
@@ -555,6 +579,7 @@ namespace Diffuse {
 	}
 
 	Texture2D::Texture2D(uint32_t width, uint32_t height, uint32_t layers, VkFormat format, uint32_t levels, VkImageUsageFlags additionalUsage, GraphicsDevice* graphics_device) {
+		DIFFUSE_PROFILE_SCOPE("Texture2D (storage)");
 		m_graphics_device = graphics_device;
 		m_width = width;
 		m_height = height;
@@ -0,0 +1,182 @@
+#include "FrameScheduler.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Step order and budgets of Utils::FrameScheduler, registered with ctest as frame_scheduler.
+// Only the TuneBudget checks depend on timing, they sleep well past the thresholds they test.
+
+namespace {
+	uint32_t s_failures = 0;
+
+	void Check(bool condition, const char* test, const std::string& what) {
+		if (condition)
+			return;
+		std::cout << test << ": " << what << std::endl;
+		s_failures++;
+	}
+
+	bool Near(double a, double b) {
+		return std::abs(a - b) < 1e-9;
+	}
+
+	// Appends its name to the log every step, finishes after step_count steps
+	Utils::BackgroundTask LoggingTask(const char* name, float visibility, uint64_t bytes, uint32_t step_count, std::vector<std::string>& log) {
+		Utils::BackgroundTask task;
+		task.name = name;
+		task.visibility = visibility;
+		task.bytes = bytes;
+		task.step = [name, step_count, &log, steps = 0u](Utils::BackgroundTask&) mutable {
+			log.push_back(name);
+			return ++steps == step_count;
+		};
+		return task;
+	}
+
+	// The byte budget leaves room for one step per frame, so the log shows the order
+	void TestPriorityOrder() {
+		const char* test = "priority order";
+		Utils::FrameScheduler scheduler;
+		scheduler.SetByteBudget(100);
+		std::vector<std::string> log;
+		scheduler.Add(LoggingTask("hidden", 0.0f, 100, 1, log));
+		scheduler.Add(LoggingTask("visible", 1.0f, 100, 1, log));
+		scheduler.Add(LoggingTask("half", 0.5f, 100, 1, log));
+
+		scheduler.RunFrame(1.0);
+		Check(scheduler.GetStats().steps == 1, test, "more than one step within the byte budget");
+		Check(scheduler.GetStats().deferred == 2, test, "two tasks should be left for later frames");
+		scheduler.RunFrame(1.0);
+		scheduler.RunFrame(1.0);
+		Check(log == std::vector<std::string>{ "visible", "half", "hidden" }, test, "tasks did not run by visibility");
+		Check(scheduler.GetPendingCount() == 0, test, "finished tasks are still pending");
+	}
+
+	void TestEqualPriorityKeepsOrder() {
+		const char* test = "equal priority";
+		Utils::FrameScheduler scheduler;
+		scheduler.SetByteBudget(100);
+		std::vector<std::string> log;
+		scheduler.Add(LoggingTask("first", 0.5f, 100, 1, log));
+		scheduler.Add(LoggingTask("second", 0.5f, 100, 1, log));
+		scheduler.Add(LoggingTask("third", 0.5f, 100, 1, log));
+		for (uint32_t i = 0; i < 3; i++) {
+			scheduler.RunFrame(1.0);
+		}
+		Check(log == std::vector<std::string>{ "first", "second", "third" }, test, "tasks did not run in the order they were added");
+	}
+
+	void TestByteBudget() {
+		const char* test = "byte budget";
+		Utils::FrameScheduler scheduler;
+		scheduler.SetByteBudget(100);
+		std::vector<std::string> log;
+		scheduler.Add(LoggingTask("upload", 0.0f, 40, 5, log));
+		// 40 + 40 fit, a third step would make 120
+		scheduler.RunFrame(1.0);
+		Check(scheduler.GetStats().steps == 2, test, "expected two steps, got " + std::to_string(scheduler.GetStats().steps));
+		Check(scheduler.GetStats().spent_bytes == 80, test, "expected 80 bytes, got " + std::to_string(scheduler.GetStats().spent_bytes));
+		scheduler.RunFrame(1.0);
+		scheduler.RunFrame(1.0);
+		Check(scheduler.GetStats().steps == 1 && scheduler.GetStats().finished == 1, test, "the last step should finish the task");
+
+		// The first step of a frame runs even when it alone is over the budget
+		scheduler.Add(LoggingTask("large", 0.0f, 1000, 1, log));
+		scheduler.RunFrame(1.0);
+		Check(scheduler.GetStats().finished == 1, test, "a step over the budget never ran");
+	}
+
+	// A waiting task overtakes a visible one that was added later
+	void TestAging() {
+		const char* test = "aging";
+		Utils::FrameScheduler scheduler;
+		scheduler.SetByteBudget(100);
+		std::vector<std::string> log;
+		scheduler.Add(LoggingTask("old", 0.0f, 100, 1000, log));
+		for (uint32_t i = 0; i < 200; i++) {
+			scheduler.RunFrame(1.0);
+		}
+		scheduler.Add(LoggingTask("new", 1.0f, 100, 1000, log));
+		log.clear();
+		scheduler.RunFrame(1.0);
+		Check(log == std::vector<std::string>{ "old" }, test, "a task waiting 200 frames should outrank a new visible one");
+	}
+
+	void TestSetVisibility() {
+		const char* test = "set visibility";
+		Utils::FrameScheduler scheduler;
+		scheduler.SetByteBudget(100);
+		std::vector<std::string> log;
+		scheduler.Add(LoggingTask("a", 1.0f, 100, 2, log));
+		const uint64_t b = scheduler.Add(LoggingTask("b", 0.5f, 100, 2, log));
+		scheduler.RunFrame(1.0);
+		// b is already scheduled, c still waits to be picked up by the next RunFrame
+		scheduler.SetVisibility(b, 2.0f);
+		scheduler.RunFrame(1.0);
+		const uint64_t c = scheduler.Add(LoggingTask("c", 0.0f, 100, 1, log));
+		scheduler.SetVisibility(c, 10.0f);
+		scheduler.RunFrame(1.0);
+		Check(log == std::vector<std::string>{ "a", "b", "c" }, test, "visibility changes were not picked up");
+	}
+
+	void TestTuneBudget() {
+		const char* test = "tune budget";
+		const double target_ms = 16.0;
+		const double max_budget_ms = target_ms * 0.25;
+		Utils::FrameScheduler scheduler;
+		scheduler.SetTargetFrameTime(target_ms);
+
+		// Grows back slowly up to a quarter of the target
+		scheduler.RunFrame(2.0);
+		double budget = scheduler.GetStats().budget_ms;
+		Check(Near(budget, 1.15), test, "first budget should be 1.15 ms, got " + std::to_string(budget));
+		for (uint32_t i = 0; i < 100; i++) {
+			scheduler.RunFrame(2.0);
+			Check(scheduler.GetStats().budget_ms >= budget, test, "budget shrank without a miss");
+			budget = scheduler.GetStats().budget_ms;
+		}
+		Check(Near(budget, max_budget_ms), test, "budget should settle at a quarter of the target, got " + std::to_string(budget));
+
+		// Never past the target of the frame
+		scheduler.RunFrame(14.0);
+		Check(Near(scheduler.GetStats().budget_ms, 2.0), test, "budget should be what is left of the target, got " + std::to_string(scheduler.GetStats().budget_ms));
+		scheduler.RunFrame(20.0);
+		Check(Near(scheduler.GetStats().budget_ms, 0.1), test, "an overrun frame should get the minimum budget");
+
+		// Background work that made the frame miss its target halves the budget of the next one
+		for (uint32_t i = 0; i < 100; i++) {
+			scheduler.RunFrame(2.0);
+		}
+		Utils::BackgroundTask slow;
+		slow.name = "slow";
+		slow.step = [](Utils::BackgroundTask&) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			return true;
+		};
+		scheduler.Add(slow);
+		scheduler.RunFrame(2.0);
+		Check(scheduler.GetStats().spent_ms >= 20.0, test, "the slow step did not run");
+		scheduler.RunFrame(2.0);
+		Check(Near(scheduler.GetStats().budget_ms, max_budget_ms * 0.5), test, "budget should halve after a miss, got " + std::to_string(scheduler.GetStats().budget_ms));
+	}
+}
+
+int main() {
+	TestPriorityOrder();
+	TestEqualPriorityKeepsOrder();
+	TestByteBudget();
+	TestAging();
+	TestSetVisibility();
+	TestTuneBudget();
+	if (s_failures > 0) {
+		std::cout << s_failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "All FrameScheduler checks passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,167 @@
+#include "MaterialRegistry.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Id bookkeeping of Diffuse::MaterialRegistry, registered with ctest as material_registry
+
+namespace {
+	uint32_t s_failures = 0;
+
+	void Check(bool condition, const char* test, const std::string& what) {
+		if (condition)
+			return;
+		std::cout << test << ": " << what << std::endl;
+		s_failures++;
+	}
+
+	// Materials that differ in one parameter only
+	Diffuse::ShaderMaterial MakeMaterial(float roughness) {
+		Diffuse::ShaderMaterial material{};
+		material.baseColorFactor = glm::vec4(1.0f);
+		material.colorTextureSet = -1;
+		material.roughnessFactor = roughness;
+		return material;
+	}
+
+	std::vector<Diffuse::MaterialRange> CollectDirty(Diffuse::MaterialRegistry& registry) {
+		std::vector<Diffuse::MaterialRange> ranges;
+		registry.CollectDirty(ranges);
+		return ranges;
+	}
+
+	bool SameRanges(const std::vector<Diffuse::MaterialRange>& ranges, const std::vector<Diffuse::MaterialRange>& expected) {
+		if (ranges.size() != expected.size())
+			return false;
+		for (size_t i = 0; i < ranges.size(); i++) {
+			if (ranges[i].first != expected[i].first || ranges[i].count != expected[i].count)
+				return false;
+		}
+		return true;
+	}
+
+	void TestDedupe() {
+		const char* test = "dedupe";
+		Diffuse::MaterialRegistry registry(8);
+		uint32_t a = registry.Acquire(MakeMaterial(0.5f));
+		uint32_t b = registry.Acquire(MakeMaterial(0.5f));
+		uint32_t c = registry.Acquire(MakeMaterial(0.25f));
+		Check(a == b, test, "identical materials got different ids");
+		Check(a != c, test, "different materials share an id");
+		Check(registry.GetMaterialCount() == 2, test, "expected 2 materials, got " + std::to_string(registry.GetMaterialCount()));
+		Check(registry.GetReferenceCount() == 3, test, "expected 3 references, got " + std::to_string(registry.GetReferenceCount()));
+
+		// The shared id outlives one of its references
+		registry.Release(a);
+		Check(registry.Acquire(MakeMaterial(0.5f)) == a, test, "a still referenced material got a new id");
+	}
+
+	void TestFreeListReuse() {
+		const char* test = "free list reuse";
+		Diffuse::MaterialRegistry registry(2);
+		uint32_t a = registry.Acquire(MakeMaterial(0.1f));
+		uint32_t b = registry.Acquire(MakeMaterial(0.2f));
+		registry.Release(a);
+		Check(registry.GetMaterialCount() == 1, test, "released material is still live");
+		uint32_t c = registry.Acquire(MakeMaterial(0.3f));
+		Check(c == a, test, "released id was not reused");
+		Check(c != b, test, "live id handed out twice");
+
+		bool threw = false;
+		try {
+			registry.Acquire(MakeMaterial(0.4f));
+		}
+		catch (const std::exception&) {
+			threw = true;
+		}
+		Check(threw, test, "acquire past the capacity should throw");
+		Check(registry.GetReferenceCount() == 2, test, "a failed acquire changed the reference count");
+	}
+
+	void TestUpdate() {
+		const char* test = "update";
+		Diffuse::MaterialRegistry registry(3);
+		uint32_t shared = registry.Acquire(MakeMaterial(0.5f));
+		uint32_t other = registry.Acquire(MakeMaterial(0.5f));
+		uint32_t single = registry.Acquire(MakeMaterial(0.7f));
+		CollectDirty(registry);
+
+		// A sole reference keeps its id
+		uint32_t id = single;
+		Check(registry.Update(id, MakeMaterial(0.8f)) && id == single, test, "a sole reference moved to another id");
+		Check(registry.Get(single).roughnessFactor == 0.8f, test, "edit was not applied");
+
+		// A shared id is left alone for the other reference
+		id = shared;
+		Check(registry.Update(id, MakeMaterial(0.9f)) && id != shared, test, "a shared id was edited in place");
+		Check(registry.Get(shared).roughnessFactor == 0.5f, test, "the other reference sees the edit");
+		Check(other == shared, test, "setup did not share the id");
+
+		// Editing to parameters already in the table joins that entry
+		uint32_t joined = id;
+		Check(registry.Update(joined, MakeMaterial(0.8f)) && joined == single, test, "edit did not join the identical material");
+		Check(registry.GetMaterialCount() == 2, test, "the edited entry was not freed");
+
+		// An unchanged edit uploads nothing
+		CollectDirty(registry);
+		id = single;
+		Check(registry.Update(id, MakeMaterial(0.8f)) && id == single, test, "unchanged edit moved the id");
+		Check(CollectDirty(registry).empty(), test, "unchanged edit marked the entry dirty");
+	}
+
+	void TestUpdateFullTable() {
+		const char* test = "update full table";
+		Diffuse::MaterialRegistry registry(2);
+		uint32_t a = registry.Acquire(MakeMaterial(0.1f));
+		registry.Acquire(MakeMaterial(0.1f));
+		uint32_t b = registry.Acquire(MakeMaterial(0.2f));
+		CollectDirty(registry);
+
+		// Splitting the shared id needs a third entry
+		uint32_t id = a;
+		Check(!registry.Update(id, MakeMaterial(0.3f)), test, "update into a full table should fail");
+		Check(id == a, test, "failed update changed the id");
+		Check(registry.Get(a).roughnessFactor == 0.1f, test, "failed update changed the material");
+		Check(registry.GetReferenceCount() == 3, test, "failed update changed the reference count");
+		Check(CollectDirty(registry).empty(), test, "failed update marked an entry dirty");
+
+		// Joining an existing entry or editing a sole reference needs no new one
+		Check(registry.Update(id, MakeMaterial(0.2f)) && id == b, test, "joining an existing entry failed in a full table");
+		uint32_t sole = a;
+		Check(registry.Update(sole, MakeMaterial(0.3f)) && sole == a, test, "editing a sole reference failed in a full table");
+	}
+
+	void TestDirtyCoalescing() {
+		const char* test = "dirty coalescing";
+		Diffuse::MaterialRegistry registry(16);
+		std::vector<uint32_t> ids;
+		for (uint32_t i = 0; i < 8; i++) {
+			ids.push_back(registry.Acquire(MakeMaterial(0.1f * i)));
+		}
+		Check(SameRanges(CollectDirty(registry), { { 0, 8 } }), test, "new entries should upload as one range");
+		Check(CollectDirty(registry).empty(), test, "collected entries are still dirty");
+
+		// Out of order edits, one of them twice
+		for (uint32_t index : { 6u, 2u, 3u, 6u, 7u }) {
+			registry.Update(ids[index], MakeMaterial(1.0f + index + registry.Get(ids[index]).roughnessFactor));
+		}
+		Check(SameRanges(CollectDirty(registry), { { 2, 2 }, { 6, 2 } }), test, "edits were not merged into ascending ranges");
+	}
+}
+
+int main() {
+	TestDedupe();
+	TestFreeListReuse();
+	TestUpdate();
+	TestUpdateFullTable();
+	TestDirtyCoalescing();
+	if (s_failures > 0) {
+		std::cout << s_failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "All MaterialRegistry checks passed" << std::endl;
+	return 0;
+}
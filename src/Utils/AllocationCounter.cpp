@@ -0,0 +1,112 @@
+#include "AllocationCounter.hpp"
+
+#ifdef DIFFUSE_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t s_allocations = 0;
+static std::atomic<uint64_t> s_process_allocations = 0;
+
+namespace Utils {
+	uint64_t AllocationCounter::ThreadCount() {
+		return s_allocations;
+	}
+
+	uint64_t AllocationCounter::Count() {
+		return s_process_allocations.load(std::memory_order_relaxed);
+	}
+}
+
+static void CountAllocation() {
+	s_allocations++;
+	s_process_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void* Allocate(std::size_t size) {
+	CountAllocation();
+	return std::malloc(size ? size : 1);
+}
+
+static void* AllocateAligned(std::size_t size, std::align_val_t alignment) {
+	CountAllocation();
+	const std::size_t align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+	return _aligned_malloc(size ? size : 1, align);
+#else
+	// aligned_alloc wants a multiple of the alignment
+	return std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+}
+
+static void FreeAligned(void* pointer) {
+#ifdef _WIN32
+	_aligned_free(pointer);
+#else
+	std::free(pointer);
+#endif
+}
+
+void* operator new(std::size_t size) {
+	if (void* pointer = Allocate(size))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return Allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	if (void* pointer = AllocateAligned(size, alignment))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return AllocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(pointer); }
+
+#else
+
+namespace Utils {
+	uint64_t AllocationCounter::ThreadCount() {
+		return 0;
+	}
+
+	uint64_t AllocationCounter::Count() {
+		return 0;
+	}
+}
+
+#endif
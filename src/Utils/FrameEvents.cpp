@@ -0,0 +1,42 @@
+#include "FrameEvents.hpp"
+
+#include <mutex>
+
+namespace Utils {
+	const char* FrameEventName(FrameEventType type) {
+		switch (type) {
+		case FrameEventType::PipelineCompile: return "pipeline compile";
+		case FrameEventType::Allocation: return "allocation";
+		case FrameEventType::UploadWait: return "upload wait";
+		case FrameEventType::FenceTimeout: return "fence timeout";
+		case FrameEventType::Resize: return "resize";
+		default: return "unknown";
+		}
+	}
+
+	struct FrameEventState {
+		std::mutex mutex;
+		std::vector<FrameEvent> events;
+	};
+
+	static FrameEventState& State() {
+		static FrameEventState state;
+		return state;
+	}
+
+	void FrameEvents::Record(FrameEventType type, const char* detail, double ms) {
+		FrameEventState& state = State();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		// Nobody drains the list while loading, keep it from growing without bound
+		if (state.events.size() >= 4096)
+			state.events.erase(state.events.begin(), state.events.begin() + 2048);
+		state.events.push_back({ type, detail, ms });
+	}
+
+	void FrameEvents::Take(std::vector<FrameEvent>& events) {
+		FrameEventState& state = State();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		events.clear();
+		events.swap(state.events);
+	}
+}
@@ -0,0 +1,107 @@
+#include "FrameScheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Utils {
+	// Priority a task gains per frame it waits, an invisible task catches up with a fully visible one after two seconds at 60 fps
+	static constexpr float s_age_weight = 1.0f / 120.0f;
+	static constexpr double s_min_budget_ms = 0.1;
+	// Share of the target frame time background work may take at most
+	static constexpr double s_max_budget_share = 0.25;
+
+	static double ElapsedMs(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	uint64_t FrameScheduler::Add(BackgroundTask task) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Entry entry;
+		entry.task = std::move(task);
+		entry.id = m_next_id++;
+		m_added.push_back(std::move(entry));
+		return m_added.back().id;
+	}
+
+	void FrameScheduler::SetVisibility(uint64_t id, float visibility) {
+		for (Entry& entry : m_tasks) {
+			if (entry.id == id) {
+				entry.task.visibility = visibility;
+				return;
+			}
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (Entry& entry : m_added) {
+			if (entry.id == id) {
+				entry.task.visibility = visibility;
+				return;
+			}
+		}
+	}
+
+	void FrameScheduler::TuneBudget(double busy_ms) {
+		// The last frame with the background work it ran, halve after a miss and grow back slowly
+		if (m_frame > 0 && m_stats.frame_ms + m_stats.spent_ms > m_target_ms)
+			m_budget_ms *= 0.5;
+		else
+			m_budget_ms = m_budget_ms * 1.1 + 0.05;
+		// Never plan past the target of this frame
+		m_budget_ms = std::min(m_budget_ms, m_target_ms - busy_ms);
+		m_budget_ms = std::clamp(m_budget_ms, s_min_budget_ms, std::max(s_min_budget_ms, m_target_ms * s_max_budget_share));
+	}
+
+	void FrameScheduler::RunFrame(double busy_ms) {
+		TuneBudget(busy_ms);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (Entry& entry : m_added) {
+				entry.added_frame = m_frame;
+				m_tasks.push_back(std::move(entry));
+			}
+			m_added.clear();
+		}
+
+		m_stats = {};
+		m_stats.frame_ms = busy_ms;
+		m_stats.budget_ms = m_budget_ms;
+
+		m_order.resize(m_tasks.size());
+		for (uint32_t i = 0; i < m_tasks.size(); i++) {
+			Entry& entry = m_tasks[i];
+			entry.priority = entry.task.visibility + static_cast<float>(m_frame - entry.added_frame) * s_age_weight;
+			m_order[i] = i;
+		}
+		// Equal priorities keep the order they were added in
+		std::stable_sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b) {
+			return m_tasks[a].priority > m_tasks[b].priority;
+		});
+
+		const auto start = std::chrono::steady_clock::now();
+		for (uint32_t index : m_order) {
+			Entry& entry = m_tasks[index];
+			while (!entry.finished) {
+				// The first step of a frame always runs, later ones only if their last duration still fits
+				if (m_stats.steps > 0) {
+					if (ElapsedMs(start) + entry.step_ms > m_budget_ms)
+						break;
+					if (entry.task.bytes > 0 && m_stats.spent_bytes + entry.task.bytes > m_byte_budget)
+						break;
+				}
+				const uint64_t bytes = entry.task.bytes;
+				const auto step_start = std::chrono::steady_clock::now();
+				entry.finished = entry.task.step(entry.task);
+				const double step_ms = ElapsedMs(step_start);
+				entry.step_ms = entry.step_ms > 0.0 ? 0.75 * entry.step_ms + 0.25 * step_ms : step_ms;
+				m_stats.spent_bytes += bytes;
+				m_stats.steps++;
+			}
+		}
+		m_stats.spent_ms = ElapsedMs(start);
+
+		const size_t pending = m_tasks.size();
+		m_tasks.erase(std::remove_if(m_tasks.begin(), m_tasks.end(), [](const Entry& entry) { return entry.finished; }), m_tasks.end());
+		m_stats.finished = static_cast<uint32_t>(pending - m_tasks.size());
+		m_stats.deferred = static_cast<uint32_t>(m_tasks.size());
+		m_frame++;
+	}
+}
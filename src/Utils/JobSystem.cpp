@@ -0,0 +1,247 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <thread>
+
+namespace Utils {
+	struct QueuedJob {
+		Job job;
+		JobCounter* counter = nullptr;
+	};
+
+	// Ring buffer that only ever grows, so pushing and popping do not allocate once it is warm
+	struct WorkQueue {
+		std::mutex mutex;
+		std::vector<QueuedJob> jobs;
+		size_t head = 0;
+		size_t size = 0;
+
+		void PushBack(QueuedJob&& job) {
+			if (size == jobs.size()) {
+				std::vector<QueuedJob> grown(std::max<size_t>(jobs.size() * 2, 64));
+				for (size_t i = 0; i < size; i++) {
+					grown[i] = std::move(jobs[(head + i) % jobs.size()]);
+				}
+				jobs.swap(grown);
+				head = 0;
+			}
+			jobs[(head + size) % jobs.size()] = std::move(job);
+			size++;
+		}
+		QueuedJob PopBack() {
+			size--;
+			return std::move(jobs[(head + size) % jobs.size()]);
+		}
+		QueuedJob PopFront() {
+			QueuedJob job = std::move(jobs[head]);
+			head = (head + 1) % jobs.size();
+			size--;
+			return job;
+		}
+	};
+
+	struct JobSystemState {
+		// Index 0 belongs to the thread that called Init
+		std::vector<std::unique_ptr<WorkQueue>> queues;
+		std::vector<std::thread> workers;
+		std::atomic<bool> running{ false };
+		std::atomic<uint32_t> queued{ 0 };
+		// Threads blocked in Wait, they share the condition variable with idle workers
+		std::atomic<uint32_t> waiters{ 0 };
+		// Round robin queue of threads that have no queue of their own
+		std::atomic<uint32_t> next_queue{ 0 };
+		std::mutex sleep_mutex;
+		std::condition_variable wake;
+	};
+
+	static constexpr uint32_t s_foreign_thread = std::numeric_limits<uint32_t>::max();
+	// Yields before Wait blocks, the last jobs of a group are usually about to finish
+	static constexpr uint32_t s_wait_spin_count = 64;
+
+	static JobSystemState s_state;
+	static thread_local uint32_t t_thread_index = s_foreign_thread;
+
+	static void Push(QueuedJob job) {
+		const uint32_t index = t_thread_index != s_foreign_thread ? t_thread_index :
+			s_state.next_queue.fetch_add(1, std::memory_order_relaxed) % static_cast<uint32_t>(s_state.queues.size());
+		WorkQueue& queue = *s_state.queues[index];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.PushBack(std::move(job));
+		}
+		s_state.queued.fetch_add(1, std::memory_order_release);
+		// Taking the lock orders this against a worker that is about to go to sleep
+		{ std::lock_guard<std::mutex> lock(s_state.sleep_mutex); }
+		s_state.wake.notify_one();
+	}
+
+	// Newest job of the own queue first (still warm in cache), then the oldest of everybody else's
+	static bool TryPop(QueuedJob& out) {
+		const uint32_t queue_count = static_cast<uint32_t>(s_state.queues.size());
+		const bool own_queue = t_thread_index != s_foreign_thread;
+		const uint32_t first = own_queue ? t_thread_index : s_state.next_queue.load(std::memory_order_relaxed) % queue_count;
+		for (uint32_t i = 0; i < queue_count; i++) {
+			const uint32_t index = (first + i) % queue_count;
+			WorkQueue& queue = *s_state.queues[index];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.size == 0)
+				continue;
+			out = own_queue && i == 0 ? queue.PopBack() : queue.PopFront();
+			s_state.queued.fetch_sub(1, std::memory_order_acq_rel);
+			return true;
+		}
+		return false;
+	}
+
+	bool JobCounter::Done() const {
+		if (m_pending.load(std::memory_order_acquire) != 0)
+			return false;
+		// The last decrement happens under the lock, wait until that job has let go of it
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return true;
+	}
+
+	void JobSystem::Execute(QueuedJob& job) {
+		job.job();
+		Finish(job.counter);
+	}
+
+	void JobSystem::Schedule(Job job, JobCounter* counter) {
+		if (!s_state.running.load(std::memory_order_acquire)) {
+			QueuedJob inline_job{ std::move(job), counter };
+			Execute(inline_job);
+			return;
+		}
+		Push({ std::move(job), counter });
+	}
+
+	void JobSystem::Finish(JobCounter* counter) {
+		if (!counter)
+			return;
+		std::vector<std::pair<Job, JobCounter*>> continuations;
+		{
+			std::lock_guard<std::mutex> lock(counter->m_mutex);
+			// Sequentially consistent with the waiters count, so a thread about to block in Wait sees either zero here or gets notified
+			if (counter->m_pending.fetch_sub(1) != 1)
+				return;
+			continuations.swap(counter->m_continuations);
+		}
+		if (s_state.waiters.load() > 0) {
+			{ std::lock_guard<std::mutex> lock(s_state.sleep_mutex); }
+			s_state.wake.notify_all();
+		}
+		for (auto& [job, continuation_counter] : continuations) {
+			Schedule(std::move(job), continuation_counter);
+		}
+	}
+
+	void JobSystem::Init(uint32_t worker_count) {
+		if (s_state.running)
+			return;
+		if (worker_count == 0) {
+			const uint32_t hardware_threads = std::thread::hardware_concurrency();
+			worker_count = hardware_threads > 1 ? hardware_threads - 1 : 0;
+		}
+
+		t_thread_index = 0;
+		s_state.queues.clear();
+		for (uint32_t i = 0; i < worker_count + 1; i++) {
+			s_state.queues.push_back(std::make_unique<WorkQueue>());
+		}
+		s_state.running = true;
+		s_state.next_queue = 0;
+		for (uint32_t i = 1; i <= worker_count; i++) {
+			s_state.workers.emplace_back([i] {
+				t_thread_index = i;
+				while (s_state.running.load(std::memory_order_acquire)) {
+					QueuedJob job;
+					if (TryPop(job)) {
+						Execute(job);
+						continue;
+					}
+					std::unique_lock<std::mutex> lock(s_state.sleep_mutex);
+					s_state.wake.wait(lock, [] { return s_state.queued.load(std::memory_order_acquire) > 0 || !s_state.running.load(std::memory_order_acquire); });
+				}
+			});
+		}
+	}
+
+	void JobSystem::Shutdown() {
+		if (!s_state.running)
+			return;
+		QueuedJob job;
+		while (TryPop(job)) {
+			Execute(job);
+		}
+		{
+			std::lock_guard<std::mutex> lock(s_state.sleep_mutex);
+			s_state.running = false;
+		}
+		s_state.wake.notify_all();
+		for (std::thread& worker : s_state.workers) {
+			worker.join();
+		}
+		s_state.workers.clear();
+		s_state.queues.clear();
+		s_state.queued = 0;
+	}
+
+	uint32_t JobSystem::GetWorkerCount() {
+		return static_cast<uint32_t>(s_state.workers.size());
+	}
+
+	uint32_t JobSystem::GetThreadIndex() {
+		return t_thread_index;
+	}
+
+	bool JobSystem::IsRunning() {
+		return s_state.running.load(std::memory_order_acquire);
+	}
+
+	void JobSystem::Run(Job job, JobCounter* counter) {
+		if (counter)
+			counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+		Schedule(std::move(job), counter);
+	}
+
+	void JobSystem::RunAfter(JobCounter& dependency, Job job, JobCounter* counter) {
+		if (counter)
+			counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+		{
+			// Finish swaps the list out under the same lock after the count reached zero
+			std::lock_guard<std::mutex> lock(dependency.m_mutex);
+			if (dependency.m_pending.load(std::memory_order_acquire) != 0) {
+				dependency.m_continuations.emplace_back(std::move(job), counter);
+				return;
+			}
+		}
+		Schedule(std::move(job), counter);
+	}
+
+	void JobSystem::Wait(JobCounter& counter) {
+		uint32_t idle_spins = 0;
+		while (!counter.Done()) {
+			QueuedJob job;
+			if (s_state.running && TryPop(job)) {
+				Execute(job);
+				idle_spins = 0;
+				continue;
+			}
+			if (!s_state.running || ++idle_spins < s_wait_spin_count) {
+				std::this_thread::yield();
+				continue;
+			}
+			// Nothing left to help with, sleep until the counter is done or new jobs arrive
+			std::unique_lock<std::mutex> lock(s_state.sleep_mutex);
+			s_state.waiters.fetch_add(1);
+			s_state.wake.wait(lock, [&] {
+				return counter.m_pending.load() == 0 || s_state.queued.load(std::memory_order_acquire) > 0 || !s_state.running.load(std::memory_order_acquire);
+			});
+			s_state.waiters.fetch_sub(1);
+			idle_spins = 0;
+		}
+	}
+}
@@ -0,0 +1,203 @@
+#include "Profiler.hpp"
+
+#ifdef DIFFUSE_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace Utils {
+	// Events per thread before the ring wraps and overwrites the oldest ones
+	static constexpr uint32_t s_ring_size = 1 << 16;
+
+	// Relaxed atomics, so a trace can copy a slot while its thread overwrites it; copies that may be torn are dropped
+	struct EventSlot {
+		std::atomic<const char*> name{ nullptr };
+		std::atomic<uint64_t> tsc{ 0 };
+		std::atomic<Profiler::EventType> type{ Profiler::EventType::Begin };
+	};
+
+	struct ThreadRing {
+		uint32_t thread_id = 0;
+		std::atomic<uint64_t> write_index{ 0 };
+		std::unique_ptr<EventSlot[]> events{ new EventSlot[s_ring_size] };
+	};
+
+	struct ProfilerState {
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadRing>> rings;
+
+		// Reference point to convert ticks to microseconds
+		uint64_t base_tsc = Profiler::Now();
+		std::chrono::steady_clock::time_point base_time = std::chrono::steady_clock::now();
+
+		uint64_t frame = 0;
+		uint64_t capture_start = 0;
+		bool capturing = false;
+
+		uint64_t frame_capture_first = 0;
+		uint64_t frame_capture_last = 0;
+		std::string frame_capture_path;
+	};
+
+	static ProfilerState& State() {
+		static ProfilerState state;
+		return state;
+	}
+
+	static ThreadRing& LocalRing() {
+		thread_local ThreadRing* ring = nullptr;
+		if (!ring) {
+			ProfilerState& state = State();
+			std::lock_guard<std::mutex> lock(state.mutex);
+			state.rings.push_back(std::make_unique<ThreadRing>());
+			ring = state.rings.back().get();
+			ring->thread_id = static_cast<uint32_t>(state.rings.size() - 1);
+		}
+		return *ring;
+	}
+
+	uint64_t Profiler::Now() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	void Profiler::Record(const char* name, EventType type) {
+		ThreadRing& ring = LocalRing();
+		uint64_t index = ring.write_index.load(std::memory_order_relaxed);
+		EventSlot& slot = ring.events[index & (s_ring_size - 1)];
+		slot.name.store(name, std::memory_order_relaxed);
+		slot.tsc.store(Now(), std::memory_order_relaxed);
+		slot.type.store(type, std::memory_order_relaxed);
+		ring.write_index.store(index + 1, std::memory_order_release);
+	}
+
+	static double TicksPerMicrosecond(ProfilerState& state) {
+		uint64_t tsc = Profiler::Now();
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - state.base_time).count();
+		return us > 0.0 ? double(tsc - state.base_tsc) / us : 1.0;
+	}
+
+	static void WriteJsonString(std::ostream& out, const char* text) {
+		out << '"';
+		for (const char* c = text; *c; c++) {
+			switch (*c) {
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(*c) < 0x20) {
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(*c));
+					out << escaped;
+				}
+				else {
+					out << *c;
+				}
+			}
+		}
+		out << '"';
+	}
+
+	// Copies the events of ring up to its published write index. The owning thread keeps recording meanwhile,
+	// so the index is read again afterwards and the oldest copies, whose slots it may have reused, are dropped.
+	static std::vector<Profiler::Event> SnapshotRing(const ThreadRing& ring) {
+		uint64_t last = ring.write_index.load(std::memory_order_acquire);
+		uint64_t first = last > s_ring_size ? last - s_ring_size : 0;
+		std::vector<Profiler::Event> events;
+		events.reserve(last - first);
+		for (uint64_t i = first; i < last; i++) {
+			const EventSlot& slot = ring.events[i & (s_ring_size - 1)];
+			events.push_back({ slot.name.load(std::memory_order_relaxed), slot.tsc.load(std::memory_order_relaxed), slot.type.load(std::memory_order_relaxed) });
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t written = ring.write_index.load(std::memory_order_relaxed);
+		// The slot of index written is being filled right now, so everything up to written - s_ring_size is stale
+		uint64_t valid = written >= s_ring_size ? written - s_ring_size + 1 : 0;
+		if (valid > first)
+			events.erase(events.begin(), events.begin() + std::min<uint64_t>(valid - first, events.size()));
+		return events;
+	}
+
+	static void WriteTrace(ProfilerState& state, uint64_t start, uint64_t end, const std::string& path) {
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			std::cout << "Failed to write trace " << path << std::endl;
+			return;
+		}
+
+		const double ticks_per_us = TicksPerMicrosecond(state);
+		size_t written = 0;
+
+		file << "{\"traceEvents\":[";
+		std::lock_guard<std::mutex> lock(state.mutex);
+		for (auto& ring : state.rings) {
+			for (const Profiler::Event& event : SnapshotRing(*ring)) {
+				if (event.tsc < start || event.tsc > end)
+					continue;
+				double ts = double(event.tsc - state.base_tsc) / ticks_per_us;
+				file << (written++ ? ",\n" : "\n") << "{\"name\":";
+				WriteJsonString(file, event.name);
+				file << ",\"ph\":\"" << (event.type == Profiler::EventType::Begin ? "B" : "E")
+					<< "\",\"ts\":" << ts << ",\"pid\":0,\"tid\":" << ring->thread_id << "}";
+			}
+		}
+		file << "\n]}\n";
+		std::cout << "Wrote " << written << " trace events to " << path << std::endl;
+	}
+
+	void Profiler::MarkFrame() {
+		ProfilerState& state = State();
+		state.frame++;
+
+		if (state.frame_capture_path.empty())
+			return;
+		if (state.frame == state.frame_capture_first) {
+			BeginCapture();
+		}
+		else if (state.frame == state.frame_capture_last) {
+			EndCapture(state.frame_capture_path);
+			state.frame_capture_path.clear();
+		}
+	}
+
+	void Profiler::BeginCapture() {
+		ProfilerState& state = State();
+		state.capture_start = Now();
+		state.capturing = true;
+	}
+
+	void Profiler::EndCapture(const std::string& path) {
+		ProfilerState& state = State();
+		if (!state.capturing)
+			return;
+		state.capturing = false;
+		WriteTrace(state, state.capture_start, Now(), path);
+	}
+
+	void Profiler::CaptureFrames(uint64_t first_frame, uint64_t frame_count, const std::string& path) {
+		ProfilerState& state = State();
+		state.frame_capture_first = first_frame;
+		state.frame_capture_last = first_frame + frame_count;
+		state.frame_capture_path = path;
+	}
+}
+
+#endif
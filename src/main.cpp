@@ -1,10 +1,51 @@
 #include "Application.hpp"
 
 #include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    // --replay <path.json> [--out <results.json>] [--dt <seconds>] [--record <path.json>] [--gpu-log <frames>] [--pipeline-stats <frames>]
+    // [--load-report <path.json>] [--spike-ms <ms>] [--spike-factor <x>] [--frame-histogram <frames>] [--target-frame-ms <ms>]
+    // [--animation <index>]
+    Diffuse::ApplicationOptions options;
+    for (int i = 1; i + 1 < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--replay")
+            options.replay_path = argv[++i];
+        else if (arg == "--out")
+            options.benchmark_output = argv[++i];
+        else if (arg == "--dt")
+            options.fixed_dt = std::stof(argv[++i]);
+        else if (arg == "--record")
+            options.record_path = argv[++i];
+        else if (arg == "--gpu-log")
+            options.gpu_log_interval = std::stoul(argv[++i]);
+        else if (arg == "--pipeline-stats")
+            options.pipeline_statistics_interval = std::stoul(argv[++i]);
+        else if (arg == "--trace-load")
+            options.trace_load_path = argv[++i];
+        else if (arg == "--trace-frames")
+            options.trace_frames_path = argv[++i];
+        else if (arg == "--trace-first-frame")
+            options.trace_first_frame = std::stoul(argv[++i]);
+        else if (arg == "--trace-frame-count")
+            options.trace_frame_count = std::stoul(argv[++i]);
+        else if (arg == "--load-report")
+            options.load_report_path = argv[++i];
+        else if (arg == "--spike-ms")
+            options.spike_threshold_ms = std::stof(argv[++i]);
+        else if (arg == "--spike-factor")
+            options.spike_factor = std::stof(argv[++i]);
+        else if (arg == "--frame-histogram")
+            options.frame_histogram_interval = std::stoul(argv[++i]);
+        else if (arg == "--target-frame-ms")
+            options.target_frame_ms = std::stof(argv[++i]);
+        else if (arg == "--animation")
+            options.animation = std::stoi(argv[++i]);
+    }
 
-int main(int argc, char** argv[]) {
     Diffuse::Application* app = new Diffuse::Application();
-    app->Init();
+    app->Init(options);
     app->Update();
     app->Destroy();
     delete app;